@@ -0,0 +1,49 @@
+#ifndef PDB_BREAKPOINT_SITE_HPP
+#define PDB_BREAKPOINT_SITE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <libpdb/types.hpp>
+
+namespace pdb
+{
+    class process;
+
+    // a software breakpoint: an int3 (0xcc) patched over the first byte of an instruction
+    class breakpoint_site
+    {
+    public:
+        // only the process creates breakpoint sites
+        breakpoint_site() = delete;
+        breakpoint_site(const breakpoint_site &) = delete;
+        breakpoint_site &operator=(const breakpoint_site &) = delete;
+
+        using id_type = std::int32_t;
+        id_type id() const { return id_; }
+
+        // patches/unpatches the int3 in the inferior
+        // to change many sites at once use process::enable_breakpoint_sites which batches the writes
+        void enable();
+        void disable();
+
+        bool is_enabled() const { return is_enabled_; }
+        virt_addr address() const { return address_; }
+
+        bool at_address(virt_addr addr) const { return address_ == addr; }
+        bool in_range(virt_addr low, virt_addr high) const { return low <= address_ and high > address_; }
+
+    private:
+        friend process;
+        breakpoint_site(process &proc, virt_addr address);
+
+        id_type id_;
+        process *process_;
+        virt_addr address_;
+        bool is_enabled_ = false;
+
+        // the byte the int3 replaced, written back on disable
+        std::byte saved_data_{};
+    };
+}
+
+#endif
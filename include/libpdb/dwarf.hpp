@@ -0,0 +1,236 @@
+#ifndef PDB_DWARF_HPP
+#define PDB_DWARF_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <libpdb/types.hpp>
+
+namespace pdb
+{
+    class elf;
+    class dwarf;
+    class compile_unit;
+    class dwarf_index;
+    class index_cache;
+
+    // one attribute of an abbreviation, implicit_const is only used by DW_FORM_implicit_const
+    struct attr_spec
+    {
+        std::uint64_t attr;
+        std::uint64_t form;
+        std::int64_t implicit_const;
+    };
+
+    // a .debug_abbrev entry, the layout shared by every DIE with this code
+    struct abbrev
+    {
+        std::uint64_t code;
+        std::uint64_t tag;
+        bool has_children;
+        std::vector<attr_spec> attr_specs;
+    };
+
+    using abbrev_table = std::unordered_map<std::uint64_t, abbrev>;
+
+    // the debug sections, empty when the file doesn't have them
+    struct dwarf_sections
+    {
+        span<const std::byte> info;
+        span<const std::byte> abbrev;
+        span<const std::byte> line;
+        span<const std::byte> str;
+        span<const std::byte> line_str;
+        span<const std::byte> str_offsets;
+        span<const std::byte> addr;
+        span<const std::byte> aranges;
+        span<const std::byte> ranges;
+        span<const std::byte> rnglists;
+    };
+
+    // the decoded .debug_line program of one compile unit
+    // rows are kept as a structure of arrays sorted by address, so the binary search only walks the addresses
+    // every sequence ends with a row flagged end_sequence, which marks the first address past it
+    class line_table
+    {
+    public:
+        static constexpr std::uint8_t is_stmt = 1 << 0;
+        static constexpr std::uint8_t basic_block = 1 << 1;
+        static constexpr std::uint8_t end_sequence = 1 << 2;
+        static constexpr std::uint8_t prologue_end = 1 << 3;
+        static constexpr std::uint8_t epilogue_begin = 1 << 4;
+
+        struct entry
+        {
+            file_addr address;
+            const std::filesystem::path *file;
+            std::uint32_t file_index;
+            std::uint32_t line;
+            std::uint8_t flags;
+        };
+
+        explicit line_table(const compile_unit &unit);
+
+        std::size_t size() const { return addresses_.size(); }
+        entry operator[](std::size_t row) const;
+
+        // the files the rows point at, paths that show up more than once in the header are merged
+        const std::vector<std::filesystem::path> &files() const { return files_; }
+
+        // the row covering the address, nothing if it is in a gap between sequences
+        std::optional<entry> get_entry_by_address(file_addr address) const;
+
+        // the first row of every run of rows on that line that starts a statement, in address order
+        span<const std::uint32_t> get_rows_by_line(std::uint32_t file_index, std::uint32_t line) const;
+
+    private:
+        friend class index_cache;
+        line_table() = default;
+
+        void build_line_index();
+
+        std::vector<std::filesystem::path> files_;
+
+        std::vector<std::uint64_t> addresses_;
+        std::vector<std::uint32_t> file_indices_;
+        std::vector<std::uint32_t> lines_;
+        std::vector<std::uint8_t> flags_;
+
+        // (file index << 32 | line) sorted, line_rows_ holds the row for each key
+        std::vector<std::uint64_t> line_keys_;
+        std::vector<std::uint32_t> line_rows_;
+    };
+
+    // a unit in .debug_info, only its header is read up front
+    // the root DIE and the line table are read the first time something asks for them
+    // reading the root DIE is thread safe, it is needed by every thread that builds the dwarf_index
+    class compile_unit
+    {
+    public:
+        struct header
+        {
+            std::uint64_t offset;
+            std::uint64_t size;
+            std::uint16_t version;
+            bool dwarf64;
+            std::uint8_t address_size;
+            std::uint64_t abbrev_offset;
+            // from the start of the unit
+            std::uint64_t first_die_offset;
+        };
+
+        compile_unit(const dwarf &parent, const header &info) : parent_(&parent), header_(info) {}
+
+        const dwarf &get_dwarf() const { return *parent_; }
+        const header &get_header() const { return header_; }
+
+        // the whole unit, header included
+        span<const std::byte> data() const;
+        const abbrev_table &abbrevs() const;
+
+        std::string_view name() const;
+        std::string_view comp_dir() const;
+
+        // [low, high) ranges of code the unit covers
+        const std::vector<std::pair<file_addr, file_addr>> &ranges() const;
+
+        // DW_AT_low_pc of the unit, offsets in its range lists are from here
+        std::uint64_t base_address() const;
+
+        // DW_AT_str_offsets_base, DW_AT_addr_base and DW_AT_rnglists_base, needed to read strx, addrx and rnglistx
+        std::uint64_t str_offsets_base() const;
+        std::uint64_t addr_base() const;
+        std::optional<std::uint64_t> rnglists_base() const;
+
+        bool has_line_table() const;
+        bool line_table_decoded() const { return lines_ != nullptr; }
+        const line_table &lines() const;
+
+    private:
+        friend class line_table;
+
+        struct root_info
+        {
+            std::string_view name;
+            std::string_view comp_dir;
+            std::optional<std::uint64_t> stmt_list;
+            std::uint64_t base_address = 0;
+            std::uint64_t str_offsets_base = 0;
+            std::uint64_t addr_base = 0;
+            std::optional<std::uint64_t> rnglists_base;
+            std::vector<std::pair<file_addr, file_addr>> ranges;
+        };
+
+        const root_info &root() const;
+        std::unique_ptr<root_info> read_root() const;
+
+        const dwarf *parent_;
+        header header_;
+
+        mutable std::once_flag root_once_;
+        mutable std::unique_ptr<root_info> root_;
+        mutable std::unique_ptr<line_table> lines_;
+    };
+
+    // DWARF of an elf file
+    // building one only walks the unit headers, so a huge binary costs nothing for the units we never look at
+    class dwarf
+    {
+    public:
+        explicit dwarf(const elf &file);
+        ~dwarf();
+
+        const elf &get_elf() const { return *elf_; }
+        const dwarf_sections &sections() const { return sections_; }
+
+        const std::vector<std::unique_ptr<compile_unit>> &compile_units() const { return compile_units_; }
+
+        // the unit a .debug_info offset is in, for DW_FORM_ref_addr
+        const compile_unit *compile_unit_at_offset(std::uint64_t offset) const;
+
+        // parsed on first use and shared by every unit that points at the same table, safe to call from many threads
+        const abbrev_table &get_abbrev_table(std::uint64_t offset) const;
+
+        // names and function ranges of every unit, built on first use with one thread per core
+        const dwarf_index &index() const;
+
+        // the unit ranges come from .debug_aranges, units it doesn't cover are asked for their root DIE ranges
+        const compile_unit *compile_unit_containing_address(file_addr address) const;
+
+        // only decodes the line table of the unit covering the address
+        std::optional<line_table::entry> line_entry_at_address(file_addr address) const;
+
+        // path can be a file name or any trailing part of the full path
+        // every unit's line table has to be decoded to answer this
+        std::vector<file_addr> addresses_for_line(const std::filesystem::path &path, std::uint32_t line) const;
+
+    private:
+        void index_unit_ranges() const;
+
+        const elf *elf_;
+        dwarf_sections sections_;
+        std::vector<std::unique_ptr<compile_unit>> compile_units_;
+
+        mutable std::mutex abbrev_mutex_;
+        mutable std::unordered_map<std::uint64_t, abbrev_table> abbrev_tables_;
+
+        mutable std::unique_ptr<dwarf_index> index_;
+
+        struct unit_range
+        {
+            std::uint64_t end;
+            const compile_unit *unit;
+        };
+        mutable bool unit_ranges_indexed_ = false;
+        mutable std::vector<std::uint64_t> unit_range_starts_;
+        mutable std::vector<unit_range> unit_ranges_;
+    };
+}
+
+#endif
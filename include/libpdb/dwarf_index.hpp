@@ -0,0 +1,63 @@
+#ifndef PDB_DWARF_INDEX_HPP
+#define PDB_DWARF_INDEX_HPP
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include <libpdb/types.hpp>
+
+namespace pdb
+{
+    class dwarf;
+    class index_cache;
+
+    // a function with code, a function split into several ranges (hot/cold parts) has one entry per range
+    struct function_entry
+    {
+        file_addr low;
+        file_addr high;
+        std::uint64_t die_offset;
+        std::string_view name;
+        std::string_view linkage_name;
+    };
+
+    // a named DIE that isn't a declaration and isn't local to a function
+    struct name_entry
+    {
+        std::string_view name;
+        std::uint64_t die_offset;
+        std::uint64_t tag;
+    };
+
+    // names and function ranges of every unit, from one walk over all the DIEs
+    // the units are split over a work_stealing_pool, each worker fills its own arena, the arenas are
+    // sorted in parallel and then merged pairwise, so no thread ever waits on a lock for an entry
+    // the strings point into the mapped file
+    class dwarf_index
+    {
+    public:
+        // 0 threads means one per core
+        explicit dwarf_index(const dwarf &debug_info, unsigned thread_count = 0);
+
+        // every entry with that name (plain or linkage name), in .debug_info order
+        span<const name_entry> find(std::string_view name) const;
+
+        const function_entry *function_containing_address(file_addr address) const;
+
+        // sorted by name and by low address
+        span<const name_entry> names() const { return names_; }
+        span<const function_entry> functions() const { return functions_; }
+
+        std::size_t die_count() const { return die_count_; }
+
+    private:
+        friend class index_cache;
+        dwarf_index() = default;
+
+        std::vector<name_entry> names_;
+        std::vector<function_entry> functions_;
+        std::size_t die_count_ = 0;
+    };
+}
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef PDB_ELF_HPP
+#define PDB_ELF_HPP
+
+#include <elf.h>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <libpdb/types.hpp>
+
+namespace pdb
+{
+    class index_cache;
+
+    // a read only mapping of an ELF file
+    // headers, sections and symbols are used in place, nothing is copied out of the mapping
+    // the indexes are built once on load so the lookups below never allocate
+    // given a cache directory they are taken from the index_cache of this build when there is one
+    class elf
+    {
+    public:
+        explicit elf(const std::filesystem::path &path, const std::filesystem::path &cache_directory = {});
+        ~elf();
+
+        elf(const elf &) = delete;
+        elf &operator=(const elf &) = delete;
+
+        const std::filesystem::path &path() const { return path_; }
+        const Elf64_Ehdr &get_header() const { return *header_; }
+        span<const std::byte> data() const { return span<const std::byte>(data_, file_size_); }
+
+        // the NT_GNU_BUILD_ID note as hex, empty when the linker didn't add one
+        std::string build_id() const;
+
+        // the cache the indexes came from, nullptr if they were built
+        const index_cache *cache() const { return cache_.get(); }
+
+        span<const Elf64_Shdr> sections() const { return section_headers_; }
+        // program headers, empty for relocatable files
+        span<const Elf64_Phdr> segments() const { return program_headers_; }
+        std::string_view get_section_name(std::size_t index) const;
+
+        // nullptr when there is no such section
+        const Elf64_Shdr *get_section(std::string_view name) const;
+        span<const std::byte> get_section_contents(std::string_view name) const;
+        const Elf64_Shdr *get_section_containing_address(file_addr address) const;
+
+        // symbols come from .symtab and .dynsym
+        std::size_t symbol_count() const { return symtab_.size() + dynsym_.size(); }
+        std::string_view get_symbol_name(const Elf64_Sym &symbol) const;
+
+        // every symbol with that name, empty if there is none
+        span<const Elf64_Sym *const> get_symbols_by_name(std::string_view name) const;
+
+        // nullptr when nothing matches
+        const Elf64_Sym *get_symbol_at_address(file_addr address) const;
+        const Elf64_Sym *get_symbol_containing_address(file_addr address) const;
+
+        // runtime addresses of a PIE are the file addresses plus where it was loaded
+        void notify_loaded(virt_addr load_bias) { load_bias_ = load_bias; }
+        virt_addr load_bias() const { return load_bias_; }
+
+        file_addr to_file_addr(virt_addr address) const { return file_addr(address.addr() - load_bias_.addr()); }
+        virt_addr to_virt_addr(file_addr address) const { return virt_addr(address.addr() + load_bias_.addr()); }
+
+        const Elf64_Sym *get_symbol_at_address(virt_addr address) const { return get_symbol_at_address(to_file_addr(address)); }
+        const Elf64_Sym *get_symbol_containing_address(virt_addr address) const { return get_symbol_containing_address(to_file_addr(address)); }
+
+    private:
+        friend class index_cache;
+
+        // checks that a range of the file is really inside the mapping before we point into it
+        span<const std::byte> file_range(std::uint64_t offset, std::uint64_t size) const;
+        span<const std::byte> section_data(const Elf64_Shdr &section) const;
+
+        void parse_symbol_tables();
+        void build_address_index();
+        void build_name_index();
+
+        // symbols are numbered across both tables, .symtab first, which is how the indexes refer to them
+        std::uint32_t symbol_index(const Elf64_Sym &symbol) const;
+        const Elf64_Sym *symbol_at_index(std::uint32_t index) const;
+
+        std::filesystem::path path_;
+        int fd_ = -1;
+        const std::byte *data_ = nullptr;
+        std::size_t file_size_ = 0;
+
+        const Elf64_Ehdr *header_ = nullptr;
+        span<const Elf64_Shdr> section_headers_;
+        span<const Elf64_Phdr> program_headers_;
+        span<const char> section_names_;
+
+        span<const Elf64_Sym> symtab_;
+        span<const char> strtab_;
+        span<const Elf64_Sym> dynsym_;
+        span<const char> dynstr_;
+
+        virt_addr load_bias_;
+
+        // the index arrays have no pointers in them so they can be used straight out of a cache mapping
+        // the spans below point either into that or into the vectors the build filled
+        std::unique_ptr<index_cache> cache_;
+
+        // address index sorted by start address, the starts are kept apart so the binary search only walks
+        // them and the end and symbol of the match sit together and are touched once at the end
+        struct address_entry
+        {
+            std::uint64_t end;
+            std::uint32_t symbol;
+            std::uint32_t unused;
+        };
+        span<const std::uint64_t> symbol_starts_;
+        span<const address_entry> symbols_by_address_;
+
+        // name index: symbols grouped by name, and an open addressing table from the name hash to the group
+        struct name_group
+        {
+            std::uint64_t hash;
+            std::uint32_t first;
+            std::uint32_t count;
+        };
+        span<const name_group> name_groups_;
+        // group index + 1, 0 is an empty slot
+        span<const std::uint32_t> name_slots_;
+
+        // get_symbols_by_name hands out pointers, so these are always rebuilt from the numbered form
+        std::vector<const Elf64_Sym *> symbols_by_name_;
+
+        struct built_indexes
+        {
+            std::vector<std::uint64_t> symbol_starts;
+            std::vector<address_entry> symbols_by_address;
+            std::vector<name_group> name_groups;
+            std::vector<std::uint32_t> name_slots;
+        };
+        built_indexes built_;
+    };
+}
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef PDB_EXPECTED_HPP
+#define PDB_EXPECTED_HPP
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <sys/types.h>
+#include <libpdb/error.hpp>
+
+namespace pdb
+{
+    // what failed, one per error the throwing API can report from the operations that have a try_ version
+    enum class errc : std::uint8_t
+    {
+        process_ended,
+        open_register_transaction,
+        resume_failed,
+        resume_thread_failed,
+        single_step_failed,
+        stop_thread_failed,
+        wait_failed,
+        waitid_failed,
+        event_message_failed,
+        signal_info_failed,
+        read_gprs_failed,
+        read_fprs_failed,
+        read_debug_registers_failed,
+        write_user_area_failed,
+        write_fprs_failed,
+        write_gprs_failed,
+        unexpected_register_size,
+        open_memory_failed,
+        read_memory_failed,
+        write_memory_failed
+    };
+
+    // a failure without the string, the errno of the syscall that failed (0 if none did) and the thread
+    // or process it failed on where the message names one
+    // the message is only put together when somebody asks for it, which is what the throwing API does
+    struct error_code
+    {
+        errc code;
+        int sys_errno = 0;
+        pid_t pid = 0;
+
+        // the text the throwing API sends for this failure
+        std::string message() const;
+    };
+
+    // a T or the error_code of why there is none
+    template <class T>
+    class [[nodiscard]] expected
+    {
+    public:
+        // anything a T is made from, so a function returning expected<T> can return what makes its T
+        template <class U = T, class = std::enable_if_t<std::is_constructible_v<T, U &&> and
+                                                        !std::is_same_v<std::decay_t<U>, error_code>>>
+        expected(U &&value) : storage_(std::in_place_index<0>, std::forward<U>(value)) {}
+        expected(error_code code) : storage_(std::in_place_index<1>, code) {}
+
+        bool has_value() const { return storage_.index() == 0; }
+        explicit operator bool() const { return has_value(); }
+
+        // throws the error the throwing API would have
+        T &value() &
+        {
+            if (!has_value())
+                error::send(error().message());
+            return std::get<0>(storage_);
+        }
+        T &&value() &&
+        {
+            if (!has_value())
+                error::send(error().message());
+            return std::get<0>(std::move(storage_));
+        }
+
+        T &operator*() { return std::get<0>(storage_); }
+        const T &operator*() const { return std::get<0>(storage_); }
+        T *operator->() { return &std::get<0>(storage_); }
+        const T *operator->() const { return &std::get<0>(storage_); }
+
+        const error_code &error() const { return std::get<1>(storage_); }
+
+    private:
+        std::variant<T, error_code> storage_;
+    };
+
+    template <>
+    class [[nodiscard]] expected<void>
+    {
+    public:
+        expected() = default;
+        expected(error_code code) : error_(code) {}
+
+        bool has_value() const { return !error_; }
+        explicit operator bool() const { return has_value(); }
+
+        void value() const
+        {
+            if (error_)
+                error::send(error_->message());
+        }
+
+        const error_code &error() const { return *error_; }
+
+    private:
+        std::optional<error_code> error_;
+    };
+
+    // an error_code with the errno of the call that just failed
+    inline error_code last_error(errc code, pid_t pid = 0) { return {code, errno, pid}; }
+}
+
+#endif
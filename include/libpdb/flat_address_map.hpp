@@ -0,0 +1,158 @@
+#ifndef PDB_FLAT_ADDRESS_MAP_HPP
+#define PDB_FLAT_ADDRESS_MAP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <libpdb/types.hpp>
+
+namespace pdb
+{
+    // open addressing hash map keyed by inferior address
+    // everything lives in one flat array so a lookup after a SIGTRAP is a multiply, a shift and usually one probe
+    // address 0 marks an empty slot so it can't be used as a key
+    template <class T>
+    class flat_address_map
+    {
+    public:
+        flat_address_map() { rehash(min_capacity); }
+
+        T *find(virt_addr address)
+        {
+            auto key = address.addr();
+            for (auto i = home(key);; i = (i + 1) & mask_)
+            {
+                if (slots_[i].key == key)
+                    return &slots_[i].value;
+                if (slots_[i].key == empty_key)
+                    return nullptr;
+            }
+        }
+
+        const T *find(virt_addr address) const
+        {
+            return const_cast<flat_address_map *>(this)->find(address);
+        }
+
+        bool contains(virt_addr address) const { return find(address) != nullptr; }
+
+        // inserts or overwrites
+        void insert(virt_addr address, T value)
+        {
+            // keep the table at most half full so probe chains stay short
+            if ((size_ + 1) * 2 > slots_.size())
+                rehash(slots_.size() * 2);
+
+            auto key = address.addr();
+            for (auto i = home(key);; i = (i + 1) & mask_)
+            {
+                if (slots_[i].key == key)
+                {
+                    slots_[i].value = value;
+                    return;
+                }
+                if (slots_[i].key == empty_key)
+                {
+                    slots_[i] = {key, value};
+                    ++size_;
+                    return;
+                }
+            }
+        }
+
+        // backward shift deletion, we move later entries of the probe chain into the hole
+        // instead of leaving tombstones that would slow down every later lookup
+        bool erase(virt_addr address)
+        {
+            auto key = address.addr();
+            auto i = home(key);
+            while (slots_[i].key != key)
+            {
+                if (slots_[i].key == empty_key)
+                    return false;
+                i = (i + 1) & mask_;
+            }
+
+            auto hole = i;
+            for (auto j = (i + 1) & mask_; slots_[j].key != empty_key; j = (j + 1) & mask_)
+            {
+                // an entry can fill the hole if its home is not between the hole and where it sits
+                auto h = home(slots_[j].key);
+                bool movable = hole <= j ? (h <= hole or h > j) : (h <= hole and h > j);
+                if (movable)
+                {
+                    slots_[hole] = slots_[j];
+                    hole = j;
+                }
+            }
+
+            slots_[hole] = slot{};
+            --size_;
+            return true;
+        }
+
+        void clear()
+        {
+            size_ = 0;
+            slots_.clear();
+            rehash(min_capacity);
+        }
+
+        std::size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+
+        // makes room for n entries up front, used by batched insertion
+        void reserve(std::size_t n)
+        {
+            auto capacity = slots_.size();
+            while (capacity < n * 2)
+                capacity *= 2;
+            if (capacity != slots_.size())
+                rehash(capacity);
+        }
+
+    private:
+        static constexpr std::uint64_t empty_key = 0;
+        static constexpr std::size_t min_capacity = 16;
+
+        struct slot
+        {
+            std::uint64_t key = empty_key;
+            T value{};
+        };
+
+        // fibonacci hashing, the high bits of the product are well mixed even for aligned addresses
+        std::size_t home(std::uint64_t key) const
+        {
+            return static_cast<std::size_t>((key * 0x9e3779b97f4a7c15ull) >> shift_);
+        }
+
+        void rehash(std::size_t capacity)
+        {
+            std::vector<slot> old(capacity);
+            old.swap(slots_);
+            mask_ = capacity - 1;
+            shift_ = 64;
+            for (auto c = capacity; c > 1; c >>= 1)
+                --shift_;
+
+            for (auto &s : old)
+            {
+                if (s.key == empty_key)
+                    continue;
+
+                auto i = home(s.key);
+                while (slots_[i].key != empty_key)
+                    i = (i + 1) & mask_;
+                slots_[i] = s;
+            }
+        }
+
+        std::vector<slot> slots_;
+        std::size_t size_ = 0;
+        std::size_t mask_ = 0;
+        unsigned shift_ = 64;
+    };
+}
+
+#endif
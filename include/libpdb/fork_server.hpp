@@ -0,0 +1,52 @@
+#ifndef PDB_FORK_SERVER_HPP
+#define PDB_FORK_SERVER_HPP
+
+#include <filesystem>
+#include <memory>
+#include <string_view>
+#include <sys/user.h>
+#include <libpdb/process.hpp>
+#include <libpdb/types.hpp>
+
+namespace pdb
+{
+    // hands out copies of one inferior stopped at the same point, made by forking it instead of launching
+    // the program again, so the exec, the dynamic loader and whatever ran before that point are paid once
+    // the template process is made to run a clone syscall we put at its entry point (which never runs again
+    // once the program is up); the clone has CLONE_PARENT, so every copy is our child and we reap it, and
+    // PTRACE_O_TRACEFORK has it traced from its first instruction
+    // a copy starts with the template's general purpose registers and memory, it has none of our
+    // breakpoints or watchpoints, and the floating point state is whatever the template had
+    class fork_server
+    {
+    public:
+        // takes over a stopped template, its breakpoint sites are disabled so the copies run clean code
+        explicit fork_server(std::unique_ptr<process> template_process);
+
+        // launches path and runs it to the start of function, found in its symbol table
+        static std::unique_ptr<fork_server> launch(const std::filesystem::path &path, const launch_options &options = {},
+                                                   std::string_view function = "main");
+
+        ~fork_server();
+
+        fork_server(const fork_server &) = delete;
+        fork_server &operator=(const fork_server &) = delete;
+
+        // a new inferior, stopped where the template is
+        std::unique_ptr<process> spawn();
+
+        const process &template_process() const { return *template_; }
+        std::uint64_t spawned() const { return spawned_; }
+
+    private:
+        // runs the template until it stops again and checks it stopped the way we expect
+        void continue_template(int expected_event, const char *what);
+
+        std::unique_ptr<process> template_;
+        user_regs_struct saved_regs_;
+        virt_addr entry_;
+        std::uint64_t spawned_ = 0;
+    };
+}
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef PDB_INDEX_CACHE_HPP
+#define PDB_INDEX_CACHE_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <libpdb/types.hpp>
+
+namespace pdb
+{
+    class elf;
+    class dwarf;
+    class dwarf_index;
+    class compile_unit;
+    class line_table;
+
+    // the symbol, function and line indexes of one build of a binary, saved so the next session on the same
+    // build maps them instead of parsing the ELF and DWARF again
+    // files are named after the build-id note, so a rebuilt binary never picks up the indexes of the old one
+    // the file is a header, a table of blocks and the blocks, each 8 byte aligned and laid out the way the
+    // indexes keep them in memory, so the symbol indexes are used straight out of the mapping
+    // a cache that doesn't check out (other format version, other file size, truncated) is treated as missing
+    class index_cache
+    {
+    public:
+        // bumped whenever anything in the layout changes
+        static constexpr std::uint32_t format_version = 1;
+
+        // $XDG_CACHE_HOME/pdb, or ~/.cache/pdb when it isn't set
+        static std::filesystem::path default_directory();
+
+        // where the cache of this build goes, empty for files without a build-id
+        static std::filesystem::path path_for(const elf &file, const std::filesystem::path &directory);
+
+        // nullptr when there is no usable cache of this build
+        static std::unique_ptr<index_cache> open(const elf &file, const std::filesystem::path &directory);
+
+        // builds every index (the dwarf_index and all the line tables included) and writes them out
+        // the file is written under a temporary name and renamed into place, so readers never see half of one
+        // returns the path written, empty if the file has no build-id to key it on
+        static std::filesystem::path write(const dwarf &debug_info, const std::filesystem::path &directory);
+
+        ~index_cache();
+
+        index_cache(const index_cache &) = delete;
+        index_cache &operator=(const index_cache &) = delete;
+
+        const std::filesystem::path &path() const { return path_; }
+
+        // the indexes of the file, called by the classes that own them
+        void read_symbol_indexes(elf &file) const;
+        // nullptr if the cache has no entry for it, the owner then builds it
+        std::unique_ptr<dwarf_index> read_dwarf_index(const dwarf &debug_info) const;
+        std::unique_ptr<line_table> read_line_table(const compile_unit &unit) const;
+
+    private:
+        enum block : std::uint32_t
+        {
+            symbol_starts,
+            symbols_by_address,
+            symbols_by_name,
+            name_groups,
+            name_slots,
+            dwarf_info,
+            dwarf_names,
+            dwarf_functions,
+            line_table_units,
+            line_table_data,
+            block_count
+        };
+
+        index_cache(std::filesystem::path path, const std::byte *data, std::size_t size);
+
+        template <class T>
+        span<const T> get(block kind) const;
+        bool symbol_indexes_valid(const elf &file) const;
+
+        std::filesystem::path path_;
+        const std::byte *data_;
+        std::size_t size_;
+    };
+}
+
+#endif
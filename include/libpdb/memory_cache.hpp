@@ -0,0 +1,60 @@
+#ifndef PDB_MEMORY_CACHE_HPP
+#define PDB_MEMORY_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace pdb
+{
+    // page granular copy of inferior memory
+    // it is only correct while the inferior is stopped, so pdb::process clears it on resume and on writes
+    class memory_cache
+    {
+    public:
+        static constexpr std::size_t page_size = 4096;
+
+        struct stats
+        {
+            // counted per page
+            std::uint64_t hits = 0;
+            std::uint64_t misses = 0;
+            // syscalls used to fill missing pages
+            std::uint64_t fills = 0;
+            // reads that were served without going to the kernel, ie the syscalls we saved
+            std::uint64_t reads_served = 0;
+            std::uint64_t invalidations = 0;
+        };
+
+        static std::uint64_t page_of(std::uint64_t addr) { return addr & ~(page_size - 1); }
+
+        // returns the cached page or nullptr
+        const std::byte *find(std::uint64_t page) const;
+        std::byte *find(std::uint64_t page);
+
+        // makes room for a page, find() gives the place to fill it
+        // inserting may move the storage so pointers from find() are only good until the next insert
+        void insert(std::uint64_t page);
+        void erase(std::uint64_t page);
+
+        // drops every page, the page storage is kept around for the next stop
+        void clear();
+
+        // drops the pages overlapping [addr, addr + size)
+        void invalidate(std::uint64_t addr, std::size_t size);
+
+        bool empty() const { return pages_.empty(); }
+        stats &get_stats() { return stats_; }
+        const stats &get_stats() const { return stats_; }
+
+    private:
+        // page address -> slot in storage_
+        std::unordered_map<std::uint64_t, std::size_t> pages_;
+        std::vector<std::byte> storage_;
+        std::size_t used_slots_ = 0;
+        stats stats_;
+    };
+}
+
+#endif
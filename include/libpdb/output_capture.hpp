@@ -0,0 +1,116 @@
+#ifndef PDB_OUTPUT_CAPTURE_HPP
+#define PDB_OUTPUT_CAPTURE_HPP
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <libpdb/pipe.hpp>
+#include <libpdb/process.hpp>
+#include <libpdb/types.hpp>
+
+namespace pdb
+{
+    enum class output_stream
+    {
+        out,
+        err
+    };
+
+    // captures the stdout and stderr of an inferior
+    // each stream gets its own pipe, and a thread of ours empties the read ends as soon as anything is in
+    // them, whether or not the debugger is waiting on the inferior, so a chatty inferior never blocks on a
+    // full pipe and never keeps us from reaching the next stop
+    // a stream goes either into a ring buffer in memory, read straight from the pipe into the ring with no
+    // copy in between, or into a log file with splice(), never passing through our memory at all
+    // when the ring is full the oldest output is dropped and counted, the inferior is never held up
+    class output_capture
+    {
+    public:
+        // ring_size is per stream and rounded up to a power of two
+        explicit output_capture(std::size_t ring_size = default_ring_size);
+        ~output_capture();
+
+        output_capture(const output_capture &) = delete;
+        output_capture &operator=(const output_capture &) = delete;
+
+        // the stream goes to path (created or truncated) instead of the ring, call before start()
+        void log_to(output_stream stream, const std::filesystem::path &path);
+
+        // points stdout_replacement and stderr_replacement of a launch at our pipes
+        void attach(launch_options &options) const;
+
+        // once the inferior is launched: closes our copies of the write ends, so the streams end when the
+        // inferior's do, and starts draining
+        void start();
+
+        // takes up to out.size() bytes of a stream out of the ring, never blocks
+        std::size_t read(output_stream stream, span<std::byte> out);
+
+        // everything in the ring of a stream
+        std::string take(output_stream stream);
+
+        // blocks until the ring of a stream has something, or the stream ended; false on timeout
+        bool wait_for_data(output_stream stream, std::chrono::milliseconds timeout);
+
+        // blocks until both streams ended (every copy of the write ends is closed), false on timeout
+        bool wait_for_end(std::chrono::milliseconds timeout);
+
+        struct stats
+        {
+            // read into the ring, or spliced into the log
+            std::uint64_t bytes = 0;
+            // overwritten in the ring before anybody read them
+            std::uint64_t dropped = 0;
+            // read or splice calls that moved something
+            std::uint64_t transfers = 0;
+        };
+        stats get_stats(output_stream stream);
+
+        static constexpr std::size_t default_ring_size = 1 << 20;
+
+        // what we ask for with F_SETPIPE_SZ, the kernel caps it at /proc/sys/fs/pipe-max-size
+        static constexpr int pipe_size = 1 << 20;
+
+    private:
+        struct channel
+        {
+            pdb::pipe pipe{/*close_on_exec=*/true};
+            int log_fd = -1;
+            bool ended = false;
+
+            // the ring, head and tail only grow, a byte lives at its position & mask
+            std::vector<std::byte> ring;
+            std::uint64_t head = 0;
+            std::uint64_t tail = 0;
+
+            stats counters;
+        };
+
+        channel &get(output_stream stream) { return channels_[static_cast<std::size_t>(stream)]; }
+
+        void drain_loop();
+        // moves whatever is in the pipe, returns false once the stream ended
+        bool drain(channel &chan);
+        bool drain_to_ring(channel &chan);
+        bool drain_to_log(channel &chan);
+
+        std::array<channel, 2> channels_;
+        std::uint64_t mask_;
+
+        // the drain thread sleeps in poll on the pipes and this eventfd, which the destructor writes to
+        int wake_fd_ = -1;
+        std::thread thread_;
+
+        std::mutex mutex_;
+        std::condition_variable data_ready_;
+    };
+}
+
+#endif
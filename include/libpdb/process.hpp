@@ -4,9 +4,22 @@
 #include <filesystem>
 #include <memory>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <cstdint>
+#include <libpdb/expected.hpp>
 #include <libpdb/registers.hpp>
+#include <libpdb/types.hpp>
+#include <libpdb/bit.hpp>
+#include <libpdb/memory_cache.hpp>
+#include <libpdb/breakpoint_site.hpp>
+#include <libpdb/watchpoint.hpp>
+#include <libpdb/stoppoint_collection.hpp>
+#include <libpdb/syscalls.hpp>
 #include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace pdb
 {
@@ -20,6 +33,16 @@ namespace pdb
         terminated
     };
 
+    // what raised a SIGTRAP, read from the siginfo
+    enum class trap_type
+    {
+        single_step,
+        software_break,
+        hardware_break,
+        syscall,
+        unknown
+    };
+
     struct stop_reason
     {
         stop_reason(int wait_status);
@@ -29,6 +52,100 @@ namespace pdb
 
         // contains info abt stop like return value or signal
         std::uint8_t info;
+
+        // only filled for SIGTRAP stops while stoppoints are set, and for syscall stops
+        std::optional<trap_type> trap_reason;
+
+        std::optional<syscall_information> syscall_info;
+    };
+
+    // one range of a scatter/gather memory transfer
+    struct memory_read_request
+    {
+        virt_addr address;
+        span<std::byte> into;
+    };
+
+    struct memory_write_request
+    {
+        virt_addr address;
+        span<const std::byte> from;
+    };
+
+    // how memory transfers reach the inferior
+    // process_vm falls back to /proc/<pid>/mem for the ranges the vm calls can't touch (eg. read only text pages)
+    enum class memory_backend
+    {
+        process_vm,
+        proc_mem
+    };
+
+    // counts the syscalls and bytes that went through each memory path
+    struct memory_stats
+    {
+        std::uint64_t vm_calls = 0;
+        std::uint64_t vm_bytes = 0;
+        std::uint64_t proc_mem_calls = 0;
+        std::uint64_t proc_mem_bytes = 0;
+    };
+
+    // how process::attach takes hold of a running process
+    // attach is PTRACE_ATTACH, which stops it with a SIGSTOP and needs a SIGCONT after the detach
+    // seize is PTRACE_SEIZE, which sends no signal at all, threads are stopped with PTRACE_INTERRUPT
+    enum class attach_mode
+    {
+        attach,
+        seize
+    };
+
+    // how launch creates the child
+    // vfork shares our address space until the exec (clone with CLONE_VM | CLONE_VFORK), so it costs the same
+    // however much memory the debugger holds; fork copies our page tables first, which grows with it
+    // a launch with the seccomp syscall backend always forks, its child stops for us before the exec
+    enum class launch_method
+    {
+        vfork,
+        fork
+    };
+
+    // what process::launch starts and how, the defaults are what launch(path) does
+    struct launch_options
+    {
+        // argv from argv[1] on, argv[0] is the path
+        std::vector<std::string> arguments;
+        // the whole environment as NAME=value, without one the inferior gets ours
+        std::optional<std::vector<std::string>> environment;
+        // empty keeps ours
+        std::filesystem::path working_directory;
+        // dup2'd onto stdin, stdout and stderr of the inferior
+        std::optional<int> stdin_replacement;
+        std::optional<int> stdout_replacement;
+        std::optional<int> stderr_replacement;
+        bool debug = true;
+        syscall_catch_policy syscalls = syscall_catch_policy::catch_none();
+        launch_method method = launch_method::vfork;
+    };
+
+    // one entry of the thread table, the main thread (tid == pid) is always the first one
+    struct thread_state
+    {
+        pid_t tid = 0;
+        process_state state = process_state::stopped;
+
+        // a stop we collected while stopping the other threads, the next wait_on_signal reports it
+        std::optional<int> pending_status;
+
+        // we sent a SIGSTOP (or PTRACE_INTERRUPT) that has not shown up yet
+        bool stop_requested = false;
+
+        // its stop was reported since the last resume, so it may sit on a stoppoint we have to step over
+        bool reported = false;
+
+        // between a syscall entry stop and its exit stop, the thread is resumed with PTRACE_SYSCALL until the exit
+        bool in_syscall = false;
+
+        // made on first use, most threads of a big process are never looked at
+        std::unique_ptr<registers> regs;
     };
 
     // we need to create a process type
@@ -43,16 +160,40 @@ namespace pdb
         stop_reason wait_on_signal();
 
         // to launch a process 
-        static std::unique_ptr<process> launch(std::filesystem::path path, bool debug = true, std::optional<int> stdout_replacement = std::nullopt);
+        static std::unique_ptr<process> launch(std::filesystem::path path, bool debug = true, std::optional<int> stdout_replacement = std::nullopt,
+                                               const syscall_catch_policy &syscalls = syscall_catch_policy::catch_none());
         // we provide a file descriptor to the stdout_replaceement so as to commnicate with the test progs
+        // syscalls picks the syscalls that stop the inferior, with the seccomp backend the filter goes in before exec
+
+        // the same with arguments, environment, working directory and all three streams
+        static std::unique_ptr<process> launch(std::filesystem::path path, const launch_options &options);
+
+        const syscall_catch_policy &get_syscall_catch_policy() const { return syscall_catch_policy_; }
         
         // to attach to a process
-        static std::unique_ptr<process> attach(pid_t pid);
+        static std::unique_ptr<process> attach(pid_t pid, attach_mode mode = attach_mode::seize);
+
+        // takes our stoppoints out and lets the process go, the destructor does this for an attached process
+        // a seized process is only stopped for as long as the cleanup takes and never sees a signal from us
+        void detach();
+
+        bool seized() const { return seized_; }
 
         void resume();
 
+        // resume and wait_on_signal without exceptions, for loops where a failure is routine (resuming a
+        // process that just ended, ESRCH from a thread on its way out): a failure comes back as an
+        // error_code and nothing formats a string unless the error is turned into one
+        // the throwing versions are these plus .value()
+        // patching breakpoint sites in and out around a step still throws, it fails on bad addresses only
+        expected<void> try_resume();
+        expected<stop_reason> try_wait_on_signal();
+
         pid_t pid() const { return pid_; }
 
+        // the auxiliary vector the kernel gave the inferior, AT_ENTRY in there tells where a PIE got loaded
+        std::unordered_map<int, std::uint64_t> get_auxv() const;
+
         // this is to force to use static members
         process() = delete;
 
@@ -62,9 +203,29 @@ namespace pdb
 
         process_state state() const { return state_; }
 
-        // const and non-const getter function
-        registers &get_registers() { return *registers_; }
-        const registers &get_registers() const { return *registers_; }
+        // const and non-const getter function, these are the registers of the current thread
+        registers &get_registers() { return *current_registers_; }
+        const registers &get_registers() const { return *current_registers_; }
+
+        // registers of any thread, built the first time they are asked for
+        registers &get_registers(pid_t tid);
+
+        // fetches every register bank of the current thread at once, what each stop paid before the
+        // register cache fetched banks on first use
+        void read_all_registers();
+
+        // threads, kept up to date through PTRACE_O_TRACECLONE
+        const std::vector<thread_state> &threads() const { return threads_; }
+        pid_t current_thread() const { return current_tid_; }
+        void set_current_thread(pid_t tid);
+
+        // in all-stop mode (the default) a stop of one thread stops every other thread too
+        void set_all_stop(bool enable) { all_stop_ = enable; }
+        bool all_stop() const { return all_stop_; }
+
+        // asks every running thread to stop in one pass (PTRACE_INTERRUPT when seized, SIGSTOP otherwise)
+        // and then collects the stops, so the pause costs one round trip instead of one per thread
+        void stop_all_threads();
 
         // writes in the user area of process
         void write_user_area(std::size_t offset, std::uint64_t data);
@@ -72,10 +233,165 @@ namespace pdb
         void write_fprs(const user_fpregs_struct &fprs);
         void write_gprs(const user_regs_struct &gprs);
 
+        // reads and writes whole ranges of inferior memory with process_vm_readv/process_vm_writev
+        // instead of one PTRACE_PEEKDATA per word
+        std::vector<std::byte> read_memory(virt_addr address, std::size_t amount) const;
+        void read_memory(virt_addr address, span<std::byte> into) const;
+        void write_memory(virt_addr address, span<const std::byte> data);
+
+        // the same without exceptions
+        expected<void> try_read_memory(virt_addr address, span<std::byte> into) const;
+        expected<void> try_write_memory(virt_addr address, span<const std::byte> data);
+
+        // scatter/gather over many ranges, the vm calls move up to IOV_MAX ranges per syscall
+        void read_memory_ranges(span<const memory_read_request> requests) const;
+        void write_memory_ranges(span<const memory_write_request> requests);
+
+        template <class T>
+        T read_memory_as(virt_addr address) const
+        {
+            auto data = read_memory(address, sizeof(T));
+            return from_bytes<T>(data.data());
+        }
+
+        // small reads go through a page cache that lives until the next resume or write
+        // reads bigger than this skip it, there is nothing to gain from copying a buffer dump twice
+        static constexpr std::size_t max_cached_read = 16 * memory_cache::page_size;
+
+        void set_memory_cache_enabled(bool enable);
+        bool memory_cache_enabled() const { return memory_cache_enabled_; }
+        const memory_cache::stats &memory_cache_stats() const { return memory_cache_.get_stats(); }
+
+        // software breakpoints
+        breakpoint_site &create_breakpoint_site(virt_addr address);
+
+        // for setting thousands of sites at once, the int3s go out in a few coalesced writes
+        std::vector<breakpoint_site *> create_breakpoint_sites(span<const virt_addr> addresses, bool enable = true);
+        void enable_breakpoint_sites(span<breakpoint_site *const> sites);
+        void disable_breakpoint_sites(span<breakpoint_site *const> sites);
+
+        // removes every site pred holds for, the enabled ones are unpatched in the same coalesced writes
+        template <class F>
+        std::size_t remove_breakpoint_sites_if(F pred)
+        {
+            return breakpoint_sites_.remove_if(pred, [this](span<breakpoint_site *const> sites) { disable_breakpoint_sites(sites); });
+        }
+
+        stoppoint_collection<breakpoint_site> &breakpoint_sites() { return breakpoint_sites_; }
+        const stoppoint_collection<breakpoint_site> &breakpoint_sites() const { return breakpoint_sites_; }
+
+        // hardware watchpoints, at most four can be enabled at once
+        watchpoint &create_watchpoint(virt_addr address, stoppoint_mode mode, std::size_t size);
+
+        stoppoint_collection<watchpoint> &watchpoints() { return watchpoints_; }
+        const stoppoint_collection<watchpoint> &watchpoints() const { return watchpoints_; }
+
+        // decodes dr6 after a hardware_break stop and returns the watchpoint whose slot fired
+        std::optional<watchpoint::id_type> triggered_watchpoint() const;
+
+        virt_addr get_pc() const
+        {
+            return virt_addr(get_registers().read_by_id_As<std::uint64_t>(register_id::rip));
+        }
+
+        void set_pc(virt_addr address)
+        {
+            get_registers().write_by_id(register_id::rip, address.addr());
+        }
+
+        void set_memory_backend(memory_backend backend) { memory_backend_ = backend; }
+        memory_backend get_memory_backend() const { return memory_backend_; }
+        const pdb::memory_stats &memory_stats() const { return memory_stats_; }
+
     private:
-        process(pid_t pid, bool terminate_on_end, bool is_attached) : pid_(pid), terminate_on_end_(terminate_on_end), is_attached_(is_attached), registers_(new registers(*this)) {}
+        // registers pulls its banks from the kernel lazily through the read_* functions
+        friend registers;
 
-        void read_all_registers();
+        // a session waits for many processes itself and hands us the wait status
+        friend class session;
+
+        // a fork server builds the process objects of the copies it makes
+        friend class fork_server;
+
+        // returns nothing for the events we deal with ourselves (new threads, thread exits, our own SIGSTOPs)
+        expected<std::optional<stop_reason>> handle_wait_status(pid_t tid, int wait_status);
+        // the same without the trace event around it
+        expected<std::optional<stop_reason>> interpret_wait_status(pid_t tid, int wait_status);
+
+        process(pid_t pid, bool terminate_on_end, bool is_attached);
+
+        // each of these fills one bank of the given register cache
+        expected<void> read_gprs(const registers &regs);
+        expected<void> read_fprs(const registers &regs);
+        expected<void> read_debug_register(const registers &regs, int index);
+
+        expected<void> write_user_area(pid_t tid, std::size_t offset, std::uint64_t data);
+        expected<void> write_fprs(pid_t tid, const user_fpregs_struct &fprs);
+        expected<void> write_gprs(pid_t tid, const user_regs_struct &gprs);
+
+        thread_state *find_thread(pid_t tid);
+        thread_state &add_thread(pid_t tid);
+        void remove_thread(pid_t tid);
+
+        // true for our threads, including ones whose clone event we have not seen yet
+        bool owns_thread(pid_t tid) const;
+
+        // blocks until one of our threads has something to report
+        expected<std::pair<pid_t, int>> wait_for_thread();
+
+        // stop_all_threads without exceptions
+        expected<void> try_stop_all_threads();
+
+        // waits for every stop we asked for, events that come first are put aside
+        expected<void> collect_requested_stops();
+        void drop_exited_threads();
+
+        // hands out a stop stop_all_threads() put aside
+        expected<std::optional<stop_reason>> take_pending_stop();
+
+        expected<void> continue_thread(thread_state &thread);
+
+        // sets PTRACE_O_TRACECLONE so new threads are traced and reported, plus what syscall catching needs
+        void set_ptrace_options(pid_t tid);
+
+        // PTRACE_SYSCALL while syscalls are stopped on by ptrace itself or an exit stop is due, PTRACE_CONT otherwise
+        int resume_request(const thread_state &thread) const;
+
+        // fills in a syscall entry or exit stop, returns nothing for a stop we filter out ourselves
+        std::optional<syscall_information> read_syscall_stop(thread_state &thread, int wait_status);
+
+        // runs the instruction under an int3 or execute watchpoint with a single step
+        expected<void> step_over_stoppoint(thread_state &thread);
+        // what to do when the step ended in something other than its SIGTRAP
+        expected<void> hold_step_status(thread_state &thread, int wait_status, breakpoint_site *site, watchpoint *hardware);
+
+        // moves the ranges described by the iovecs, local and remote must describe the same bytes
+        // ranges the vm calls fail on go through /proc/<pid>/mem
+        expected<void> transfer_memory(std::vector<struct iovec> &local, std::vector<struct iovec> &remote, bool write, memory_backend backend) const;
+        expected<void> try_read_memory_ranges(span<const memory_read_request> requests) const;
+        expected<void> write_memory_ranges(span<const memory_write_request> requests, memory_backend backend);
+        expected<void> transfer_proc_mem(const struct iovec &local, const struct iovec &remote, bool write) const;
+
+        // serves the small requests from the page cache, filling the missing pages in one transfer
+        // returns false if the pages could not be read, the caller then reads the requests directly
+        bool read_through_cache(const std::vector<const memory_read_request *> &requests) const;
+
+        // reads the code around the sites in coalesced runs, swaps the int3s in or out and writes the runs back
+        void patch_breakpoint_sites(span<breakpoint_site *const> sites, bool enable);
+
+        // watchpoints program their debug register slot through these
+        friend watchpoint;
+        int set_hardware_stoppoint(virt_addr address, stoppoint_mode mode, std::size_t size);
+        void clear_hardware_stoppoint(int index);
+
+        // debug registers are per thread, a new thread gets the enabled watchpoints copied in
+        void program_watchpoints(registers &regs);
+
+        // reads the siginfo of a SIGTRAP to tell int3s, single steps and debug register hits apart
+        expected<void> augment_stop_reason(pid_t tid, stop_reason &reason);
+
+        // opened on first use of the /proc/<pid>/mem fallback
+        expected<int> memory_fd() const;
 
         pid_t pid_ = 0;
 
@@ -84,8 +400,24 @@ namespace pdb
         bool is_attached_ = true;
         process_state state_ = process_state::stopped;
 
-        // pointer to the register data
-        std::unique_ptr<registers> registers_;
+        std::vector<thread_state> threads_;
+        pid_t current_tid_ = 0;
+        // kept next to current_tid_ so get_registers() does not search the table
+        registers *current_registers_ = nullptr;
+        bool all_stop_ = true;
+        bool seized_ = false;
+
+        syscall_catch_policy syscall_catch_policy_ = syscall_catch_policy::catch_none();
+
+        memory_backend memory_backend_ = memory_backend::process_vm;
+        mutable int memory_fd_ = -1;
+        mutable pdb::memory_stats memory_stats_;
+
+        bool memory_cache_enabled_ = true;
+        mutable memory_cache memory_cache_;
+
+        stoppoint_collection<breakpoint_site> breakpoint_sites_;
+        stoppoint_collection<watchpoint> watchpoints_;
     };
 }
 
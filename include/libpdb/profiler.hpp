@@ -0,0 +1,189 @@
+#ifndef PDB_PROFILER_HPP
+#define PDB_PROFILER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include <libpdb/types.hpp>
+#include <libpdb/unwinder.hpp>
+
+namespace pdb
+{
+    class process;
+
+    // the call paths of every sample, one node per (caller path, pc)
+    // the children of a node are found by hashing (parent, pc) into one open addressing table for the whole
+    // trie, so adding a stack is a probe per frame and no node holds a container of its own
+    class call_trie
+    {
+    public:
+        using node_id = std::uint32_t;
+        static constexpr node_id root = 0;
+
+        struct node
+        {
+            std::uint64_t pc = 0;
+            node_id parent = root;
+            std::uint32_t depth = 0;
+            // every frame but the innermost one, its pc is where the call returns to
+            bool return_address = false;
+            // samples that ended here, and samples that went through here
+            std::uint64_t self = 0;
+            std::uint64_t total = 0;
+        };
+
+        call_trie();
+
+        // one sample, innermost frame first the way the unwinder hands them out
+        void add(span<const stack_frame> frames, std::uint64_t count = 1);
+
+        const std::vector<node> &nodes() const { return nodes_; }
+        std::uint64_t samples() const { return nodes_[root].total; }
+
+        // the name of a frame, return_address is set for every frame but the innermost
+        using symbolizer = std::function<std::string(virt_addr pc, bool return_address)>;
+
+        // "outer;inner count" per distinct stack of names, the input of flamegraph.pl and friends
+        void write_folded(std::ostream &out, const symbolizer &name) const;
+
+        // per function: samples in it, and samples with it anywhere on the stack, sorted by the first
+        void write_flat(std::ostream &out, const symbolizer &name) const;
+
+    private:
+        node_id child(node_id parent, std::uint64_t pc, bool return_address);
+        void grow();
+
+        std::vector<node> nodes_;
+        // node ids, 0 (the root, which is nobody's child) marks a free slot
+        std::vector<node_id> slots_;
+    };
+
+    // a sampling profiler for a process we are attached to
+    // a sample stops every thread, reads the general purpose registers and unwinds the stacks into a buffer
+    // that is already there, and resumes the process; only then are the stacks added to the trie, so the
+    // inferior is only held for as long as the unwinds take
+    class sampling_profiler
+    {
+    public:
+        sampling_profiler(process &proc, unsigned hz, std::size_t max_depth = 256);
+
+        // takes one sample of a running process, false once a thread stopped for something else (an exit,
+        // a signal, a trap); that stop is left for wait_on_signal
+        bool sample();
+
+        // resumes the process and samples it hz times a second until duration is over (zero runs until it
+        // ends), the process stops for another reason or stop turns true; the process is left stopped
+        // returns false in the second case, the stop is then waiting in wait_on_signal
+        bool run(std::chrono::nanoseconds duration, const std::atomic<bool> *stop = nullptr);
+
+        const call_trie &trie() const { return trie_; }
+        unwinder &get_unwinder() { return unwinder_; }
+
+        // the trie with symbols from the modules the unwinder opened, demangled
+        void write_folded(std::ostream &out);
+        void write_flat(std::ostream &out);
+
+        struct stats
+        {
+            std::uint64_t samples = 0;
+            std::uint64_t stacks = 0;
+            std::uint64_t frames = 0;
+            // from the first stop request to the last thread resumed
+            std::chrono::nanoseconds stopped_time{0};
+            std::chrono::nanoseconds longest_stop{0};
+            // ticks that came around while the previous sample was still being taken
+            std::uint64_t missed_ticks = 0;
+        };
+        const stats &get_stats() const { return stats_; }
+
+    private:
+        process *process_;
+        unwinder unwinder_;
+        std::chrono::nanoseconds period_;
+        std::size_t max_depth_;
+
+        // threads * max_depth frames, filled while the process is stopped
+        std::vector<stack_frame> frames_;
+        std::vector<std::size_t> depths_;
+
+        call_trie trie_;
+        stats stats_;
+    };
+
+    // the same profile without stopping the process once: the kernel samples every thread on a cpu-clock
+    // software event (perf_event_open with PERF_SAMPLE_IP | PERF_SAMPLE_CALLCHAIN) and we read the samples
+    // out of a ring buffer mapped per thread
+    // the process doesn't have to be traced, but the kernel walks user stacks with frame pointers, code
+    // built without them has shorter stacks here than with the ptrace sampler
+    // needs perf_event_paranoid <= 2 (or CAP_PERFMON) for a process of the same user
+    class perf_sampler
+    {
+    public:
+        perf_sampler(pid_t pid, unsigned hz, std::size_t max_depth = 256);
+        ~perf_sampler();
+
+        perf_sampler(const perf_sampler &) = delete;
+        perf_sampler &operator=(const perf_sampler &) = delete;
+
+        // collects samples until duration is over (zero runs until the process ends) or stop turns true
+        // returns false if the process ended
+        bool run(std::chrono::nanoseconds duration, const std::atomic<bool> *stop = nullptr);
+
+        // reads whatever the kernel wrote since the last drain into the trie
+        void drain();
+
+        const call_trie &trie() const { return trie_; }
+
+        void write_folded(std::ostream &out);
+        void write_flat(std::ostream &out);
+
+        struct stats
+        {
+            std::uint64_t samples = 0;
+            std::uint64_t frames = 0;
+            // samples the kernel dropped because a ring was full
+            std::uint64_t lost = 0;
+            std::uint64_t threads = 0;
+        };
+        const stats &get_stats() const { return stats_; }
+
+        // data pages of each ring, a power of two
+        static constexpr std::size_t ring_pages = 32;
+
+    private:
+        struct stream
+        {
+            pid_t tid;
+            int fd;
+            std::byte *ring;
+            bool hung_up = false;
+        };
+
+        // opens an event for every thread in /proc/<pid>/task that doesn't have one, false if there are none
+        bool open_new_threads();
+        void open_thread(pid_t tid);
+        void drain(stream &thread);
+        void close(stream &thread);
+
+        pid_t pid_;
+        unsigned hz_;
+        std::size_t max_depth_;
+        std::size_t page_size_;
+        std::vector<stream> streams_;
+        // every thread we opened an event for, a thread whose ring hung up is not opened again
+        std::unordered_set<pid_t> seen_;
+        std::vector<std::byte> record_;
+        std::vector<stack_frame> frames_;
+
+        module_map modules_;
+        call_trie trie_;
+        stats stats_;
+    };
+}
+
+#endif
@@ -6,6 +6,8 @@
 #include <string_view>
 #include <sys/user.h>
 #include <algorithm>
+#include <array>
+#include <iterator>
 #include <libpdb/error.hpp>
 
 namespace pdb
@@ -58,6 +60,7 @@ namespace pdb
 
 
     // returns the the required register by passing a default comparator
+    // this is a linear scan, the by_id/by_name/by_dwarf lookups below use the compile time tables instead
     template<class F>
     const register_info& register_info_by(F f)
     {
@@ -70,23 +73,180 @@ namespace pdb
         return *it;
     }
 
+    namespace detail
+    {
+        inline constexpr std::size_t register_count = std::size(g_register_infos);
+
+        // register_id and g_register_infos are generated from the same X-macro in the same order
+        // so the id is the index, we still check it at compile time
+        constexpr bool register_ids_are_indices()
+        {
+            for (std::size_t i = 0; i < register_count; ++i)
+            {
+                if (static_cast<std::size_t>(g_register_infos[i].id) != i)
+                    return false;
+            }
+            return true;
+        }
+        static_assert(register_ids_are_indices(), "register_id must match the position in g_register_infos");
+
+        // dwarf ids are small and dense (0 to 66) so a plain array indexed by dwarf id works
+        constexpr std::int32_t max_dwarf_id()
+        {
+            std::int32_t max = 0;
+            for (auto &info : g_register_infos)
+            {
+                if (info.dwarf_id > max)
+                    max = info.dwarf_id;
+            }
+            return max;
+        }
+
+        // -1 marks a dwarf id with no register
+        constexpr std::array<std::int16_t, max_dwarf_id() + 1> make_dwarf_table()
+        {
+            std::array<std::int16_t, max_dwarf_id() + 1> table{};
+            for (auto &slot : table)
+                slot = -1;
+
+            for (std::size_t i = 0; i < register_count; ++i)
+            {
+                if (g_register_infos[i].dwarf_id >= 0)
+                    table[g_register_infos[i].dwarf_id] = static_cast<std::int16_t>(i);
+            }
+            return table;
+        }
+        inline constexpr auto dwarf_table = make_dwarf_table();
+
+        // names go through a perfect hash built with hash-and-displace:
+        // the first hash picks a bucket, each bucket stores the seed for a second hash that we search
+        // for at compile time so that every register name ends up in its own slot
+        inline constexpr std::size_t name_bucket_count = 128;
+        inline constexpr std::size_t name_table_size = 256;
+        static_assert(name_table_size >= register_count, "name table needs a slot per register");
+
+        // FNV-1a
+        constexpr std::uint32_t hash_register_name(std::string_view name, std::uint32_t seed)
+        {
+            std::uint32_t hash = 2166136261u ^ (seed * 0x9e3779b9u);
+            for (char c : name)
+            {
+                hash ^= static_cast<std::uint8_t>(c);
+                hash *= 16777619u;
+            }
+            return hash ^ (hash >> 16);
+        }
+
+        constexpr std::size_t name_bucket(std::string_view name)
+        {
+            return hash_register_name(name, 0) % name_bucket_count;
+        }
+
+        constexpr std::size_t name_slot(std::string_view name, std::uint16_t seed)
+        {
+            return hash_register_name(name, seed) % name_table_size;
+        }
+
+        struct name_hash
+        {
+            std::array<std::uint16_t, name_bucket_count> seeds{};
+            std::array<std::int16_t, name_table_size> table{};
+        };
+
+        constexpr name_hash make_name_hash()
+        {
+            name_hash hash{};
+            for (auto &slot : hash.table)
+                slot = -1;
+
+            std::size_t bucket_sizes[name_bucket_count] = {};
+            std::size_t largest = 0;
+            for (auto &info : g_register_infos)
+            {
+                auto size = ++bucket_sizes[name_bucket(info.name)];
+                if (size > largest)
+                    largest = size;
+            }
+
+            // place the crowded buckets first while the table is still empty
+            for (auto size = largest; size > 0; --size)
+            {
+                for (std::size_t bucket = 0; bucket < name_bucket_count; ++bucket)
+                {
+                    if (bucket_sizes[bucket] != size)
+                        continue;
+
+                    for (std::uint16_t seed = 1;; ++seed)
+                    {
+                        bool fits = true;
+                        bool taken[name_table_size] = {};
+                        for (auto &info : g_register_infos)
+                        {
+                            if (name_bucket(info.name) != bucket)
+                                continue;
+
+                            auto slot = name_slot(info.name, seed);
+                            if (hash.table[slot] != -1 or taken[slot])
+                            {
+                                fits = false;
+                                break;
+                            }
+                            taken[slot] = true;
+                        }
+
+                        if (fits)
+                        {
+                            hash.seeds[bucket] = seed;
+                            break;
+                        }
+                    }
+
+                    for (std::size_t i = 0; i < register_count; ++i)
+                    {
+                        if (name_bucket(g_register_infos[i].name) == bucket)
+                            hash.table[name_slot(g_register_infos[i].name, hash.seeds[bucket])] = static_cast<std::int16_t>(i);
+                    }
+                }
+            }
+            return hash;
+        }
+        inline constexpr name_hash name_lookup = make_name_hash();
+    }
 
     // finds the register by id
+    // the id is the index into g_register_infos
     inline const register_info& register_info_by_id(register_id id)
     {
-        return register_info_by([id](auto &i) { return i.id == id; }); 
+        auto index = static_cast<std::size_t>(id);
+        if (index >= detail::register_count)
+            error::send("Can't find register info");
+
+        return g_register_infos[index];
     }
 
     // finds the register by name
+    // one hash and one compare, the compare is only there to reject names that are not registers
     inline const register_info& register_info_by_name(std::string_view name)
     {
-        return register_info_by([name] (auto &i) { return i.name == name; });   
+        auto seed = detail::name_lookup.seeds[detail::name_bucket(name)];
+        auto index = detail::name_lookup.table[detail::name_slot(name, seed)];
+        if (index < 0 or g_register_infos[index].name != name)
+            error::send("Can't find register info");
+
+        return g_register_infos[index];
     }
 
     // finds the register by dwarf_id
     inline const register_info& register_info_by_dwarf(std::int32_t dwarf_id)
     {
-        return register_info_by([dwarf_id](auto &i) { return i.dwarf_id == dwarf_id;});
+        if (dwarf_id < 0 or dwarf_id >= static_cast<std::int32_t>(detail::dwarf_table.size()))
+            error::send("Can't find register info");
+
+        auto index = detail::dwarf_table[dwarf_id];
+        if (index < 0)
+            error::send("Can't find register info");
+
+        return g_register_infos[index];
     }
 }
 #endif
\ No newline at end of file
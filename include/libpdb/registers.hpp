@@ -2,7 +2,9 @@
 #define PDB_REGISTER_HPP
 
 #include <sys/user.h>
+#include <sys/types.h>
 #include <variant>
+#include <libpdb/expected.hpp>
 #include <libpdb/register_info.hpp>
 #include <libpdb/types.hpp>
 
@@ -29,6 +31,10 @@ namespace pdb
 
             void write(const register_info& info, value val);
 
+            // the same without exceptions, a failed fetch or store comes back as an error_code
+            expected<value> try_read(const register_info& info) const;
+            expected<void> try_write(const register_info& info, value val);
+
             template <class T>
             T read_by_id_As(register_id id) const 
             {
@@ -41,15 +47,105 @@ namespace pdb
                 write(register_info_by_id(id), val);
             }
 
+            // an eager fetch costs PTRACE_GETREGS + PTRACE_GETFPREGS + 8 PTRACE_PEEKUSER for dr0-dr7
+            static constexpr std::uint64_t eager_fetch_syscalls = 10;
+
+            // counters for the register cache
+            // syscalls_saved is what we would have paid with the old read-everything-on-stop approach
+            struct cache_stats
+            {
+                std::uint64_t stops = 0;
+                std::uint64_t syscalls = 0;
+                std::uint64_t write_syscalls = 0;
+                std::uint64_t flushes = 0;
+                std::uint64_t syscalls_saved() const
+                {
+                    auto eager = stops * eager_fetch_syscalls;
+                    return eager > syscalls ? eager - syscalls : 0;
+                }
+                double syscalls_saved_per_stop() const { return stops ? static_cast<double>(syscalls_saved()) / stops : 0.0; }
+            };
+
+            const cache_stats& stats() const { return stats_; }
+
+            // the thread these registers belong to
+            pid_t tid() const { return tid_; }
+
+            // drops every cached bank so the next read goes back to the kernel
+            // any write that has not been flushed yet is lost
+            void invalidate() { valid_banks_ = 0; valid_drs_ = 0; dirty_banks_ = 0; dirty_drs_ = 0; }
+
+            // in write-back mode writes only touch data_ and are pushed to the kernel by flush()
+            // process::resume flushes for us so the inferior always runs with what we wrote
+            void set_write_back(bool enable);
+            bool write_back() const { return write_back_; }
+
+            // pushes the dirty banks to the kernel: one PTRACE_SETREGS, one PTRACE_SETFPREGS and a
+            // PTRACE_POKEUSER only for the debug registers that changed
+            void flush();
+            expected<void> try_flush();
+            bool dirty() const { return dirty_banks_ != 0; }
+
+            // groups writes so they can be committed or thrown away together
+            // writes inside a transaction are always buffered, commit flushes them unless we are in write-back mode
+            void begin_transaction();
+            void commit_transaction();
+            void rollback_transaction();
+            bool in_transaction() const { return in_transaction_; }
+
         private:
             // only the pdb::process will construct an pdb::register
+            // every thread of the inferior has its own registers, tid_ says whose these are
             friend process;
-            registers(process& proc) : proc_(&proc) {}
+            registers(process& proc, pid_t tid) : proc_(&proc), tid_(tid) {}
+
+            // registers are fetched from the kernel in banks, one bit per bank in valid_banks_
+            // the debug registers have no bulk call, each one is its own PTRACE_PEEKUSER, so they are tracked one by one in valid_drs_
+            enum bank : std::uint8_t
+            {
+                gpr_bank = 1 << 0,
+                fpr_bank = 1 << 1,
+                dr_bank = 1 << 2,
+                all_banks = gpr_bank | fpr_bank | dr_bank
+            };
+
+            static bank bank_of(register_type type);
+
+            // position of a debug register in u_debugreg
+            static int dr_index(const register_info& info) { return (info.offset - offsetof(user, u_debugreg)) / 8; }
+
+            // fetches what holds the given register (its bank, or just itself for a debug register) if it is not cached yet
+            expected<void> ensure_register(const register_info& info) const;
+            expected<void> ensure_banks(std::uint8_t banks) const;
+
+            // called by the process every time the inferior stops
+            void on_stop() { invalidate(); ++stats_.stops; }
+
+            // records that a write changed data_ but not the kernel copy
+            void mark_dirty(const register_info& info);
             
             // data member user data from sys/user.h and we'll store the reg value here 
             // data_ stores the memomry blokc of the whole registers so if we add any offset then to its address then we can get the snapshot of a current register
-            user data_;
+            // mutable as a const read may have to fill a bank on first access
+            mutable user data_;
+            mutable std::uint8_t valid_banks_ = 0;
+            mutable std::uint8_t valid_drs_ = 0;
+            mutable cache_stats stats_;
             process *proc_;
+            pid_t tid_;
+
+            bool write_back_ = false;
+            std::uint8_t dirty_banks_ = 0;
+            // one bit per debug register so a flush only pokes the ones that changed
+            std::uint8_t dirty_drs_ = 0;
+
+            // state saved by begin_transaction so rollback_transaction can restore it
+            bool in_transaction_ = false;
+            user saved_data_;
+            std::uint8_t saved_valid_banks_ = 0;
+            std::uint8_t saved_valid_drs_ = 0;
+            std::uint8_t saved_dirty_banks_ = 0;
+            std::uint8_t saved_dirty_drs_ = 0;
     };
 }
 
@@ -0,0 +1,71 @@
+#ifndef PDB_SESSION_HPP
+#define PDB_SESSION_HPP
+
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <signal.h>
+#include <sys/types.h>
+#include <libpdb/process.hpp>
+
+namespace pdb
+{
+    // a state change of one of the processes in a session
+    struct session_event
+    {
+        process *proc;
+        stop_reason reason;
+    };
+
+    // watches many inferiors from a single thread
+    // instead of blocking in waitpid on one pid, the session waits in epoll on a signalfd for SIGCHLD
+    // (the tracer gets one for every stop and exit of a tracee) and then collects the state changes
+    // with non-blocking waitid, so hundreds of inferiors need neither a thread each nor a blocking wait each
+    //
+    // SIGCHLD is blocked in the creating thread for the lifetime of the session, use it from that thread only
+    class session
+    {
+    public:
+        session();
+        ~session();
+
+        session(const session &) = delete;
+        session &operator=(const session &) = delete;
+
+        // the session owns the processes it watches
+        process &add(std::unique_ptr<process> proc);
+        std::unique_ptr<process> remove(pid_t pid);
+
+        process *find(pid_t pid);
+        std::size_t size() const { return processes_.size(); }
+        bool empty() const { return processes_.empty(); }
+
+        template <class F>
+        void for_each(F f)
+        {
+            for (auto &[pid, proc] : processes_)
+                f(*proc);
+        }
+
+        // waits up to timeout_ms (-1 blocks) for state changes and puts every one that arrived in events
+        // returns the number of events, 0 on timeout
+        std::size_t poll(std::vector<session_event> &events, int timeout_ms = -1);
+
+        // the epoll fd, so a session can be nested in an outer event loop
+        int fd() const { return epoll_fd_; }
+
+    private:
+        // reaps every pending state change of our processes without blocking
+        void collect(std::vector<session_event> &events);
+        // slow path when a child that isn't ours is first in line for waitid
+        void scan(std::vector<session_event> &events);
+        void drain_signalfd();
+
+        std::unordered_map<pid_t, std::unique_ptr<process>> processes_;
+        int epoll_fd_ = -1;
+        int signal_fd_ = -1;
+        sigset_t old_mask_;
+    };
+}
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef PDB_STATS_HPP
+#define PDB_STATS_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+// set by the PDB_STATS cmake option, without it every probe compiles to the bare syscall
+#ifndef PDB_STATS
+#define PDB_STATS 1
+#endif
+
+namespace pdb::stats
+{
+    inline constexpr bool enabled = PDB_STATS != 0;
+
+    // every kind of kernel round trip libpdb makes, ptrace by request
+    enum class op : std::uint8_t
+    {
+        ptrace_cont,
+        ptrace_syscall,
+        ptrace_singlestep,
+        ptrace_interrupt,
+        ptrace_attach,
+        ptrace_seize,
+        ptrace_detach,
+        ptrace_setoptions,
+        ptrace_geteventmsg,
+        ptrace_getsiginfo,
+        ptrace_getregs,
+        ptrace_setregs,
+        ptrace_getfpregs,
+        ptrace_setfpregs,
+        ptrace_peekuser,
+        ptrace_pokeuser,
+        ptrace_other,
+        waitpid,
+        waitid,
+        tgkill,
+        process_vm_readv,
+        process_vm_writev,
+        proc_mem_read,
+        proc_mem_write,
+        count
+    };
+
+    inline constexpr std::size_t op_count = static_cast<std::size_t>(op::count);
+
+    std::string_view op_name(op what);
+
+    // latencies go into log-linear buckets: values under 8 ns get one each, above that every power of
+    // two is split into four, so a bucket is at most 25% wide; the last one takes everything from 2^40 ns
+    inline constexpr std::size_t histogram_buckets = 160;
+
+    std::size_t bucket_of(std::uint64_t ns);
+    // the smallest value that lands in the bucket
+    std::uint64_t bucket_floor(std::size_t bucket);
+
+    struct operation
+    {
+        op what;
+        std::uint64_t calls = 0;
+        std::uint64_t errors = 0;
+        // moved by the memory transfers
+        std::uint64_t bytes = 0;
+        std::uint64_t total_ns = 0;
+        std::array<std::uint64_t, histogram_buckets> buckets{};
+
+        double mean_ns() const { return calls ? static_cast<double>(total_ns) / calls : 0.0; }
+
+        // the floor of the bucket the q quantile falls in, q in [0, 1]
+        std::uint64_t quantile_ns(double q) const;
+    };
+
+    // the counters of every thread that made a call added up, operations nobody made are left out
+    // each thread counts into storage only it writes, so recording never takes a lock or a locked
+    // instruction; a thread's counts stay in the totals after it exits
+    std::vector<operation> snapshot();
+
+    // later snapshots only count what happens from here on
+    void reset();
+
+    // one line per operation: calls, errors, mean, p50, p99, max bucket and bytes
+    void write_table(std::ostream &out, const std::vector<operation> &operations);
+}
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef PDB_STOPPOINT_COLLECTION_HPP
+#define PDB_STOPPOINT_COLLECTION_HPP
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <libpdb/types.hpp>
+#include <libpdb/error.hpp>
+#include <libpdb/flat_address_map.hpp>
+
+namespace pdb
+{
+    // owns the stoppoints (breakpoint sites, watchpoints) of a process
+    // by address lookups go through a flat hash so the check after every SIGTRAP is O(1)
+    template <class Stoppoint>
+    class stoppoint_collection
+    {
+    public:
+        Stoppoint &push(std::unique_ptr<Stoppoint> stoppoint)
+        {
+            auto &ref = *stoppoint;
+            by_address_.insert(ref.address(), &ref);
+            stoppoints_.push_back(std::move(stoppoint));
+            return ref;
+        }
+
+        void reserve(std::size_t n)
+        {
+            stoppoints_.reserve(n);
+            by_address_.reserve(n);
+        }
+
+        bool contains_id(typename Stoppoint::id_type id) const
+        {
+            return find_by_id(id) != stoppoints_.end();
+        }
+
+        bool contains_address(virt_addr address) const
+        {
+            return by_address_.contains(address);
+        }
+
+        bool enabled_stoppoint_at_address(virt_addr address) const
+        {
+            auto found = by_address_.find(address);
+            return found and (*found)->is_enabled();
+        }
+
+        Stoppoint &get_by_id(typename Stoppoint::id_type id)
+        {
+            auto it = find_by_id(id);
+            if (it == stoppoints_.end())
+                error::send("Invalid stoppoint id");
+            return **it;
+        }
+
+        const Stoppoint &get_by_id(typename Stoppoint::id_type id) const
+        {
+            return const_cast<stoppoint_collection *>(this)->get_by_id(id);
+        }
+
+        Stoppoint &get_by_address(virt_addr address)
+        {
+            auto found = by_address_.find(address);
+            if (!found)
+                error::send("Stoppoint with given address not found");
+            return **found;
+        }
+
+        const Stoppoint &get_by_address(virt_addr address) const
+        {
+            return const_cast<stoppoint_collection *>(this)->get_by_address(address);
+        }
+
+        // removing a stoppoint disables it first so no trap is left behind in the inferior
+        void remove_by_id(typename Stoppoint::id_type id)
+        {
+            auto it = find_by_id(id);
+            if (it == stoppoints_.end())
+                error::send("Invalid stoppoint id");
+            erase(it);
+        }
+
+        void remove_by_address(virt_addr address)
+        {
+            auto &stoppoint = get_by_address(address);
+            erase(std::find_if(stoppoints_.begin(), stoppoints_.end(),
+                               [&](auto &point) { return point.get() == &stoppoint; }));
+        }
+
+        // removes every stoppoint pred holds for in one pass over the collection
+        // disable is handed the enabled ones all at once, so the writes can be batched the way
+        // process::disable_breakpoint_sites does; nothing is removed if it throws
+        template <class Pred, class Disable>
+        std::size_t remove_if(Pred pred, Disable disable)
+        {
+            std::vector<char> doomed(stoppoints_.size());
+            std::vector<Stoppoint *> enabled;
+            for (std::size_t i = 0; i < stoppoints_.size(); ++i)
+            {
+                auto &point = *stoppoints_[i];
+                if (!pred(point))
+                    continue;
+                doomed[i] = true;
+                if (point.is_enabled())
+                    enabled.push_back(&point);
+            }
+
+            if (!enabled.empty())
+                disable(span<Stoppoint *const>(enabled.data(), enabled.size()));
+
+            auto kept = stoppoints_.begin();
+            for (std::size_t i = 0; i < stoppoints_.size(); ++i)
+            {
+                if (doomed[i])
+                    by_address_.erase(stoppoints_[i]->address());
+                else
+                    *kept++ = std::move(stoppoints_[i]);
+            }
+
+            auto removed = static_cast<std::size_t>(stoppoints_.end() - kept);
+            stoppoints_.erase(kept, stoppoints_.end());
+            return removed;
+        }
+
+        // the same with a disable() per stoppoint, for the kinds with nothing to batch
+        template <class Pred>
+        std::size_t remove_if(Pred pred)
+        {
+            return remove_if(pred, [](span<Stoppoint *const> points) {
+                for (auto point : points)
+                    point->disable();
+            });
+        }
+
+        template <class F>
+        void for_each(F f)
+        {
+            for (auto &point : stoppoints_)
+                f(*point);
+        }
+
+        template <class F>
+        void for_each(F f) const
+        {
+            for (const auto &point : stoppoints_)
+                f(*point);
+        }
+
+        std::size_t size() const { return stoppoints_.size(); }
+        bool empty() const { return stoppoints_.empty(); }
+
+    private:
+        using points_t = std::vector<std::unique_ptr<Stoppoint>>;
+
+        typename points_t::iterator find_by_id(typename Stoppoint::id_type id)
+        {
+            return std::find_if(stoppoints_.begin(), stoppoints_.end(),
+                                [=](auto &point) { return point->id() == id; });
+        }
+
+        typename points_t::const_iterator find_by_id(typename Stoppoint::id_type id) const
+        {
+            return const_cast<stoppoint_collection *>(this)->find_by_id(id);
+        }
+
+        void erase(typename points_t::iterator it)
+        {
+            (*it)->disable();
+            by_address_.erase((*it)->address());
+            stoppoints_.erase(it);
+        }
+
+        points_t stoppoints_;
+        flat_address_map<Stoppoint *> by_address_;
+    };
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef PDB_SYSCALLS_HPP
+#define PDB_SYSCALLS_HPP
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace pdb
+{
+    // x64 syscall names, from the kernel's unistd_64.h
+    std::string_view syscall_id_to_name(int id);
+    int syscall_name_to_id(std::string_view name);
+
+    // how syscall stops are produced
+    // seccomp installs a BPF filter in the child before exec that returns SECCOMP_RET_TRACE only for the
+    // caught syscalls, everything else runs without ever stopping
+    // ptrace_syscall is plain PTRACE_SYSCALL, every syscall stops twice and we filter the stops ourselves
+    enum class syscall_trace_backend
+    {
+        seccomp,
+        ptrace_syscall
+    };
+
+    // which syscalls stop the inferior, fixed at launch as a seccomp filter can't be changed once installed
+    class syscall_catch_policy
+    {
+    public:
+        enum class mode
+        {
+            none,
+            some,
+            all
+        };
+
+        static syscall_catch_policy catch_none() { return {mode::none, {}, syscall_trace_backend::ptrace_syscall}; }
+
+        // catching everything gains nothing from a filter, so it is always PTRACE_SYSCALL
+        static syscall_catch_policy catch_all() { return {mode::all, {}, syscall_trace_backend::ptrace_syscall}; }
+
+        static syscall_catch_policy catch_some(std::vector<int> to_catch, syscall_trace_backend backend = syscall_trace_backend::seccomp)
+        {
+            return {mode::some, std::move(to_catch), backend};
+        }
+
+        mode get_mode() const { return mode_; }
+        const std::vector<int> &get_to_catch() const { return to_catch_; }
+        syscall_trace_backend backend() const { return backend_; }
+
+        bool catches(int id) const;
+
+    private:
+        syscall_catch_policy(mode mode, std::vector<int> to_catch, syscall_trace_backend backend)
+            : mode_(mode), to_catch_(std::move(to_catch)), backend_(backend) {}
+
+        mode mode_ = mode::none;
+        std::vector<int> to_catch_;
+        syscall_trace_backend backend_ = syscall_trace_backend::ptrace_syscall;
+    };
+
+    // what a syscall stop reports, the arguments on entry and the return value on exit
+    struct syscall_information
+    {
+        std::uint16_t id;
+        bool entry;
+        union
+        {
+            std::array<std::uint64_t, 6> args;
+            std::int64_t ret;
+        };
+    };
+}
+
+#endif
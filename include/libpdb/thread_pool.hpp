@@ -0,0 +1,63 @@
+#ifndef PDB_THREAD_POOL_HPP
+#define PDB_THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pdb
+{
+    // a fixed set of threads to split a job over the cores
+    // every worker has its own queue of task indexes and takes from the back of it, a worker that runs dry
+    // steals from the front of someone else's, so a few huge tasks don't leave the others idle
+    class work_stealing_pool
+    {
+    public:
+        // 0 means one worker per core, the calling thread counts as one of them
+        explicit work_stealing_pool(unsigned thread_count = 0);
+        ~work_stealing_pool();
+
+        work_stealing_pool(const work_stealing_pool &) = delete;
+        work_stealing_pool &operator=(const work_stealing_pool &) = delete;
+
+        unsigned size() const { return static_cast<unsigned>(queues_.size()); }
+
+        // runs task(index, worker) for every index in [0, count) and returns once they are all done
+        // worker is in [0, size()) and no two tasks run on the same worker at once, so it can pick per
+        // worker state without locking; the first exception a task throws is rethrown here
+        void parallel_for(std::size_t count, const std::function<void(std::size_t, unsigned)> &task);
+
+    private:
+        struct task_queue
+        {
+            std::mutex mutex;
+            std::deque<std::size_t> tasks;
+        };
+
+        void worker_loop(unsigned worker);
+        void run_tasks(unsigned worker);
+        bool take_task(unsigned worker, std::size_t &index);
+
+        std::vector<std::unique_ptr<task_queue>> queues_;
+        std::vector<std::thread> threads_;
+
+        std::mutex mutex_;
+        std::condition_variable work_ready_;
+        std::condition_variable work_done_;
+        std::size_t generation_ = 0;
+        bool stopping_ = false;
+
+        const std::function<void(std::size_t, unsigned)> *task_ = nullptr;
+        std::atomic<std::size_t> remaining_{0};
+        std::exception_ptr error_;
+    };
+}
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef PDB_TRACE_HPP
+#define PDB_TRACE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <ostream>
+#include <string_view>
+#include <vector>
+#include <sys/types.h>
+
+// a timeline of what libpdb does around every stop, for latency debugging of the debugger itself
+// events go into a ring of fixed size records allocated up front, with a raw clock value at each end,
+// and are only turned into text when the ring is written out as a Chrome trace (which Perfetto loads too)
+namespace pdb::trace
+{
+    enum class event : std::uint8_t
+    {
+        launch,
+        attach,
+        resume,
+        // from asking the kernel for the next state change to getting one
+        wait,
+        // from getting a state change to knowing what to report, one per waitpid status we handle
+        stop,
+        register_fetch,
+        register_write,
+        count
+    };
+
+    std::string_view event_name(event what);
+
+    // what a register event moved, in the low byte of its arg, with the user area offset above it
+    enum class register_bank : std::uint8_t
+    {
+        gprs,
+        fprs,
+        user_area
+    };
+
+    inline std::uint32_t register_arg(register_bank bank, std::size_t offset = 0)
+    {
+        return static_cast<std::uint32_t>(bank) | static_cast<std::uint32_t>(offset) << 8;
+    }
+
+    // the stop_reason of a stop event and whether it was reported or handled on the way (a clone, a thread exit)
+    inline std::uint32_t stop_arg(int reason, std::uint8_t info, bool reported)
+    {
+        return static_cast<std::uint32_t>(reason) | static_cast<std::uint32_t>(info) << 8 | (reported ? 1u << 16 : 0);
+    }
+
+    // start and end are clock ticks, see now()
+    struct record
+    {
+        std::uint64_t start;
+        std::uint64_t end;
+        std::int32_t pid;
+        std::int32_t tid;
+        std::uint32_t arg;
+        event what;
+    };
+
+    namespace detail
+    {
+        extern std::atomic<bool> active;
+        // set once at load time, the tsc is only used when it ticks at the same rate on every cpu and in every
+        // power state (the invariant tsc cpuid bit)
+        extern const bool use_tsc;
+    }
+
+    // rdtsc where we can, CLOCK_MONOTONIC_RAW nanoseconds otherwise
+    inline std::uint64_t now()
+    {
+        if (detail::use_tsc)
+            return __builtin_ia32_rdtsc();
+
+        timespec time;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &time);
+        return static_cast<std::uint64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+    }
+
+    inline bool recording() { return detail::active.load(std::memory_order_relaxed); }
+
+    // allocates (and touches) a ring of capacity records, rounded up to a power of two, and starts recording
+    // into it; what was recorded before is gone
+    // once the ring is full every event overwrites the oldest one
+    void start(std::size_t capacity = 1 << 16);
+    // keeps what was recorded for records() and write_chrome_json
+    void stop();
+    void clear();
+
+    // start, stop, clear and the readers below are for one thread while no other one is recording
+    // emit itself can be called from any number of threads at once
+
+    // the event from start to now(), a no op while not recording
+    void emit(event what, pid_t pid, pid_t tid, std::uint64_t start, std::uint32_t arg = 0);
+
+    // oldest first, times still in ticks
+    std::vector<record> records();
+    // events that were overwritten since start()
+    std::uint64_t dropped();
+
+    // the ticks of a record in nanoseconds of CLOCK_MONOTONIC_RAW
+    std::uint64_t to_ns(std::uint64_t ticks);
+
+    // {"traceEvents": [...]} with one complete ("X") event per record, microseconds with nanosecond digits,
+    // one row per inferior thread under a process per inferior
+    void write_chrome_json(std::ostream &out);
+
+    // an event from construction to destruction, the clock is only read while recording
+    class scope
+    {
+    public:
+        scope(event what, pid_t pid, pid_t tid, std::uint32_t arg = 0)
+            : what_(what), pid_(pid), tid_(tid), arg_(arg), start_(recording() ? now() : 0)
+        {
+        }
+
+        ~scope()
+        {
+            if (start_)
+                emit(what_, pid_, tid_, start_, arg_);
+        }
+
+        scope(const scope &) = delete;
+        scope &operator=(const scope &) = delete;
+
+        // for what is only known on the way, the pid of a launch
+        void set_pid(pid_t pid) { pid_ = tid_ = pid; }
+        void set_arg(std::uint32_t arg) { arg_ = arg; }
+
+    private:
+        event what_;
+        pid_t pid_;
+        pid_t tid_;
+        std::uint32_t arg_;
+        std::uint64_t start_;
+    };
+}
+
+#endif
@@ -3,11 +3,96 @@
 
 #include <array>
 #include <cstddef>
+#include <cstdint>
+#include <vector>
 
 namespace pdb
 {
     using byte64 = std::array<std::byte, 8>;
     using byte128 = std::array<std::byte, 16>;
+
+    // what kind of access a hardware stoppoint fires on
+    enum class stoppoint_mode
+    {
+        write,
+        read_write,
+        execute
+    };
+
+    // an address in the inferior's address space
+    // we wrap it so it can't be mixed up with sizes or addresses in the debugger
+    class virt_addr
+    {
+    public:
+        virt_addr() = default;
+        explicit virt_addr(std::uint64_t addr) : addr_(addr) {}
+
+        std::uint64_t addr() const { return addr_; }
+
+        virt_addr operator+(std::int64_t offset) const { return virt_addr(addr_ + offset); }
+        virt_addr operator-(std::int64_t offset) const { return virt_addr(addr_ - offset); }
+        virt_addr &operator+=(std::int64_t offset) { addr_ += offset; return *this; }
+        virt_addr &operator-=(std::int64_t offset) { addr_ -= offset; return *this; }
+
+        bool operator==(const virt_addr &other) const { return addr_ == other.addr_; }
+        bool operator!=(const virt_addr &other) const { return addr_ != other.addr_; }
+        bool operator<(const virt_addr &other) const { return addr_ < other.addr_; }
+        bool operator<=(const virt_addr &other) const { return addr_ <= other.addr_; }
+        bool operator>(const virt_addr &other) const { return addr_ > other.addr_; }
+        bool operator>=(const virt_addr &other) const { return addr_ >= other.addr_; }
+
+    private:
+        std::uint64_t addr_ = 0;
+    };
+
+    // an address as the ELF file has it, for a PIE it only becomes a virt_addr once we know where it was loaded
+    class file_addr
+    {
+    public:
+        file_addr() = default;
+        explicit file_addr(std::uint64_t addr) : addr_(addr) {}
+
+        std::uint64_t addr() const { return addr_; }
+
+        file_addr operator+(std::int64_t offset) const { return file_addr(addr_ + offset); }
+        file_addr operator-(std::int64_t offset) const { return file_addr(addr_ - offset); }
+
+        bool operator==(const file_addr &other) const { return addr_ == other.addr_; }
+        bool operator!=(const file_addr &other) const { return addr_ != other.addr_; }
+        bool operator<(const file_addr &other) const { return addr_ < other.addr_; }
+        bool operator<=(const file_addr &other) const { return addr_ <= other.addr_; }
+        bool operator>(const file_addr &other) const { return addr_ > other.addr_; }
+        bool operator>=(const file_addr &other) const { return addr_ >= other.addr_; }
+
+    private:
+        std::uint64_t addr_ = 0;
+    };
+
+    // non owning view over contiguous memory, we are on C++17 so there is no std::span
+    template <class T>
+    class span
+    {
+    public:
+        span() = default;
+        span(T *data, std::size_t size) : data_(data), size_(size) {}
+        span(T *data, T *end) : data_(data), size_(end - data) {}
+
+        template <class U>
+        span(std::vector<U> &vec) : data_(vec.data()), size_(vec.size()) {}
+        template <class U>
+        span(const std::vector<U> &vec) : data_(vec.data()), size_(vec.size()) {}
+
+        T *begin() const { return data_; }
+        T *end() const { return data_ + size_; }
+        T *data() const { return data_; }
+        std::size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+        T &operator[](std::size_t n) const { return data_[n]; }
+
+    private:
+        T *data_ = nullptr;
+        std::size_t size_ = 0;
+    };
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,263 @@
+#ifndef PDB_UNWINDER_HPP
+#define PDB_UNWINDER_HPP
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+#include <libpdb/types.hpp>
+
+namespace pdb
+{
+    class elf;
+    class process;
+
+    // DWARF register numbers 0 to 15 are the general purpose registers, 16 is the return address (rip)
+    inline constexpr std::size_t unwind_register_count = 17;
+    inline constexpr std::size_t return_address_register = 16;
+    inline constexpr std::size_t stack_pointer_register = 7;
+    inline constexpr std::size_t frame_pointer_register = 6;
+
+    // how to get a register of the caller back, registers the CFI says nothing about keep their value
+    struct register_rule
+    {
+        enum kind : std::uint8_t
+        {
+            same_value,
+            undefined,
+            at_offset,      // saved at cfa + offset
+            val_offset,     // is cfa + offset
+            in_register,    // is in register reg
+            at_expression,  // saved at the address the expression computes
+            val_expression  // is what the expression computes
+        };
+
+        kind type = same_value;
+        std::uint16_t reg = 0;
+        std::int64_t offset = 0;
+        span<const std::byte> expr;
+    };
+
+    // the canonical frame address, the stack pointer of the caller just before the call
+    struct cfa_rule
+    {
+        bool is_expression = false;
+        std::uint16_t reg = stack_pointer_register;
+        std::int64_t offset = 0;
+        span<const std::byte> expr;
+    };
+
+    // one row of the table a CFA program describes, it holds from its location up to the next row
+    struct unwind_row
+    {
+        cfa_rule cfa;
+        std::array<register_rule, unwind_register_count> registers;
+    };
+
+    // the .eh_frame of one elf
+    // the FDE of a pc is found with the binary search table in .eh_frame_hdr (a sorted table is built from
+    // .eh_frame when there is none), and the CIE and FDE programs of an FDE are run once for all of its rows
+    // the first time it is needed, later lookups are a hash lookup and a binary search over those rows
+    class call_frame_info
+    {
+    public:
+        explicit call_frame_info(const elf &file);
+
+        bool empty() const { return eh_frame_.empty(); }
+
+        // the row that holds at pc, nullptr if no FDE covers it
+        // signal_frame is set for the frames of signal trampolines, their pc is not a return address
+        const unwind_row *find_row(file_addr pc, bool &signal_frame);
+
+        std::size_t cached_fde_count() const { return fdes_.size(); }
+        std::uint64_t cache_hits() const { return cache_hits_; }
+        std::uint64_t cache_misses() const { return cache_misses_; }
+
+    private:
+        struct cie
+        {
+            std::uint64_t code_alignment = 1;
+            std::int64_t data_alignment = 1;
+            std::uint64_t return_register = return_address_register;
+            std::uint8_t fde_encoding = 0;
+            bool has_augmentation_data = false;
+            bool signal_frame = false;
+            span<const std::byte> instructions;
+        };
+
+        // the decoded rule table of an FDE, locations_[i] is where rows_[i] starts
+        struct fde_rules
+        {
+            std::uint64_t low = 0;
+            std::uint64_t high = 0;
+            bool signal_frame = false;
+            std::vector<std::uint64_t> locations;
+            std::vector<unwind_row> rows;
+        };
+
+        std::optional<std::uint64_t> find_fde(std::uint64_t pc) const;
+        fde_rules decode_fde(std::uint64_t offset);
+        const cie &get_cie(std::uint64_t offset);
+        void build_fde_table();
+
+        const elf *elf_;
+        span<const std::byte> eh_frame_;
+        std::uint64_t eh_frame_address_ = 0;
+
+        // the .eh_frame_hdr table when it uses the datarel sdata4 pairs every linker writes
+        span<const std::byte> hdr_table_;
+        std::uint64_t hdr_address_ = 0;
+        std::size_t hdr_count_ = 0;
+
+        // otherwise (pc_begin, FDE offset) pairs sorted by pc_begin
+        std::vector<std::pair<std::uint64_t, std::uint64_t>> fde_table_;
+
+        std::unordered_map<std::uint64_t, cie> cies_;
+        std::unordered_map<std::uint64_t, fde_rules> fdes_;
+        std::uint64_t cache_hits_ = 0;
+        std::uint64_t cache_misses_ = 0;
+    };
+
+    enum class unwind_method
+    {
+        cfi,
+        frame_pointer
+    };
+
+    struct stack_frame
+    {
+        virt_addr pc;
+        // the stack pointer of the frame's caller, unique per frame
+        virt_addr cfa;
+        unwind_method method;
+    };
+
+    // the mappings of a process from /proc/<pid>/maps and the ELF files with code in them
+    // a module is opened (its symbols and CFI) the first time an address lands in it, and a lookup that
+    // misses reads the maps again once until mark_stale(), for code that was mapped since
+    // it only needs the pid, so it also works for a process nobody is tracing
+    class module_map
+    {
+    public:
+        explicit module_map(pid_t pid);
+        ~module_map();
+
+        module_map(const module_map &) = delete;
+        module_map &operator=(const module_map &) = delete;
+
+        struct mapping
+        {
+            std::uint64_t start;
+            std::uint64_t end;
+            std::uint64_t offset;
+            bool executable;
+            std::string path;
+        };
+
+        struct module
+        {
+            std::uint64_t start;
+            std::uint64_t end;
+            std::string path;
+            bool loaded = false;
+            std::unique_ptr<elf> file;
+            std::unique_ptr<call_frame_info> cfi;
+            std::uint64_t load_bias = 0;
+        };
+
+        // nullptr for addresses outside every mapping (or every executable one for find_module)
+        module *find_module(std::uint64_t pc);
+        const mapping *find_mapping(std::uint64_t address);
+
+        // modules we had opened already are kept when their mapping is still there
+        void reload();
+        void mark_stale() { fresh_ = false; }
+
+        // the symbol holding pc in whichever module it is in, empty if there is none
+        // return addresses are looked up one byte back, the call can be the last instruction of a function
+        std::string_view symbol_name(virt_addr pc, bool return_address = false);
+
+    private:
+        void load_module(module &mod);
+
+        pid_t pid_;
+        std::vector<mapping> mappings_;
+        std::vector<module> modules_;
+        bool fresh_ = false;
+    };
+
+    // walks the stacks of a stopped inferior
+    // the code of every mapped ELF (the executable and its libraries) is unwound with its .eh_frame, and
+    // with frame pointers where there is no CFI; stack memory is read a window at a time with one transfer,
+    // not a word at a time
+    // an unwinder is meant to live across many stops, the CFI rule caches are what make repeated backtraces cheap
+    class unwinder
+    {
+    public:
+        explicit unwinder(process &proc);
+        ~unwinder();
+
+        unwinder(const unwinder &) = delete;
+        unwinder &operator=(const unwinder &) = delete;
+
+        // the frames of the current thread, innermost first
+        std::vector<stack_frame> backtrace(std::size_t max_frames = 512);
+
+        // fills out with the frames of thread tid and returns how many there are, allocates nothing once
+        // every module on the stack has been seen, which is what the profiler calls on every sample
+        std::size_t backtrace(pid_t tid, span<stack_frame> out);
+
+        // with CFI off every frame is unwound with frame pointers, mostly to compare the two
+        void set_cfi_enabled(bool enable) { cfi_enabled_ = enable; }
+        bool cfi_enabled() const { return cfi_enabled_; }
+
+        // reads /proc/<pid>/maps again, the unwinder does this itself when a pc is outside every known module
+        void reload_modules() { modules_.reload(); }
+
+        std::string_view symbol_name(virt_addr pc, bool return_address = false) { return modules_.symbol_name(pc, return_address); }
+        module_map &modules() { return modules_; }
+
+        struct stats
+        {
+            std::uint64_t backtraces = 0;
+            std::uint64_t cfi_frames = 0;
+            std::uint64_t frame_pointer_frames = 0;
+            std::uint64_t stack_reads = 0;
+            std::uint64_t stack_bytes = 0;
+        };
+        const stats &get_stats() const { return stats_; }
+
+        // bytes of stack one transfer reads, less at the end of a mapping
+        static constexpr std::size_t stack_window_size = 16 * 1024;
+
+    private:
+        // reads from the stack window, refilling it around the address when it isn't in there
+        bool read_word(std::uint64_t address, std::uint64_t &value);
+
+        using register_set = std::array<std::uint64_t, unwind_register_count>;
+        using register_mask = std::uint32_t;
+
+        bool step_cfi(register_set &regs, register_mask &known, bool caller_frame, bool &signal_frame, std::uint64_t &cfa);
+        bool step_frame_pointer(register_set &regs, register_mask &known, std::uint64_t &cfa);
+        bool evaluate(span<const std::byte> expr, const register_set &regs, register_mask known,
+                      std::optional<std::uint64_t> initial, std::uint64_t &result);
+
+        process *process_;
+        bool cfi_enabled_ = true;
+        module_map modules_;
+
+        std::vector<std::byte> window_;
+        std::uint64_t window_start_ = 0;
+        std::size_t window_size_ = 0;
+
+        stats stats_;
+    };
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef PDB_WATCHPOINT_HPP
+#define PDB_WATCHPOINT_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <libpdb/types.hpp>
+
+namespace pdb
+{
+    class process;
+
+    // a hardware stoppoint living in one of the debug registers dr0-dr3
+    // the cpu checks the address on every access so the inferior runs at full speed,
+    // but there are only four of them
+    class watchpoint
+    {
+    public:
+        // only the process creates watchpoints
+        watchpoint() = delete;
+        watchpoint(const watchpoint &) = delete;
+        watchpoint &operator=(const watchpoint &) = delete;
+
+        using id_type = std::int32_t;
+        id_type id() const { return id_; }
+
+        // takes a debug register slot and programs it, fails if all four are in use
+        void enable();
+        // frees the slot
+        void disable();
+
+        bool is_enabled() const { return is_enabled_; }
+        virt_addr address() const { return address_; }
+        stoppoint_mode mode() const { return mode_; }
+        std::size_t size() const { return size_; }
+
+        // the debug register slot (0-3) while enabled
+        int hardware_index() const { return hardware_index_; }
+
+        bool at_address(virt_addr addr) const { return address_ == addr; }
+        bool in_range(virt_addr low, virt_addr high) const { return low <= address_ and high > address_; }
+
+    private:
+        friend process;
+        watchpoint(process &proc, virt_addr address, stoppoint_mode mode, std::size_t size);
+
+        id_type id_;
+        process *process_;
+        virt_addr address_;
+        stoppoint_mode mode_;
+        std::size_t size_;
+        bool is_enabled_ = false;
+        int hardware_index_ = -1;
+    };
+}
+
+#endif
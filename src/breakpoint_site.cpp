@@ -0,0 +1,29 @@
+#include <libpdb/breakpoint_site.hpp>
+#include <libpdb/process.hpp>
+
+namespace
+{
+    // ids are unique across all processes
+    auto get_next_id()
+    {
+        static pdb::breakpoint_site::id_type id = 0;
+        return ++id;
+    }
+}
+
+pdb::breakpoint_site::breakpoint_site(process &proc, virt_addr address)
+    : id_(get_next_id()), process_(&proc), address_(address)
+{
+}
+
+void pdb::breakpoint_site::enable()
+{
+    breakpoint_site *site = this;
+    process_->enable_breakpoint_sites(span<breakpoint_site *const>(&site, 1));
+}
+
+void pdb::breakpoint_site::disable()
+{
+    breakpoint_site *site = this;
+    process_->disable_breakpoint_sites(span<breakpoint_site *const>(&site, 1));
+}
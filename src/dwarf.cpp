@@ -0,0 +1,839 @@
+#include <libpdb/dwarf.hpp>
+#include <libpdb/elf.hpp>
+#include <libpdb/dwarf_index.hpp>
+#include <libpdb/error.hpp>
+#include <libpdb/index_cache.hpp>
+#include <dwarf_reader.hpp>
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <string>
+#include <tuple>
+
+namespace
+{
+    // a sub range of a section, checked against the section size
+    pdb::span<const std::byte> subspan(pdb::span<const std::byte> data, std::uint64_t offset, std::uint64_t size)
+    {
+        if (offset > data.size() or size > data.size() - offset)
+            pdb::dwarf_cursor::malformed();
+        return pdb::span<const std::byte>(data.data() + offset, size);
+    }
+
+    // a row of the line program state machine before it goes into the arrays
+    struct line_row
+    {
+        std::uint64_t address;
+        std::uint32_t file;
+        std::uint32_t line;
+        std::uint8_t flags;
+    };
+
+    // true if the trailing components of full are the components of path
+    bool path_ends_with(const std::filesystem::path &full, const std::filesystem::path &path)
+    {
+        if (path.is_absolute())
+            return full == path;
+
+        auto full_it = full.end();
+        auto path_it = path.end();
+        while (path_it != path.begin())
+        {
+            if (full_it == full.begin())
+                return false;
+            if (*--full_it != *--path_it)
+                return false;
+        }
+        return true;
+    }
+
+    // linkers leave the sequences of functions they threw away at 0 (or at -1 with lld tombstones)
+    bool is_dead_address(std::uint64_t address)
+    {
+        return address == 0 or address == ~std::uint64_t(0) or address == ~std::uint64_t(1);
+    }
+}
+
+pdb::dwarf::~dwarf() = default;
+
+pdb::dwarf::dwarf(const elf &file) : elf_(&file)
+{
+    sections_.info = file.get_section_contents(".debug_info");
+    sections_.abbrev = file.get_section_contents(".debug_abbrev");
+    sections_.line = file.get_section_contents(".debug_line");
+    sections_.str = file.get_section_contents(".debug_str");
+    sections_.line_str = file.get_section_contents(".debug_line_str");
+    sections_.str_offsets = file.get_section_contents(".debug_str_offsets");
+    sections_.addr = file.get_section_contents(".debug_addr");
+    sections_.aranges = file.get_section_contents(".debug_aranges");
+    sections_.ranges = file.get_section_contents(".debug_ranges");
+    sections_.rnglists = file.get_section_contents(".debug_rnglists");
+
+    // only the unit headers, a few bytes each, the DIEs are left alone
+    dwarf_cursor cursor(sections_.info);
+    while (!cursor.finished())
+    {
+        compile_unit::header info{};
+        info.offset = cursor.position();
+
+        auto length = cursor.initial_length(info.dwarf64);
+        auto unit_start = cursor.position();
+        info.size = unit_start - info.offset + length;
+        if (length > sections_.info.size() - unit_start)
+            dwarf_cursor::malformed();
+
+        info.version = cursor.u16();
+        if (info.version < 2 or info.version > 5)
+        {
+            error::send("Unsupported DWARF version " + std::to_string(info.version));
+        }
+
+        std::uint8_t unit_type = DW_UT_compile;
+        if (info.version == 5)
+        {
+            unit_type = cursor.u8();
+            info.address_size = cursor.u8();
+            info.abbrev_offset = cursor.section_offset(info.dwarf64);
+
+            if (unit_type == DW_UT_skeleton or unit_type == DW_UT_split_compile)
+                cursor.skip(8);
+            else if (unit_type == DW_UT_type or unit_type == DW_UT_split_type)
+                cursor.skip(8 + (info.dwarf64 ? 8 : 4));
+        }
+        else
+        {
+            info.abbrev_offset = cursor.section_offset(info.dwarf64);
+            info.address_size = cursor.u8();
+        }
+        info.first_die_offset = cursor.position() - info.offset;
+
+        // type units have no code and no line table
+        if (unit_type != DW_UT_type and unit_type != DW_UT_split_type)
+            compile_units_.push_back(std::make_unique<compile_unit>(*this, info));
+
+        cursor.seek(unit_start + length);
+    }
+}
+
+const pdb::abbrev_table &pdb::dwarf::get_abbrev_table(std::uint64_t offset) const
+{
+    {
+        std::lock_guard lock(abbrev_mutex_);
+        auto it = abbrev_tables_.find(offset);
+        if (it != abbrev_tables_.end())
+            return it->second;
+    }
+
+    // parsed outside the lock, if two threads race for the same table the first one in wins
+    // (references into an unordered_map stay valid when it grows)
+    abbrev_table table;
+    dwarf_cursor cursor(sections_.abbrev);
+    cursor.seek(offset);
+
+    // a table ends with a 0 code, every attribute list ends with a (0, 0) pair
+    for (auto code = cursor.uleb128(); code != 0; code = cursor.uleb128())
+    {
+        abbrev entry{code, cursor.uleb128(), cursor.u8() != 0, {}};
+        for (;;)
+        {
+            auto attr = cursor.uleb128();
+            auto form = cursor.uleb128();
+            if (attr == 0 and form == 0)
+                break;
+
+            auto implicit_const = form == DW_FORM_implicit_const ? cursor.sleb128() : 0;
+            entry.attr_specs.push_back({attr, form, implicit_const});
+        }
+        table.emplace(code, std::move(entry));
+    }
+
+    std::lock_guard lock(abbrev_mutex_);
+    return abbrev_tables_.emplace(offset, std::move(table)).first->second;
+}
+
+const pdb::compile_unit *pdb::dwarf::compile_unit_at_offset(std::uint64_t offset) const
+{
+    auto it = std::upper_bound(compile_units_.begin(), compile_units_.end(), offset,
+                               [](auto offset, auto &unit) { return offset < unit->get_header().offset; });
+    if (it == compile_units_.begin())
+        return nullptr;
+
+    auto &unit = *std::prev(it);
+    return offset < unit->get_header().offset + unit->get_header().size ? unit.get() : nullptr;
+}
+
+const pdb::dwarf_index &pdb::dwarf::index() const
+{
+    if (!index_)
+    {
+        if (auto cache = elf_->cache())
+            index_ = cache->read_dwarf_index(*this);
+        if (!index_)
+            index_ = std::make_unique<dwarf_index>(*this);
+    }
+    return *index_;
+}
+
+void pdb::dwarf::index_unit_ranges() const
+{
+    std::vector<std::pair<std::uint64_t, unit_range>> ranges;
+
+    // units are in offset order, so the owner of an aranges set is a binary search away
+    auto unit_at = [&](std::uint64_t offset) -> const compile_unit * {
+        auto it = std::lower_bound(compile_units_.begin(), compile_units_.end(), offset,
+                                   [](auto &unit, auto offset) { return unit->get_header().offset < offset; });
+        if (it == compile_units_.end() or (*it)->get_header().offset != offset)
+            return nullptr;
+        return it->get();
+    };
+
+    std::vector<const compile_unit *> covered;
+
+    dwarf_cursor cursor(sections_.aranges);
+    while (!cursor.finished())
+    {
+        auto set_start = cursor.position();
+        bool dwarf64;
+        auto length = cursor.initial_length(dwarf64);
+        auto set_end = cursor.position() + length;
+
+        cursor.u16();
+        auto unit = unit_at(cursor.section_offset(dwarf64));
+        auto address_size = cursor.u8();
+        auto segment_size = cursor.u8();
+
+        // the tuples are aligned to twice the address size from the start of the set
+        auto tuple_size = 2 * address_size;
+        auto header_size = cursor.position() - set_start;
+        cursor.skip((tuple_size - header_size % tuple_size) % tuple_size);
+
+        while (cursor.position() < set_end)
+        {
+            cursor.skip(segment_size);
+            auto start = cursor.address(address_size);
+            auto size = cursor.address(address_size);
+            if (start == 0 and size == 0)
+                break;
+            if (unit and size != 0 and !is_dead_address(start))
+                ranges.push_back({start, {start + size, unit}});
+        }
+
+        if (unit)
+            covered.push_back(unit);
+        cursor.seek(set_end);
+    }
+
+    // .debug_aranges is optional (clang leaves it out by default), the rest come from their root DIE
+    std::sort(covered.begin(), covered.end());
+    for (auto &unit : compile_units_)
+    {
+        if (std::binary_search(covered.begin(), covered.end(), unit.get()))
+            continue;
+
+        for (auto &[low, high] : unit->ranges())
+            ranges.push_back({low.addr(), {high.addr(), unit.get()}});
+    }
+
+    std::sort(ranges.begin(), ranges.end(), [](auto &a, auto &b) { return a.first < b.first; });
+
+    unit_range_starts_.reserve(ranges.size());
+    unit_ranges_.reserve(ranges.size());
+    for (auto &[start, range] : ranges)
+    {
+        unit_range_starts_.push_back(start);
+        unit_ranges_.push_back(range);
+    }
+    unit_ranges_indexed_ = true;
+}
+
+const pdb::compile_unit *pdb::dwarf::compile_unit_containing_address(file_addr address) const
+{
+    if (!unit_ranges_indexed_)
+        index_unit_ranges();
+
+    auto it = std::upper_bound(unit_range_starts_.begin(), unit_range_starts_.end(), address.addr());
+    if (it == unit_range_starts_.begin())
+        return nullptr;
+
+    auto &range = unit_ranges_[(it - unit_range_starts_.begin()) - 1];
+    return address.addr() < range.end ? range.unit : nullptr;
+}
+
+std::optional<pdb::line_table::entry> pdb::dwarf::line_entry_at_address(file_addr address) const
+{
+    auto unit = compile_unit_containing_address(address);
+    if (!unit or !unit->has_line_table())
+        return std::nullopt;
+    return unit->lines().get_entry_by_address(address);
+}
+
+std::vector<pdb::file_addr> pdb::dwarf::addresses_for_line(const std::filesystem::path &path, std::uint32_t line) const
+{
+    std::vector<file_addr> addresses;
+    for (auto &unit : compile_units_)
+    {
+        if (!unit->has_line_table())
+            continue;
+
+        auto &table = unit->lines();
+        for (std::uint32_t file = 0; file < table.files().size(); ++file)
+        {
+            if (!path_ends_with(table.files()[file], path))
+                continue;
+
+            for (auto row : table.get_rows_by_line(file, line))
+                addresses.push_back(table[row].address);
+        }
+    }
+
+    // headers pulled into many units show up once per unit
+    std::sort(addresses.begin(), addresses.end());
+    addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+    return addresses;
+}
+
+pdb::span<const std::byte> pdb::compile_unit::data() const
+{
+    return subspan(parent_->sections().info, header_.offset, header_.size);
+}
+
+const pdb::abbrev_table &pdb::compile_unit::abbrevs() const
+{
+    return parent_->get_abbrev_table(header_.abbrev_offset);
+}
+
+std::string_view pdb::compile_unit::name() const { return root().name; }
+std::string_view pdb::compile_unit::comp_dir() const { return root().comp_dir; }
+const std::vector<std::pair<pdb::file_addr, pdb::file_addr>> &pdb::compile_unit::ranges() const { return root().ranges; }
+std::uint64_t pdb::compile_unit::base_address() const { return root().base_address; }
+std::uint64_t pdb::compile_unit::str_offsets_base() const { return root().str_offsets_base; }
+std::uint64_t pdb::compile_unit::addr_base() const { return root().addr_base; }
+std::optional<std::uint64_t> pdb::compile_unit::rnglists_base() const { return root().rnglists_base; }
+bool pdb::compile_unit::has_line_table() const { return root().stmt_list.has_value(); }
+
+const pdb::line_table &pdb::compile_unit::lines() const
+{
+    if (!lines_)
+    {
+        // a cached table is copied out without running the line program, or even reading the root DIE
+        if (auto cache = parent_->get_elf().cache())
+        {
+            lines_ = cache->read_line_table(*this);
+            if (lines_)
+                return *lines_;
+        }
+
+        if (!has_line_table())
+        {
+            error::send("Compile unit has no line table");
+        }
+        lines_ = std::make_unique<line_table>(*this);
+    }
+    return *lines_;
+}
+
+const pdb::compile_unit::root_info &pdb::compile_unit::root() const
+{
+    std::call_once(root_once_, [this] { root_ = read_root(); });
+    return *root_;
+}
+
+std::unique_ptr<pdb::compile_unit::root_info> pdb::compile_unit::read_root() const
+{
+    auto info = std::make_unique<root_info>();
+    form_context context{&parent_->sections(), header_.dwarf64, header_.address_size, 0, 0};
+
+    dwarf_cursor cursor(data());
+    cursor.seek(header_.first_die_offset);
+
+    auto code = cursor.uleb128();
+    if (code == 0)
+        return info;
+
+    auto &table = abbrevs();
+    auto abbrev_it = table.find(code);
+    if (abbrev_it == table.end())
+        dwarf_cursor::malformed();
+
+    form_value name, comp_dir, low_pc, high_pc, ranges;
+    for (auto &spec : abbrev_it->second.attr_specs)
+    {
+        auto value = read_form(cursor, spec.form, spec.implicit_const, context);
+        switch (spec.attr)
+        {
+        case DW_AT_name: name = value; break;
+        case DW_AT_comp_dir: comp_dir = value; break;
+        case DW_AT_stmt_list: info->stmt_list = value.value; break;
+        case DW_AT_low_pc: low_pc = value; break;
+        case DW_AT_high_pc: high_pc = value; break;
+        case DW_AT_ranges: ranges = value; break;
+        case DW_AT_str_offsets_base: info->str_offsets_base = value.value; break;
+        case DW_AT_addr_base: info->addr_base = value.value; break;
+        case DW_AT_rnglists_base: info->rnglists_base = value.value; break;
+        }
+    }
+
+    // the bases can come after the attributes that need them, so strx and addrx are resolved last
+    context.str_offsets_base = info->str_offsets_base;
+    context.addr_base = info->addr_base;
+    info->name = resolve_string(name, context);
+    info->comp_dir = resolve_string(comp_dir, context);
+
+    info->base_address = low_pc.form ? resolve_address(low_pc, context) : 0;
+    append_pc_range(low_pc, high_pc, context, info->ranges);
+    if (ranges.form)
+        append_range_list(*this, ranges, info->base_address, info->rnglists_base, context, info->ranges);
+
+    return info;
+}
+
+void pdb::append_pc_range(const form_value &low_pc, const form_value &high_pc, const form_context &context,
+                          std::vector<std::pair<file_addr, file_addr>> &out)
+{
+    if (!low_pc.form or !high_pc.form)
+        return;
+
+    // high_pc is either an address or, from DWARF 4 on, usually the size as a constant
+    auto low = resolve_address(low_pc, context);
+    auto high = high_pc.form == DW_FORM_addr or is_addrx_form(high_pc.form) ? resolve_address(high_pc, context) : low + high_pc.value;
+    if (high > low and !is_dead_address(low))
+        out.push_back({file_addr(low), file_addr(high)});
+}
+
+void pdb::append_range_list(const compile_unit &unit, const form_value &ranges, std::uint64_t base,
+                            std::optional<std::uint64_t> rnglists_base, const form_context &context,
+                            std::vector<std::pair<file_addr, file_addr>> &out)
+{
+    auto &header = unit.get_header();
+    auto &sections = unit.get_dwarf().sections();
+
+    auto add = [&](std::uint64_t start, std::uint64_t end) {
+        if (end > start and !is_dead_address(start))
+            out.push_back({file_addr(start), file_addr(end)});
+    };
+
+    if (header.version < 5)
+    {
+        // .debug_ranges: pairs relative to the base, a pair starting with the max address sets a new base
+        dwarf_cursor list(sections.ranges);
+        list.seek(ranges.value);
+        auto base_selector = header.address_size == 8 ? ~std::uint64_t(0) : 0xffffffffull;
+        for (;;)
+        {
+            auto start = list.address(header.address_size);
+            auto end = list.address(header.address_size);
+            if (start == 0 and end == 0)
+                break;
+            if (start == base_selector)
+                base = end;
+            else
+                add(base + start, base + end);
+        }
+        return;
+    }
+
+    // rnglistx is an index into the offsets table at rnglists_base, offsets are relative to it
+    auto offset = ranges.value;
+    if (ranges.form == DW_FORM_rnglistx)
+    {
+        auto table = rnglists_base.value_or(header.dwarf64 ? 20 : 12);
+        dwarf_cursor offsets(sections.rnglists);
+        offsets.seek(table + ranges.value * (header.dwarf64 ? 8 : 4));
+        offset = table + offsets.section_offset(header.dwarf64);
+    }
+
+    auto address_at = [&](std::uint64_t index) {
+        form_value value;
+        value.form = DW_FORM_addrx;
+        value.value = index;
+        return resolve_address(value, context);
+    };
+
+    dwarf_cursor list(sections.rnglists);
+    list.seek(offset);
+    for (auto kind = list.u8(); kind != DW_RLE_end_of_list; kind = list.u8())
+    {
+        switch (kind)
+        {
+        case DW_RLE_base_addressx: base = address_at(list.uleb128()); break;
+        case DW_RLE_startx_endx:
+        {
+            auto start = address_at(list.uleb128());
+            add(start, address_at(list.uleb128()));
+            break;
+        }
+        case DW_RLE_startx_length:
+        {
+            auto start = address_at(list.uleb128());
+            add(start, start + list.uleb128());
+            break;
+        }
+        case DW_RLE_offset_pair:
+        {
+            auto start = list.uleb128();
+            add(base + start, base + list.uleb128());
+            break;
+        }
+        case DW_RLE_base_address: base = list.address(header.address_size); break;
+        case DW_RLE_start_end:
+        {
+            auto start = list.address(header.address_size);
+            add(start, list.address(header.address_size));
+            break;
+        }
+        case DW_RLE_start_length:
+        {
+            auto start = list.address(header.address_size);
+            add(start, start + list.uleb128());
+            break;
+        }
+        default: dwarf_cursor::malformed();
+        }
+    }
+}
+
+pdb::line_table::line_table(const compile_unit &unit)
+{
+    auto &header = unit.get_header();
+    auto &sections = unit.get_dwarf().sections();
+
+    dwarf_cursor cursor(sections.line);
+    cursor.seek(*unit.root().stmt_list);
+
+    bool dwarf64;
+    auto length = cursor.initial_length(dwarf64);
+    auto program_end = cursor.position() + length;
+    auto version = cursor.u16();
+    if (version < 2 or version > 5)
+    {
+        error::send("Unsupported line table version " + std::to_string(version));
+    }
+
+    auto address_size = header.address_size;
+    if (version == 5)
+    {
+        address_size = cursor.u8();
+        cursor.u8();
+    }
+
+    auto header_length = cursor.section_offset(dwarf64);
+    auto program_start = cursor.position() + header_length;
+
+    auto minimum_instruction_length = cursor.u8();
+    if (version >= 4)
+        cursor.u8();
+    bool default_is_stmt = cursor.u8() != 0;
+    auto line_base = cursor.s8();
+    auto line_range = cursor.u8();
+    auto opcode_base = cursor.u8();
+    if (line_range == 0 or opcode_base == 0)
+        dwarf_cursor::malformed();
+
+    std::array<std::uint8_t, 256> standard_opcode_lengths{};
+    for (int i = 1; i < opcode_base; ++i)
+        standard_opcode_lengths[i] = cursor.u8();
+
+    form_context context{&sections, dwarf64, address_size, unit.str_offsets_base(), unit.addr_base()};
+    std::filesystem::path comp_dir(unit.comp_dir());
+
+    // relative directories are relative to the compilation directory
+    std::vector<std::filesystem::path> directories;
+    auto add_directory = [&](std::string_view name) {
+        std::filesystem::path dir(name);
+        directories.push_back(dir.is_relative() and !comp_dir.empty() ? comp_dir / dir : dir);
+    };
+
+    // header file index -> index in files_, the same path can be listed more than once
+    std::vector<std::uint32_t> file_map;
+    std::unordered_map<std::string, std::uint32_t> file_indices;
+    auto add_file = [&](std::string_view name, std::uint64_t directory) {
+        std::filesystem::path path(name);
+        if (path.is_relative())
+        {
+            if (directory < directories.size())
+                path = directories[directory] / path;
+            else if (!comp_dir.empty())
+                path = comp_dir / path;
+        }
+        path = path.lexically_normal();
+
+        auto [it, inserted] = file_indices.emplace(path.string(), files_.size());
+        if (inserted)
+            files_.push_back(std::move(path));
+        file_map.push_back(it->second);
+    };
+
+    if (version < 5)
+    {
+        // directory 0 and file 0 are implicit before DWARF 5, they are the unit's own
+        add_directory(unit.comp_dir());
+        for (auto dir = cursor.string(); !dir.empty(); dir = cursor.string())
+            add_directory(dir);
+
+        add_file(unit.name(), 0);
+        for (auto name = cursor.string(); !name.empty(); name = cursor.string())
+        {
+            auto directory = cursor.uleb128();
+            cursor.uleb128();
+            cursor.uleb128();
+            add_file(name, directory);
+        }
+    }
+    else
+    {
+        // DWARF 5 describes the layout of its directory and file entries before listing them
+        auto read_formats = [&] {
+            std::vector<std::pair<std::uint64_t, std::uint64_t>> formats(cursor.u8());
+            for (auto &[content, form] : formats)
+            {
+                content = cursor.uleb128();
+                form = cursor.uleb128();
+            }
+            return formats;
+        };
+
+        auto directory_formats = read_formats();
+        auto directory_count = cursor.uleb128();
+        for (std::uint64_t i = 0; i < directory_count; ++i)
+        {
+            std::string_view name;
+            for (auto &[content, form] : directory_formats)
+            {
+                auto value = read_form(cursor, form, 0, context);
+                if (content == DW_LNCT_path)
+                    name = resolve_string(value, context);
+            }
+            add_directory(name);
+        }
+
+        auto file_formats = read_formats();
+        auto file_count = cursor.uleb128();
+        for (std::uint64_t i = 0; i < file_count; ++i)
+        {
+            std::string_view name;
+            std::uint64_t directory = 0;
+            for (auto &[content, form] : file_formats)
+            {
+                auto value = read_form(cursor, form, 0, context);
+                if (content == DW_LNCT_path)
+                    name = resolve_string(value, context);
+                else if (content == DW_LNCT_directory_index)
+                    directory = value.value;
+            }
+            add_file(name, directory);
+        }
+    }
+
+    // the line number program, see section 6.2 of the DWARF 5 standard
+    // gcc output comes out at around one row per five bytes of program, this saves most of the regrowth
+    std::vector<line_row> rows;
+    rows.reserve((program_end - program_start) / 4);
+    // start address, first row, one past the last row
+    std::vector<std::tuple<std::uint64_t, std::size_t, std::size_t>> sequences;
+    std::size_t sequence_start = 0;
+
+    std::uint64_t address = 0;
+    std::uint64_t file = 1;
+    std::int64_t line = 1;
+    bool statement = default_is_stmt;
+    std::uint8_t flags = 0;
+
+    auto reset = [&] {
+        address = 0;
+        file = 1;
+        line = 1;
+        statement = default_is_stmt;
+        flags = 0;
+    };
+    auto emit = [&] {
+        if (file >= file_map.size())
+            dwarf_cursor::malformed();
+        rows.push_back({address, file_map[file], static_cast<std::uint32_t>(line),
+                        static_cast<std::uint8_t>(flags | (statement ? is_stmt : 0))});
+        flags = 0;
+    };
+
+    cursor.seek(program_start);
+    while (cursor.position() < program_end)
+    {
+        auto opcode = cursor.u8();
+
+        if (opcode >= opcode_base)
+        {
+            auto adjusted = opcode - opcode_base;
+            address += minimum_instruction_length * (adjusted / line_range);
+            line += line_base + adjusted % line_range;
+            emit();
+            continue;
+        }
+
+        switch (opcode)
+        {
+        case 0:
+        {
+            auto size = cursor.uleb128();
+            auto end = cursor.position() + size;
+            if (size == 0)
+                break;
+
+            switch (cursor.u8())
+            {
+            case DW_LNE_end_sequence:
+                flags |= end_sequence;
+                emit();
+                sequences.push_back({rows[sequence_start].address, sequence_start, rows.size()});
+                sequence_start = rows.size();
+                reset();
+                break;
+            case DW_LNE_set_address:
+                address = cursor.address(static_cast<std::uint8_t>(size - 1));
+                break;
+            case DW_LNE_define_file:
+            {
+                auto name = cursor.string();
+                auto directory = cursor.uleb128();
+                add_file(name, directory);
+                break;
+            }
+            default:
+                break;
+            }
+            cursor.seek(end);
+            break;
+        }
+        case DW_LNS_copy: emit(); break;
+        case DW_LNS_advance_pc: address += minimum_instruction_length * cursor.uleb128(); break;
+        case DW_LNS_advance_line: line += cursor.sleb128(); break;
+        case DW_LNS_set_file: file = cursor.uleb128(); break;
+        case DW_LNS_set_column: cursor.uleb128(); break;
+        case DW_LNS_negate_stmt: statement = !statement; break;
+        case DW_LNS_set_basic_block: flags |= basic_block; break;
+        case DW_LNS_const_add_pc: address += minimum_instruction_length * ((255 - opcode_base) / line_range); break;
+        case DW_LNS_fixed_advance_pc: address += cursor.u16(); break;
+        case DW_LNS_set_prologue_end: flags |= prologue_end; break;
+        case DW_LNS_set_epilogue_begin: flags |= epilogue_begin; break;
+        default:
+            // an opcode newer than us, the header says how many uleb operands to skip
+            for (int i = 0; i < standard_opcode_lengths[opcode]; ++i)
+                cursor.uleb128();
+            break;
+        }
+    }
+
+    // sequences are sorted inside but not against each other, so they are moved as a whole
+    // the start address is in the tuple so the sort never has to go back to the rows
+    sequences.erase(std::remove_if(sequences.begin(), sequences.end(),
+                                   [](auto &seq) { return is_dead_address(std::get<0>(seq)); }),
+                    sequences.end());
+    std::sort(sequences.begin(), sequences.end());
+
+    std::size_t row_count = 0;
+    for (auto &[start, first, last] : sequences)
+        row_count += last - first;
+
+    addresses_.reserve(row_count);
+    file_indices_.reserve(row_count);
+    lines_.reserve(row_count);
+    flags_.reserve(row_count);
+    for (auto &[start, first, last] : sequences)
+    {
+        for (auto i = first; i < last; ++i)
+        {
+            addresses_.push_back(rows[i].address);
+            file_indices_.push_back(rows[i].file);
+            lines_.push_back(rows[i].line);
+            flags_.push_back(rows[i].flags);
+        }
+    }
+
+    build_line_index();
+}
+
+void pdb::line_table::build_line_index()
+{
+    std::vector<std::uint64_t> keys;
+    std::vector<std::uint32_t> rows;
+    keys.reserve(size());
+    rows.reserve(size());
+
+    std::uint64_t all_bits = 0;
+    for (std::uint32_t row = 0; row < size(); ++row)
+    {
+        if (!(flags_[row] & is_stmt) or (flags_[row] & end_sequence))
+            continue;
+
+        // only where a line starts, the rows that follow on the same line add nothing for a breakpoint
+        auto sequence_start = row == 0 or (flags_[row - 1] & end_sequence);
+        if (!sequence_start and file_indices_[row - 1] == file_indices_[row] and lines_[row - 1] == lines_[row])
+            continue;
+
+        auto key = (std::uint64_t(file_indices_[row]) << 32) | lines_[row];
+        keys.push_back(key);
+        rows.push_back(row);
+        all_bits |= key;
+    }
+
+    // line numbers and file indexes are small, so an LSD radix sort over the digits that are ever set
+    // does a few linear passes instead of a comparison sort, and being stable it keeps each key's rows
+    // in address order
+    constexpr int digit_bits = 11;
+    constexpr std::size_t bucket_count = std::size_t(1) << digit_bits;
+    std::vector<std::uint64_t> sorted_keys(keys.size());
+    std::vector<std::uint32_t> sorted_rows(rows.size());
+    std::vector<std::size_t> buckets(bucket_count);
+
+    for (int shift = 0; shift < 64; shift += digit_bits)
+    {
+        if (((all_bits >> shift) & (bucket_count - 1)) == 0)
+            continue;
+
+        std::fill(buckets.begin(), buckets.end(), 0);
+        for (auto key : keys)
+            ++buckets[(key >> shift) & (bucket_count - 1)];
+
+        std::size_t position = 0;
+        for (auto &bucket : buckets)
+        {
+            auto count = bucket;
+            bucket = position;
+            position += count;
+        }
+
+        for (std::size_t i = 0; i < keys.size(); ++i)
+        {
+            auto slot = buckets[(keys[i] >> shift) & (bucket_count - 1)]++;
+            sorted_keys[slot] = keys[i];
+            sorted_rows[slot] = rows[i];
+        }
+        keys.swap(sorted_keys);
+        rows.swap(sorted_rows);
+    }
+
+    line_keys_ = std::move(keys);
+    line_rows_ = std::move(rows);
+}
+
+pdb::line_table::entry pdb::line_table::operator[](std::size_t row) const
+{
+    return {file_addr(addresses_[row]), &files_[file_indices_[row]], file_indices_[row], lines_[row], flags_[row]};
+}
+
+std::optional<pdb::line_table::entry> pdb::line_table::get_entry_by_address(file_addr address) const
+{
+    // the last row at or before the address, several rows can share an address and the last one wins
+    auto it = std::upper_bound(addresses_.begin(), addresses_.end(), address.addr());
+    if (it == addresses_.begin())
+        return std::nullopt;
+
+    auto row = (it - addresses_.begin()) - 1;
+    if (flags_[row] & end_sequence)
+        return std::nullopt;
+    return (*this)[row];
+}
+
+pdb::span<const std::uint32_t> pdb::line_table::get_rows_by_line(std::uint32_t file_index, std::uint32_t line) const
+{
+    auto key = (std::uint64_t(file_index) << 32) | line;
+    auto [first, last] = std::equal_range(line_keys_.begin(), line_keys_.end(), key);
+    return span<const std::uint32_t>(line_rows_.data() + (first - line_keys_.begin()), last - first);
+}
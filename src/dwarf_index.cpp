@@ -0,0 +1,309 @@
+#include <libpdb/dwarf_index.hpp>
+#include <libpdb/thread_pool.hpp>
+#include <dwarf_reader.hpp>
+#include <algorithm>
+
+namespace
+{
+    // everything one worker found, nobody else touches it until the merge
+    struct arena
+    {
+        std::vector<pdb::name_entry> names;
+        std::vector<pdb::function_entry> functions;
+        std::size_t die_count = 0;
+    };
+
+    bool is_indexed_tag(std::uint64_t tag)
+    {
+        switch (tag)
+        {
+        case DW_TAG_subprogram:
+        case DW_TAG_variable:
+        case DW_TAG_base_type:
+        case DW_TAG_class_type:
+        case DW_TAG_structure_type:
+        case DW_TAG_union_type:
+        case DW_TAG_enumeration_type:
+        case DW_TAG_typedef:
+        case DW_TAG_namespace:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // the children of these are locals, parameters and blocks, which the index leaves out
+    bool opens_local_scope(std::uint64_t tag)
+    {
+        return tag == DW_TAG_subprogram or tag == DW_TAG_lexical_block or tag == DW_TAG_inlined_subroutine;
+    }
+
+    bool name_less(const pdb::name_entry &a, const pdb::name_entry &b)
+    {
+        return a.name != b.name ? a.name < b.name : a.die_offset < b.die_offset;
+    }
+
+    bool function_less(const pdb::function_entry &a, const pdb::function_entry &b)
+    {
+        return a.low != b.low ? a.low < b.low : a.die_offset < b.die_offset;
+    }
+
+    struct die_names
+    {
+        std::string_view name;
+        std::string_view linkage_name;
+    };
+
+    // the names of the DIE at a .debug_info offset, following DW_AT_specification and DW_AT_abstract_origin
+    // an out of line member function definition only has a reference to its declaration, which has the name
+    die_names read_die_names(const pdb::dwarf &debug_info, std::uint64_t offset, int depth = 0)
+    {
+        auto unit = debug_info.compile_unit_at_offset(offset);
+        if (!unit or depth > 4)
+            return {};
+
+        auto &header = unit->get_header();
+        pdb::form_context context{&debug_info.sections(), header.dwarf64, header.address_size,
+                                  unit->str_offsets_base(), unit->addr_base()};
+
+        pdb::dwarf_cursor cursor(unit->data());
+        cursor.seek(offset - header.offset);
+
+        auto &abbrevs = unit->abbrevs();
+        auto abbrev_it = abbrevs.find(cursor.uleb128());
+        if (abbrev_it == abbrevs.end())
+            return {};
+
+        die_names names;
+        pdb::form_value reference;
+        for (auto &spec : abbrev_it->second.attr_specs)
+        {
+            switch (spec.attr)
+            {
+            case DW_AT_name:
+                names.name = pdb::resolve_string(pdb::read_form(cursor, spec.form, spec.implicit_const, context), context);
+                break;
+            case DW_AT_linkage_name:
+            case DW_AT_MIPS_linkage_name:
+                names.linkage_name = pdb::resolve_string(pdb::read_form(cursor, spec.form, spec.implicit_const, context), context);
+                break;
+            case DW_AT_specification:
+            case DW_AT_abstract_origin:
+                reference = pdb::read_form(cursor, spec.form, spec.implicit_const, context);
+                break;
+            default:
+                pdb::skip_form(cursor, spec.form, context);
+                break;
+            }
+        }
+
+        if ((names.name.empty() or names.linkage_name.empty()) and reference.form)
+        {
+            if (auto target = pdb::reference_offset(reference, *unit))
+            {
+                auto more = read_die_names(debug_info, *target, depth + 1);
+                if (names.name.empty())
+                    names.name = more.name;
+                if (names.linkage_name.empty())
+                    names.linkage_name = more.linkage_name;
+            }
+        }
+        return names;
+    }
+
+    void index_unit(const pdb::dwarf &debug_info, const pdb::compile_unit &unit, arena &out)
+    {
+        auto &header = unit.get_header();
+        auto &abbrevs = unit.abbrevs();
+        pdb::form_context context{&debug_info.sections(), header.dwarf64, header.address_size,
+                                  unit.str_offsets_base(), unit.addr_base()};
+
+        std::vector<std::pair<pdb::file_addr, pdb::file_addr>> ranges;
+
+        // one entry per open DIE with children: whether we are inside a function there
+        std::vector<bool> local_scopes;
+
+        pdb::dwarf_cursor cursor(unit.data());
+        cursor.seek(header.first_die_offset);
+        while (!cursor.finished())
+        {
+            auto die_offset = header.offset + cursor.position();
+            auto code = cursor.uleb128();
+            if (code == 0)
+            {
+                if (!local_scopes.empty())
+                    local_scopes.pop_back();
+                continue;
+            }
+
+            auto abbrev_it = abbrevs.find(code);
+            if (abbrev_it == abbrevs.end())
+                pdb::dwarf_cursor::malformed();
+            auto &entry = abbrev_it->second;
+            ++out.die_count;
+
+            auto local = !local_scopes.empty() and local_scopes.back();
+            auto wanted = !local and is_indexed_tag(entry.tag);
+
+            pdb::form_value name, linkage_name, low_pc, high_pc, range_list, reference, sibling;
+            bool declaration = false;
+            for (auto &spec : entry.attr_specs)
+            {
+                // most DIEs are skipped without decoding anything but the sibling link
+                if (!wanted and spec.attr != DW_AT_sibling)
+                {
+                    pdb::skip_form(cursor, spec.form, context);
+                    continue;
+                }
+
+                switch (spec.attr)
+                {
+                case DW_AT_sibling: sibling = pdb::read_form(cursor, spec.form, spec.implicit_const, context); break;
+                case DW_AT_name: name = pdb::read_form(cursor, spec.form, spec.implicit_const, context); break;
+                case DW_AT_linkage_name:
+                case DW_AT_MIPS_linkage_name:
+                    linkage_name = pdb::read_form(cursor, spec.form, spec.implicit_const, context);
+                    break;
+                case DW_AT_low_pc: low_pc = pdb::read_form(cursor, spec.form, spec.implicit_const, context); break;
+                case DW_AT_high_pc: high_pc = pdb::read_form(cursor, spec.form, spec.implicit_const, context); break;
+                case DW_AT_ranges: range_list = pdb::read_form(cursor, spec.form, spec.implicit_const, context); break;
+                case DW_AT_specification:
+                case DW_AT_abstract_origin:
+                    reference = pdb::read_form(cursor, spec.form, spec.implicit_const, context);
+                    break;
+                case DW_AT_declaration:
+                    declaration = pdb::read_form(cursor, spec.form, spec.implicit_const, context).value != 0;
+                    break;
+                default:
+                    pdb::skip_form(cursor, spec.form, context);
+                    break;
+                }
+            }
+
+            if (wanted and !declaration)
+            {
+                die_names names{pdb::resolve_string(name, context), pdb::resolve_string(linkage_name, context)};
+                if ((names.name.empty() or names.linkage_name.empty()) and reference.form)
+                {
+                    if (auto target = pdb::reference_offset(reference, unit))
+                    {
+                        auto more = read_die_names(debug_info, *target);
+                        if (names.name.empty())
+                            names.name = more.name;
+                        if (names.linkage_name.empty())
+                            names.linkage_name = more.linkage_name;
+                    }
+                }
+
+                if (entry.tag == DW_TAG_subprogram)
+                {
+                    ranges.clear();
+                    pdb::append_pc_range(low_pc, high_pc, context, ranges);
+                    if (range_list.form)
+                        pdb::append_range_list(unit, range_list, unit.base_address(), unit.rnglists_base(), context, ranges);
+
+                    for (auto &[low, high] : ranges)
+                        out.functions.push_back({low, high, die_offset, names.name, names.linkage_name});
+                }
+
+                if (!names.name.empty())
+                    out.names.push_back({names.name, die_offset, entry.tag});
+                if (!names.linkage_name.empty() and names.linkage_name != names.name)
+                    out.names.push_back({names.linkage_name, die_offset, entry.tag});
+            }
+
+            if (!entry.has_children)
+                continue;
+
+            // nothing below a function is indexed, so its whole subtree is skipped when we know where it ends
+            auto local_below = local or opens_local_scope(entry.tag);
+            if (local_below and sibling.form)
+            {
+                if (auto next = pdb::reference_offset(sibling, unit); next and *next > die_offset)
+                {
+                    cursor.seek(*next - header.offset);
+                    continue;
+                }
+            }
+            local_scopes.push_back(local_below);
+        }
+    }
+
+    // merges sorted runs two by two, the merges of one round run in parallel
+    template <class T, class Less>
+    std::vector<T> merge_runs(pdb::work_stealing_pool &pool, std::vector<std::vector<T>> runs, Less less)
+    {
+        if (runs.empty())
+            return {};
+
+        while (runs.size() > 1)
+        {
+            std::vector<std::vector<T>> merged((runs.size() + 1) / 2);
+            pool.parallel_for(merged.size(), [&](std::size_t i, unsigned) {
+                if (2 * i + 1 == runs.size())
+                {
+                    merged[i] = std::move(runs[2 * i]);
+                    return;
+                }
+
+                auto &a = runs[2 * i];
+                auto &b = runs[2 * i + 1];
+                merged[i].resize(a.size() + b.size());
+                std::merge(a.begin(), a.end(), b.begin(), b.end(), merged[i].begin(), less);
+                std::vector<T>().swap(a);
+                std::vector<T>().swap(b);
+            });
+            runs = std::move(merged);
+        }
+        return std::move(runs[0]);
+    }
+}
+
+pdb::dwarf_index::dwarf_index(const dwarf &debug_info, unsigned thread_count)
+{
+    work_stealing_pool pool(thread_count);
+    std::vector<arena> arenas(pool.size());
+
+    // one task per unit, units differ in size by orders of magnitude and stealing evens that out
+    auto &units = debug_info.compile_units();
+    pool.parallel_for(units.size(), [&](std::size_t i, unsigned worker) {
+        index_unit(debug_info, *units[i], arenas[worker]);
+    });
+
+    pool.parallel_for(arenas.size(), [&](std::size_t i, unsigned) {
+        std::sort(arenas[i].names.begin(), arenas[i].names.end(), name_less);
+        std::sort(arenas[i].functions.begin(), arenas[i].functions.end(), function_less);
+    });
+
+    std::vector<std::vector<name_entry>> name_runs;
+    std::vector<std::vector<function_entry>> function_runs;
+    for (auto &arena : arenas)
+    {
+        die_count_ += arena.die_count;
+        name_runs.push_back(std::move(arena.names));
+        function_runs.push_back(std::move(arena.functions));
+    }
+
+    names_ = merge_runs(pool, std::move(name_runs), name_less);
+    functions_ = merge_runs(pool, std::move(function_runs), function_less);
+}
+
+pdb::span<const pdb::name_entry> pdb::dwarf_index::find(std::string_view name) const
+{
+    auto first = std::lower_bound(names_.begin(), names_.end(), name,
+                                  [](auto &entry, auto name) { return entry.name < name; });
+    auto last = std::upper_bound(first, names_.end(), name,
+                                 [](auto name, auto &entry) { return name < entry.name; });
+    return span<const name_entry>(names_.data() + (first - names_.begin()), last - first);
+}
+
+const pdb::function_entry *pdb::dwarf_index::function_containing_address(file_addr address) const
+{
+    auto it = std::upper_bound(functions_.begin(), functions_.end(), address,
+                               [](auto address, auto &function) { return address < function.low; });
+    if (it == functions_.begin())
+        return nullptr;
+
+    auto &function = *std::prev(it);
+    return address < function.high ? &function : nullptr;
+}
@@ -0,0 +1,442 @@
+#include <libpdb/elf.hpp>
+#include <libpdb/error.hpp>
+#include <libpdb/index_cache.hpp>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    // FNV-1a, the same 64 bit hash is used to build the name index and to look names up
+    std::uint64_t hash_symbol_name(std::string_view name)
+    {
+        std::uint64_t hash = 0xcbf29ce484222325ull;
+        for (auto c : name)
+        {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    // a string out of a string table, cut at the table end if it isn't terminated
+    std::string_view string_at(pdb::span<const char> table, std::size_t index)
+    {
+        if (index >= table.size())
+            return {};
+
+        auto start = table.data() + index;
+        auto end = static_cast<const char *>(std::memchr(start, '\0', table.size() - index));
+        return std::string_view(start, end ? end - start : table.size() - index);
+    }
+}
+
+pdb::elf::elf(const std::filesystem::path &path, const std::filesystem::path &cache_directory) : path_(path)
+{
+    fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0)
+    {
+        error::send_errno("Could not open ELF file " + path.string());
+    }
+
+    struct stat stats;
+    if (fstat(fd_, &stats) < 0)
+    {
+        close(fd_);
+        error::send_errno("Could not retrieve ELF file stats");
+    }
+    file_size_ = stats.st_size;
+
+    if (file_size_ < sizeof(Elf64_Ehdr))
+    {
+        close(fd_);
+        error::send("File is too small to be an ELF file");
+    }
+
+    // pages are only read in when we touch them, so a huge binary costs what its headers and symbols cost
+    auto mapping = mmap(nullptr, file_size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (mapping == MAP_FAILED)
+    {
+        close(fd_);
+        error::send_errno("Could not mmap ELF file");
+    }
+    data_ = static_cast<const std::byte *>(mapping);
+
+    // the destructor does not run when the constructor throws, so the mapping is undone by hand
+    try
+    {
+        header_ = reinterpret_cast<const Elf64_Ehdr *>(data_);
+        if (std::memcmp(header_->e_ident, ELFMAG, SELFMAG) != 0)
+        {
+            error::send("Not an ELF file");
+        }
+        if (header_->e_ident[EI_CLASS] != ELFCLASS64)
+        {
+            error::send("Only 64 bit ELF files are supported");
+        }
+
+        if (header_->e_shoff != 0)
+        {
+            if (header_->e_shentsize != sizeof(Elf64_Shdr))
+            {
+                error::send("Unexpected section header size");
+            }
+
+            // section 0 holds the real count when there are too many for e_shnum
+            auto first = file_range(header_->e_shoff, sizeof(Elf64_Shdr));
+            auto count = header_->e_shnum;
+            auto real_count = count == 0 ? reinterpret_cast<const Elf64_Shdr *>(first.data())->sh_size : count;
+
+            // a 64 bit count times the header size can wrap, so it is checked against what fits first
+            if (real_count > (file_size_ - header_->e_shoff) / sizeof(Elf64_Shdr))
+            {
+                error::send("ELF file is truncated or corrupt");
+            }
+
+            auto headers = file_range(header_->e_shoff, real_count * sizeof(Elf64_Shdr));
+            section_headers_ = span<const Elf64_Shdr>(reinterpret_cast<const Elf64_Shdr *>(headers.data()), real_count);
+
+            auto names_index = header_->e_shstrndx == SHN_XINDEX ? section_headers_[0].sh_link : header_->e_shstrndx;
+            if (names_index != SHN_UNDEF and names_index < section_headers_.size())
+            {
+                auto names = section_data(section_headers_[names_index]);
+                section_names_ = span<const char>(reinterpret_cast<const char *>(names.data()), names.size());
+            }
+        }
+
+        if (header_->e_phoff != 0 and header_->e_phnum != 0)
+        {
+            if (header_->e_phentsize != sizeof(Elf64_Phdr))
+            {
+                error::send("Unexpected program header size");
+            }
+
+            auto headers = file_range(header_->e_phoff, header_->e_phnum * sizeof(Elf64_Phdr));
+            program_headers_ = span<const Elf64_Phdr>(reinterpret_cast<const Elf64_Phdr *>(headers.data()), header_->e_phnum);
+        }
+
+        parse_symbol_tables();
+
+        if (!cache_directory.empty())
+            cache_ = index_cache::open(*this, cache_directory);
+
+        if (cache_)
+        {
+            cache_->read_symbol_indexes(*this);
+        }
+        else
+        {
+            build_address_index();
+            build_name_index();
+        }
+    }
+    catch (...)
+    {
+        munmap(const_cast<std::byte *>(data_), file_size_);
+        close(fd_);
+        throw;
+    }
+}
+
+pdb::elf::~elf()
+{
+    munmap(const_cast<std::byte *>(data_), file_size_);
+    close(fd_);
+}
+
+pdb::span<const std::byte> pdb::elf::file_range(std::uint64_t offset, std::uint64_t size) const
+{
+    if (offset > file_size_ or size > file_size_ - offset)
+    {
+        error::send("ELF file is truncated or corrupt");
+    }
+    return span<const std::byte>(data_ + offset, size);
+}
+
+pdb::span<const std::byte> pdb::elf::section_data(const Elf64_Shdr &section) const
+{
+    // .bss and friends take up no room in the file
+    if (section.sh_type == SHT_NOBITS)
+        return {};
+    return file_range(section.sh_offset, section.sh_size);
+}
+
+std::string_view pdb::elf::get_section_name(std::size_t index) const
+{
+    if (index >= section_headers_.size())
+        return {};
+    return string_at(section_names_, section_headers_[index].sh_name);
+}
+
+const Elf64_Shdr *pdb::elf::get_section(std::string_view name) const
+{
+    // there are a few dozen sections at most, a scan beats building a table for them
+    for (std::size_t i = 0; i < section_headers_.size(); ++i)
+    {
+        if (get_section_name(i) == name)
+            return &section_headers_[i];
+    }
+    return nullptr;
+}
+
+pdb::span<const std::byte> pdb::elf::get_section_contents(std::string_view name) const
+{
+    auto section = get_section(name);
+    if (!section)
+        return {};
+    return section_data(*section);
+}
+
+const Elf64_Shdr *pdb::elf::get_section_containing_address(file_addr address) const
+{
+    for (auto &section : section_headers_)
+    {
+        // only sections that are loaded have an address
+        if (!(section.sh_flags & SHF_ALLOC))
+            continue;
+
+        if (section.sh_addr <= address.addr() and address.addr() < section.sh_addr + section.sh_size)
+            return &section;
+    }
+    return nullptr;
+}
+
+void pdb::elf::parse_symbol_tables()
+{
+    for (auto &section : section_headers_)
+    {
+        if (section.sh_type != SHT_SYMTAB and section.sh_type != SHT_DYNSYM)
+            continue;
+
+        if (section.sh_entsize != sizeof(Elf64_Sym) or section.sh_link >= section_headers_.size())
+        {
+            error::send("Malformed symbol table");
+        }
+
+        auto contents = section_data(section);
+        auto strings = section_data(section_headers_[section.sh_link]);
+
+        span<const Elf64_Sym> symbols(reinterpret_cast<const Elf64_Sym *>(contents.data()), contents.size() / sizeof(Elf64_Sym));
+        span<const char> names(reinterpret_cast<const char *>(strings.data()), strings.size());
+
+        if (section.sh_type == SHT_SYMTAB)
+        {
+            symtab_ = symbols;
+            strtab_ = names;
+        }
+        else
+        {
+            dynsym_ = symbols;
+            dynstr_ = names;
+        }
+    }
+}
+
+std::string pdb::elf::build_id() const
+{
+    for (auto &section : section_headers_)
+    {
+        if (section.sh_type != SHT_NOTE)
+            continue;
+
+        // a note is its header, the owner name and the descriptor, both padded to 4 bytes
+        auto notes = section_data(section);
+        std::size_t offset = 0;
+        while (offset + sizeof(Elf64_Nhdr) <= notes.size())
+        {
+            Elf64_Nhdr note;
+            std::memcpy(&note, notes.data() + offset, sizeof(note));
+            auto name_offset = offset + sizeof(note);
+            auto desc_offset = name_offset + ((note.n_namesz + 3) & ~3u);
+            auto next = desc_offset + ((note.n_descsz + 3) & ~std::size_t(3));
+            if (next > notes.size())
+                break;
+
+            auto name = std::string_view(reinterpret_cast<const char *>(notes.data() + name_offset), note.n_namesz);
+            if (note.n_type == NT_GNU_BUILD_ID and name == std::string_view("GNU", 4))
+            {
+                static constexpr char digits[] = "0123456789abcdef";
+                std::string id;
+                for (std::size_t i = 0; i < note.n_descsz; ++i)
+                {
+                    auto byte = static_cast<std::uint8_t>(notes[desc_offset + i]);
+                    id += digits[byte >> 4];
+                    id += digits[byte & 0xf];
+                }
+                return id;
+            }
+            offset = next;
+        }
+    }
+    return {};
+}
+
+std::uint32_t pdb::elf::symbol_index(const Elf64_Sym &symbol) const
+{
+    if (&symbol >= dynsym_.begin() and &symbol < dynsym_.end())
+        return static_cast<std::uint32_t>(symtab_.size() + (&symbol - dynsym_.begin()));
+    return static_cast<std::uint32_t>(&symbol - symtab_.begin());
+}
+
+const Elf64_Sym *pdb::elf::symbol_at_index(std::uint32_t index) const
+{
+    return index < symtab_.size() ? &symtab_[index] : &dynsym_[index - symtab_.size()];
+}
+
+std::string_view pdb::elf::get_symbol_name(const Elf64_Sym &symbol) const
+{
+    // which string table to use depends on the table the symbol lives in
+    if (&symbol >= dynsym_.begin() and &symbol < dynsym_.end())
+        return string_at(dynstr_, symbol.st_name);
+    return string_at(strtab_, symbol.st_name);
+}
+
+void pdb::elf::build_address_index()
+{
+    struct entry
+    {
+        std::uint64_t start;
+        std::uint64_t size;
+        const Elf64_Sym *symbol;
+    };
+
+    std::vector<entry> entries;
+    entries.reserve(symbol_count());
+
+    auto add_table = [&](span<const Elf64_Sym> table) {
+        for (auto &symbol : table)
+        {
+            auto type = ELF64_ST_TYPE(symbol.st_info);
+
+            // undefined symbols have no address, TLS values are offsets in the TLS block and section
+            // and file symbols only name things
+            if (symbol.st_value == 0 or symbol.st_shndx == SHN_UNDEF or type == STT_TLS or
+                type == STT_SECTION or type == STT_FILE)
+                continue;
+
+            entries.push_back({symbol.st_value, symbol.st_size, &symbol});
+        }
+    };
+    add_table(symtab_);
+    add_table(dynsym_);
+
+    // .symtab and .dynsym repeat each other and aliases share an address, only the biggest symbol
+    // at each address is kept (the first one of those, so .symtab wins over .dynsym)
+    std::stable_sort(entries.begin(), entries.end(), [](auto &a, auto &b) {
+        return a.start != b.start ? a.start < b.start : a.size > b.size;
+    });
+    entries.erase(std::unique(entries.begin(), entries.end(), [](auto &a, auto &b) { return a.start == b.start; }), entries.end());
+
+    built_.symbol_starts.reserve(entries.size());
+    built_.symbols_by_address.reserve(entries.size());
+    for (auto &e : entries)
+    {
+        built_.symbol_starts.push_back(e.start);
+        built_.symbols_by_address.push_back({e.start + e.size, symbol_index(*e.symbol), 0});
+    }
+    symbol_starts_ = built_.symbol_starts;
+    symbols_by_address_ = built_.symbols_by_address;
+}
+
+const Elf64_Sym *pdb::elf::get_symbol_at_address(file_addr address) const
+{
+    auto it = std::lower_bound(symbol_starts_.begin(), symbol_starts_.end(), address.addr());
+    if (it == symbol_starts_.end() or *it != address.addr())
+        return nullptr;
+    return symbol_at_index(symbols_by_address_[it - symbol_starts_.begin()].symbol);
+}
+
+const Elf64_Sym *pdb::elf::get_symbol_containing_address(file_addr address) const
+{
+    // the last symbol starting at or before the address
+    auto it = std::upper_bound(symbol_starts_.begin(), symbol_starts_.end(), address.addr());
+    if (it == symbol_starts_.begin())
+        return nullptr;
+
+    auto index = (it - symbol_starts_.begin()) - 1;
+    auto &entry = symbols_by_address_[index];
+
+    // a symbol without a size only covers its own address
+    if (address.addr() < entry.end or address.addr() == symbol_starts_[index])
+        return symbol_at_index(entry.symbol);
+    return nullptr;
+}
+
+void pdb::elf::build_name_index()
+{
+    std::vector<std::pair<std::uint64_t, const Elf64_Sym *>> hashed;
+    hashed.reserve(symbol_count());
+
+    auto add_table = [&](span<const Elf64_Sym> table) {
+        for (auto &symbol : table)
+        {
+            auto name = get_symbol_name(symbol);
+            if (!name.empty())
+                hashed.push_back({hash_symbol_name(name), &symbol});
+        }
+    };
+    add_table(symtab_);
+    add_table(dynsym_);
+
+    // sorting on the hash is an integer compare, names are only compared when two hashes are equal
+    // which keeps equal names next to each other even if two different names collide
+    std::sort(hashed.begin(), hashed.end(), [&](auto &a, auto &b) {
+        if (a.first != b.first)
+            return a.first < b.first;
+        auto name_a = get_symbol_name(*a.second);
+        auto name_b = get_symbol_name(*b.second);
+        return name_a != name_b ? name_a < name_b : a.second < b.second;
+    });
+
+    auto &groups = built_.name_groups;
+    symbols_by_name_.reserve(hashed.size());
+    for (std::size_t i = 0; i < hashed.size(); ++i)
+    {
+        auto &[hash, symbol] = hashed[i];
+        auto new_group = i == 0 or hash != hashed[i - 1].first or
+                         get_symbol_name(*symbol) != get_symbol_name(*hashed[i - 1].second);
+        if (new_group)
+            groups.push_back({hash, static_cast<std::uint32_t>(i), 0});
+
+        ++groups.back().count;
+        symbols_by_name_.push_back(symbol);
+    }
+
+    // power of two and at most half full, so a probe sequence is short and ends at an empty slot
+    std::size_t slot_count = 16;
+    while (slot_count < groups.size() * 2)
+        slot_count *= 2;
+    auto &slots = built_.name_slots;
+    slots.assign(slot_count, 0);
+
+    auto mask = slot_count - 1;
+    for (std::size_t group = 0; group < groups.size(); ++group)
+    {
+        auto slot = groups[group].hash & mask;
+        while (slots[slot] != 0)
+            slot = (slot + 1) & mask;
+        slots[slot] = group + 1;
+    }
+
+    name_groups_ = groups;
+    name_slots_ = slots;
+}
+
+pdb::span<const Elf64_Sym *const> pdb::elf::get_symbols_by_name(std::string_view name) const
+{
+    auto hash = hash_symbol_name(name);
+    auto mask = name_slots_.size() - 1;
+
+    for (auto slot = hash & mask; name_slots_[slot] != 0; slot = (slot + 1) & mask)
+    {
+        auto &group = name_groups_[name_slots_[slot] - 1];
+        if (group.hash == hash and get_symbol_name(*symbols_by_name_[group.first]) == name)
+            return span<const Elf64_Sym *const>(symbols_by_name_.data() + group.first, group.count);
+    }
+
+    return {};
+}
@@ -0,0 +1,69 @@
+#include <cstring>
+#include <libpdb/expected.hpp>
+
+namespace
+{
+    const char *describe(pdb::errc code)
+    {
+        using pdb::errc;
+        switch (code)
+        {
+        case errc::process_ended:
+            return "Could not resume: the process has ended";
+        case errc::open_register_transaction:
+            return "Cannot resume with an open register transaction";
+        case errc::resume_failed:
+            return "Could not resume";
+        case errc::resume_thread_failed:
+            return "Could not resume thread";
+        case errc::single_step_failed:
+            return "Failed to single step";
+        case errc::stop_thread_failed:
+            return "Could not stop thread";
+        case errc::wait_failed:
+            return "waitpid failed";
+        case errc::waitid_failed:
+            return "waitid failed";
+        case errc::event_message_failed:
+            return "Could not read the new thread id";
+        case errc::signal_info_failed:
+            return "Failed to get signal info";
+        case errc::read_gprs_failed:
+            return "Could not read GPR registers";
+        case errc::read_fprs_failed:
+            return "Could not read FPR registers";
+        case errc::read_debug_registers_failed:
+            return "Could not read debug registers";
+        case errc::write_user_area_failed:
+            return "Could not write to user area";
+        case errc::write_fprs_failed:
+            return "Could not write FP registers";
+        case errc::write_gprs_failed:
+            return "Could not write GP registers";
+        case errc::unexpected_register_size:
+            return "Unexpected register size";
+        case errc::open_memory_failed:
+            return "Could not open /proc";
+        case errc::read_memory_failed:
+            return "Could not read memory";
+        case errc::write_memory_failed:
+            return "Could not write memory";
+        }
+        return "Unknown error";
+    }
+}
+
+std::string pdb::error_code::message() const
+{
+    std::string text = describe(code);
+
+    // these name the thread, or the /proc/<pid>/mem file
+    if (code == errc::resume_thread_failed or code == errc::stop_thread_failed)
+        text += " " + std::to_string(pid);
+    else if (code == errc::open_memory_failed)
+        text += "/" + std::to_string(pid) + "/mem";
+
+    if (sys_errno != 0)
+        text += std::string(": ") + std::strerror(sys_errno);
+    return text;
+}
@@ -0,0 +1,179 @@
+#include <csignal>
+#include <cstring>
+#include <elf.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <libpdb/elf.hpp>
+#include <libpdb/error.hpp>
+#include <libpdb/fork_server.hpp>
+#include <syscall_probes.hpp>
+
+namespace
+{
+    // syscall; int3, what the template runs for every copy
+    constexpr std::byte clone_stub[] = {std::byte{0x0f}, std::byte{0x05}, std::byte{0xcc}};
+
+    // waitpid for one task, retrying when a signal handler of ours got in the way
+    int wait_for(pid_t pid)
+    {
+        int status;
+        while (pdb::sys::waitpid(pid, &status, __WALL) < 0)
+        {
+            if (errno != EINTR)
+                pdb::error::send_errno("Could not wait for the fork server");
+        }
+        return status;
+    }
+}
+
+pdb::fork_server::fork_server(std::unique_ptr<process> template_process)
+    : template_(std::move(template_process))
+{
+    if (!template_ or template_->state() != process_state::stopped)
+    {
+        error::send("A fork server needs a stopped template process");
+    }
+
+    // a copy would start with the template's syscall stops armed and no way for us to know
+    if (template_->get_syscall_catch_policy().get_mode() != syscall_catch_policy::mode::none)
+    {
+        error::send("A fork server template can't catch syscalls");
+    }
+
+    auto pid = template_->pid();
+
+    // the copies get the template's memory as it is, int3s included
+    std::vector<breakpoint_site *> sites;
+    template_->breakpoint_sites().for_each([&](auto &site) {
+        if (site.is_enabled())
+            sites.push_back(&site);
+    });
+    if (!sites.empty())
+        template_->disable_breakpoint_sites(sites);
+
+    // whatever we wrote to the registers goes in first, the saved set is what every copy starts with
+    auto &regs = template_->get_registers(pid);
+    regs.flush();
+    if (sys::ptrace(PTRACE_GETREGS, pid, nullptr, &saved_regs_) < 0)
+    {
+        error::send_errno("Could not read the template registers");
+    }
+
+    // the entry point has done its job once the program is past it, so the stub can live there for good
+    auto auxv = template_->get_auxv();
+    entry_ = virt_addr(auxv[AT_ENTRY]);
+    template_->write_memory(entry_, {clone_stub, sizeof(clone_stub)});
+
+    // the copy is traced from its first instruction and reported to us as a fork event
+    if (sys::ptrace(PTRACE_SETOPTIONS, pid, nullptr, PTRACE_O_TRACECLONE | PTRACE_O_TRACEFORK) < 0)
+    {
+        error::send_errno("Could not set the fork server ptrace options");
+    }
+}
+
+pdb::fork_server::~fork_server() = default;
+
+std::unique_ptr<pdb::fork_server> pdb::fork_server::launch(const std::filesystem::path &path, const launch_options &options,
+                                                           std::string_view function)
+{
+    auto proc = process::launch(path, options);
+
+    elf file(path);
+    auto auxv = proc->get_auxv();
+    file.notify_loaded(virt_addr(auxv[AT_ENTRY] - file.get_header().e_entry));
+
+    auto symbols = file.get_symbols_by_name(function);
+    if (symbols.empty())
+    {
+        error::send("Could not find " + std::string(function) + " in " + path.string());
+    }
+
+    auto address = file.to_virt_addr(file_addr(symbols[0]->st_value));
+    auto &site = proc->create_breakpoint_site(address);
+    site.enable();
+
+    proc->resume();
+    auto reason = proc->wait_on_signal();
+    if (reason.reason != process_state::stopped or reason.info != SIGTRAP or proc->get_pc() != address)
+    {
+        error::send("The fork server template didn't get to " + std::string(function));
+    }
+
+    proc->breakpoint_sites().remove_by_address(address);
+    return std::make_unique<fork_server>(std::move(proc));
+}
+
+void pdb::fork_server::continue_template(int expected_event, const char *what)
+{
+    auto pid = template_->pid();
+    if (sys::ptrace(PTRACE_CONT, pid, nullptr, nullptr) < 0)
+    {
+        error::send_errno("Could not resume the fork server template");
+    }
+
+    auto status = wait_for(pid);
+    auto expected = expected_event ? (SIGTRAP | (expected_event << 8)) : SIGTRAP;
+    if (!WIFSTOPPED(status) or (status >> 8) != expected)
+    {
+        error::send(std::string("The fork server template didn't stop at the ") + what);
+    }
+}
+
+std::unique_ptr<pdb::process> pdb::fork_server::spawn()
+{
+    auto pid = template_->pid();
+
+    // clone(CLONE_PARENT | SIGCHLD) at the entry point, CLONE_PARENT makes the copy a child of ours like
+    // the template, so the template never has to run again to reap it
+    // orig_rax -1 keeps the kernel from restarting a syscall the template was stopped in
+    auto regs = saved_regs_;
+    regs.rip = entry_.addr();
+    regs.rax = SYS_clone;
+    regs.orig_rax = static_cast<std::uint64_t>(-1);
+    regs.rdi = CLONE_PARENT | SIGCHLD;
+    regs.rsi = regs.rdx = regs.r10 = regs.r8 = 0;
+    if (sys::ptrace(PTRACE_SETREGS, pid, nullptr, &regs) < 0)
+    {
+        error::send_errno("Could not set up the fork server template");
+    }
+
+    // from here on the template registers are ours, the cache in the process object is stale
+    template_->get_registers(pid).invalidate();
+
+    continue_template(PTRACE_EVENT_FORK, "fork");
+
+    unsigned long message;
+    if (sys::ptrace(PTRACE_GETEVENTMSG, pid, nullptr, &message) < 0)
+    {
+        error::send_errno("Could not get the pid of the fork server child");
+    }
+    auto child = static_cast<pid_t>(message);
+
+    // the int3 after the syscall, the template is stopped again
+    continue_template(0, "int3 after the fork");
+    if (sys::ptrace(PTRACE_SETREGS, pid, nullptr, &saved_regs_) < 0)
+    {
+        error::send_errno("Could not restore the fork server template");
+    }
+
+    // an automatically attached child starts with a SIGSTOP we swallow by resuming it without a signal
+    auto status = wait_for(child);
+    if (!WIFSTOPPED(status) or WSTOPSIG(status) != SIGSTOP)
+    {
+        kill(child, SIGKILL);
+        wait_for(child);
+        error::send("The fork server child didn't start stopped");
+    }
+
+    // it returned from the clone at entry + 2, put it back where the template was
+    std::unique_ptr<process> proc(new process(child, /*terminate_on_end=*/true, /*is_attached=*/true));
+    if (sys::ptrace(PTRACE_SETREGS, child, nullptr, &saved_regs_) < 0)
+    {
+        error::send_errno("Could not set up the fork server child");
+    }
+    proc->set_ptrace_options(child);
+
+    ++spawned_;
+    return proc;
+}
@@ -0,0 +1,316 @@
+#ifndef PDB_DWARF_READER_HPP
+#define PDB_DWARF_READER_HPP
+
+#include <libpdb/dwarf.hpp>
+#include <libpdb/error.hpp>
+#include <libpdb/detail/dwarf.h>
+#include <cstring>
+#include <optional>
+#include <vector>
+#include <string_view>
+
+namespace pdb
+{
+    // reads DWARF encodings out of a section, every read is checked against the end of the data
+    class dwarf_cursor
+    {
+    public:
+        explicit dwarf_cursor(span<const std::byte> data) : data_(data), pos_(data.begin()) {}
+
+        bool finished() const { return pos_ >= data_.end(); }
+        std::size_t position() const { return pos_ - data_.begin(); }
+        void seek(std::size_t offset)
+        {
+            if (offset > data_.size())
+                malformed();
+            pos_ = data_.begin() + offset;
+        }
+        void skip(std::size_t count) { need(count); pos_ += count; }
+
+        template <class T>
+        T fixed_int()
+        {
+            need(sizeof(T));
+            T value;
+            std::memcpy(&value, pos_, sizeof(T));
+            pos_ += sizeof(T);
+            return value;
+        }
+
+        std::uint8_t u8() { return fixed_int<std::uint8_t>(); }
+        std::uint16_t u16() { return fixed_int<std::uint16_t>(); }
+        std::uint32_t u32() { return fixed_int<std::uint32_t>(); }
+        std::uint64_t u64() { return fixed_int<std::uint64_t>(); }
+        std::int8_t s8() { return fixed_int<std::int8_t>(); }
+
+        std::uint32_t u24()
+        {
+            need(3);
+            std::uint32_t value = 0;
+            std::memcpy(&value, pos_, 3);
+            pos_ += 3;
+            return value;
+        }
+
+        std::uint64_t uleb128()
+        {
+            std::uint64_t value = 0;
+            int shift = 0;
+            std::uint8_t byte;
+            do
+            {
+                byte = u8();
+                if (shift < 64)
+                    value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+                shift += 7;
+            } while (byte & 0x80);
+            return value;
+        }
+
+        std::int64_t sleb128()
+        {
+            std::uint64_t value = 0;
+            int shift = 0;
+            std::uint8_t byte;
+            do
+            {
+                byte = u8();
+                if (shift < 64)
+                    value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+                shift += 7;
+            } while (byte & 0x80);
+
+            // sign extend from the last byte we read
+            if (shift < 64 and (byte & 0x40))
+                value |= ~std::uint64_t(0) << shift;
+            return static_cast<std::int64_t>(value);
+        }
+
+        // a unit length, 0xffffffff switches to the 64 bit format
+        std::uint64_t initial_length(bool &dwarf64)
+        {
+            auto length = u32();
+            dwarf64 = length == 0xffffffff;
+            if (dwarf64)
+                return u64();
+            if (length >= 0xfffffff0)
+                malformed();
+            return length;
+        }
+
+        std::uint64_t section_offset(bool dwarf64) { return dwarf64 ? u64() : u32(); }
+
+        std::uint64_t address(std::uint8_t size)
+        {
+            switch (size)
+            {
+            case 1: return u8();
+            case 2: return u16();
+            case 4: return u32();
+            case 8: return u64();
+            default: malformed();
+            }
+        }
+
+        std::string_view string()
+        {
+            auto left = static_cast<std::size_t>(data_.end() - pos_);
+            auto start = reinterpret_cast<const char *>(pos_);
+            auto end = static_cast<const char *>(std::memchr(start, '\0', left));
+            if (!end)
+                malformed();
+
+            std::string_view str(start, end - start);
+            pos_ += str.size() + 1;
+            return str;
+        }
+
+        span<const std::byte> bytes(std::size_t count)
+        {
+            need(count);
+            span<const std::byte> out(pos_, count);
+            pos_ += count;
+            return out;
+        }
+
+        [[noreturn]] static void malformed()
+        {
+            error::send("Malformed DWARF data");
+        }
+
+    private:
+        void need(std::size_t count) const
+        {
+            if (static_cast<std::size_t>(data_.end() - pos_) < count)
+                malformed();
+        }
+
+        span<const std::byte> data_;
+        const std::byte *pos_;
+    };
+
+    // what reading a form needs to know about the unit it is in
+    struct form_context
+    {
+        const dwarf_sections *sections;
+        bool dwarf64;
+        std::uint8_t address_size;
+        std::uint64_t str_offsets_base;
+        std::uint64_t addr_base;
+    };
+
+    // strp and line_strp are looked up right away, strx and addrx keep their index in value until
+    // resolved with the unit bases, which can come after them in the same DIE
+    struct form_value
+    {
+        std::uint64_t form = 0;
+        std::uint64_t value = 0;
+        std::string_view string;
+        span<const std::byte> block;
+    };
+
+    inline std::string_view string_at_offset(span<const std::byte> section, std::uint64_t offset)
+    {
+        dwarf_cursor cursor(section);
+        cursor.seek(offset);
+        return cursor.string();
+    }
+
+    inline form_value read_form(dwarf_cursor &cursor, std::uint64_t form, std::int64_t implicit_const, const form_context &context)
+    {
+        form_value out;
+        out.form = form;
+
+        switch (form)
+        {
+        case DW_FORM_addr: out.value = cursor.address(context.address_size); break;
+        case DW_FORM_data1: case DW_FORM_ref1: case DW_FORM_flag: case DW_FORM_strx1: case DW_FORM_addrx1:
+            out.value = cursor.u8(); break;
+        case DW_FORM_data2: case DW_FORM_ref2: case DW_FORM_strx2: case DW_FORM_addrx2:
+            out.value = cursor.u16(); break;
+        case DW_FORM_strx3: case DW_FORM_addrx3:
+            out.value = cursor.u24(); break;
+        case DW_FORM_data4: case DW_FORM_ref4: case DW_FORM_ref_sup4: case DW_FORM_strx4: case DW_FORM_addrx4:
+            out.value = cursor.u32(); break;
+        case DW_FORM_data8: case DW_FORM_ref8: case DW_FORM_ref_sig8: case DW_FORM_ref_sup8:
+            out.value = cursor.u64(); break;
+        case DW_FORM_data16: out.block = cursor.bytes(16); break;
+        case DW_FORM_sdata: out.value = static_cast<std::uint64_t>(cursor.sleb128()); break;
+        case DW_FORM_udata: case DW_FORM_ref_udata: case DW_FORM_strx: case DW_FORM_addrx:
+        case DW_FORM_loclistx: case DW_FORM_rnglistx:
+            out.value = cursor.uleb128(); break;
+        case DW_FORM_ref_addr: case DW_FORM_sec_offset: case DW_FORM_strp_sup:
+            out.value = cursor.section_offset(context.dwarf64); break;
+        case DW_FORM_strp:
+            out.value = cursor.section_offset(context.dwarf64);
+            out.string = string_at_offset(context.sections->str, out.value);
+            break;
+        case DW_FORM_line_strp:
+            out.value = cursor.section_offset(context.dwarf64);
+            out.string = string_at_offset(context.sections->line_str, out.value);
+            break;
+        case DW_FORM_string: out.string = cursor.string(); break;
+        case DW_FORM_block1: out.block = cursor.bytes(cursor.u8()); break;
+        case DW_FORM_block2: out.block = cursor.bytes(cursor.u16()); break;
+        case DW_FORM_block4: out.block = cursor.bytes(cursor.u32()); break;
+        case DW_FORM_block: case DW_FORM_exprloc: out.block = cursor.bytes(cursor.uleb128()); break;
+        case DW_FORM_flag_present: out.value = 1; break;
+        case DW_FORM_implicit_const: out.value = static_cast<std::uint64_t>(implicit_const); break;
+        case DW_FORM_indirect:
+        {
+            auto real_form = cursor.uleb128();
+            auto implicit = real_form == DW_FORM_implicit_const ? cursor.sleb128() : 0;
+            return read_form(cursor, real_form, implicit, context);
+        }
+        default: error::send("Unknown DWARF form " + std::to_string(form));
+        }
+
+        return out;
+    }
+
+    inline bool is_strx_form(std::uint64_t form)
+    {
+        return form == DW_FORM_strx or (form >= DW_FORM_strx1 and form <= DW_FORM_strx4);
+    }
+
+    inline bool is_addrx_form(std::uint64_t form)
+    {
+        return form == DW_FORM_addrx or (form >= DW_FORM_addrx1 and form <= DW_FORM_addrx4);
+    }
+
+    inline std::string_view resolve_string(const form_value &value, const form_context &context)
+    {
+        if (!is_strx_form(value.form))
+            return value.string;
+
+        dwarf_cursor cursor(context.sections->str_offsets);
+        cursor.seek(context.str_offsets_base + value.value * (context.dwarf64 ? 8 : 4));
+        return string_at_offset(context.sections->str, cursor.section_offset(context.dwarf64));
+    }
+
+    inline std::uint64_t resolve_address(const form_value &value, const form_context &context)
+    {
+        if (!is_addrx_form(value.form))
+            return value.value;
+
+        dwarf_cursor cursor(context.sections->addr);
+        cursor.seek(context.addr_base + value.value * context.address_size);
+        return cursor.address(context.address_size);
+    }
+
+    // moves past an attribute without looking at it, no string lookups and no copies
+    inline void skip_form(dwarf_cursor &cursor, std::uint64_t form, const form_context &context)
+    {
+        switch (form)
+        {
+        case DW_FORM_flag_present: case DW_FORM_implicit_const: return;
+        case DW_FORM_data1: case DW_FORM_ref1: case DW_FORM_flag: case DW_FORM_strx1: case DW_FORM_addrx1:
+            cursor.skip(1); return;
+        case DW_FORM_data2: case DW_FORM_ref2: case DW_FORM_strx2: case DW_FORM_addrx2:
+            cursor.skip(2); return;
+        case DW_FORM_strx3: case DW_FORM_addrx3: cursor.skip(3); return;
+        case DW_FORM_data4: case DW_FORM_ref4: case DW_FORM_ref_sup4: case DW_FORM_strx4: case DW_FORM_addrx4:
+            cursor.skip(4); return;
+        case DW_FORM_data8: case DW_FORM_ref8: case DW_FORM_ref_sig8: case DW_FORM_ref_sup8:
+            cursor.skip(8); return;
+        case DW_FORM_data16: cursor.skip(16); return;
+        case DW_FORM_addr: cursor.skip(context.address_size); return;
+        case DW_FORM_ref_addr: case DW_FORM_sec_offset: case DW_FORM_strp: case DW_FORM_line_strp: case DW_FORM_strp_sup:
+            cursor.skip(context.dwarf64 ? 8 : 4); return;
+        case DW_FORM_sdata: case DW_FORM_udata: case DW_FORM_ref_udata: case DW_FORM_strx: case DW_FORM_addrx:
+        case DW_FORM_loclistx: case DW_FORM_rnglistx:
+            cursor.uleb128(); return;
+        case DW_FORM_string: cursor.string(); return;
+        case DW_FORM_block1: cursor.skip(cursor.u8()); return;
+        case DW_FORM_block2: cursor.skip(cursor.u16()); return;
+        case DW_FORM_block4: cursor.skip(cursor.u32()); return;
+        case DW_FORM_block: case DW_FORM_exprloc: cursor.skip(cursor.uleb128()); return;
+        default: read_form(cursor, form, 0, context); return;
+        }
+    }
+
+    // the .debug_info offset a reference attribute points at, nothing for type signatures
+    inline std::optional<std::uint64_t> reference_offset(const form_value &value, const compile_unit &unit)
+    {
+        switch (value.form)
+        {
+        case DW_FORM_ref1: case DW_FORM_ref2: case DW_FORM_ref4: case DW_FORM_ref8: case DW_FORM_ref_udata:
+            return unit.get_header().offset + value.value;
+        case DW_FORM_ref_addr:
+            return value.value;
+        default:
+            return std::nullopt;
+        }
+    }
+
+    // the [low_pc, high_pc) range of a DIE, if it has both
+    void append_pc_range(const form_value &low_pc, const form_value &high_pc, const form_context &context,
+                         std::vector<std::pair<file_addr, file_addr>> &out);
+
+    // the ranges of a DW_AT_ranges list, from .debug_rnglists for DWARF 5 and .debug_ranges before it
+    void append_range_list(const compile_unit &unit, const form_value &ranges, std::uint64_t base,
+                           std::optional<std::uint64_t> rnglists_base, const form_context &context,
+                           std::vector<std::pair<file_addr, file_addr>> &out);
+}
+
+#endif
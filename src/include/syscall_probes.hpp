@@ -0,0 +1,112 @@
+#ifndef PDB_SYSCALL_PROBES_HPP
+#define PDB_SYSCALL_PROBES_HPP
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <libpdb/stats.hpp>
+
+// every kernel round trip of libpdb goes through these, so pdb::stats can count it and time it
+// with PDB_STATS off they are the plain calls
+namespace pdb::sys
+{
+    namespace detail
+    {
+        void record(stats::op what, std::uint64_t ns, bool failed, std::uint64_t bytes);
+
+        stats::op ptrace_op(long request);
+
+        template <class Call>
+        auto probe(stats::op what, Call &&call)
+        {
+            if constexpr (stats::enabled)
+            {
+                auto start = std::chrono::steady_clock::now();
+                auto ret = call();
+                auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+                // the caller looks at errno after us
+                auto saved = errno;
+                record(what, ns, ret < 0, ret > 0 and what >= stats::op::process_vm_readv ? ret : 0);
+                errno = saved;
+                return ret;
+            }
+            else
+            {
+                return call();
+            }
+        }
+    }
+
+    template <class Address, class Data>
+    long ptrace(__ptrace_request request, pid_t pid, Address address, Data data)
+    {
+        if constexpr (stats::enabled)
+        {
+            auto what = detail::ptrace_op(request);
+
+            // a peek returns the word it read, only errno tells a failure
+            errno = 0;
+            auto start = std::chrono::steady_clock::now();
+            auto ret = ::ptrace(request, pid, address, data);
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+            auto saved = errno;
+            detail::record(what, ns, what == stats::op::ptrace_peekuser ? saved != 0 : ret < 0, 0);
+            errno = saved;
+            return ret;
+        }
+        else
+        {
+            return ::ptrace(request, pid, address, data);
+        }
+    }
+
+    inline pid_t waitpid(pid_t pid, int *status, int options)
+    {
+        return detail::probe(stats::op::waitpid, [&] { return ::waitpid(pid, status, options); });
+    }
+
+    inline int waitid(idtype_t type, id_t id, siginfo_t *info, int options)
+    {
+        return detail::probe(stats::op::waitid, [&] { return ::waitid(type, id, info, options); });
+    }
+
+    inline int tgkill(pid_t pid, pid_t tid, int signal)
+    {
+        return detail::probe(stats::op::tgkill, [&] { return ::tgkill(pid, tid, signal); });
+    }
+
+    inline ssize_t process_vm_readv(pid_t pid, const iovec *local, unsigned long local_count, const iovec *remote,
+                                    unsigned long remote_count)
+    {
+        return detail::probe(stats::op::process_vm_readv,
+                             [&] { return ::process_vm_readv(pid, local, local_count, remote, remote_count, 0); });
+    }
+
+    inline ssize_t process_vm_writev(pid_t pid, const iovec *local, unsigned long local_count, const iovec *remote,
+                                     unsigned long remote_count)
+    {
+        return detail::probe(stats::op::process_vm_writev,
+                             [&] { return ::process_vm_writev(pid, local, local_count, remote, remote_count, 0); });
+    }
+
+    // the /proc/<pid>/mem fallback
+    inline ssize_t pread(int fd, void *buffer, std::size_t size, off_t offset)
+    {
+        return detail::probe(stats::op::proc_mem_read, [&] { return ::pread(fd, buffer, size, offset); });
+    }
+
+    inline ssize_t pwrite(int fd, const void *buffer, std::size_t size, off_t offset)
+    {
+        return detail::probe(stats::op::proc_mem_write, [&] { return ::pwrite(fd, buffer, size, offset); });
+    }
+}
+
+#endif
@@ -0,0 +1,515 @@
+#include <libpdb/index_cache.hpp>
+#include <libpdb/elf.hpp>
+#include <libpdb/dwarf.hpp>
+#include <libpdb/dwarf_index.hpp>
+#include <libpdb/error.hpp>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <pwd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace
+{
+    constexpr char cache_magic[8] = {'P', 'D', 'B', 'I', 'N', 'D', 'E', 'X'};
+
+    struct block_entry
+    {
+        std::uint64_t offset;
+        std::uint64_t size;
+    };
+
+    struct file_header
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t block_count;
+        // the build-id should be enough, the size is a cheap check against a reused one
+        std::uint64_t elf_size;
+        std::uint32_t build_id_size;
+        char build_id[132];
+    };
+
+    // names in the dwarf index point into the ELF mapping, the cache keeps them as offsets into the file
+    struct cached_name
+    {
+        std::uint64_t name_offset;
+        std::uint64_t die_offset;
+        std::uint32_t name_size;
+        std::uint32_t tag;
+    };
+
+    struct cached_function
+    {
+        std::uint64_t low;
+        std::uint64_t high;
+        std::uint64_t die_offset;
+        std::uint64_t name_offset;
+        std::uint64_t linkage_name_offset;
+        std::uint32_t name_size;
+        std::uint32_t linkage_name_size;
+    };
+
+    struct cached_dwarf_info
+    {
+        std::uint64_t die_count;
+    };
+
+    // sorted by unit offset, data is where the table starts in the line_table_data block
+    struct cached_line_table
+    {
+        std::uint64_t unit_offset;
+        std::uint64_t data_offset;
+        std::uint64_t data_size;
+    };
+
+    // a table is this header, the file names (each a 4 byte length and the bytes), then the arrays
+    // widest first so each one stays aligned: addresses and line keys, file indices, lines and line rows, flags
+    struct line_table_header
+    {
+        std::uint32_t file_count;
+        std::uint32_t row_count;
+        std::uint32_t key_count;
+        std::uint32_t files_size;
+    };
+
+    std::uint64_t align8(std::uint64_t value) { return (value + 7) & ~std::uint64_t(7); }
+
+    // builds the file in memory, blocks are appended one after the other
+    class cache_writer
+    {
+    public:
+        explicit cache_writer(std::size_t header_size) : out_(align8(header_size), '\0') {}
+
+        template <class T>
+        void append(const T &value) { out_.append(reinterpret_cast<const char *>(&value), sizeof(T)); }
+        template <class T>
+        void append(pdb::span<const T> values) { out_.append(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T)); }
+        void append(std::string_view bytes) { out_.append(bytes); }
+
+        void align() { out_.resize(align8(out_.size()), '\0'); }
+        std::size_t size() const { return out_.size(); }
+
+        void begin_block() { align(); block_start_ = out_.size(); }
+        block_entry end_block() const { return {block_start_, out_.size() - block_start_}; }
+
+        template <class T>
+        block_entry add_block(pdb::span<const T> values)
+        {
+            begin_block();
+            append(values);
+            return end_block();
+        }
+
+        std::string &data() { return out_; }
+
+    private:
+        std::string out_;
+        std::size_t block_start_ = 0;
+    };
+
+    // where a name from the mapping is in the file
+    std::uint64_t offset_in(pdb::span<const std::byte> mapping, std::string_view name)
+    {
+        if (name.empty())
+            return 0;
+
+        auto start = reinterpret_cast<const std::byte *>(name.data());
+        if (start < mapping.begin() or start + name.size() > mapping.end())
+        {
+            pdb::error::send("Index entry is not in the ELF file");
+        }
+        return start - mapping.begin();
+    }
+
+    // a name back from its offset, false if it doesn't fit in the file
+    bool name_at(pdb::span<const std::byte> mapping, std::uint64_t offset, std::uint32_t size, std::string_view &out)
+    {
+        if (offset > mapping.size() or size > mapping.size() - offset)
+            return false;
+        out = std::string_view(reinterpret_cast<const char *>(mapping.data() + offset), size);
+        return true;
+    }
+
+    void write_file(const std::filesystem::path &path, const std::string &data)
+    {
+        auto fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            pdb::error::send_errno("Could not create index cache " + path.string());
+        }
+
+        std::size_t written = 0;
+        while (written < data.size())
+        {
+            auto result = ::write(fd, data.data() + written, data.size() - written);
+            if (result < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                auto saved = errno;
+                close(fd);
+                unlink(path.c_str());
+                errno = saved;
+                pdb::error::send_errno("Could not write index cache");
+            }
+            written += result;
+        }
+        close(fd);
+    }
+}
+
+pdb::index_cache::index_cache(std::filesystem::path path, const std::byte *data, std::size_t size)
+    : path_(std::move(path)), data_(data), size_(size)
+{
+}
+
+pdb::index_cache::~index_cache()
+{
+    munmap(const_cast<std::byte *>(data_), size_);
+}
+
+std::filesystem::path pdb::index_cache::default_directory()
+{
+    // the XDG spec says relative paths in these variables are to be ignored
+    if (auto cache_home = std::getenv("XDG_CACHE_HOME"); cache_home and cache_home[0] == '/')
+        return std::filesystem::path(cache_home) / "pdb";
+
+    if (auto home = std::getenv("HOME"); home and home[0] == '/')
+        return std::filesystem::path(home) / ".cache" / "pdb";
+
+    if (auto user = getpwuid(getuid()); user and user->pw_dir)
+        return std::filesystem::path(user->pw_dir) / ".cache" / "pdb";
+
+    return {};
+}
+
+std::filesystem::path pdb::index_cache::path_for(const elf &file, const std::filesystem::path &directory)
+{
+    auto id = file.build_id();
+    if (id.empty() or directory.empty())
+        return {};
+    return directory / (id + ".index");
+}
+
+std::unique_ptr<pdb::index_cache> pdb::index_cache::open(const elf &file, const std::filesystem::path &directory)
+{
+    auto path = path_for(file, directory);
+    if (path.empty())
+        return nullptr;
+
+    auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat stats;
+    if (fstat(fd, &stats) < 0 or static_cast<std::size_t>(stats.st_size) < sizeof(file_header) + block_count * sizeof(block_entry))
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    auto size = static_cast<std::size_t>(stats.st_size);
+    auto mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return nullptr;
+
+    // from here on the destructor unmaps it
+    std::unique_ptr<index_cache> cache(new index_cache(path, static_cast<const std::byte *>(mapping), size));
+
+    file_header header;
+    std::memcpy(&header, cache->data_, sizeof(header));
+
+    auto id = file.build_id();
+    if (std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 or header.version != format_version or
+        header.block_count != block_count or header.elf_size != file.data().size() or
+        header.build_id_size != id.size() or std::string_view(header.build_id, id.size()) != id)
+        return nullptr;
+
+    // every block has to be inside the file, aligned, and a whole number of its entries
+    const std::array<std::size_t, block_count> entry_sizes{
+        sizeof(std::uint64_t), sizeof(elf::address_entry), sizeof(std::uint32_t), sizeof(elf::name_group),
+        sizeof(std::uint32_t), sizeof(cached_dwarf_info), sizeof(cached_name), sizeof(cached_function),
+        sizeof(cached_line_table), 1};
+
+    auto blocks = reinterpret_cast<const block_entry *>(cache->data_ + align8(sizeof(file_header)));
+    for (std::size_t i = 0; i < block_count; ++i)
+    {
+        auto &entry = blocks[i];
+        if (entry.offset % 8 != 0 or entry.offset > size or entry.size > size - entry.offset or entry.size % entry_sizes[i] != 0)
+            return nullptr;
+    }
+
+    if (!cache->symbol_indexes_valid(file))
+        return nullptr;
+    return cache;
+}
+
+template <class T>
+pdb::span<const T> pdb::index_cache::get(block kind) const
+{
+    auto blocks = reinterpret_cast<const block_entry *>(data_ + align8(sizeof(file_header)));
+    auto &entry = blocks[kind];
+    return span<const T>(reinterpret_cast<const T *>(data_ + entry.offset), entry.size / sizeof(T));
+}
+
+bool pdb::index_cache::symbol_indexes_valid(const elf &file) const
+{
+    // the lookups index with these values without checking, so a damaged cache is caught here
+    auto symbol_count = file.symbol_count();
+    auto starts = get<std::uint64_t>(symbol_starts);
+    auto by_address = get<elf::address_entry>(symbols_by_address);
+    auto by_name = get<std::uint32_t>(symbols_by_name);
+    auto groups = get<elf::name_group>(name_groups);
+    auto slots = get<std::uint32_t>(name_slots);
+
+    if (starts.size() != by_address.size() or slots.size() < 16 or (slots.size() & (slots.size() - 1)) != 0)
+        return false;
+
+    return std::all_of(by_address.begin(), by_address.end(), [&](auto &entry) { return entry.symbol < symbol_count; }) and
+           std::all_of(by_name.begin(), by_name.end(), [&](auto index) { return index < symbol_count; }) and
+           std::all_of(groups.begin(), groups.end(), [&](auto &group) {
+               return group.count > 0 and group.first <= by_name.size() and group.count <= by_name.size() - group.first;
+           }) and
+           std::all_of(slots.begin(), slots.end(), [&](auto slot) { return slot <= groups.size(); });
+}
+
+void pdb::index_cache::read_symbol_indexes(elf &file) const
+{
+    file.symbol_starts_ = get<std::uint64_t>(symbol_starts);
+    file.symbols_by_address_ = get<elf::address_entry>(symbols_by_address);
+    file.name_groups_ = get<elf::name_group>(name_groups);
+    file.name_slots_ = get<std::uint32_t>(name_slots);
+
+    auto by_name = get<std::uint32_t>(symbols_by_name);
+    file.symbols_by_name_.resize(by_name.size());
+    std::transform(by_name.begin(), by_name.end(), file.symbols_by_name_.begin(),
+                   [&](auto index) { return file.symbol_at_index(index); });
+}
+
+std::unique_ptr<pdb::dwarf_index> pdb::index_cache::read_dwarf_index(const dwarf &debug_info) const
+{
+    auto info = get<cached_dwarf_info>(dwarf_info);
+    if (info.empty())
+        return nullptr;
+
+    auto mapping = debug_info.get_elf().data();
+    std::unique_ptr<dwarf_index> index(new dwarf_index());
+    index->die_count_ = info[0].die_count;
+
+    auto names = get<cached_name>(dwarf_names);
+    index->names_.resize(names.size());
+    for (std::size_t i = 0; i < names.size(); ++i)
+    {
+        auto &in = names[i];
+        auto &out = index->names_[i];
+        if (!name_at(mapping, in.name_offset, in.name_size, out.name))
+            return nullptr;
+        out.die_offset = in.die_offset;
+        out.tag = in.tag;
+    }
+
+    auto functions = get<cached_function>(dwarf_functions);
+    index->functions_.resize(functions.size());
+    for (std::size_t i = 0; i < functions.size(); ++i)
+    {
+        auto &in = functions[i];
+        auto &out = index->functions_[i];
+        if (!name_at(mapping, in.name_offset, in.name_size, out.name) or
+            !name_at(mapping, in.linkage_name_offset, in.linkage_name_size, out.linkage_name))
+            return nullptr;
+        out.low = file_addr(in.low);
+        out.high = file_addr(in.high);
+        out.die_offset = in.die_offset;
+    }
+
+    return index;
+}
+
+std::unique_ptr<pdb::line_table> pdb::index_cache::read_line_table(const compile_unit &unit) const
+{
+    auto units = get<cached_line_table>(line_table_units);
+    auto offset = unit.get_header().offset;
+    auto it = std::lower_bound(units.begin(), units.end(), offset,
+                               [](auto &entry, auto offset) { return entry.unit_offset < offset; });
+    if (it == units.end() or it->unit_offset != offset)
+        return nullptr;
+
+    auto data = get<std::byte>(line_table_data);
+    if (it->data_offset > data.size() or it->data_size > data.size() - it->data_offset)
+        return nullptr;
+
+    // copies out of the mapping with a bounds check each, any damage means the table is decoded instead
+    auto position = data.data() + it->data_offset;
+    auto end = position + it->data_size;
+    auto take = [&](void *out, std::size_t size) {
+        if (static_cast<std::size_t>(end - position) < size)
+            return false;
+        std::memcpy(out, position, size);
+        position += size;
+        return true;
+    };
+
+    line_table_header header;
+    if (!take(&header, sizeof(header)))
+        return nullptr;
+
+    std::unique_ptr<line_table> table(new line_table());
+    table->files_.reserve(header.file_count);
+    auto files_end = position + header.files_size;
+    if (files_end > end)
+        return nullptr;
+    for (std::uint32_t i = 0; i < header.file_count; ++i)
+    {
+        std::uint32_t size;
+        if (!take(&size, sizeof(size)) or static_cast<std::size_t>(files_end - position) < size)
+            return nullptr;
+        table->files_.emplace_back(std::string(reinterpret_cast<const char *>(position), size));
+        position += size;
+    }
+    position = data.data() + it->data_offset + align8(sizeof(header) + header.files_size);
+
+    table->addresses_.resize(header.row_count);
+    table->line_keys_.resize(header.key_count);
+    table->file_indices_.resize(header.row_count);
+    table->lines_.resize(header.row_count);
+    table->line_rows_.resize(header.key_count);
+    table->flags_.resize(header.row_count);
+
+    if (!take(table->addresses_.data(), header.row_count * sizeof(std::uint64_t)) or
+        !take(table->line_keys_.data(), header.key_count * sizeof(std::uint64_t)) or
+        !take(table->file_indices_.data(), header.row_count * sizeof(std::uint32_t)) or
+        !take(table->lines_.data(), header.row_count * sizeof(std::uint32_t)) or
+        !take(table->line_rows_.data(), header.key_count * sizeof(std::uint32_t)) or
+        !take(table->flags_.data(), header.row_count))
+        return nullptr;
+
+    auto bad_file = [&](auto index) { return index >= table->files_.size(); };
+    auto bad_row = [&](auto row) { return row >= header.row_count; };
+    if (std::any_of(table->file_indices_.begin(), table->file_indices_.end(), bad_file) or
+        std::any_of(table->line_rows_.begin(), table->line_rows_.end(), bad_row))
+        return nullptr;
+
+    return table;
+}
+
+std::filesystem::path pdb::index_cache::write(const dwarf &debug_info, const std::filesystem::path &directory)
+{
+    auto &file = debug_info.get_elf();
+    auto path = path_for(file, directory);
+    if (path.empty())
+        return {};
+
+    auto mapping = file.data();
+    cache_writer writer(sizeof(file_header) + block_count * sizeof(block_entry));
+    std::array<block_entry, block_count> blocks{};
+
+    blocks[symbol_starts] = writer.add_block(file.symbol_starts_);
+    blocks[symbols_by_address] = writer.add_block(file.symbols_by_address_);
+    writer.begin_block();
+    for (auto symbol : file.symbols_by_name_)
+        writer.append(file.symbol_index(*symbol));
+    blocks[symbols_by_name] = writer.end_block();
+    blocks[name_groups] = writer.add_block(file.name_groups_);
+    blocks[name_slots] = writer.add_block(file.name_slots_);
+
+    auto &index = debug_info.index();
+    writer.begin_block();
+    writer.append(cached_dwarf_info{index.die_count()});
+    blocks[dwarf_info] = writer.end_block();
+
+    writer.begin_block();
+    for (auto &entry : index.names())
+    {
+        writer.append(cached_name{offset_in(mapping, entry.name), entry.die_offset,
+                                  static_cast<std::uint32_t>(entry.name.size()), static_cast<std::uint32_t>(entry.tag)});
+    }
+    blocks[dwarf_names] = writer.end_block();
+
+    writer.begin_block();
+    for (auto &entry : index.functions())
+    {
+        writer.append(cached_function{entry.low.addr(), entry.high.addr(), entry.die_offset,
+                                      offset_in(mapping, entry.name), offset_in(mapping, entry.linkage_name),
+                                      static_cast<std::uint32_t>(entry.name.size()),
+                                      static_cast<std::uint32_t>(entry.linkage_name.size())});
+    }
+    blocks[dwarf_functions] = writer.end_block();
+
+    // the tables go in one block, the directory of where each one starts comes after it
+    std::vector<cached_line_table> tables;
+    writer.begin_block();
+    auto data_start = writer.size();
+    for (auto &unit : debug_info.compile_units())
+    {
+        if (!unit->has_line_table())
+            continue;
+
+        auto &table = unit->lines();
+        writer.align();
+        auto table_start = writer.size();
+
+        std::string files;
+        for (auto &file_path : table.files_)
+        {
+            auto &name = file_path.native();
+            auto size = static_cast<std::uint32_t>(name.size());
+            files.append(reinterpret_cast<const char *>(&size), sizeof(size));
+            files += name;
+        }
+
+        writer.append(line_table_header{static_cast<std::uint32_t>(table.files_.size()), static_cast<std::uint32_t>(table.size()),
+                                        static_cast<std::uint32_t>(table.line_keys_.size()), static_cast<std::uint32_t>(files.size())});
+        writer.append(std::string_view(files));
+        writer.align();
+        writer.append(span<const std::uint64_t>(table.addresses_));
+        writer.append(span<const std::uint64_t>(table.line_keys_));
+        writer.append(span<const std::uint32_t>(table.file_indices_));
+        writer.append(span<const std::uint32_t>(table.lines_));
+        writer.append(span<const std::uint32_t>(table.line_rows_));
+        writer.append(span<const std::uint8_t>(table.flags_));
+
+        tables.push_back({unit->get_header().offset, table_start - data_start, writer.size() - table_start});
+    }
+    blocks[line_table_data] = writer.end_block();
+
+    // units are in offset order already, the lookup relies on it
+    std::sort(tables.begin(), tables.end(), [](auto &a, auto &b) { return a.unit_offset < b.unit_offset; });
+    blocks[line_table_units] = writer.add_block(span<const cached_line_table>(tables));
+
+    file_header header{};
+    std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = format_version;
+    header.block_count = block_count;
+    header.elf_size = mapping.size();
+    auto id = file.build_id();
+    header.build_id_size = static_cast<std::uint32_t>(std::min(id.size(), sizeof(header.build_id)));
+    std::memcpy(header.build_id, id.data(), header.build_id_size);
+
+    auto &out = writer.data();
+    std::memcpy(out.data(), &header, sizeof(header));
+    std::memcpy(out.data() + align8(sizeof(file_header)), blocks.data(), sizeof(blocks));
+
+    std::error_code ignored;
+    std::filesystem::create_directories(directory, ignored);
+
+    // each writer has its own temporary name, whichever rename comes last wins and both are complete
+    auto temporary = path;
+    temporary += ".tmp." + std::to_string(getpid());
+    write_file(temporary, out);
+    if (rename(temporary.c_str(), path.c_str()) < 0)
+    {
+        auto saved = errno;
+        unlink(temporary.c_str());
+        errno = saved;
+        error::send_errno("Could not move index cache into place");
+    }
+    return path;
+}
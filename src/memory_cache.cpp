@@ -0,0 +1,58 @@
+#include <libpdb/memory_cache.hpp>
+
+const std::byte *pdb::memory_cache::find(std::uint64_t page) const
+{
+    auto it = pages_.find(page);
+    if (it == pages_.end())
+        return nullptr;
+
+    return storage_.data() + it->second * page_size;
+}
+
+std::byte *pdb::memory_cache::find(std::uint64_t page)
+{
+    auto it = pages_.find(page);
+    if (it == pages_.end())
+        return nullptr;
+
+    return storage_.data() + it->second * page_size;
+}
+
+void pdb::memory_cache::insert(std::uint64_t page)
+{
+    if (pages_.count(page))
+        return;
+
+    // slots are only handed out again after clear() so the storage only grows during a stop
+    auto slot = used_slots_++;
+    if (storage_.size() < used_slots_ * page_size)
+        storage_.resize(used_slots_ * page_size);
+
+    pages_.emplace(page, slot);
+}
+
+void pdb::memory_cache::erase(std::uint64_t page)
+{
+    pages_.erase(page);
+}
+
+void pdb::memory_cache::clear()
+{
+    if (pages_.empty())
+        return;
+
+    pages_.clear();
+    used_slots_ = 0;
+    ++stats_.invalidations;
+}
+
+void pdb::memory_cache::invalidate(std::uint64_t addr, std::size_t size)
+{
+    if (pages_.empty() or size == 0)
+        return;
+
+    for (auto page = page_of(addr); page < addr + size; page += page_size)
+        pages_.erase(page);
+
+    ++stats_.invalidations;
+}
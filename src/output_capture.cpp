@@ -0,0 +1,269 @@
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <libpdb/error.hpp>
+#include <libpdb/output_capture.hpp>
+
+namespace
+{
+    std::size_t round_up_to_power_of_two(std::size_t size)
+    {
+        std::size_t rounded = 4096;
+        while (rounded < size)
+            rounded <<= 1;
+        return rounded;
+    }
+}
+
+pdb::output_capture::output_capture(std::size_t ring_size)
+    : mask_(round_up_to_power_of_two(ring_size) - 1)
+{
+    // a bigger pipe means fewer wakeups for us and fewer blocked writes for the inferior while we are
+    // busy, it is only a wish, an unprivileged process can't go over pipe-max-size
+    for (auto &chan : channels_)
+        fcntl(chan.pipe.get_write(), F_SETPIPE_SZ, pipe_size);
+}
+
+pdb::output_capture::~output_capture()
+{
+    if (thread_.joinable())
+    {
+        std::uint64_t one = 1;
+        if (::write(wake_fd_, &one, sizeof(one)) < 0)
+        {
+            // the thread only sleeps in poll, closing the pipes would be the other way to end it
+        }
+        thread_.join();
+    }
+
+    if (wake_fd_ != -1)
+        close(wake_fd_);
+
+    for (auto &chan : channels_)
+    {
+        if (chan.log_fd != -1)
+            close(chan.log_fd);
+    }
+}
+
+void pdb::output_capture::log_to(output_stream stream, const std::filesystem::path &path)
+{
+    if (thread_.joinable())
+    {
+        error::send("Output logs are set up before the capture starts");
+    }
+
+    // no O_APPEND, splice refuses to write to those
+    auto fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        error::send_errno("Could not open " + path.string());
+    }
+
+    auto &chan = get(stream);
+    if (chan.log_fd != -1)
+        close(chan.log_fd);
+    chan.log_fd = fd;
+}
+
+void pdb::output_capture::attach(launch_options &options) const
+{
+    options.stdout_replacement = channels_[0].pipe.get_write();
+    options.stderr_replacement = channels_[1].pipe.get_write();
+}
+
+void pdb::output_capture::start()
+{
+    if (thread_.joinable())
+    {
+        error::send("The output capture has already started");
+    }
+
+    for (auto &chan : channels_)
+    {
+        // the inferior has its own copies now, with ours gone a stream ends when the inferior's end
+        chan.pipe.close_write();
+
+        auto fd = chan.pipe.get_read();
+        if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0)
+        {
+            error::send_errno("Could not make the output pipe non-blocking");
+        }
+
+        if (chan.log_fd == -1)
+            chan.ring.resize(mask_ + 1);
+    }
+
+    wake_fd_ = eventfd(0, EFD_CLOEXEC);
+    if (wake_fd_ < 0)
+    {
+        error::send_errno("Could not create the output capture eventfd");
+    }
+
+    thread_ = std::thread([this] { drain_loop(); });
+}
+
+void pdb::output_capture::drain_loop()
+{
+    for (;;)
+    {
+        pollfd fds[3];
+        channel *owners[2];
+        nfds_t count = 0;
+        for (auto &chan : channels_)
+        {
+            if (chan.ended)
+                continue;
+            owners[count] = &chan;
+            fds[count++] = {chan.pipe.get_read(), POLLIN, 0};
+        }
+        if (count == 0)
+            return;
+
+        fds[count] = {wake_fd_, POLLIN, 0};
+        if (poll(fds, count + 1, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+
+        // on the way out we still take what is already in the pipes
+        if (fds[count].revents)
+        {
+            for (nfds_t i = 0; i < count; ++i)
+                drain(*owners[i]);
+            return;
+        }
+
+        for (nfds_t i = 0; i < count; ++i)
+        {
+            if (fds[i].revents)
+                drain(*owners[i]);
+        }
+    }
+}
+
+bool pdb::output_capture::drain(channel &chan)
+{
+    auto open = chan.log_fd == -1 ? drain_to_ring(chan) : drain_to_log(chan);
+    if (!open)
+    {
+        std::lock_guard lock(mutex_);
+        chan.ended = true;
+        data_ready_.notify_all();
+    }
+    return open;
+}
+
+bool pdb::output_capture::drain_to_ring(channel &chan)
+{
+    auto size = mask_ + 1;
+    for (;;)
+    {
+        std::lock_guard lock(mutex_);
+
+        // one readv from the pipe into the ring, from head to the end and on from the start
+        // a full ring is read over, the bytes we lose that way are moved past below
+        auto start = chan.head & mask_;
+        iovec parts[2] = {{chan.ring.data() + start, size - start}, {chan.ring.data(), start}};
+        auto bytes = readv(chan.pipe.get_read(), parts, 2);
+        if (bytes < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return errno == EAGAIN;
+        }
+        if (bytes == 0)
+            return false;
+
+        chan.head += bytes;
+        if (chan.head - chan.tail > size)
+        {
+            chan.counters.dropped += chan.head - chan.tail - size;
+            chan.tail = chan.head - size;
+        }
+        chan.counters.bytes += bytes;
+        ++chan.counters.transfers;
+        data_ready_.notify_all();
+    }
+}
+
+bool pdb::output_capture::drain_to_log(channel &chan)
+{
+    for (;;)
+    {
+        auto bytes = splice(chan.pipe.get_read(), nullptr, chan.log_fd, nullptr, pipe_size,
+                            SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (bytes < 0 and errno == EINVAL)
+        {
+            // a log on a file system that can't splice, the bytes go through a buffer of ours then
+            char buffer[64 * 1024];
+            bytes = ::read(chan.pipe.get_read(), buffer, sizeof(buffer));
+            if (bytes > 0 and ::write(chan.log_fd, buffer, bytes) != bytes)
+                return false;
+        }
+        if (bytes < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return errno == EAGAIN;
+        }
+        if (bytes == 0)
+            return false;
+
+        std::lock_guard lock(mutex_);
+        chan.counters.bytes += bytes;
+        ++chan.counters.transfers;
+    }
+}
+
+std::size_t pdb::output_capture::read(output_stream stream, span<std::byte> out)
+{
+    std::lock_guard lock(mutex_);
+    auto &chan = get(stream);
+
+    auto count = std::min<std::uint64_t>(chan.head - chan.tail, out.size());
+    auto start = chan.tail & mask_;
+    auto first = std::min<std::uint64_t>(count, mask_ + 1 - start);
+    std::memcpy(out.data(), chan.ring.data() + start, first);
+    std::memcpy(out.data() + first, chan.ring.data(), count - first);
+    chan.tail += count;
+    return count;
+}
+
+std::string pdb::output_capture::take(output_stream stream)
+{
+    std::string text;
+    {
+        std::lock_guard lock(mutex_);
+        auto &chan = get(stream);
+        text.resize(chan.head - chan.tail);
+    }
+    auto count = read(stream, {reinterpret_cast<std::byte *>(text.data()), text.size()});
+    text.resize(count);
+    return text;
+}
+
+bool pdb::output_capture::wait_for_data(output_stream stream, std::chrono::milliseconds timeout)
+{
+    std::unique_lock lock(mutex_);
+    auto &chan = get(stream);
+    return data_ready_.wait_for(lock, timeout, [&] { return chan.head != chan.tail or chan.ended; });
+}
+
+bool pdb::output_capture::wait_for_end(std::chrono::milliseconds timeout)
+{
+    std::unique_lock lock(mutex_);
+    return data_ready_.wait_for(lock, timeout, [&] { return channels_[0].ended and channels_[1].ended; });
+}
+
+pdb::output_capture::stats pdb::output_capture::get_stats(output_stream stream)
+{
+    std::lock_guard lock(mutex_);
+    return get(stream).counters;
+}
@@ -1,106 +1,472 @@
 #include <libpdb/process.hpp>
 #include <libpdb/error.hpp>
 #include <libpdb/pipe.hpp>
+#include <libpdb/trace.hpp>
+#include <syscall_probes.hpp>
 
 #include <sys/ptrace.h>
+#include <signal.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
+#include <sys/prctl.h>
+#include <sys/auxv.h>
+#include <sys/syscall.h>
+#include <sched.h>
+#include <pthread.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <chrono>
 
 namespace
 {
-    // writes the error representation to the pipe
-    void exit_with_perror(pdb::pipe &channel, std::string const &prefix)
+    // the step of a launch that failed in the child, the parent turns it into the message
+    enum class launch_step : int
     {
-        // get the error msg based on errno
-        auto message = prefix + ": " + std::strerror(errno);
-        channel.write(
-            reinterpret_cast<std::byte *>(message.data()),
-            message.size());
-        exit(-1);
+        redirect_stdin,
+        redirect_stdout,
+        redirect_stderr,
+        change_directory,
+        trace,
+        no_new_privs,
+        install_filter,
+        exec
+    };
+
+    struct launch_failure
+    {
+        launch_step step;
+        int error;
+    };
+
+    std::string launch_step_message(launch_step step)
+    {
+        switch (step)
+        {
+        case launch_step::redirect_stdin: return "stdin replacement failed";
+        case launch_step::redirect_stdout: return "stdout replacement failed";
+        case launch_step::redirect_stderr: return "stderr replacement failed";
+        case launch_step::change_directory: return "Could not change directory";
+        case launch_step::trace: return "Tracing failed";
+        case launch_step::no_new_privs: return "Could not set no_new_privs";
+        case launch_step::install_filter: return "Could not install the syscall filter";
+        case launch_step::exec: return "exec failed";
+        }
+        return "launch failed";
+    }
+
+    // everything the child does between the fork and the exec, prepared by the parent
+    // the child allocates nothing and throws nothing: after a vfork it runs on our memory, and after a fork
+    // of a threaded debugger another thread may have held the malloc lock
+    struct child_setup
+    {
+        const char *path;
+        char *const *argv;
+        char *const *envp;
+        // nullptr keeps ours
+        const char *working_directory;
+        // dup2'd onto stdin, stdout and stderr, -1 leaves the stream alone
+        int redirections[3];
+        bool trace;
+        // fork only: stop until the parent set PTRACE_O_TRACESECCOMP, then install this filter
+        const sock_fprog *filter;
+        int error_fd;
+        // what the parent had before it blocked every signal around the vfork
+        sigset_t signal_mask;
+    };
+
+    // reports the step and errno through the pipe, the parent reads it once our end closes
+    [[noreturn]] void fail_launch(const child_setup &setup, launch_step step)
+    {
+        launch_failure failure{step, errno};
+        [[maybe_unused]] auto written = ::write(setup.error_fd, &failure, sizeof(failure));
+        _exit(127);
+    }
+
+    int run_child(void *arg)
+    {
+        auto &setup = *static_cast<const child_setup *>(arg);
+
+        // a handler we inherited would run on the parent's memory after a vfork
+        for (int signal = 1; signal < NSIG; ++signal)
+        {
+            struct sigaction action;
+            if (sigaction(signal, nullptr, &action) == 0 and action.sa_handler != SIG_DFL and action.sa_handler != SIG_IGN)
+            {
+                action = {};
+                action.sa_handler = SIG_DFL;
+                sigaction(signal, &action, nullptr);
+            }
+        }
+
+        // the program starts with the mask of whoever launched it, minus SIGCHLD: a pdb::session blocks that
+        // one for its signalfd, and a shell or anything else that forks and waits for SIGCHLD would never get it
+        auto signal_mask = setup.signal_mask;
+        sigdelset(&signal_mask, SIGCHLD);
+        sigprocmask(SIG_SETMASK, &signal_mask, nullptr);
+
+        for (int stream = 0; stream < 3; ++stream)
+        {
+            auto fd = setup.redirections[stream];
+            if (fd < 0)
+                continue;
+
+            // dup2 onto itself leaves close on exec set
+            auto failed = fd == stream ? fcntl(fd, F_SETFD, 0) < 0 : dup2(fd, stream) < 0;
+            if (failed)
+                fail_launch(setup, static_cast<launch_step>(static_cast<int>(launch_step::redirect_stdin) + stream));
+        }
+
+        if (setup.working_directory and chdir(setup.working_directory) < 0)
+            fail_launch(setup, launch_step::change_directory);
+
+        if (setup.trace and ptrace(PTRACE_TRACEME, 0, nullptr, nullptr) < 0)
+            fail_launch(setup, launch_step::trace);
+
+        if (setup.filter)
+        {
+            // without PTRACE_O_TRACESECCOMP a SECCOMP_RET_TRACE syscall fails with ENOSYS, execve included
+            // so we stop until the parent has set it
+            raise(SIGSTOP);
+
+            // a filter needs no_new_privs unless we have CAP_SYS_ADMIN
+            if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0)
+                fail_launch(setup, launch_step::no_new_privs);
+            if (syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, 0, setup.filter) < 0)
+                fail_launch(setup, launch_step::install_filter);
+        }
+
+        execve(setup.path, setup.argv, setup.envp);
+        fail_launch(setup, launch_step::exec);
+    }
+
+    // what execlp would run, searched for in the parent since the child can't allocate
+    // a name that isn't found is kept as it is and the exec reports ENOENT
+    std::string find_program(const std::filesystem::path &path)
+    {
+        auto name = path.string();
+        if (name.find('/') != std::string::npos)
+            return name;
+
+        auto search = std::getenv("PATH");
+        std::string_view directories = search ? search : "/usr/local/bin:/usr/bin:/bin";
+        while (!directories.empty())
+        {
+            auto end = directories.find(':');
+            auto directory = directories.substr(0, end);
+            auto candidate = (directory.empty() ? std::string(".") : std::string(directory)) + "/" + name;
+            if (access(candidate.c_str(), X_OK) == 0)
+                return candidate;
+            if (end == std::string_view::npos)
+                break;
+            directories.remove_prefix(end + 1);
+        }
+        return name;
+    }
+
+    // every thread of a process has an entry in /proc/<pid>/task
+    std::vector<pid_t> list_threads(pid_t pid)
+    {
+        std::vector<pid_t> tids;
+        std::error_code ec;
+        for (auto &entry : std::filesystem::directory_iterator("/proc/" + std::to_string(pid) + "/task", ec))
+        {
+            tids.push_back(std::stoi(entry.path().filename().string()));
+        }
+        return tids;
+    }
+
+    // a new thread reports a PTRACE_EVENT_CLONE on its parent before it runs
+    bool is_clone_event(int wait_status)
+    {
+        return WIFSTOPPED(wait_status) and (wait_status >> 8) == (SIGTRAP | (PTRACE_EVENT_CLONE << 8));
+    }
+
+    bool is_seccomp_event(int wait_status)
+    {
+        return WIFSTOPPED(wait_status) and (wait_status >> 8) == (SIGTRAP | (PTRACE_EVENT_SECCOMP << 8));
+    }
+
+    // with PTRACE_O_TRACESYSGOOD syscall stops report SIGTRAP | 0x80 so they can't be mistaken for a real SIGTRAP
+    bool is_syscall_stop(int wait_status)
+    {
+        return WIFSTOPPED(wait_status) and (WSTOPSIG(wait_status) == (SIGTRAP | 0x80) or is_seccomp_event(wait_status));
+    }
+
+    bool uses_seccomp(const pdb::syscall_catch_policy &policy)
+    {
+        return policy.get_mode() == pdb::syscall_catch_policy::mode::some and policy.backend() == pdb::syscall_trace_backend::seccomp;
+    }
+
+    long ptrace_options(const pdb::syscall_catch_policy &policy)
+    {
+        long options = PTRACE_O_TRACECLONE;
+        if (policy.get_mode() != pdb::syscall_catch_policy::mode::none)
+            options |= PTRACE_O_TRACESYSGOOD;
+        if (uses_seccomp(policy))
+            options |= PTRACE_O_TRACESECCOMP;
+        return options;
+    }
+
+    // allows everything except the syscalls we catch, those return SECCOMP_RET_TRACE and stop the inferior
+    // each id is a compare and a return so the jumps never go past the 255 instructions a BPF jump can reach
+    std::vector<sock_filter> make_syscall_filter(const std::vector<int> &to_catch)
+    {
+        std::vector<sock_filter> filter = {
+            // other architectures (eg. 32 bit code) have other syscall numbers, we leave them alone
+            BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, arch)),
+            BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, AUDIT_ARCH_X86_64, 1, 0),
+            BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+            BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, nr)),
+        };
+
+        for (auto id : to_catch)
+        {
+            filter.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, static_cast<std::uint32_t>(id), 0, 1));
+            filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_TRACE));
+        }
+
+        filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+        return filter;
     }
+
+    // the stop we asked for, and the one every new thread starts with
+    // a seized thread reports PTRACE_EVENT_STOP with SIGTRAP for both, otherwise it is a plain SIGSTOP
+    bool is_stop_request(int wait_status, bool seized)
+    {
+        if (!WIFSTOPPED(wait_status))
+            return false;
+        if (seized)
+            return (wait_status >> 16) == PTRACE_EVENT_STOP and WSTOPSIG(wait_status) == SIGTRAP;
+        return WSTOPSIG(wait_status) == SIGSTOP and (wait_status >> 16) == 0;
+    }
+}
+
+pdb::process::process(pid_t pid, bool terminate_on_end, bool is_attached)
+    : pid_(pid), terminate_on_end_(terminate_on_end), is_attached_(is_attached)
+{
+    // the main thread always has its registers, they are what get_registers() hands out by default
+    auto &main = add_thread(pid);
+    main.regs.reset(new registers(*this, pid));
+    current_tid_ = pid;
+    current_registers_ = main.regs.get();
+}
+
+std::unique_ptr<pdb::process> pdb::process::launch(std::filesystem::path path, bool debug, std::optional<int> stdout_replacement,
+                                                   const syscall_catch_policy &syscalls)
+{
+    launch_options options;
+    options.debug = debug;
+    options.stdout_replacement = stdout_replacement;
+    options.syscalls = syscalls;
+    return launch(std::move(path), options);
 }
 
 // this function executes the process and waits for it to halt
-// optional indicatest that this arg can be empty thats why the null check
-std::unique_ptr<pdb::process> pdb::process::launch(std::filesystem::path path, bool debug, std::optional<int> stdout_replacement)
+std::unique_ptr<pdb::process> pdb::process::launch(std::filesystem::path path, const launch_options &options)
 {
+    trace::scope traced(trace::event::launch, 0, 0);
+
     // we set close on exec as true bcoz we dont want to leave the fd hanging
     pipe channel(/*close_on_exec=*/true);
 
-    pid_t pid;
+    // the filter is built here, the child only installs it
+    auto seccomp = options.debug and uses_seccomp(options.syscalls);
+    std::vector<sock_filter> filter;
+    if (seccomp)
+        filter = make_syscall_filter(options.syscalls.get_to_catch());
+    sock_fprog program{static_cast<unsigned short>(filter.size()), filter.data()};
+
+    // argv and envp are pointers into strings that outlive the child's use of them
+    auto program_path = find_program(path);
+    auto first_argument = path.string();
+    std::vector<char *> argv{first_argument.data()};
+    auto arguments = options.arguments;
+    for (auto &argument : arguments)
+        argv.push_back(argument.data());
+    argv.push_back(nullptr);
 
-    // when we call fork this program gets duplicated into new process
-    // the two process differs in pid ie the child has 0 and parent has pid of child
-    if ((pid = fork()) < 0)
+    std::vector<std::string> environment_strings;
+    std::vector<char *> envp;
+    if (options.environment)
     {
-        // Error: fork failed
-        error::send_errno("fork failed");
+        environment_strings = *options.environment;
+        for (auto &entry : environment_strings)
+            envp.push_back(entry.data());
+        envp.push_back(nullptr);
     }
+    auto working_directory = options.working_directory.string();
 
-    if (pid == 0)
+    child_setup setup{};
+    setup.path = program_path.c_str();
+    setup.argv = argv.data();
+    setup.envp = options.environment ? envp.data() : environ;
+    setup.working_directory = working_directory.empty() ? nullptr : working_directory.c_str();
+    setup.redirections[0] = options.stdin_replacement.value_or(-1);
+    setup.redirections[1] = options.stdout_replacement.value_or(-1);
+    setup.redirections[2] = options.stderr_replacement.value_or(-1);
+    setup.trace = options.debug;
+    setup.filter = seccomp ? &program : nullptr;
+    setup.error_fd = channel.get_write();
+
+    pid_t pid;
+
+    // the seccomp child has to stop for us before its exec, a vfork parent would wait on it forever
+    if (options.method == launch_method::vfork and !seccomp)
     {
-        // if we are inside the process we ensure that we will not perform read operations
-        channel.close_read();
-        
-        // nullcheck for the replacement
-        if(stdout_replacement)
-        {   
-            // dup2 is a syscall which closes the second File Descriptor arg and then duplicates teh first fd to the second
-            // simple temrss anything that goes through stdout now goes through whaterver *stdout_replacement points to 
-            if(dup2(*stdout_replacement, STDOUT_FILENO) < 0)
-            {
-                exit_with_perror(channel, "stdout replacement failed");
-            }
+        // we are suspended until the child execs or exits, it runs on this stack of ours meanwhile
+        // every signal is blocked so no handler of ours runs in the child, which unblocks them again
+        std::vector<std::byte> child_stack(64 * 1024);
+        sigset_t all;
+        sigfillset(&all);
+        pthread_sigmask(SIG_SETMASK, &all, &setup.signal_mask);
+
+        pid = clone(run_child, child_stack.data() + child_stack.size(), CLONE_VM | CLONE_VFORK | SIGCHLD, &setup);
+        auto saved_errno = errno;
+        pthread_sigmask(SIG_SETMASK, &setup.signal_mask, nullptr);
+        if (pid < 0)
+        {
+            errno = saved_errno;
+            error::send_errno("clone failed");
         }
+    }
+    else
+    {
+        pthread_sigmask(SIG_SETMASK, nullptr, &setup.signal_mask);
 
-        // we attach this process(child) by PTRACE_TRACEME
-        if (debug and ptrace(PTRACE_TRACEME, 0, nullptr, nullptr) < 0)
+        // when we call fork this program gets duplicated into new process
+        // the two process differs in pid ie the child has 0 and parent has pid of child
+        if ((pid = fork()) < 0)
         {
-            // Error: Trace Failed
-            exit_with_perror(channel, "Tracing failed");
+            // Error: fork failed
+            error::send_errno("fork failed");
         }
 
-        // execute the program passed in arguments
-        if (execlp(path.c_str(), path.c_str(), nullptr) < 0)
+        if (pid == 0)
         {
-            // Error: exec failed
-            exit_with_perror(channel, "exec failed");
+            // if we are inside the process we ensure that we will not perform read operations
+            channel.close_read();
+            run_child(&setup);
         }
     }
 
     channel.close_write();
+    traced.set_pid(pid);
+
+    // the child holds the pipe open while it waits for us, so this comes before the read
+    if (seccomp)
+    {
+        int wait_status;
+        if (sys::waitpid(pid, &wait_status, 0) < 0)
+        {
+            error::send_errno("waitpid failed");
+        }
+
+        // if it didn't stop it already failed and the reason is in the pipe
+        if (WIFSTOPPED(wait_status))
+        {
+            if (sys::ptrace(PTRACE_SETOPTIONS, pid, nullptr, ptrace_options(options.syscalls)) < 0 or
+                sys::ptrace(PTRACE_CONT, pid, nullptr, nullptr) < 0)
+            {
+                kill(pid, SIGKILL);
+                sys::waitpid(pid, nullptr, 0);
+                error::send_errno("Could not set ptrace options");
+            }
+        }
+    }
+
+    // nothing comes through unless the child failed, the exec closes the pipe
     auto data = channel.read();
     channel.close_read();
 
-    if (data.size() > 0)
+    if (data.size() >= sizeof(launch_failure))
     {
-        waitpid(pid, nullptr, 0);
-        auto chars = reinterpret_cast<char *>(data.data());
-        error::send(std::string(chars, chars + data.size()));
+        sys::waitpid(pid, nullptr, 0);
+        launch_failure failure;
+        std::memcpy(&failure, data.data(), sizeof(failure));
+        error::send(launch_step_message(failure.step) + ": " + std::strerror(failure.error));
     }
 
     // create a new process and set terminate on end as true as we want to end it on termination of the parent program
-    std::unique_ptr<process> proc(new process(pid, /*terminate_on_end=*/true, debug));
+    std::unique_ptr<process> proc(new process(pid, /*terminate_on_end=*/true, options.debug));
+    proc->syscall_catch_policy_ = options.syscalls;
 
     // stop the process after attach to it
-    // it will stop at the entry of the program
-    if (debug)
+    // it will stop at the entry of the program, or at the execve itself if that is a syscall we catch
+    if (options.debug)
+    {
         proc->wait_on_signal();
+        proc->set_ptrace_options(pid);
+    }
 
     return proc;
 }
 
 // here we attach the process via the pid to the running process or debugger(parent)
-std::unique_ptr<pdb::process> pdb::process::attach(pid_t pid)
+std::unique_ptr<pdb::process> pdb::process::attach(pid_t pid, attach_mode mode)
 {
+    trace::scope traced(trace::event::attach, pid, pid);
+
     if (pid == 0)
     {
         // Error: Invalid pid
         error::send("Invalid PID");
     }
 
-    if (ptrace(PTRACE_ATTACH, pid, nullptr, nullptr) < 0)
+    if (mode == attach_mode::seize)
+    {
+        // PTRACE_SEIZE only makes us the tracer, the process keeps running until we interrupt it
+        if (sys::ptrace(PTRACE_SEIZE, pid, nullptr, PTRACE_O_TRACECLONE) < 0)
+        {
+            error::send_errno("Could not attach");
+        }
+
+        std::unique_ptr<process> proc(new process(pid, /*terminate_on_end=*/false, /*attached=*/true));
+        proc->seized_ = true;
+        proc->state_ = process_state::running;
+        proc->threads_.front().state = process_state::running;
+
+        // seize every thread, then interrupt them all in one pass
+        // threads started meanwhile are picked up on the next pass, the stopped ones can't start any
+        for (bool seized = true; seized;)
+        {
+            seized = false;
+            for (auto tid : list_threads(pid))
+            {
+                if (proc->find_thread(tid))
+                    continue;
+
+                if (sys::ptrace(PTRACE_SEIZE, tid, nullptr, PTRACE_O_TRACECLONE) < 0)
+                {
+                    // it exited before we got to it
+                    if (errno == ESRCH)
+                        continue;
+                    error::send_errno("Could not attach to thread " + std::to_string(tid));
+                }
+
+                proc->add_thread(tid).state = process_state::running;
+                seized = true;
+            }
+
+            proc->stop_all_threads();
+        }
+
+        proc->state_ = process_state::stopped;
+        return proc;
+    }
+
+    if (sys::ptrace(PTRACE_ATTACH, pid, nullptr, nullptr) < 0)
     {
         // Error: could not attach
         error::send_errno("Could not attach");
@@ -110,6 +476,40 @@ std::unique_ptr<pdb::process> pdb::process::attach(pid_t pid)
 
     // wait for the process to stop at the entry of the program
     proc->wait_on_signal();
+    proc->set_ptrace_options(pid);
+
+    // every other thread needs an attach of its own
+    // a thread started while we go is picked up on the next pass, the ones we hold can't start any
+    for (bool attached = true; attached;)
+    {
+        attached = false;
+        for (auto tid : list_threads(pid))
+        {
+            if (proc->find_thread(tid))
+                continue;
+
+            if (sys::ptrace(PTRACE_ATTACH, tid, nullptr, nullptr) < 0)
+            {
+                // it exited before we got to it
+                if (errno == ESRCH)
+                    continue;
+                error::send_errno("Could not attach to thread " + std::to_string(tid));
+            }
+
+            int wait_status;
+            if (sys::waitpid(tid, &wait_status, __WALL) < 0)
+            {
+                error::send_errno("waitpid failed");
+            }
+
+            attached = true;
+            if (!WIFSTOPPED(wait_status))
+                continue;
+
+            proc->set_ptrace_options(tid);
+            proc->add_thread(tid);
+        }
+    }
 
     return proc;
 }
@@ -121,44 +521,323 @@ pdb::process::~process()
     {
         int status;
 
-        if (is_attached_)
+        // a process we are about to kill is not worth cleaning up and detaching from
+        if (is_attached_ and !terminate_on_end_)
         {
+            detach();
+        }
 
-            // inferior(child) must be stopped before we can detach
-            if (state_ == process_state::running)
-            {
-                // SIGSTOP stops the process
-                kill(pid_, SIGSTOP);
-                // we wait for it to stop by using status flag
-                waitpid(pid_, &status, 0);
-            }
-
-            // detch the inferior
-            ptrace(PTRACE_DETACH, pid_, nullptr, nullptr);
-
-            // let it continue
-            kill(pid_, SIGCONT);
+        if (memory_fd_ != -1)
+        {
+            close(memory_fd_);
         }
 
         // depending upon whether to terminate on end or not we simply kill the process
         // and then we wait for it to terminate
         if (terminate_on_end_)
         {
+            // the main thread can only be reaped once the threads we still trace are, including
+            // the ones whose clone event we never saw
+            auto tids = list_threads(pid_);
             kill(pid_, SIGKILL);
-            waitpid(pid_, &status, 0);
+
+            if (is_attached_)
+            {
+                for (auto tid : tids)
+                {
+                    if (tid != pid_)
+                        sys::waitpid(tid, &status, __WALL);
+                }
+            }
+            sys::waitpid(pid_, &status, __WALL);
+        }
+    }
+}
+
+std::unordered_map<int, std::uint64_t> pdb::process::get_auxv() const
+{
+    auto path = "/proc/" + std::to_string(pid_) + "/auxv";
+    auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        error::send_errno("Could not open auxv");
+    }
+
+    // the vector is a list of (type, value) pairs ended by AT_NULL
+    std::unordered_map<int, std::uint64_t> auxv;
+    std::uint64_t entry[2];
+    while (read(fd, entry, sizeof(entry)) == sizeof(entry))
+    {
+        if (entry[0] == AT_NULL)
+            break;
+        auxv[entry[0]] = entry[1];
+    }
+
+    close(fd);
+    return auxv;
+}
+
+// nothing in here throws, it also runs from the destructor
+void pdb::process::detach()
+{
+    if (!is_attached_)
+        return;
+
+    // inferior(child) must be stopped before we can detach, that goes for every thread
+    // a seized process gets a PTRACE_INTERRUPT per thread, nothing it can see
+    try
+    {
+        stop_all_threads();
+    }
+    catch (const error &)
+    {
+    }
+
+    // take our int3s out, a process we leave running must not trap on them
+    // the cleanup is skipped entirely when there is nothing to undo, so a plain attach and detach
+    // keeps the target stopped only for the interrupt and the detach
+    if (!terminate_on_end_)
+    {
+        try
+        {
+            std::vector<breakpoint_site *> sites;
+            breakpoint_sites_.for_each([&](auto &site) {
+                if (site.is_enabled())
+                    sites.push_back(&site);
+            });
+            if (!sites.empty())
+                disable_breakpoint_sites(sites);
+
+            watchpoints_.for_each([](auto &point) {
+                if (point.is_enabled())
+                    point.disable();
+            });
+
+            for (auto &thread : threads_)
+            {
+                if (thread.regs and thread.regs->dirty())
+                    thread.regs->flush();
+            }
         }
+        catch (const error &)
+        {
+        }
+    }
+
+    // detch the inferior, the main thread last
+    for (auto it = threads_.rbegin(); it != threads_.rend(); ++it)
+    {
+        sys::ptrace(PTRACE_DETACH, it->tid, nullptr, nullptr);
+    }
+
+    // let it continue, PTRACE_ATTACH and our SIGSTOPs may have left it in a group stop
+    // a seized process never got a SIGSTOP from us, so it doesn't get a SIGCONT either
+    if (!seized_)
+    {
+        kill(pid_, SIGCONT);
     }
+
+    is_attached_ = false;
+    if (state_ == process_state::stopped)
+        state_ = process_state::running;
 }
 
 // we use PTRACE_CONT to continue the process and to keep track on the process we update the state variable
 void pdb::process::resume()
 {
-    if (ptrace(PTRACE_CONT, pid_, nullptr, nullptr) < 0)
+    try_resume().value();
+}
+
+pdb::expected<void> pdb::process::try_resume()
+{
+    trace::scope traced(trace::event::resume, pid_, pid_);
+
+    if (state_ == process_state::exited or state_ == process_state::terminated)
+    {
+        return error_code{errc::process_ended};
+    }
+
+    for (auto &thread : threads_)
+    {
+        if (thread.regs and thread.regs->in_transaction())
+        {
+            return error_code{errc::open_register_transaction};
+        }
+    }
+
+    // push any buffered register writes before the inferior runs
+    for (auto &thread : threads_)
+    {
+        if (thread.regs)
+        {
+            if (auto result = thread.regs->try_flush(); !result)
+                return result;
+        }
+    }
+
+    // a stop we collected while stopping the other threads is reported before anything runs again,
+    // so nothing is resumed and the next wait_on_signal returns it straight away
+    auto pending = [this] {
+        return std::any_of(threads_.begin(), threads_.end(), [](auto &thread) { return thread.pending_status.has_value(); });
+    };
+    std::uint32_t resumed = 0;
+    if (!pending() and (!breakpoint_sites_.empty() or !watchpoints_.empty()))
+    {
+        for (auto &thread : threads_)
+        {
+            if (thread.state == process_state::stopped and (thread.reported or thread.tid == current_tid_))
+            {
+                if (auto result = step_over_stoppoint(thread); !result)
+                    return result;
+            }
+        }
+        drop_exited_threads();
+    }
+
+    // the same goes for a signal or an exit that came in while stepping over a stoppoint
+    if (!pending())
     {
-        error::send_errno("Could not resume");
+        // the main thread is first in the table, if it can't be resumed we fail before touching the rest
+        for (auto &thread : threads_)
+        {
+            if (thread.state != process_state::stopped)
+                continue;
+
+            if (sys::ptrace(static_cast<__ptrace_request>(resume_request(thread)), thread.tid, nullptr, nullptr) < 0)
+            {
+                // a thread on its way out, we hear about its exit from waitpid
+                if (errno == ESRCH and thread.tid != pid_)
+                    continue;
+                return last_error(errc::resume_failed);
+            }
+
+            thread.state = process_state::running;
+            thread.reported = false;
+            ++resumed;
+
+            // the register values we cached are stale as soon as the thread runs again
+            if (thread.regs)
+                thread.regs->invalidate();
+        }
     }
 
     state_ = process_state::running;
+    memory_cache_.clear();
+    traced.set_arg(resumed);
+    return {};
+}
+
+// if we are sitting on an enabled breakpoint we take the int3 (or the execute watchpoint) out,
+// execute the real instruction with a single step and put it back before continuing
+pdb::expected<void> pdb::process::step_over_stoppoint(thread_state &thread)
+{
+    auto &regs = get_registers(thread.tid);
+    auto rip = regs.try_read(register_info_by_id(register_id::rip));
+    if (!rip)
+        return rip.error();
+    auto pc = virt_addr(std::get<std::uint64_t>(*rip));
+    breakpoint_site *site = breakpoint_sites_.enabled_stoppoint_at_address(pc) ? &breakpoint_sites_.get_by_address(pc) : nullptr;
+    watchpoint *hardware = watchpoints_.enabled_stoppoint_at_address(pc) ? &watchpoints_.get_by_address(pc) : nullptr;
+
+    // data watchpoints fire after the access, only execute ones stop before the instruction
+    if (hardware and hardware->mode() != stoppoint_mode::execute)
+        hardware = nullptr;
+
+    if (!site and !hardware)
+        return {};
+
+    if (site)
+        site->disable();
+    if (hardware)
+        hardware->disable();
+
+    // the step must see the debug registers without the execute watchpoint
+    if (auto result = regs.try_flush(); !result)
+        return result;
+
+    int wait_status;
+    for (;;)
+    {
+        if (sys::ptrace(PTRACE_SINGLESTEP, thread.tid, nullptr, nullptr) < 0)
+        {
+            return last_error(errc::single_step_failed);
+        }
+
+        if (sys::waitpid(thread.tid, &wait_status, __WALL) < 0)
+        {
+            return last_error(errc::wait_failed);
+        }
+
+        // a SIGSTOP we sent earlier can show up before the step, then the instruction has not run yet
+        if (thread.stop_requested and is_stop_request(wait_status, seized_))
+        {
+            thread.stop_requested = false;
+            continue;
+        }
+        break;
+    }
+
+    // only a SIGTRAP means the instruction ran
+    if (!WIFSTOPPED(wait_status) or WSTOPSIG(wait_status) != SIGTRAP)
+        return hold_step_status(thread, wait_status, site, hardware);
+
+    // the inferior ran one instruction
+    regs.invalidate();
+    memory_cache_.clear();
+
+    if (site)
+        site->enable();
+    if (hardware)
+        hardware->enable();
+
+    return regs.try_flush();
+}
+
+// a signal that came in before the step stops the thread still sitting on the stoppoint, and the thread can
+// also be gone; either is kept for the next wait_on_signal the way collect_requested_stops keeps them, so
+// the signal is reported instead of lost and the stoppoint is not reported a second time
+pdb::expected<void> pdb::process::hold_step_status(thread_state &thread, int wait_status, breakpoint_site *site, watchpoint *hardware)
+{
+    if (WIFSTOPPED(wait_status))
+    {
+        thread.pending_status = wait_status;
+    }
+    else
+    {
+        thread.state = stop_reason(wait_status).reason;
+        if (thread.regs)
+            thread.regs->invalidate();
+
+        // the main thread exits last, with it the whole process is gone and there is nothing to put back
+        if (thread.tid == pid_)
+        {
+            thread.pending_status = wait_status;
+            return {};
+        }
+
+        // the watchpoint below goes in through the current thread's debug registers
+        if (thread.tid == current_tid_)
+            set_current_thread(pid_);
+    }
+
+    if (site)
+        site->enable();
+    if (hardware)
+        hardware->enable();
+
+    if (thread.state != process_state::stopped)
+        return {};
+    return get_registers(thread.tid).try_flush();
+}
+
+// the threads that exited leave the table, the main thread stays until its exit is reported
+void pdb::process::drop_exited_threads()
+{
+    threads_.erase(std::remove_if(threads_.begin() + 1, threads_.end(), [](auto &thread) {
+        return thread.state == process_state::exited or thread.state == process_state::terminated;
+    }), threads_.end());
+    if (!find_thread(current_tid_))
+        set_current_thread(pid_);
 }
 
 // wait_status holds the exit signal or signal status
@@ -202,83 +881,1172 @@ pdb::stop_reason::stop_reason(int wait_status)
 // such as terminating or stopping due to a signal.
 pdb::stop_reason pdb::process::wait_on_signal()
 {
-    int wait_status;
-    int options = 0;
+    return try_wait_on_signal().value();
+}
 
-    if (waitpid(pid_, &wait_status, options) < 0)
-    {
-        error::send_errno("waitpid failed");
-    }
+pdb::expected<pdb::stop_reason> pdb::process::try_wait_on_signal()
+{
+    auto pending = take_pending_stop();
+    if (!pending)
+        return pending.error();
+    if (*pending)
+        return **pending;
 
-    stop_reason reason(wait_status);
-    state_ = reason.reason;
-    
-    // every time the inferior is not terminated and stopped then we read all the register values
-    if(is_attached_ and state_ == process_state::stopped)
+    // clone events, new threads and thread exits are handled on the way and not reported
+    for (;;)
     {
-        read_all_registers();
-    }
+        auto waiting = trace::recording() ? trace::now() : 0;
+        auto waited = wait_for_thread();
+        if (waiting)
+            trace::emit(trace::event::wait, pid_, pid_, waiting);
+        if (!waited)
+            return waited.error();
 
-    return reason;
+        auto [tid, wait_status] = *waited;
+        auto reason = handle_wait_status(tid, wait_status);
+        if (!reason)
+            return reason.error();
+        if (*reason)
+            return **reason;
+    }
 }
 
-void pdb::process::read_all_registers()
+pdb::expected<std::optional<pdb::stop_reason>> pdb::process::take_pending_stop()
 {
-    // read all the gpr and store them in the data_.regs  
-    if(ptrace(PTRACE_GETREGS, pid_, nullptr, &get_registers().data_.regs) < 0)
+    for (std::size_t i = 0; i < threads_.size(); ++i)
     {
-        error::send_errno("Could not read GPR registers");
+        if (!threads_[i].pending_status)
+            continue;
+
+        auto wait_status = *threads_[i].pending_status;
+        threads_[i].pending_status.reset();
+        auto reason = handle_wait_status(threads_[i].tid, wait_status);
+        if (!reason or *reason)
+            return reason;
     }
-    
-    // read all the fpr and store them in the data_.i387 
-    if(ptrace(PTRACE_GETFPREGS, pid_, nullptr, &get_registers().data_.i387) < 0)
+    return std::optional<stop_reason>();
+}
+
+pdb::expected<std::pair<pid_t, int>> pdb::process::wait_for_thread()
+{
+    int wait_status;
+
+    // __WALL as threads other than the main one count as clone children
+    if (threads_.size() == 1)
+    {
+        if (sys::waitpid(pid_, &wait_status, __WALL) < 0)
+        {
+            return last_error(errc::wait_failed);
+        }
+        return std::pair(pid_, wait_status);
+    }
+
+    // waitpid(-1) could reap a child that is not ours, so we peek first and only consume our own threads
+    for (;;)
+    {
+        siginfo_t info{};
+        if (sys::waitid(P_ALL, 0, &info, WEXITED | WSTOPPED | WNOWAIT | __WALL) < 0)
+        {
+            return last_error(errc::waitid_failed);
+        }
+
+        if (owns_thread(info.si_pid))
+        {
+            if (sys::waitpid(info.si_pid, &wait_status, __WALL) < 0)
+            {
+                return last_error(errc::wait_failed);
+            }
+            return std::pair(info.si_pid, wait_status);
+        }
+
+        // somebody else's child is first in line and will stay there, so we ask our threads one by one
+        for (auto &thread : threads_)
+        {
+            auto tid = thread.tid;
+            if (sys::waitpid(tid, &wait_status, WNOHANG | __WALL) > 0)
+                return std::pair(tid, wait_status);
+        }
+
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+// everything that happens once we know the new state, shared with pdb::session which does its own waiting
+pdb::expected<std::optional<pdb::stop_reason>> pdb::process::handle_wait_status(pid_t tid, int wait_status)
+{
+    if (!trace::recording())
+        return interpret_wait_status(tid, wait_status);
+
+    // the stop to report latency: from the status coming in to the reason going out
+    auto start = trace::now();
+    auto reason = interpret_wait_status(tid, wait_status);
+    auto reported = reason and *reason;
+    auto what = reported ? **reason : stop_reason(wait_status);
+    trace::emit(trace::event::stop, pid_, tid, start, trace::stop_arg(static_cast<int>(what.reason), what.info, reported));
+    return reason;
+}
+
+pdb::expected<std::optional<pdb::stop_reason>> pdb::process::interpret_wait_status(pid_t tid, int wait_status)
+{
+    using no_stop = std::optional<stop_reason>;
+
+    auto thread = find_thread(tid);
+    if (!thread)
+    {
+        // a new thread can report its first stop before its parent reports the clone
+        thread = &add_thread(tid);
+        thread->state = process_state::running;
+        thread->stop_requested = true;
+    }
+
+    std::optional<syscall_information> syscall;
+
+    if (WIFEXITED(wait_status) or WIFSIGNALED(wait_status))
+    {
+        // the main thread is reported last, its exit is the end of the whole process
+        if (tid != pid_)
+        {
+            remove_thread(tid);
+            return no_stop();
+        }
+
+        threads_.erase(threads_.begin() + 1, threads_.end());
+        set_current_thread(pid_);
+    }
+    else if (WIFSTOPPED(wait_status))
+    {
+        thread->state = process_state::stopped;
+
+        // we do not read the registers here, the register cache fetches each bank on first access
+        // so a stop where nobody looks at a register costs no extra syscalls
+        if (thread->regs)
+            thread->regs->on_stop();
+
+        if (is_clone_event(wait_status))
+        {
+            unsigned long new_tid;
+            if (sys::ptrace(PTRACE_GETEVENTMSG, tid, nullptr, &new_tid) < 0)
+            {
+                return last_error(errc::event_message_failed);
+            }
+
+            // the new thread starts with a SIGSTOP which we swallow below
+            if (!find_thread(new_tid))
+            {
+                auto &added = add_thread(new_tid);
+                added.state = process_state::running;
+                added.stop_requested = true;
+            }
+
+            // add_thread can move the table
+            thread = find_thread(tid);
+            if (state_ == process_state::running)
+            {
+                if (auto result = continue_thread(*thread); !result)
+                    return result.error();
+            }
+            return no_stop();
+        }
+
+        if (thread->stop_requested and is_stop_request(wait_status, seized_))
+        {
+            thread->stop_requested = false;
+
+            // debug registers are not inherited, a new thread gets the watchpoints the others have
+            if (!watchpoints_.empty())
+            {
+                auto &regs = get_registers(tid);
+                program_watchpoints(regs);
+                if (auto result = regs.try_flush(); !result)
+                    return result.error();
+            }
+
+            if (state_ == process_state::running)
+            {
+                if (auto result = continue_thread(*thread); !result)
+                    return result.error();
+            }
+            return no_stop();
+        }
+
+        if (is_syscall_stop(wait_status))
+        {
+            // read_syscall_stop reads from the general purpose registers, fetched here so it can't fail
+            if (auto result = get_registers(tid).ensure_banks(registers::gpr_bank); !result)
+                return result.error();
+
+            syscall = read_syscall_stop(*thread, wait_status);
+            if (!syscall)
+            {
+                if (state_ == process_state::running)
+                {
+                    if (auto result = continue_thread(*thread); !result)
+                        return result.error();
+                }
+                return no_stop();
+            }
+        }
+    }
+
+    stop_reason reason(wait_status);
+    state_ = reason.reason;
+    thread->state = reason.reason;
+
+    if (syscall)
+    {
+        reason.info = SIGTRAP;
+        reason.trap_reason = trap_type::syscall;
+        reason.syscall_info = syscall;
+    }
+
+    if(is_attached_ and state_ == process_state::stopped)
+    {
+        thread->reported = true;
+        set_current_thread(tid);
+
+        // only SIGTRAP stops with stoppoints set pay for the siginfo and the pc
+        if (reason.info == SIGTRAP and !syscall and (!breakpoint_sites_.empty() or !watchpoints_.empty()))
+        {
+            if (auto result = augment_stop_reason(tid, reason); !result)
+                return result.error();
+
+            // after hitting an int3 the pc is one past it, we move it back onto the instruction we replaced
+            if (reason.trap_reason == trap_type::software_break)
+            {
+                auto &rip = register_info_by_id(register_id::rip);
+                auto pc = get_registers().try_read(rip);
+                if (!pc)
+                    return pc.error();
+
+                auto instr_begin = virt_addr(std::get<std::uint64_t>(*pc)) - 1;
+                if (breakpoint_sites_.enabled_stoppoint_at_address(instr_begin))
+                {
+                    if (auto result = get_registers().try_write(rip, instr_begin.addr()); !result)
+                        return result.error();
+                }
+            }
+        }
+
+        if (all_stop_)
+        {
+            if (auto result = try_stop_all_threads(); !result)
+                return result.error();
+        }
+    }
+
+    return no_stop(reason);
+}
+
+pdb::expected<void> pdb::process::continue_thread(thread_state &thread)
+{
+    if (sys::ptrace(static_cast<__ptrace_request>(resume_request(thread)), thread.tid, nullptr, nullptr) < 0)
+    {
+        if (errno == ESRCH)
+            return {};
+        return last_error(errc::resume_thread_failed, thread.tid);
+    }
+
+    thread.state = process_state::running;
+    if (thread.regs)
+        thread.regs->invalidate();
+    return {};
+}
+
+void pdb::process::stop_all_threads()
+{
+    try_stop_all_threads().value();
+}
+
+pdb::expected<void> pdb::process::try_stop_all_threads()
+{
+    // first pass: ask every running thread to stop without waiting on any of them
+    for (auto &thread : threads_)
+    {
+        if (thread.state != process_state::running or thread.stop_requested)
+            continue;
+
+        auto ret = seized_ ? sys::ptrace(PTRACE_INTERRUPT, thread.tid, nullptr, nullptr) : sys::tgkill(pid_, thread.tid, SIGSTOP);
+        if (ret < 0)
+        {
+            // it is exiting, waitpid will tell us later
+            if (errno == ESRCH)
+                continue;
+            return last_error(errc::stop_thread_failed, thread.tid);
+        }
+        thread.stop_requested = true;
+    }
+
+    // second pass
+    return collect_requested_stops();
+}
+
+pdb::expected<void> pdb::process::collect_requested_stops()
+{
+    // new threads are appended as we go so we index instead of iterating
+    bool any_exited = false;
+    for (std::size_t i = 0; i < threads_.size(); ++i)
+    {
+        while (threads_[i].state == process_state::running and threads_[i].stop_requested)
+        {
+            auto tid = threads_[i].tid;
+            int wait_status;
+            if (sys::waitpid(tid, &wait_status, __WALL) < 0)
+            {
+                return last_error(errc::wait_failed);
+            }
+
+            if (is_stop_request(wait_status, seized_))
+            {
+                threads_[i].stop_requested = false;
+                threads_[i].state = process_state::stopped;
+            }
+            else if (WIFEXITED(wait_status) or WIFSIGNALED(wait_status))
+            {
+                threads_[i].stop_requested = false;
+                threads_[i].state = stop_reason(wait_status).reason;
+                if (tid == pid_)
+                    threads_[i].pending_status = wait_status;
+                else
+                    any_exited = true;
+            }
+            else if (is_clone_event(wait_status))
+            {
+                // the SIGSTOP we sent is still queued and gets swallowed once the thread runs again
+                threads_[i].state = process_state::stopped;
+
+                unsigned long new_tid;
+                if (sys::ptrace(PTRACE_GETEVENTMSG, tid, nullptr, &new_tid) < 0)
+                {
+                    return last_error(errc::event_message_failed);
+                }
+                if (!find_thread(new_tid))
+                {
+                    auto &added = add_thread(new_tid);
+                    added.state = process_state::running;
+                    added.stop_requested = true;
+                }
+            }
+            else
+            {
+                // something real happened on this thread, it is kept for the next wait_on_signal
+                threads_[i].state = process_state::stopped;
+                threads_[i].pending_status = wait_status;
+            }
+
+            if (threads_[i].state == process_state::stopped and threads_[i].regs)
+                threads_[i].regs->on_stop();
+        }
+    }
+
+    if (any_exited)
+        drop_exited_threads();
+    return {};
+}
+
+pdb::thread_state *pdb::process::find_thread(pid_t tid)
+{
+    for (auto &thread : threads_)
+    {
+        if (thread.tid == tid)
+            return &thread;
+    }
+    return nullptr;
+}
+
+pdb::thread_state &pdb::process::add_thread(pid_t tid)
+{
+    thread_state thread;
+    thread.tid = tid;
+    threads_.push_back(std::move(thread));
+    return threads_.back();
+}
+
+void pdb::process::remove_thread(pid_t tid)
+{
+    if (tid == current_tid_)
+        set_current_thread(pid_);
+
+    threads_.erase(std::remove_if(threads_.begin() + 1, threads_.end(), [&](auto &thread) { return thread.tid == tid; }), threads_.end());
+}
+
+bool pdb::process::owns_thread(pid_t tid) const
+{
+    for (auto &thread : threads_)
     {
-        error::send_errno("Could not read FPR registers");    
+        if (thread.tid == tid)
+            return true;
     }
 
-    // we cant simple loop over the enums of the debug registers then we use this approach
-    for(int i = 0; i < 8; i++)
+    // a thread whose clone event we have not seen yet
+    auto path = "/proc/" + std::to_string(pid_) + "/task/" + std::to_string(tid);
+    return access(path.c_str(), F_OK) == 0;
+}
+
+pdb::registers &pdb::process::get_registers(pid_t tid)
+{
+    auto thread = find_thread(tid);
+    if (!thread)
+    {
+        error::send("No thread with id " + std::to_string(tid));
+    }
+
+    if (!thread->regs)
+        thread->regs.reset(new registers(*this, tid));
+    return *thread->regs;
+}
+
+void pdb::process::set_current_thread(pid_t tid)
+{
+    current_registers_ = &get_registers(tid);
+    current_tid_ = tid;
+}
+
+void pdb::process::set_ptrace_options(pid_t tid)
+{
+    if (sys::ptrace(PTRACE_SETOPTIONS, tid, nullptr, ptrace_options(syscall_catch_policy_)) < 0)
+    {
+        error::send_errno("Could not set ptrace options");
+    }
+}
+
+int pdb::process::resume_request(const thread_state &thread) const
+{
+    // the exit stop of a syscall caught through seccomp is only reported to PTRACE_SYSCALL
+    if (thread.in_syscall)
+        return PTRACE_SYSCALL;
+
+    if (syscall_catch_policy_.get_mode() != syscall_catch_policy::mode::none and
+        syscall_catch_policy_.backend() == syscall_trace_backend::ptrace_syscall)
+        return PTRACE_SYSCALL;
+
+    return PTRACE_CONT;
+}
+
+std::optional<pdb::syscall_information> pdb::process::read_syscall_stop(thread_state &thread, int wait_status)
+{
+    auto &regs = get_registers(thread.tid);
+
+    syscall_information info;
+    info.id = regs.read_by_id_As<std::uint64_t>(register_id::orig_rax);
+
+    // a seccomp stop is always an entry, PTRACE_SYSCALL stops alternate between entry and exit
+    info.entry = is_seccomp_event(wait_status) or !thread.in_syscall;
+    thread.in_syscall = info.entry;
+
+    if (info.entry)
+    {
+        register_id arg_regs[] = {register_id::rdi, register_id::rsi, register_id::rdx,
+                                  register_id::r10, register_id::r8, register_id::r9};
+        for (std::size_t i = 0; i < 6; ++i)
+            info.args[i] = regs.read_by_id_As<std::uint64_t>(arg_regs[i]);
+    }
+    else
     {
-        // retrieve the id of the dr0 register then start adding the index to it to get the correct id 
-        // hence we cast it to int
-        auto id = static_cast<int> (register_id::dr0) + i;
+        info.ret = regs.read_by_id_As<std::uint64_t>(register_id::rax);
+    }
 
-        // cast by to the register_id and call the func
-        auto info = register_info_by_id(static_cast<register_id>(id));
+    // PTRACE_SYSCALL stops on everything, the ones nobody asked for are resumed right away
+    if (!syscall_catch_policy_.catches(info.id))
+        return std::nullopt;
 
-        errno = 0;
-        // now we read the data and store it in data
-        std::int64_t data = ptrace(PTRACE_PEEKUSER, pid_, info.offset, nullptr);
-        if(errno != 0) error::send_errno("Could not read FPR registers");    
+    return info;
+}
 
-        // store this in user data_
-        get_registers().data_.u_debugreg[i] = data;
+void pdb::process::read_all_registers()
+{
+    get_registers().ensure_banks(registers::all_banks).value();
+}
+
+pdb::expected<void> pdb::process::read_gprs(const registers &regs)
+{
+    trace::scope traced(trace::event::register_fetch, pid_, regs.tid_, trace::register_arg(trace::register_bank::gprs));
+
+    // read all the gpr and store them in the data_.regs  
+    if(sys::ptrace(PTRACE_GETREGS, regs.tid_, nullptr, &regs.data_.regs) < 0)
+    {
+        return last_error(errc::read_gprs_failed);
     }
+    return {};
+}
+
+pdb::expected<void> pdb::process::read_fprs(const registers &regs)
+{
+    trace::scope traced(trace::event::register_fetch, pid_, regs.tid_, trace::register_arg(trace::register_bank::fprs));
+
+    // read all the fpr and store them in the data_.i387 
+    if(sys::ptrace(PTRACE_GETFPREGS, regs.tid_, nullptr, &regs.data_.i387) < 0)
+    {
+        return last_error(errc::read_fprs_failed);
+    }
+    return {};
+}
+
+pdb::expected<void> pdb::process::read_debug_register(const registers &regs, int index)
+{
+    // retrieve the id of the dr0 register then add the index to it to get the correct id
+    auto id = static_cast<int>(register_id::dr0) + index;
+    auto &info = register_info_by_id(static_cast<register_id>(id));
+    trace::scope traced(trace::event::register_fetch, pid_, regs.tid_, trace::register_arg(trace::register_bank::user_area, info.offset));
+
+    errno = 0;
+    // now we read the data and store it in user data_
+    std::int64_t data = sys::ptrace(PTRACE_PEEKUSER, regs.tid_, info.offset, nullptr);
+    if(errno != 0) return last_error(errc::read_debug_registers_failed);
+
+    regs.data_.u_debugreg[index] = data;
+    return {};
 }
 
 void pdb::process::write_user_area(std::size_t offset, std::uint64_t data)
 {
+    write_user_area(current_tid_, offset, data).value();
+}
+
+pdb::expected<void> pdb::process::write_user_area(pid_t tid, std::size_t offset, std::uint64_t data)
+{
+    trace::scope traced(trace::event::register_write, pid_, tid, trace::register_arg(trace::register_bank::user_area, offset));
+
     // PTRACE_POKEUSER is used to write data in the user area by ptrace
-    if(ptrace(PTRACE_POKEUSER, pid_, offset, data) < 0)
+    if(sys::ptrace(PTRACE_POKEUSER, tid, offset, data) < 0)
     {
-        error::send_errno("Could not write to user area");
+        return last_error(errc::write_user_area_failed);
     }
+    return {};
 }
 
 
 // as reading and writing may cause an error here we simply write all the FPRs
 void pdb::process::write_fprs(const user_fpregs_struct& fprs)
 {
-    if(ptrace(PTRACE_SETFPREGS, pid_, nullptr, &fprs) < 0)
+    write_fprs(current_tid_, fprs).value();
+}
+
+pdb::expected<void> pdb::process::write_fprs(pid_t tid, const user_fpregs_struct& fprs)
+{
+    trace::scope traced(trace::event::register_write, pid_, tid, trace::register_arg(trace::register_bank::fprs));
+
+    if(sys::ptrace(PTRACE_SETFPREGS, tid, nullptr, &fprs) < 0)
     {
-        error::send_errno("Could not write FP registers");
+        return last_error(errc::write_fprs_failed);
     }
+    return {};
 }
 
 void pdb::process::write_gprs(const user_regs_struct& fprs)
 {
-    if(ptrace(PTRACE_SETREGS, pid_, nullptr, &fprs) < 0)
+    write_gprs(current_tid_, fprs).value();
+}
+
+pdb::expected<void> pdb::process::write_gprs(pid_t tid, const user_regs_struct& fprs)
+{
+    trace::scope traced(trace::event::register_write, pid_, tid, trace::register_arg(trace::register_bank::gprs));
+
+    if(sys::ptrace(PTRACE_SETREGS, tid, nullptr, &fprs) < 0)
+    {
+        return last_error(errc::write_gprs_failed);
+    }
+    return {};
+}
+
+std::vector<std::byte> pdb::process::read_memory(virt_addr address, std::size_t amount) const
+{
+    std::vector<std::byte> ret(amount);
+    read_memory(address, span<std::byte>(ret));
+    return ret;
+}
+
+void pdb::process::read_memory(virt_addr address, span<std::byte> into) const
+{
+    try_read_memory(address, into).value();
+}
+
+void pdb::process::write_memory(virt_addr address, span<const std::byte> data)
+{
+    try_write_memory(address, data).value();
+}
+
+pdb::expected<void> pdb::process::try_read_memory(virt_addr address, span<std::byte> into) const
+{
+    memory_read_request request{address, into};
+    return try_read_memory_ranges(span<const memory_read_request>(&request, 1));
+}
+
+pdb::expected<void> pdb::process::try_write_memory(virt_addr address, span<const std::byte> data)
+{
+    memory_write_request request{address, data};
+    return write_memory_ranges(span<const memory_write_request>(&request, 1), memory_backend_);
+}
+
+void pdb::process::read_memory_ranges(span<const memory_read_request> requests) const
+{
+    try_read_memory_ranges(requests).value();
+}
+
+pdb::expected<void> pdb::process::try_read_memory_ranges(span<const memory_read_request> requests) const
+{
+    std::vector<iovec> local;
+    std::vector<iovec> remote;
+    std::vector<const memory_read_request *> cached;
+
+    for (auto &request : requests)
+    {
+        if (request.into.empty())
+            continue;
+
+        if (memory_cache_enabled_ and request.into.size() <= max_cached_read)
+        {
+            cached.push_back(&request);
+            continue;
+        }
+
+        local.push_back({request.into.data(), request.into.size()});
+        remote.push_back({reinterpret_cast<void *>(request.address.addr()), request.into.size()});
+    }
+
+    // if the whole pages can't be read we read the exact ranges instead,
+    // so a bad range fails the same way with or without the cache
+    if (!cached.empty() and !read_through_cache(cached))
+    {
+        for (auto request : cached)
+        {
+            local.push_back({request->into.data(), request->into.size()});
+            remote.push_back({reinterpret_cast<void *>(request->address.addr()), request->into.size()});
+        }
+    }
+
+    return transfer_memory(local, remote, /*write=*/false, memory_backend_);
+}
+
+bool pdb::process::read_through_cache(const std::vector<const memory_read_request *> &requests) const
+{
+    auto &stats = memory_cache_.get_stats();
+
+    // first pass: find the pages we don't have yet
+    std::vector<std::uint64_t> missing;
+    for (auto request : requests)
+    {
+        auto start = request->address.addr();
+        auto end = start + request->into.size();
+        bool served = true;
+
+        for (auto page = memory_cache::page_of(start); page < end; page += memory_cache::page_size)
+        {
+            if (memory_cache_.find(page))
+            {
+                ++stats.hits;
+                continue;
+            }
+
+            served = false;
+            ++stats.misses;
+            missing.push_back(page);
+        }
+
+        if (served)
+            ++stats.reads_served;
+    }
+
+    // several requests may share a missing page
+    std::sort(missing.begin(), missing.end());
+    missing.erase(std::unique(missing.begin(), missing.end()), missing.end());
+
+    // fill every missing page with a single vectored transfer
+    if (!missing.empty())
+    {
+        for (auto page : missing)
+            memory_cache_.insert(page);
+
+        // pointers are taken after all the inserts as inserting can move the storage
+        std::vector<iovec> local;
+        std::vector<iovec> remote;
+        for (auto page : missing)
+        {
+            local.push_back({memory_cache_.find(page), memory_cache::page_size});
+            remote.push_back({reinterpret_cast<void *>(page), memory_cache::page_size});
+        }
+
+        auto calls = memory_stats_.vm_calls + memory_stats_.proc_mem_calls;
+        if (!transfer_memory(local, remote, /*write=*/false, memory_backend_))
+        {
+            for (auto page : missing)
+                memory_cache_.erase(page);
+            return false;
+        }
+        stats.fills += memory_stats_.vm_calls + memory_stats_.proc_mem_calls - calls;
+    }
+
+    // second pass: copy out of the cached pages
+    for (auto request : requests)
+    {
+        auto addr = request->address.addr();
+        auto out = request->into.data();
+        auto left = request->into.size();
+
+        while (left > 0)
+        {
+            auto page = memory_cache::page_of(addr);
+            auto offset = addr - page;
+            auto amount = std::min<std::size_t>(left, memory_cache::page_size - offset);
+
+            std::copy(memory_cache_.find(page) + offset, memory_cache_.find(page) + offset + amount, out);
+
+            addr += amount;
+            out += amount;
+            left -= amount;
+        }
+    }
+
+    return true;
+}
+
+void pdb::process::set_memory_cache_enabled(bool enable)
+{
+    memory_cache_enabled_ = enable;
+    memory_cache_.clear();
+}
+
+void pdb::process::write_memory_ranges(span<const memory_write_request> requests)
+{
+    write_memory_ranges(requests, memory_backend_).value();
+}
+
+pdb::expected<void> pdb::process::write_memory_ranges(span<const memory_write_request> requests, memory_backend backend)
+{
+    std::vector<iovec> local;
+    std::vector<iovec> remote;
+    local.reserve(requests.size());
+    remote.reserve(requests.size());
+
+    for (auto &request : requests)
+    {
+        if (request.from.empty())
+            continue;
+
+        // the cached copy of these pages is stale now
+        memory_cache_.invalidate(request.address.addr(), request.from.size());
+
+        // iovec has no const version, process_vm_writev only reads from the local side
+        local.push_back({const_cast<std::byte *>(request.from.data()), request.from.size()});
+        remote.push_back({reinterpret_cast<void *>(request.address.addr()), request.from.size()});
+    }
+
+    return transfer_memory(local, remote, /*write=*/true, backend);
+}
+
+// local[i] and remote[i] always have the same length so we can walk both in lock step
+pdb::expected<void> pdb::process::transfer_memory(std::vector<iovec> &local, std::vector<iovec> &remote, bool write, memory_backend backend) const
+{
+    std::size_t next = 0;
+
+    while (next < local.size())
+    {
+        if (backend == memory_backend::proc_mem)
+        {
+            if (auto result = transfer_proc_mem(local[next], remote[next], write); !result)
+                return result;
+            ++next;
+            continue;
+        }
+
+        // the kernel takes at most IOV_MAX ranges per call
+        auto count = std::min<std::size_t>(local.size() - next, IOV_MAX);
+
+        std::size_t wanted = 0;
+        for (std::size_t i = next; i < next + count; ++i)
+            wanted += local[i].iov_len;
+
+        auto done = write
+            ? sys::process_vm_writev(pid_, &local[next], count, &remote[next], count)
+            : sys::process_vm_readv(pid_, &local[next], count, &remote[next], count);
+        ++memory_stats_.vm_calls;
+
+        // the vm calls stop at the first range they can't access (eg. a write to read only text)
+        // a failure is treated like a transfer that stopped at the first range
+        if (done < 0)
+            done = 0;
+        memory_stats_.vm_bytes += done;
+
+        if (static_cast<std::size_t>(done) == wanted)
+        {
+            next += count;
+            continue;
+        }
+
+        // skip the ranges that made it, then trim the one the kernel stopped in
+        std::size_t left = done;
+        while (left >= local[next].iov_len)
+        {
+            left -= local[next].iov_len;
+            ++next;
+        }
+
+        iovec local_rest{static_cast<std::byte *>(local[next].iov_base) + left, local[next].iov_len - left};
+        iovec remote_rest{static_cast<std::byte *>(remote[next].iov_base) + left, remote[next].iov_len - left};
+
+        // /proc/<pid>/mem goes through the ptrace access checks and can touch pages the vm calls can't
+        if (auto result = transfer_proc_mem(local_rest, remote_rest, write); !result)
+            return result;
+        ++next;
+    }
+    return {};
+}
+
+pdb::expected<void> pdb::process::transfer_proc_mem(const iovec &local, const iovec &remote, bool write) const
+{
+    auto fd = memory_fd();
+    if (!fd)
+        return fd.error();
+
+    auto buffer = static_cast<std::byte *>(local.iov_base);
+    auto address = reinterpret_cast<std::uint64_t>(remote.iov_base);
+    std::size_t done = 0;
+
+    while (done < local.iov_len)
+    {
+        auto n = write
+            ? sys::pwrite(*fd, buffer + done, local.iov_len - done, address + done)
+            : sys::pread(*fd, buffer + done, local.iov_len - done, address + done);
+        ++memory_stats_.proc_mem_calls;
+
+        if (n <= 0)
+        {
+            if (n == 0)
+                errno = EIO;
+            return last_error(write ? errc::write_memory_failed : errc::read_memory_failed);
+        }
+
+        done += n;
+        memory_stats_.proc_mem_bytes += n;
+    }
+    return {};
+}
+
+pdb::expected<int> pdb::process::memory_fd() const
+{
+    if (memory_fd_ == -1)
+    {
+        char path[32];
+        std::snprintf(path, sizeof(path), "/proc/%d/mem", pid_);
+        memory_fd_ = open(path, O_RDWR | O_CLOEXEC);
+
+        if (memory_fd_ < 0)
+        {
+            memory_fd_ = -1;
+            return last_error(errc::open_memory_failed, pid_);
+        }
+    }
+
+    return memory_fd_;
+}
+
+pdb::breakpoint_site &pdb::process::create_breakpoint_site(virt_addr address)
+{
+    if (breakpoint_sites_.contains_address(address))
+    {
+        error::send("Breakpoint site already created at address " + std::to_string(address.addr()));
+    }
+
+    if (address.addr() == 0)
+    {
+        error::send("Cannot create breakpoint site at address 0");
+    }
+
+    return breakpoint_sites_.push(std::unique_ptr<breakpoint_site>(new breakpoint_site(*this, address)));
+}
+
+std::vector<pdb::breakpoint_site *> pdb::process::create_breakpoint_sites(span<const virt_addr> addresses, bool enable)
+{
+    breakpoint_sites_.reserve(breakpoint_sites_.size() + addresses.size());
+
+    std::vector<breakpoint_site *> sites;
+    sites.reserve(addresses.size());
+    for (auto address : addresses)
+    {
+        sites.push_back(&create_breakpoint_site(address));
+    }
+
+    if (enable)
+    {
+        enable_breakpoint_sites(sites);
+    }
+
+    return sites;
+}
+
+void pdb::process::enable_breakpoint_sites(span<breakpoint_site *const> sites)
+{
+    patch_breakpoint_sites(sites, /*enable=*/true);
+}
+
+void pdb::process::disable_breakpoint_sites(span<breakpoint_site *const> sites)
+{
+    patch_breakpoint_sites(sites, /*enable=*/false);
+}
+
+void pdb::process::patch_breakpoint_sites(span<breakpoint_site *const> sites, bool enable)
+{
+    // only the sites that actually change state, sorted so nearby sites can share a run
+    std::vector<breakpoint_site *> todo;
+    for (auto site : sites)
+    {
+        if (site->is_enabled() != enable)
+            todo.push_back(site);
+    }
+
+    if (todo.empty())
+        return;
+
+    std::sort(todo.begin(), todo.end(), [](auto a, auto b) { return a->address() < b->address(); });
+
+    // a run is a stretch of code holding sites less than a page apart
+    // it costs one read and one write no matter how many sites it holds
+    struct run
+    {
+        virt_addr start;
+        std::size_t size;
+        std::size_t offset;
+    };
+    std::vector<run> runs;
+    std::size_t total = 0;
+
+    for (auto site : todo)
+    {
+        auto address = site->address();
+        if (!runs.empty() and address < runs.back().start + runs.back().size + memory_cache::page_size)
+        {
+            auto new_size = address.addr() - runs.back().start.addr() + 1;
+            total += new_size - runs.back().size;
+            runs.back().size = new_size;
+        }
+        else
+        {
+            runs.push_back({address, 1, total});
+            total += 1;
+        }
+    }
+
+    std::vector<std::byte> code(total);
+    std::vector<memory_read_request> reads;
+    std::vector<memory_write_request> writes;
+    for (auto &r : runs)
+    {
+        reads.push_back({r.start, span<std::byte>(code.data() + r.offset, r.size)});
+        writes.push_back({r.start, span<const std::byte>(code.data() + r.offset, r.size)});
+    }
+
+    read_memory_ranges(reads);
+
+    auto current = runs.begin();
+    for (auto site : todo)
+    {
+        while (site->address() >= current->start + current->size)
+            ++current;
+
+        auto &byte = code[current->offset + (site->address().addr() - current->start.addr())];
+        if (enable)
+        {
+            site->saved_data_ = byte;
+            byte = std::byte{0xcc};
+        }
+        else
+        {
+            byte = site->saved_data_;
+        }
+    }
+
+    // code pages are usually read only so we go straight to /proc/<pid>/mem instead of
+    // letting process_vm_writev fail on every run first
+    write_memory_ranges(writes, memory_backend::proc_mem).value();
+
+    for (auto site : todo)
+    {
+        site->is_enabled_ = enable;
+    }
+}
+
+pdb::watchpoint &pdb::process::create_watchpoint(virt_addr address, stoppoint_mode mode, std::size_t size)
+{
+    if (watchpoints_.contains_address(address))
+    {
+        error::send("Watchpoint already created at address " + std::to_string(address.addr()));
+    }
+
+    if (address.addr() == 0)
+    {
+        error::send("Cannot create watchpoint at address 0");
+    }
+
+    return watchpoints_.push(std::unique_ptr<watchpoint>(new watchpoint(*this, address, mode, size)));
+}
+
+namespace
+{
+    // dr7 R/W bits for a slot
+    std::uint64_t encode_hardware_stoppoint_mode(pdb::stoppoint_mode mode)
+    {
+        switch (mode)
+        {
+        case pdb::stoppoint_mode::write:
+            return 0b01;
+        case pdb::stoppoint_mode::read_write:
+            return 0b11;
+        case pdb::stoppoint_mode::execute:
+            return 0b00;
+        default:
+            pdb::error::send("Invalid stoppoint mode");
+        }
+    }
+
+    // dr7 LEN bits for a slot, note that 8 bytes is 0b10 and 4 bytes is 0b11
+    std::uint64_t encode_hardware_stoppoint_size(std::size_t size)
+    {
+        switch (size)
+        {
+        case 1:
+            return 0b00;
+        case 2:
+            return 0b01;
+        case 4:
+            return 0b11;
+        case 8:
+            return 0b10;
+        default:
+            pdb::error::send("Invalid stoppoint size");
+        }
+    }
+
+    // a slot is free when its local enable bit in dr7 is clear
+    int find_free_stoppoint_register(std::uint64_t control_register)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            if ((control_register & (0b11 << (i * 2))) == 0)
+            {
+                return i;
+            }
+        }
+
+        pdb::error::send("No remaining hardware debug registers");
+    }
+
+    // the dr7 bits a slot owns
+    std::uint64_t stoppoint_clear_mask(int index)
+    {
+        return (0b11ull << (index * 2)) | (0b1111ull << (index * 4 + 16));
+    }
+
+    std::uint64_t stoppoint_control_bits(int index, pdb::stoppoint_mode mode, std::size_t size)
+    {
+        auto enable_bit = 1ull << (index * 2);
+        auto mode_bits = encode_hardware_stoppoint_mode(mode) << (index * 4 + 16);
+        auto size_bits = encode_hardware_stoppoint_size(size) << (index * 4 + 18);
+        return enable_bit | mode_bits | size_bits;
+    }
+
+    pdb::register_id debug_address_register(int index)
+    {
+        return static_cast<pdb::register_id>(static_cast<int>(pdb::register_id::dr0) + index);
+    }
+}
+
+// these go through the register cache, so in write-back mode the dr writes wait for the next flush
+// debug registers are per thread, so the slot is written into every stopped thread (all of them in all-stop mode)
+int pdb::process::set_hardware_stoppoint(virt_addr address, stoppoint_mode mode, std::size_t size)
+{
+    auto control = get_registers().read_by_id_As<std::uint64_t>(register_id::dr7);
+
+    int index = find_free_stoppoint_register(control);
+    auto bits = stoppoint_control_bits(index, mode, size);
+
+    for (auto &thread : threads_)
+    {
+        if (thread.state != process_state::stopped)
+            continue;
+
+        auto &regs = get_registers(thread.tid);
+        regs.write_by_id(debug_address_register(index), address.addr());
+
+        // clear whatever the slot had before
+        // the address has to be in place before dr7 enables the slot
+        auto thread_control = regs.read_by_id_As<std::uint64_t>(register_id::dr7);
+        regs.write_by_id(register_id::dr7, (thread_control & ~stoppoint_clear_mask(index)) | bits);
+    }
+
+    return index;
+}
+
+// clearing the enable bits is enough, the stale address in the slot is never looked at
+void pdb::process::clear_hardware_stoppoint(int index)
+{
+    for (auto &thread : threads_)
     {
-        error::send_errno("Could not write GP registers");
+        if (thread.state != process_state::stopped)
+            continue;
+
+        auto &regs = get_registers(thread.tid);
+        auto control = regs.read_by_id_As<std::uint64_t>(register_id::dr7);
+        regs.write_by_id(register_id::dr7, control & ~stoppoint_clear_mask(index));
     }
-}
\ No newline at end of file
+}
+
+void pdb::process::program_watchpoints(registers &regs)
+{
+    std::uint64_t control = 0;
+    watchpoints_.for_each([&](auto &point) {
+        if (!point.is_enabled())
+            return;
+        regs.write_by_id(debug_address_register(point.hardware_index()), point.address().addr());
+        control |= stoppoint_control_bits(point.hardware_index(), point.mode(), point.size());
+    });
+    regs.write_by_id(register_id::dr7, control);
+}
+
+// dr6 has one status bit per slot (B0-B3) set by the cpu when the slot fires
+std::optional<pdb::watchpoint::id_type> pdb::process::triggered_watchpoint() const
+{
+    auto status = get_registers().read_by_id_As<std::uint64_t>(register_id::dr6);
+
+    for (int index = 0; index < 4; ++index)
+    {
+        if (!(status & (1 << index)))
+            continue;
+
+        std::optional<watchpoint::id_type> found;
+        watchpoints_.for_each([&](auto &point) {
+            if (point.is_enabled() and point.hardware_index() == index)
+                found = point.id();
+        });
+        if (found)
+            return found;
+    }
+
+    return std::nullopt;
+}
+
+pdb::expected<void> pdb::process::augment_stop_reason(pid_t tid, stop_reason &reason)
+{
+    siginfo_t info;
+    if (sys::ptrace(PTRACE_GETSIGINFO, tid, nullptr, &info) < 0)
+    {
+        return last_error(errc::signal_info_failed);
+    }
+
+    switch (info.si_code)
+    {
+    case TRAP_TRACE:
+        reason.trap_reason = trap_type::single_step;
+        break;
+    // int3 is reported as SI_KERNEL on x64
+    case SI_KERNEL:
+    case TRAP_BRKPT:
+        reason.trap_reason = trap_type::software_break;
+        break;
+    case TRAP_HWBKPT:
+        reason.trap_reason = trap_type::hardware_break;
+        break;
+    default:
+        reason.trap_reason = trap_type::unknown;
+        break;
+    }
+    return {};
+}
@@ -0,0 +1,532 @@
+#include <libpdb/profiler.hpp>
+#include <libpdb/error.hpp>
+#include <libpdb/process.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <filesystem>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+namespace
+{
+    std::uint64_t slot_hash(pdb::call_trie::node_id parent, std::uint64_t pc, bool return_address)
+    {
+        auto hash = (pc ^ (std::uint64_t(parent) << 1 | return_address)) * 0x9e3779b97f4a7c15;
+        return hash ^ (hash >> 29);
+    }
+
+    // the names of a node's frames from the outermost down
+    void path_names(const std::vector<pdb::call_trie::node> &nodes, std::vector<std::string> &names,
+                    pdb::call_trie::node_id id, std::vector<const std::string *> &out)
+    {
+        out.resize(nodes[id].depth);
+        for (; id != pdb::call_trie::root; id = nodes[id].parent)
+            out[nodes[id].depth - 1] = &names[id];
+    }
+
+    // the demangled symbol of a frame, its address when no module has a symbol for it
+    std::string frame_name(pdb::module_map &modules, pdb::virt_addr pc, bool return_address)
+    {
+        std::string_view name;
+        try
+        {
+            name = modules.symbol_name(pc, return_address);
+        }
+        catch (const pdb::error &)
+        {
+            // the process is gone and the maps with it, the modules we opened while it ran still answer
+        }
+
+        if (name.empty())
+        {
+            std::ostringstream hex;
+            hex << "0x" << std::hex << pc.addr();
+            return hex.str();
+        }
+
+        // __cxa_demangle wants a null terminated string and hands back a malloc'd one
+        std::string mangled(name);
+        int status = 0;
+        auto demangled = abi::__cxa_demangle(mangled.c_str(), nullptr, nullptr, &status);
+        if (status != 0)
+            return mangled;
+
+        std::string result(demangled);
+        std::free(demangled);
+        return result;
+    }
+
+    // every node symbolized once, ahead of the walks
+    std::vector<std::string> node_names(const std::vector<pdb::call_trie::node> &nodes, const pdb::call_trie::symbolizer &name)
+    {
+        std::vector<std::string> names(nodes.size());
+        for (std::size_t i = 1; i < nodes.size(); ++i)
+            names[i] = name(pdb::virt_addr(nodes[i].pc), nodes[i].return_address);
+        return names;
+    }
+}
+
+pdb::call_trie::call_trie() : nodes_(1), slots_(1024, root)
+{
+}
+
+void pdb::call_trie::grow()
+{
+    std::vector<node_id> slots(slots_.size() * 2, root);
+    auto mask = slots.size() - 1;
+    for (node_id id = 1; id < nodes_.size(); ++id)
+    {
+        auto &entry = nodes_[id];
+        auto slot = slot_hash(entry.parent, entry.pc, entry.return_address) & mask;
+        while (slots[slot] != root)
+            slot = (slot + 1) & mask;
+        slots[slot] = id;
+    }
+    slots_ = std::move(slots);
+}
+
+pdb::call_trie::node_id pdb::call_trie::child(node_id parent, std::uint64_t pc, bool return_address)
+{
+    // kept at most half full so the probes stay short
+    if (2 * (nodes_.size() + 1) > slots_.size())
+        grow();
+
+    auto mask = slots_.size() - 1;
+    auto slot = slot_hash(parent, pc, return_address) & mask;
+    for (; slots_[slot] != root; slot = (slot + 1) & mask)
+    {
+        auto &entry = nodes_[slots_[slot]];
+        if (entry.parent == parent and entry.pc == pc and entry.return_address == return_address)
+            return slots_[slot];
+    }
+
+    node added;
+    added.pc = pc;
+    added.parent = parent;
+    added.depth = nodes_[parent].depth + 1;
+    added.return_address = return_address;
+
+    auto id = static_cast<node_id>(nodes_.size());
+    nodes_.push_back(added);
+    slots_[slot] = id;
+    return id;
+}
+
+void pdb::call_trie::add(span<const stack_frame> frames, std::uint64_t count)
+{
+    auto id = root;
+    nodes_[root].total += count;
+    for (auto i = frames.size(); i-- > 0;)
+    {
+        id = child(id, frames[i].pc.addr(), i != 0);
+        nodes_[id].total += count;
+    }
+    nodes_[id].self += count;
+}
+
+void pdb::call_trie::write_folded(std::ostream &out, const symbolizer &name) const
+{
+    auto names = node_names(nodes_, name);
+
+    // different pcs of one function fold into the same line, a std::map also sorts them for us
+    std::map<std::string, std::uint64_t> folded;
+    std::vector<const std::string *> path;
+    std::string line;
+    for (node_id id = 1; id < nodes_.size(); ++id)
+    {
+        if (nodes_[id].self == 0)
+            continue;
+
+        path_names(nodes_, names, id, path);
+        line.clear();
+        for (std::size_t i = 0; i < path.size(); ++i)
+        {
+            if (i)
+                line += ';';
+            line += *path[i];
+        }
+        folded[line] += nodes_[id].self;
+    }
+
+    for (auto &[stack, count] : folded)
+        out << stack << ' ' << count << '\n';
+}
+
+void pdb::call_trie::write_flat(std::ostream &out, const symbolizer &name) const
+{
+    auto names = node_names(nodes_, name);
+
+    struct function_samples
+    {
+        std::uint64_t self = 0;
+        std::uint64_t total = 0;
+    };
+    std::unordered_map<std::string_view, function_samples> functions;
+
+    std::vector<const std::string *> path;
+    std::vector<std::string_view> seen;
+    for (node_id id = 1; id < nodes_.size(); ++id)
+    {
+        auto count = nodes_[id].self;
+        if (count == 0)
+            continue;
+
+        functions[names[id]].self += count;
+
+        // a recursive function is on the stack once as far as its total goes
+        path_names(nodes_, names, id, path);
+        seen.clear();
+        for (auto name : path)
+        {
+            if (std::find(seen.begin(), seen.end(), *name) != seen.end())
+                continue;
+            seen.push_back(*name);
+            functions[*name].total += count;
+        }
+    }
+
+    std::vector<std::pair<std::string_view, function_samples>> sorted(functions.begin(), functions.end());
+    std::sort(sorted.begin(), sorted.end(), [](auto &a, auto &b) {
+        return a.second.self != b.second.self ? a.second.self > b.second.self : a.first < b.first;
+    });
+
+    auto percent = [samples = samples()](std::uint64_t count) { return samples ? 100.0 * count / samples : 0.0; };
+
+    out << "  self%      self  total%     total  function\n";
+    for (auto &[function, counts] : sorted)
+    {
+        out << std::fixed << std::setprecision(2)
+            << std::setw(7) << percent(counts.self) << std::setw(10) << counts.self
+            << std::setw(8) << percent(counts.total) << std::setw(10) << counts.total
+            << "  " << function << '\n';
+    }
+}
+
+pdb::sampling_profiler::sampling_profiler(process &proc, unsigned hz, std::size_t max_depth)
+    : process_(&proc), unwinder_(proc), max_depth_(max_depth)
+{
+    if (hz == 0 or max_depth == 0)
+        error::send("Sampling rate and stack depth must be above zero");
+    period_ = std::chrono::nanoseconds(std::chrono::seconds(1)) / hz;
+}
+
+bool pdb::sampling_profiler::sample()
+{
+    auto start = std::chrono::steady_clock::now();
+    process_->stop_all_threads();
+
+    // only the registers and the stack are read while the process is held, nothing is allocated once
+    // the buffers fit the thread count
+    auto &threads = process_->threads();
+    if (frames_.size() < threads.size() * max_depth_)
+        frames_.resize(threads.size() * max_depth_);
+    depths_.assign(threads.size(), 0);
+
+    bool other_stop = false;
+    for (std::size_t i = 0; i < threads.size(); ++i)
+    {
+        if (threads[i].pending_status)
+            other_stop = true;
+        if (threads[i].state != process_state::stopped)
+            continue;
+
+        try
+        {
+            depths_[i] = unwinder_.backtrace(threads[i].tid, span<stack_frame>(frames_.data() + i * max_depth_, max_depth_));
+        }
+        catch (const error &)
+        {
+            // a thread that is exiting has no registers left to read, it just misses this sample
+        }
+    }
+
+    if (!other_stop)
+        process_->resume();
+
+    auto stopped = std::chrono::steady_clock::now() - start;
+    stats_.stopped_time += stopped;
+    stats_.longest_stop = std::max(stats_.longest_stop, std::chrono::duration_cast<std::chrono::nanoseconds>(stopped));
+    ++stats_.samples;
+
+    // the inferior runs again while we do the bookkeeping
+    for (std::size_t i = 0; i < depths_.size(); ++i)
+    {
+        if (depths_[i] == 0)
+            continue;
+        trie_.add(span<const stack_frame>(frames_.data() + i * max_depth_, depths_[i]));
+        ++stats_.stacks;
+        stats_.frames += depths_[i];
+    }
+    return !other_stop;
+}
+
+bool pdb::sampling_profiler::run(std::chrono::nanoseconds duration, const std::atomic<bool> *stop)
+{
+    if (process_->state() == process_state::exited or process_->state() == process_state::terminated)
+        error::send("Could not profile: the process has ended");
+    if (process_->state() == process_state::stopped)
+        process_->resume();
+
+    auto now = std::chrono::steady_clock::now();
+    auto end = now + duration;
+    auto next = now + period_;
+    while (!(stop and stop->load()))
+    {
+        if (duration.count() and next > end)
+            break;
+
+        std::this_thread::sleep_until(next);
+        if (stop and stop->load())
+            break;
+        if (!sample())
+            return false;
+
+        // a tick we slept through is dropped rather than sampled late, the samples stay evenly spread
+        next += period_;
+        now = std::chrono::steady_clock::now();
+        if (now > next)
+        {
+            auto missed = (now - next) / period_ + 1;
+            stats_.missed_ticks += missed;
+            next += missed * period_;
+        }
+    }
+    process_->stop_all_threads();
+    return true;
+}
+
+void pdb::sampling_profiler::write_folded(std::ostream &out)
+{
+    trie_.write_folded(out, [this](virt_addr pc, bool return_address) {
+        return frame_name(unwinder_.modules(), pc, return_address);
+    });
+}
+
+void pdb::sampling_profiler::write_flat(std::ostream &out)
+{
+    trie_.write_flat(out, [this](virt_addr pc, bool return_address) {
+        return frame_name(unwinder_.modules(), pc, return_address);
+    });
+}
+
+pdb::perf_sampler::perf_sampler(pid_t pid, unsigned hz, std::size_t max_depth)
+    : pid_(pid), hz_(hz), max_depth_(max_depth), page_size_(sysconf(_SC_PAGESIZE)), frames_(max_depth), modules_(pid)
+{
+    if (hz == 0 or max_depth == 0)
+        error::send("Sampling rate and stack depth must be above zero");
+    if (!open_new_threads() or streams_.empty())
+        error::send("Could not find process " + std::to_string(pid));
+}
+
+pdb::perf_sampler::~perf_sampler()
+{
+    for (auto &thread : streams_)
+        close(thread);
+}
+
+bool pdb::perf_sampler::open_new_threads()
+{
+    std::error_code ec;
+    std::filesystem::directory_iterator tasks("/proc/" + std::to_string(pid_) + "/task", ec);
+    if (ec)
+        return false;
+
+    for (auto &entry : tasks)
+    {
+        auto tid = static_cast<pid_t>(std::atoi(entry.path().filename().c_str()));
+        if (tid > 0 and seen_.insert(tid).second)
+            open_thread(tid);
+    }
+    return true;
+}
+
+void pdb::perf_sampler::open_thread(pid_t tid)
+{
+    perf_event_attr attributes{};
+    attributes.size = sizeof(attributes);
+    attributes.type = PERF_TYPE_SOFTWARE;
+    attributes.config = PERF_COUNT_SW_CPU_CLOCK;
+    attributes.freq = 1;
+    attributes.sample_freq = hz_;
+    attributes.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_CALLCHAIN;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+    attributes.exclude_callchain_kernel = 1;
+    // woken up once a ring is half full, the poll timeout picks up the rest
+    attributes.watermark = 1;
+    attributes.wakeup_watermark = ring_pages * page_size_ / 2;
+
+    // one event per thread, an inherited event can't be mapped per thread
+    auto fd = static_cast<int>(syscall(SYS_perf_event_open, &attributes, tid, -1, -1, PERF_FLAG_FD_CLOEXEC));
+    if (fd < 0)
+    {
+        // it exited since we listed it
+        if (errno == ESRCH)
+            return;
+        error::send_errno("Could not open a perf event for thread " + std::to_string(tid));
+    }
+
+    auto ring = mmap(nullptr, (ring_pages + 1) * page_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ring == MAP_FAILED)
+    {
+        ::close(fd);
+        error::send_errno("Could not map the perf ring buffer");
+    }
+
+    streams_.push_back({tid, fd, static_cast<std::byte *>(ring)});
+    ++stats_.threads;
+}
+
+void pdb::perf_sampler::close(stream &thread)
+{
+    munmap(thread.ring, (ring_pages + 1) * page_size_);
+    ::close(thread.fd);
+}
+
+void pdb::perf_sampler::drain(stream &thread)
+{
+    auto page = reinterpret_cast<perf_event_mmap_page *>(thread.ring);
+    auto data = thread.ring + page_size_;
+    auto size = ring_pages * page_size_;
+
+    // copies out of the ring, a record can wrap around its end
+    auto copy_out = [&](std::uint64_t position, void *into, std::size_t amount) {
+        auto offset = position & (size - 1);
+        auto first = std::min(amount, size - offset);
+        std::memcpy(into, data + offset, first);
+        std::memcpy(static_cast<std::byte *>(into) + first, data, amount - first);
+    };
+    auto u64_at = [&](std::size_t offset) {
+        std::uint64_t value;
+        std::memcpy(&value, record_.data() + offset, sizeof(value));
+        return value;
+    };
+
+    // the kernel publishes data_head after the records, we hand the space back through data_tail
+    auto head = __atomic_load_n(&page->data_head, __ATOMIC_ACQUIRE);
+    auto tail = page->data_tail;
+    while (tail < head)
+    {
+        perf_event_header header;
+        copy_out(tail, &header, sizeof(header));
+        if (header.size < sizeof(header))
+            break;
+
+        record_.resize(header.size);
+        copy_out(tail, record_.data(), header.size);
+        tail += header.size;
+
+        if (header.type == PERF_RECORD_LOST and header.size >= sizeof(header) + 16)
+        {
+            stats_.lost += u64_at(sizeof(header) + 8);
+            continue;
+        }
+        if (header.type != PERF_RECORD_SAMPLE or header.size < sizeof(header) + 16)
+            continue;
+
+        // ip, then the callchain: a count and that many entries, PERF_CONTEXT_* markers among them
+        auto ip = u64_at(sizeof(header));
+        auto count = std::min<std::uint64_t>(u64_at(sizeof(header) + 8), (header.size - sizeof(header) - 16) / 8);
+        std::size_t depth = 0;
+        for (std::uint64_t i = 0; i < count and depth < max_depth_; ++i)
+        {
+            auto pc = u64_at(sizeof(header) + 16 + 8 * i);
+            if (pc >= static_cast<std::uint64_t>(PERF_CONTEXT_MAX))
+                continue;
+            frames_[depth++] = {virt_addr(pc), virt_addr(0), unwind_method::frame_pointer};
+        }
+        if (depth == 0)
+            frames_[depth++] = {virt_addr(ip), virt_addr(0), unwind_method::frame_pointer};
+
+        // the modules are opened now, while the maps of the process are still there to read
+        for (std::size_t i = 0; i < depth; ++i)
+        {
+            try
+            {
+                modules_.find_module(i == 0 ? ip : frames_[i].pc.addr() - 1);
+            }
+            catch (const error &)
+            {
+            }
+        }
+
+        trie_.add(span<const stack_frame>(frames_.data(), depth));
+        ++stats_.samples;
+        stats_.frames += depth;
+    }
+    __atomic_store_n(&page->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+void pdb::perf_sampler::drain()
+{
+    // one read of the maps per drain at most, for code mapped since the last one
+    modules_.mark_stale();
+    for (auto &thread : streams_)
+        drain(thread);
+
+    // a thread that exited has nothing more to say once its ring is empty
+    for (auto &thread : streams_)
+    {
+        if (thread.hung_up)
+            close(thread);
+    }
+    streams_.erase(std::remove_if(streams_.begin(), streams_.end(), [](auto &thread) { return thread.hung_up; }), streams_.end());
+}
+
+bool pdb::perf_sampler::run(std::chrono::nanoseconds duration, const std::atomic<bool> *stop)
+{
+    using namespace std::chrono;
+
+    auto end = steady_clock::now() + duration;
+    std::vector<pollfd> fds;
+    while (!(stop and stop->load()))
+    {
+        // new threads are picked up at most this late
+        auto timeout = milliseconds(100);
+        if (duration.count())
+        {
+            auto remaining = duration_cast<milliseconds>(end - steady_clock::now());
+            if (remaining.count() <= 0)
+                break;
+            timeout = std::min(timeout, remaining);
+        }
+
+        fds.clear();
+        for (auto &thread : streams_)
+            fds.push_back({thread.fd, POLLIN, 0});
+        if (poll(fds.data(), fds.size(), static_cast<int>(timeout.count())) < 0 and errno != EINTR)
+            error::send_errno("Could not poll the perf events");
+        for (std::size_t i = 0; i < fds.size(); ++i)
+        {
+            if (fds[i].revents & POLLHUP)
+                streams_[i].hung_up = true;
+        }
+
+        drain();
+        if (!open_new_threads() or streams_.empty())
+            return false;
+    }
+    drain();
+    return true;
+}
+
+void pdb::perf_sampler::write_folded(std::ostream &out)
+{
+    trie_.write_folded(out, [this](virt_addr pc, bool return_address) { return frame_name(modules_, pc, return_address); });
+}
+
+void pdb::perf_sampler::write_flat(std::ostream &out)
+{
+    trie_.write_flat(out, [this](virt_addr pc, bool return_address) { return frame_name(modules_, pc, return_address); });
+}
@@ -45,8 +45,83 @@ namespace
     }
 }
 
+pdb::registers::bank pdb::registers::bank_of(register_type type)
+{
+    switch (type)
+    {
+    case register_type::gpr:
+    case register_type::sub_gpr:
+        return gpr_bank;
+    case register_type::fpr:
+        return fpr_bank;
+    default:
+        return dr_bank;
+    }
+}
+
+pdb::expected<void> pdb::registers::ensure_register(const register_info &info) const
+{
+    if (info.type != register_type::dr)
+        return ensure_banks(bank_of(info.type));
+
+    auto index = dr_index(info);
+    if (!(valid_drs_ & (1 << index)))
+    {
+        stats_.syscalls += 1;
+        if (auto result = proc_->read_debug_register(*this, index); !result)
+            return result;
+        valid_drs_ |= 1 << index;
+    }
+    return {};
+}
+
+// pulls every requested bank that is not cached yet and counts the syscalls it took
+// a bank only counts as cached once its read went through
+pdb::expected<void> pdb::registers::ensure_banks(std::uint8_t banks) const
+{
+    auto missing = banks & ~valid_banks_;
+
+    if (missing & gpr_bank)
+    {
+        stats_.syscalls += 1;
+        if (auto result = proc_->read_gprs(*this); !result)
+            return result;
+        valid_banks_ |= gpr_bank;
+    }
+    if (missing & fpr_bank)
+    {
+        stats_.syscalls += 1;
+        if (auto result = proc_->read_fprs(*this); !result)
+            return result;
+        valid_banks_ |= fpr_bank;
+    }
+
+    if (banks & dr_bank)
+    {
+        for (int i = 0; i < 8; ++i)
+        {
+            if (!(valid_drs_ & (1 << i)))
+            {
+                stats_.syscalls += 1;
+                if (auto result = proc_->read_debug_register(*this, i); !result)
+                    return result;
+                valid_drs_ |= 1 << i;
+            }
+        }
+    }
+    return {};
+}
+
 pdb::registers::value pdb::registers::read(const register_info &info) const
 {
+    return try_read(info).value();
+}
+
+pdb::expected<pdb::registers::value> pdb::registers::try_read(const register_info &info) const
+{
+    // make sure the bank this register lives in has been fetched for this stop
+    if (auto result = ensure_register(info); !result)
+        return result.error();
 
     // we retrieve a pointer to raw bytes of register data
     auto bytes = as_bytes(data_);
@@ -65,7 +140,7 @@ pdb::registers::value pdb::registers::read(const register_info &info) const
         case 8:
             return from_bytes<std::uint64_t>(bytes + info.offset);
         default:
-            pdb::error::send("Unexpected register size");
+            return error_code{errc::unexpected_register_size};
         }
     }
     else if (info.format == register_format::double_float)
@@ -88,6 +163,15 @@ pdb::registers::value pdb::registers::read(const register_info &info) const
 
 void pdb::registers::write(const register_info &info, value val)
 {
+    try_write(info, val).value();
+}
+
+pdb::expected<void> pdb::registers::try_write(const register_info &info, value val)
+{
+    // we write back whole 8 byte words or the whole fpr area so the rest of the bank must be current
+    if (auto result = ensure_register(info); !result)
+        return result;
+
     // first get the pointer to the whole registers memory addresses
     auto bytes = as_bytes(data_);
 
@@ -110,10 +194,19 @@ void pdb::registers::write(const register_info &info, value val)
             std::terminate();
         } }, val);
 
+    // buffered writes stay in data_ until the next flush
+    if (write_back_ or in_transaction_)
+    {
+        mark_dirty(info);
+        return {};
+    }
+
+    ++stats_.write_syscalls;
+
     // here we either write the while fpr at once and if not then write the debug and gprs one by one
     if (info.type == register_type::fpr)
     {
-        proc_->write_fprs(data_.i387);
+        return proc_->write_fprs(tid_, data_.i387);
     }
     else
     {
@@ -125,6 +218,117 @@ void pdb::registers::write(const register_info &info, value val)
         // although we made a change in our memory the operating system does not know that the values have been changed
         // ptrace provides an area of memory same format as user struct called user area where we can update it;
 
-        proc_->write_user_area(alinged_offset, from_bytes<std::uint64_t>(bytes + alinged_offset));
+        return proc_->write_user_area(tid_, alinged_offset, from_bytes<std::uint64_t>(bytes + alinged_offset));
     }
-}
\ No newline at end of file
+}
+
+void pdb::registers::mark_dirty(const register_info &info)
+{
+    auto bank = bank_of(info.type);
+    dirty_banks_ |= bank;
+
+    if (bank == dr_bank)
+    {
+        dirty_drs_ |= 1 << dr_index(info);
+    }
+}
+
+void pdb::registers::set_write_back(bool enable)
+{
+    // leaving write-back mode must not leave anything behind in the cache
+    if (!enable and !in_transaction_)
+        flush();
+
+    write_back_ = enable;
+}
+
+void pdb::registers::flush()
+{
+    if (in_transaction_)
+        error::send("Cannot flush registers with an open transaction");
+
+    try_flush().value();
+}
+
+// a bank stays dirty until its write went through, so a failed flush can be tried again
+pdb::expected<void> pdb::registers::try_flush()
+{
+    if (in_transaction_)
+        return error_code{errc::open_register_transaction};
+
+    if (!dirty_banks_)
+        return {};
+
+    // the whole gpr area goes out in a single PTRACE_SETREGS no matter how many registers changed
+    if (dirty_banks_ & gpr_bank)
+    {
+        ++stats_.write_syscalls;
+        if (auto result = proc_->write_gprs(tid_, data_.regs); !result)
+            return result;
+        dirty_banks_ &= ~gpr_bank;
+    }
+
+    if (dirty_banks_ & fpr_bank)
+    {
+        ++stats_.write_syscalls;
+        if (auto result = proc_->write_fprs(tid_, data_.i387); !result)
+            return result;
+        dirty_banks_ &= ~fpr_bank;
+    }
+
+    // there is no bulk call for the debug registers so we only poke the dirty ones
+    // in ascending order, so dr7 goes last and the addresses it enables are already in place
+    for (int i = 0; i < 8; ++i)
+    {
+        if (dirty_drs_ & (1 << i))
+        {
+            ++stats_.write_syscalls;
+            if (auto result = proc_->write_user_area(tid_, offsetof(user, u_debugreg) + i * 8, data_.u_debugreg[i]); !result)
+                return result;
+            dirty_drs_ &= ~(1 << i);
+        }
+    }
+
+    dirty_banks_ = 0;
+    dirty_drs_ = 0;
+    ++stats_.flushes;
+    return {};
+}
+
+void pdb::registers::begin_transaction()
+{
+    if (in_transaction_)
+        error::send("Register transaction already open");
+
+    saved_data_ = data_;
+    saved_valid_banks_ = valid_banks_;
+    saved_valid_drs_ = valid_drs_;
+    saved_dirty_banks_ = dirty_banks_;
+    saved_dirty_drs_ = dirty_drs_;
+    in_transaction_ = true;
+}
+
+void pdb::registers::commit_transaction()
+{
+    if (!in_transaction_)
+        error::send("No register transaction to commit");
+
+    in_transaction_ = false;
+
+    if (!write_back_)
+        flush();
+}
+
+void pdb::registers::rollback_transaction()
+{
+    if (!in_transaction_)
+        error::send("No register transaction to roll back");
+
+    // banks fetched during the transaction go back to invalid, so they are simply fetched again
+    data_ = saved_data_;
+    valid_banks_ = saved_valid_banks_;
+    valid_drs_ = saved_valid_drs_;
+    dirty_banks_ = saved_dirty_banks_;
+    dirty_drs_ = saved_dirty_drs_;
+    in_transaction_ = false;
+}
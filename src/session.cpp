@@ -0,0 +1,232 @@
+#include <libpdb/session.hpp>
+#include <libpdb/error.hpp>
+#include <syscall_probes.hpp>
+
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <chrono>
+
+pdb::session::session()
+{
+    // signalfd only sees signals that are blocked, otherwise they are delivered (or ignored) as usual
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (pthread_sigmask(SIG_BLOCK, &mask, &old_mask_) != 0)
+    {
+        error::send("Could not block SIGCHLD");
+    }
+
+    signal_fd_ = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd_ < 0)
+    {
+        pthread_sigmask(SIG_SETMASK, &old_mask_, nullptr);
+        error::send_errno("Could not create signalfd");
+    }
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0)
+    {
+        close(signal_fd_);
+        pthread_sigmask(SIG_SETMASK, &old_mask_, nullptr);
+        error::send_errno("Could not create epoll instance");
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = signal_fd_;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, signal_fd_, &event) < 0)
+    {
+        close(epoll_fd_);
+        close(signal_fd_);
+        pthread_sigmask(SIG_SETMASK, &old_mask_, nullptr);
+        error::send_errno("Could not watch signalfd");
+    }
+}
+
+pdb::session::~session()
+{
+    // the processes go first, their destructors still wait on them
+    processes_.clear();
+
+    close(epoll_fd_);
+    close(signal_fd_);
+    pthread_sigmask(SIG_SETMASK, &old_mask_, nullptr);
+}
+
+pdb::process &pdb::session::add(std::unique_ptr<process> proc)
+{
+    auto pid = proc->pid();
+    auto &slot = processes_[pid];
+    if (slot)
+    {
+        error::send("Process " + std::to_string(pid) + " is already in the session");
+    }
+
+    slot = std::move(proc);
+    return *slot;
+}
+
+std::unique_ptr<pdb::process> pdb::session::remove(pid_t pid)
+{
+    auto it = processes_.find(pid);
+    if (it == processes_.end())
+    {
+        error::send("Process " + std::to_string(pid) + " is not in the session");
+    }
+
+    auto proc = std::move(it->second);
+    processes_.erase(it);
+    return proc;
+}
+
+pdb::process *pdb::session::find(pid_t pid)
+{
+    auto it = processes_.find(pid);
+    return it == processes_.end() ? nullptr : it->second.get();
+}
+
+std::size_t pdb::session::poll(std::vector<session_event> &events, int timeout_ms)
+{
+    events.clear();
+
+    // state changes may already be pending, SIGCHLD is coalesced so one signal can stand for many
+    collect(events);
+    if (!events.empty())
+        return events.size();
+
+    // a SIGCHLD for a child outside the session, or one we already handled, wakes us up for nothing
+    // so we keep waiting until there is an event or the time is up
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    epoll_event ready[1];
+    for (;;)
+    {
+        int wait_ms = timeout_ms;
+        if (timeout_ms >= 0)
+        {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            wait_ms = left.count() > 0 ? static_cast<int>(left.count()) : 0;
+        }
+
+        auto n = epoll_wait(epoll_fd_, ready, 1, wait_ms);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                return 0;
+            error::send_errno("epoll_wait failed");
+        }
+
+        if (n == 0)
+            return 0;
+
+        drain_signalfd();
+        collect(events);
+
+        if (!events.empty())
+            return events.size();
+    }
+}
+
+void pdb::session::drain_signalfd()
+{
+    signalfd_siginfo info;
+    while (read(signal_fd_, &info, sizeof(info)) == sizeof(info))
+    {
+    }
+}
+
+void pdb::session::collect(std::vector<session_event> &events)
+{
+    // stops a process put aside while stopping its other threads come first
+    for (auto &[pid, proc] : processes_)
+    {
+        if (proc->state() != process_state::running)
+            continue;
+
+        if (auto reason = proc->take_pending_stop().value())
+            events.push_back({proc.get(), *reason});
+    }
+
+    for (;;)
+    {
+        // peek at the next pending state change without consuming it
+        // __WALL so the threads of our processes are seen too
+        siginfo_t info{};
+        if (sys::waitid(P_ALL, 0, &info, WEXITED | WSTOPPED | WNOHANG | WNOWAIT | __WALL) < 0)
+        {
+            if (errno == ECHILD)
+                return;
+            error::send_errno("waitid failed");
+        }
+
+        if (info.si_pid == 0)
+            return;
+
+        auto proc = find(info.si_pid);
+        if (!proc)
+        {
+            for (auto &[pid, candidate] : processes_)
+            {
+                if (candidate->owns_thread(info.si_pid))
+                {
+                    proc = candidate.get();
+                    break;
+                }
+            }
+        }
+
+        if (!proc)
+        {
+            // it belongs to somebody else and will stay first in line, so ask our processes one by one
+            scan(events);
+            return;
+        }
+
+        int wait_status;
+        if (sys::waitpid(info.si_pid, &wait_status, WNOHANG | __WALL) <= 0)
+        {
+            error::send_errno("waitpid failed");
+        }
+
+        // new threads and thread exits are dealt with by the process and not reported
+        if (auto reason = proc->handle_wait_status(info.si_pid, wait_status).value())
+            events.push_back({proc, *reason});
+    }
+}
+
+void pdb::session::scan(std::vector<session_event> &events)
+{
+    // a stopped process can't change state until we resume it, so only the running ones are asked
+    for (auto &[pid, proc] : processes_)
+    {
+        if (proc->state() != process_state::running)
+            continue;
+
+        // the tids are copied as handling a status can change the thread table
+        std::vector<pid_t> tids;
+        for (auto &thread : proc->threads())
+            tids.push_back(thread.tid);
+
+        for (auto tid : tids)
+        {
+            int wait_status;
+            auto ret = sys::waitpid(tid, &wait_status, WNOHANG | __WALL);
+            if (ret < 0)
+            {
+                // the thread exited and was reaped while handling an earlier status
+                if (errno == ECHILD)
+                    continue;
+                error::send_errno("waitpid failed");
+            }
+
+            if (ret > 0)
+            {
+                if (auto reason = proc->handle_wait_status(tid, wait_status).value())
+                    events.push_back({proc.get(), *reason});
+            }
+        }
+    }
+}
@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <iterator>
+#include <string>
+#include <mutex>
+#include <sys/ptrace.h>
+#include <libpdb/stats.hpp>
+#include <syscall_probes.hpp>
+
+namespace
+{
+    using pdb::stats::histogram_buckets;
+    using pdb::stats::op_count;
+
+    // written by its thread only, with plain loads and stores, read by snapshot() from anywhere
+    // the atomics are for the readers, a relaxed load and store pair is an ordinary mov
+    struct counters
+    {
+        std::atomic<std::uint64_t> calls{0};
+        std::atomic<std::uint64_t> errors{0};
+        std::atomic<std::uint64_t> bytes{0};
+        std::atomic<std::uint64_t> total_ns{0};
+        std::array<std::atomic<std::uint64_t>, histogram_buckets> buckets{};
+    };
+
+    struct thread_block
+    {
+        std::array<counters, op_count> ops;
+        thread_block *next = nullptr;
+    };
+
+    // every block ever made, pushed on with a compare and swap and never taken off
+    std::atomic<thread_block *> blocks{nullptr};
+    thread_local thread_block *own_block = nullptr;
+
+    // what reset() saw, snapshots count from there, so a reset never races with a thread recording
+    std::mutex baseline_mutex;
+    std::array<pdb::stats::operation, op_count> baseline{};
+
+    thread_block &get_block()
+    {
+        if (!own_block)
+        {
+            own_block = new thread_block;
+            own_block->next = blocks.load(std::memory_order_relaxed);
+            while (!blocks.compare_exchange_weak(own_block->next, own_block, std::memory_order_release, std::memory_order_relaxed))
+            {
+            }
+        }
+        return *own_block;
+    }
+
+    void bump(std::atomic<std::uint64_t> &counter, std::uint64_t amount)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    std::array<pdb::stats::operation, op_count> totals()
+    {
+        std::array<pdb::stats::operation, op_count> sum{};
+        for (std::size_t i = 0; i < op_count; ++i)
+            sum[i].what = static_cast<pdb::stats::op>(i);
+
+        for (auto block = blocks.load(std::memory_order_acquire); block; block = block->next)
+        {
+            for (std::size_t i = 0; i < op_count; ++i)
+            {
+                auto &from = block->ops[i];
+                sum[i].calls += from.calls.load(std::memory_order_relaxed);
+                sum[i].errors += from.errors.load(std::memory_order_relaxed);
+                sum[i].bytes += from.bytes.load(std::memory_order_relaxed);
+                sum[i].total_ns += from.total_ns.load(std::memory_order_relaxed);
+                for (std::size_t b = 0; b < histogram_buckets; ++b)
+                    sum[i].buckets[b] += from.buckets[b].load(std::memory_order_relaxed);
+            }
+        }
+        return sum;
+    }
+
+    std::string format_ns(double ns)
+    {
+        char text[32];
+        if (ns < 1e3)
+            std::snprintf(text, sizeof(text), "%.0f ns", ns);
+        else if (ns < 1e6)
+            std::snprintf(text, sizeof(text), "%.1f us", ns / 1e3);
+        else
+            std::snprintf(text, sizeof(text), "%.1f ms", ns / 1e6);
+        return text;
+    }
+}
+
+void pdb::sys::detail::record(stats::op what, std::uint64_t ns, bool failed, std::uint64_t bytes)
+{
+    auto &slot = get_block().ops[static_cast<std::size_t>(what)];
+    bump(slot.calls, 1);
+    if (failed)
+        bump(slot.errors, 1);
+    if (bytes)
+        bump(slot.bytes, bytes);
+    bump(slot.total_ns, ns);
+    bump(slot.buckets[stats::bucket_of(ns)], 1);
+}
+
+pdb::stats::op pdb::sys::detail::ptrace_op(long request)
+{
+    using stats::op;
+    switch (request)
+    {
+    case PTRACE_CONT: return op::ptrace_cont;
+    case PTRACE_SYSCALL: return op::ptrace_syscall;
+    case PTRACE_SINGLESTEP: return op::ptrace_singlestep;
+    case PTRACE_INTERRUPT: return op::ptrace_interrupt;
+    case PTRACE_ATTACH: return op::ptrace_attach;
+    case PTRACE_SEIZE: return op::ptrace_seize;
+    case PTRACE_DETACH: return op::ptrace_detach;
+    case PTRACE_SETOPTIONS: return op::ptrace_setoptions;
+    case PTRACE_GETEVENTMSG: return op::ptrace_geteventmsg;
+    case PTRACE_GETSIGINFO: return op::ptrace_getsiginfo;
+    case PTRACE_GETREGS: return op::ptrace_getregs;
+    case PTRACE_SETREGS: return op::ptrace_setregs;
+    case PTRACE_GETFPREGS: return op::ptrace_getfpregs;
+    case PTRACE_SETFPREGS: return op::ptrace_setfpregs;
+    case PTRACE_PEEKUSER: return op::ptrace_peekuser;
+    case PTRACE_POKEUSER: return op::ptrace_pokeuser;
+    default: return op::ptrace_other;
+    }
+}
+
+std::string_view pdb::stats::op_name(op what)
+{
+    static constexpr std::string_view names[] = {
+        "PTRACE_CONT", "PTRACE_SYSCALL", "PTRACE_SINGLESTEP", "PTRACE_INTERRUPT", "PTRACE_ATTACH",
+        "PTRACE_SEIZE", "PTRACE_DETACH", "PTRACE_SETOPTIONS", "PTRACE_GETEVENTMSG", "PTRACE_GETSIGINFO",
+        "PTRACE_GETREGS", "PTRACE_SETREGS", "PTRACE_GETFPREGS", "PTRACE_SETFPREGS", "PTRACE_PEEKUSER",
+        "PTRACE_POKEUSER", "ptrace (other)", "waitpid", "waitid", "tgkill", "process_vm_readv",
+        "process_vm_writev", "/proc/pid/mem read", "/proc/pid/mem write"};
+    static_assert(std::size(names) == op_count);
+    return names[static_cast<std::size_t>(what)];
+}
+
+std::size_t pdb::stats::bucket_of(std::uint64_t ns)
+{
+    if (ns < 8)
+        return ns;
+
+    // the top bit says the octave, the two bits under it the quarter
+    auto top = 63 - __builtin_clzll(ns);
+    auto bucket = static_cast<std::size_t>(top - 1) * 4 + ((ns >> (top - 2)) & 3);
+    return std::min(bucket, histogram_buckets - 1);
+}
+
+std::uint64_t pdb::stats::bucket_floor(std::size_t bucket)
+{
+    if (bucket < 8)
+        return bucket;
+
+    auto top = bucket / 4 + 1;
+    return (4 + bucket % 4) << (top - 2);
+}
+
+std::uint64_t pdb::stats::operation::quantile_ns(double q) const
+{
+    std::uint64_t count = 0;
+    for (auto bucket : buckets)
+        count += bucket;
+    if (count == 0)
+        return 0;
+
+    auto rank = static_cast<std::uint64_t>(q * (count - 1));
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < histogram_buckets; ++i)
+    {
+        seen += buckets[i];
+        if (seen > rank)
+            return bucket_floor(i);
+    }
+    return bucket_floor(histogram_buckets - 1);
+}
+
+std::vector<pdb::stats::operation> pdb::stats::snapshot()
+{
+    std::vector<operation> operations;
+    if constexpr (!enabled)
+        return operations;
+
+    auto sum = totals();
+    std::lock_guard lock(baseline_mutex);
+    for (std::size_t i = 0; i < op_count; ++i)
+    {
+        auto &now = sum[i];
+        auto &then = baseline[i];
+        now.calls -= then.calls;
+        now.errors -= then.errors;
+        now.bytes -= then.bytes;
+        now.total_ns -= then.total_ns;
+        for (std::size_t b = 0; b < histogram_buckets; ++b)
+            now.buckets[b] -= then.buckets[b];
+
+        if (now.calls)
+            operations.push_back(now);
+    }
+    return operations;
+}
+
+void pdb::stats::reset()
+{
+    auto sum = totals();
+    std::lock_guard lock(baseline_mutex);
+    baseline = sum;
+}
+
+void pdb::stats::write_table(std::ostream &out, const std::vector<operation> &operations)
+{
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-20s %10s %8s %10s %10s %10s %10s %12s\n", "operation", "calls", "errors",
+                  "mean", "p50", "p99", "max", "bytes");
+    out << line;
+
+    for (auto &operation : operations)
+    {
+        std::size_t last = 0;
+        for (std::size_t i = 0; i < histogram_buckets; ++i)
+        {
+            if (operation.buckets[i])
+                last = i;
+        }
+
+        std::snprintf(line, sizeof(line), "%-20s %10llu %8llu %10s %10s %10s %10s %12llu\n",
+                      std::string(op_name(operation.what)).c_str(), static_cast<unsigned long long>(operation.calls),
+                      static_cast<unsigned long long>(operation.errors), format_ns(operation.mean_ns()).c_str(),
+                      format_ns(operation.quantile_ns(0.5)).c_str(), format_ns(operation.quantile_ns(0.99)).c_str(),
+                      format_ns(bucket_floor(last)).c_str(), static_cast<unsigned long long>(operation.bytes));
+        out << line;
+    }
+}
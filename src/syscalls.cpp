@@ -0,0 +1,69 @@
+#include <libpdb/syscalls.hpp>
+#include <libpdb/error.hpp>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+
+namespace
+{
+    // ids are dense up to the last one, the few holes stay empty
+    const std::vector<std::string_view> &syscall_names()
+    {
+        static const auto names = [] {
+            std::vector<std::string_view> names;
+#define DEFINE_SYSCALL(name, id)        \
+    if (names.size() <= id)             \
+        names.resize(id + 1);           \
+    names[id] = #name;
+#include <syscalls.inc>
+#undef DEFINE_SYSCALL
+            return names;
+        }();
+        return names;
+    }
+
+    const std::unordered_map<std::string_view, int> &syscall_ids()
+    {
+        static const std::unordered_map<std::string_view, int> ids = {
+#define DEFINE_SYSCALL(name, id) {#name, id},
+#include <syscalls.inc>
+#undef DEFINE_SYSCALL
+        };
+        return ids;
+    }
+}
+
+std::string_view pdb::syscall_id_to_name(int id)
+{
+    auto &names = syscall_names();
+    if (id < 0 or static_cast<std::size_t>(id) >= names.size() or names[id].empty())
+    {
+        error::send("No such syscall: " + std::to_string(id));
+    }
+    return names[id];
+}
+
+int pdb::syscall_name_to_id(std::string_view name)
+{
+    auto &ids = syscall_ids();
+    auto it = ids.find(name);
+    if (it == ids.end())
+    {
+        error::send("No such syscall: " + std::string(name));
+    }
+    return it->second;
+}
+
+bool pdb::syscall_catch_policy::catches(int id) const
+{
+    switch (mode_)
+    {
+    case mode::all:
+        return true;
+    case mode::some:
+        return std::find(to_catch_.begin(), to_catch_.end(), id) != to_catch_.end();
+    default:
+        return false;
+    }
+}
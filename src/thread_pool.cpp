@@ -0,0 +1,135 @@
+#include <libpdb/thread_pool.hpp>
+#include <algorithm>
+
+pdb::work_stealing_pool::work_stealing_pool(unsigned thread_count)
+{
+    if (thread_count == 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned i = 0; i < thread_count; ++i)
+        queues_.push_back(std::make_unique<task_queue>());
+
+    // worker 0 is whoever calls parallel_for
+    for (unsigned i = 1; i < thread_count; ++i)
+        threads_.emplace_back([this, i] { worker_loop(i); });
+}
+
+pdb::work_stealing_pool::~work_stealing_pool()
+{
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    work_ready_.notify_all();
+
+    for (auto &thread : threads_)
+        thread.join();
+}
+
+void pdb::work_stealing_pool::parallel_for(std::size_t count, const std::function<void(std::size_t, unsigned)> &task)
+{
+    if (count == 0)
+        return;
+
+    {
+        std::lock_guard lock(mutex_);
+
+        // set before any task is queued, a worker still busy with the last run can take one right away
+        // and the queue locks order these writes before its reads
+        task_ = &task;
+        error_ = nullptr;
+        remaining_ = count;
+
+        // contiguous blocks so neighbouring tasks, which usually touch neighbouring data, stay on one worker
+        auto workers = queues_.size();
+        for (std::size_t worker = 0; worker < workers; ++worker)
+        {
+            std::lock_guard queue_lock(queues_[worker]->mutex);
+            for (auto i = worker * count / workers; i < (worker + 1) * count / workers; ++i)
+                queues_[worker]->tasks.push_back(i);
+        }
+
+        ++generation_;
+    }
+    work_ready_.notify_all();
+
+    run_tasks(0);
+
+    std::unique_lock lock(mutex_);
+    work_done_.wait(lock, [this] { return remaining_ == 0; });
+    task_ = nullptr;
+
+    if (error_)
+        std::rethrow_exception(error_);
+}
+
+void pdb::work_stealing_pool::worker_loop(unsigned worker)
+{
+    std::size_t seen_generation = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock lock(mutex_);
+            work_ready_.wait(lock, [&] { return stopping_ or generation_ != seen_generation; });
+            if (stopping_)
+                return;
+            seen_generation = generation_;
+        }
+
+        run_tasks(worker);
+    }
+}
+
+void pdb::work_stealing_pool::run_tasks(unsigned worker)
+{
+    std::size_t index;
+    while (take_task(worker, index))
+    {
+        try
+        {
+            (*task_)(index, worker);
+        }
+        catch (...)
+        {
+            std::lock_guard lock(mutex_);
+            if (!error_)
+                error_ = std::current_exception();
+        }
+
+        // the last task wakes the caller, the lock makes sure it is already waiting or will see zero
+        if (--remaining_ == 0)
+        {
+            std::lock_guard lock(mutex_);
+            work_done_.notify_all();
+        }
+    }
+}
+
+bool pdb::work_stealing_pool::take_task(unsigned worker, std::size_t &index)
+{
+    {
+        auto &own = *queues_[worker];
+        std::lock_guard lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            index = own.tasks.back();
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    // steal from the front, the end of the queue its owner is furthest away from
+    for (std::size_t i = 1; i < queues_.size(); ++i)
+    {
+        auto &victim = *queues_[(worker + i) % queues_.size()];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            index = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,213 @@
+#include <chrono>
+#include <cstdio>
+#include <iterator>
+#include <set>
+#include <string>
+#include <thread>
+#include <cpuid.h>
+#include <libpdb/trace.hpp>
+
+namespace
+{
+    using pdb::trace::record;
+
+    bool has_invariant_tsc()
+    {
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+            return false;
+        return edx & (1 << 8);
+    }
+
+    std::uint64_t raw_ns()
+    {
+        timespec time;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &time);
+        return static_cast<std::uint64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+    }
+
+    // the ring, its size is a power of two so a slot is the running count masked
+    std::vector<record> ring;
+    std::size_t mask = 0;
+    std::atomic<std::uint64_t> head{0};
+
+    // a tick and nanosecond pair read together at start(), ticks are converted from there
+    std::uint64_t anchor_ticks = 0;
+    std::uint64_t anchor_ns = 0;
+    double ticks_per_ns = 1.0;
+
+    // how fast the tsc goes, measured once against the raw clock over a few milliseconds
+    double measure_tsc_rate()
+    {
+        auto ticks = __builtin_ia32_rdtsc();
+        auto ns = raw_ns();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        auto ticks_after = __builtin_ia32_rdtsc();
+        auto ns_after = raw_ns();
+        return static_cast<double>(ticks_after - ticks) / static_cast<double>(ns_after - ns);
+    }
+
+    const char *reason_name(std::uint32_t reason)
+    {
+        // the order of pdb::process_state
+        static constexpr const char *names[] = {"stopped", "running", "exited", "terminated"};
+        return reason < std::size(names) ? names[reason] : "unknown";
+    }
+
+    const char *bank_name(std::uint32_t bank)
+    {
+        static constexpr const char *names[] = {"gprs", "fprs", "user area"};
+        return bank < std::size(names) ? names[bank] : "unknown";
+    }
+
+    // microseconds with three decimals, without going through a double
+    std::string microseconds(std::uint64_t ns)
+    {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%llu.%03llu", static_cast<unsigned long long>(ns / 1000),
+                      static_cast<unsigned long long>(ns % 1000));
+        return text;
+    }
+}
+
+std::atomic<bool> pdb::trace::detail::active{false};
+const bool pdb::trace::detail::use_tsc = has_invariant_tsc();
+
+std::string_view pdb::trace::event_name(event what)
+{
+    static constexpr std::string_view names[] = {"launch", "attach", "resume", "wait", "stop", "register fetch",
+                                                 "register write"};
+    static_assert(std::size(names) == static_cast<std::size_t>(event::count));
+    return names[static_cast<std::size_t>(what)];
+}
+
+void pdb::trace::start(std::size_t capacity)
+{
+    detail::active.store(false, std::memory_order_relaxed);
+
+    if (detail::use_tsc)
+    {
+        static const double rate = measure_tsc_rate();
+        ticks_per_ns = rate;
+    }
+
+    std::size_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+
+    // every page is written here, so no event pays for a page fault
+    ring.assign(size, record{});
+    mask = size - 1;
+    head.store(0, std::memory_order_relaxed);
+
+    anchor_ticks = now();
+    anchor_ns = raw_ns();
+    detail::active.store(true, std::memory_order_release);
+}
+
+void pdb::trace::stop()
+{
+    detail::active.store(false, std::memory_order_relaxed);
+
+    // a recording long enough is a better measure of the tsc rate than the one at the first start
+    auto ticks = now();
+    auto ns = raw_ns();
+    if (detail::use_tsc and anchor_ns and ns - anchor_ns > 100000000)
+        ticks_per_ns = static_cast<double>(ticks - anchor_ticks) / static_cast<double>(ns - anchor_ns);
+}
+
+void pdb::trace::clear()
+{
+    head.store(0, std::memory_order_relaxed);
+}
+
+void pdb::trace::emit(event what, pid_t pid, pid_t tid, std::uint64_t start, std::uint32_t arg)
+{
+    if (!recording())
+        return;
+
+    auto end = now();
+    auto index = head.fetch_add(1, std::memory_order_relaxed);
+    ring[index & mask] = record{start, end, pid, tid, arg, what};
+}
+
+std::vector<pdb::trace::record> pdb::trace::records()
+{
+    std::vector<record> ret;
+    auto count = head.load(std::memory_order_acquire);
+    auto first = count > ring.size() ? count - ring.size() : 0;
+    ret.reserve(count - first);
+    for (auto i = first; i < count; ++i)
+        ret.push_back(ring[i & mask]);
+    return ret;
+}
+
+std::uint64_t pdb::trace::dropped()
+{
+    auto count = head.load(std::memory_order_relaxed);
+    return count > ring.size() ? count - ring.size() : 0;
+}
+
+std::uint64_t pdb::trace::to_ns(std::uint64_t ticks)
+{
+    if (!detail::use_tsc)
+        return ticks;
+
+    auto delta = static_cast<double>(static_cast<std::int64_t>(ticks - anchor_ticks)) / ticks_per_ns;
+    return anchor_ns + static_cast<std::int64_t>(delta);
+}
+
+void pdb::trace::write_chrome_json(std::ostream &out)
+{
+    auto events = records();
+
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    auto separator = [&] {
+        out << (first ? "\n" : ",\n");
+        first = false;
+    };
+
+    // the viewer names a process by its pid alone unless it is told otherwise
+    std::set<pid_t> pids;
+    for (auto &event : events)
+        pids.insert(event.pid);
+    for (auto pid : pids)
+    {
+        separator();
+        out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"args\":{\"name\":\"inferior " << pid << "\"}}";
+    }
+
+    for (auto &record : events)
+    {
+        auto start = to_ns(record.start);
+        auto end = to_ns(record.end);
+
+        separator();
+        out << "{\"name\":\"" << event_name(record.what) << "\",\"cat\":\"pdb\",\"ph\":\"X\",\"ts\":" << microseconds(start)
+            << ",\"dur\":" << microseconds(end > start ? end - start : 0) << ",\"pid\":" << record.pid
+            << ",\"tid\":" << record.tid << ",\"args\":{";
+
+        switch (record.what)
+        {
+        case event::resume:
+            out << "\"threads\":" << record.arg;
+            break;
+        case event::stop:
+            out << "\"reason\":\"" << reason_name(record.arg & 0xff) << "\",\"info\":" << ((record.arg >> 8) & 0xff)
+                << ",\"reported\":" << ((record.arg >> 16) & 1 ? "true" : "false");
+            break;
+        case event::register_fetch:
+        case event::register_write:
+            out << "\"bank\":\"" << bank_name(record.arg & 0xff) << "\"";
+            if ((record.arg & 0xff) == static_cast<std::uint32_t>(register_bank::user_area))
+                out << ",\"offset\":" << (record.arg >> 8);
+            break;
+        default:
+            break;
+        }
+        out << "}}";
+    }
+
+    out << "\n]}\n";
+}
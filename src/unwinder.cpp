@@ -0,0 +1,912 @@
+#include <libpdb/unwinder.hpp>
+#include <libpdb/elf.hpp>
+#include <libpdb/error.hpp>
+#include <libpdb/process.hpp>
+#include <libpdb/register_info.hpp>
+#include <dwarf_reader.hpp>
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+
+namespace
+{
+    constexpr std::uint32_t register_bit(std::size_t reg) { return std::uint32_t(1) << reg; }
+
+    // a pointer in one of the DW_EH_PE encodings, section_address is where the cursor's data is loaded
+    std::uint64_t read_encoded(pdb::dwarf_cursor &cursor, std::uint8_t encoding, std::uint64_t section_address,
+                               std::uint64_t data_base = 0)
+    {
+        auto field_address = section_address + cursor.position();
+
+        std::uint64_t value;
+        switch (encoding & 0x0f)
+        {
+        case DW_EH_PE_absptr: value = cursor.u64(); break;
+        case DW_EH_PE_uleb128: value = cursor.uleb128(); break;
+        case DW_EH_PE_udata2: value = cursor.u16(); break;
+        case DW_EH_PE_udata4: value = cursor.u32(); break;
+        case DW_EH_PE_udata8: value = cursor.u64(); break;
+        case DW_EH_PE_sleb128: value = cursor.sleb128(); break;
+        case DW_EH_PE_sdata2: value = static_cast<std::int16_t>(cursor.u16()); break;
+        case DW_EH_PE_sdata4: value = static_cast<std::int32_t>(cursor.u32()); break;
+        case DW_EH_PE_sdata8: value = cursor.u64(); break;
+        default: pdb::dwarf_cursor::malformed();
+        }
+
+        // textrel and funcrel don't show up on x86-64, indirect only for personality routines we skip
+        switch (encoding & 0x70)
+        {
+        case 0: break;
+        case DW_EH_PE_pcrel: value += field_address; break;
+        case DW_EH_PE_datarel: value += data_base; break;
+        default: pdb::dwarf_cursor::malformed();
+        }
+        return value;
+    }
+
+    std::int32_t read_s32(const std::byte *data)
+    {
+        std::int32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+}
+
+pdb::call_frame_info::call_frame_info(const elf &file) : elf_(&file)
+{
+    auto section = file.get_section(".eh_frame");
+    if (!section)
+        return;
+    eh_frame_ = file.get_section_contents(".eh_frame");
+    eh_frame_address_ = section->sh_addr;
+
+    // version, then the encodings of the .eh_frame pointer, the entry count and the table
+    if (auto hdr = file.get_section(".eh_frame_hdr"))
+    {
+        try
+        {
+            auto data = file.get_section_contents(".eh_frame_hdr");
+            dwarf_cursor cursor(data);
+            auto version = cursor.u8();
+            auto pointer_encoding = cursor.u8();
+            auto count_encoding = cursor.u8();
+            auto table_encoding = cursor.u8();
+
+            if (version == 1 and count_encoding != DW_EH_PE_omit and table_encoding == (DW_EH_PE_datarel | DW_EH_PE_sdata4))
+            {
+                read_encoded(cursor, pointer_encoding, hdr->sh_addr);
+                auto count = read_encoded(cursor, count_encoding, hdr->sh_addr);
+                hdr_table_ = cursor.bytes(count * 8);
+                hdr_address_ = hdr->sh_addr;
+                hdr_count_ = count;
+                return;
+            }
+        }
+        catch (const error &)
+        {
+        }
+    }
+
+    build_fde_table();
+}
+
+void pdb::call_frame_info::build_fde_table()
+{
+    // walk every entry once and keep where each FDE starts
+    dwarf_cursor cursor(eh_frame_);
+    while (!cursor.finished())
+    {
+        auto offset = cursor.position();
+        bool dwarf64;
+        auto length = cursor.initial_length(dwarf64);
+        if (length == 0)
+            break;
+
+        auto start = cursor.position();
+        auto pointer_position = cursor.position();
+        auto cie_pointer = cursor.section_offset(dwarf64);
+        if (cie_pointer != 0)
+        {
+            auto &owner = get_cie(pointer_position - cie_pointer);
+            auto low = read_encoded(cursor, owner.fde_encoding, eh_frame_address_);
+            fde_table_.push_back({low, offset});
+        }
+        cursor.seek(start + length);
+    }
+
+    std::sort(fde_table_.begin(), fde_table_.end());
+}
+
+std::optional<std::uint64_t> pdb::call_frame_info::find_fde(std::uint64_t pc) const
+{
+    if (hdr_count_ != 0)
+    {
+        // (initial location, FDE address) pairs of int32 offsets from .eh_frame_hdr, sorted by location
+        auto target = static_cast<std::int64_t>(pc - hdr_address_);
+        std::size_t low = 0;
+        std::size_t high = hdr_count_;
+        while (low < high)
+        {
+            auto middle = low + (high - low) / 2;
+            if (read_s32(hdr_table_.data() + middle * 8) <= target)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        if (low == 0)
+            return std::nullopt;
+
+        auto fde_address = hdr_address_ + read_s32(hdr_table_.data() + (low - 1) * 8 + 4);
+        if (fde_address < eh_frame_address_ or fde_address >= eh_frame_address_ + eh_frame_.size())
+            return std::nullopt;
+        return fde_address - eh_frame_address_;
+    }
+
+    auto it = std::upper_bound(fde_table_.begin(), fde_table_.end(), pc, [](auto pc, auto &entry) { return pc < entry.first; });
+    if (it == fde_table_.begin())
+        return std::nullopt;
+    return std::prev(it)->second;
+}
+
+const pdb::call_frame_info::cie &pdb::call_frame_info::get_cie(std::uint64_t offset)
+{
+    if (auto it = cies_.find(offset); it != cies_.end())
+        return it->second;
+
+    dwarf_cursor cursor(eh_frame_);
+    cursor.seek(offset);
+    bool dwarf64;
+    auto length = cursor.initial_length(dwarf64);
+    auto end = cursor.position() + length;
+    if (cursor.section_offset(dwarf64) != 0)
+        dwarf_cursor::malformed();
+
+    cie entry;
+    auto version = cursor.u8();
+    auto augmentation = cursor.string();
+    if (augmentation.substr(0, 2) == "eh")
+        cursor.u64();
+
+    entry.code_alignment = cursor.uleb128();
+    entry.data_alignment = cursor.sleb128();
+    entry.return_register = version == 1 ? cursor.u8() : cursor.uleb128();
+
+    if (!augmentation.empty() and augmentation[0] == 'z')
+    {
+        entry.has_augmentation_data = true;
+        auto data_length = cursor.uleb128();
+        auto data_end = cursor.position() + data_length;
+        for (auto c : augmentation.substr(1))
+        {
+            if (c == 'L')
+                cursor.u8();
+            else if (c == 'P')
+                read_encoded(cursor, cursor.u8(), eh_frame_address_);
+            else if (c == 'R')
+                entry.fde_encoding = cursor.u8();
+            else if (c == 'S')
+                entry.signal_frame = true;
+            else
+                break;
+        }
+        cursor.seek(data_end);
+    }
+
+    if (end < cursor.position() or end > eh_frame_.size())
+        dwarf_cursor::malformed();
+    entry.instructions = span<const std::byte>(eh_frame_.data() + cursor.position(), end - cursor.position());
+    return cies_.emplace(offset, entry).first->second;
+}
+
+namespace
+{
+    // runs a CFA program, appending a row to out every time the location moves past the current one
+    // initial is the row after the CIE program, what DW_CFA_restore goes back to
+    // instructions_address is where the program is loaded, pc relative DW_CFA_set_loc operands need it
+    void run_cfa_program(pdb::span<const std::byte> instructions, std::uint64_t code_alignment, std::int64_t data_alignment,
+                         std::uint64_t instructions_address, std::uint8_t fde_encoding, const pdb::unwind_row *initial,
+                         std::uint64_t &location, pdb::unwind_row &row, std::vector<std::uint64_t> *locations,
+                         std::vector<pdb::unwind_row> *rows)
+    {
+        std::vector<pdb::unwind_row> remembered;
+        pdb::register_rule ignored;
+        auto rule_for = [&](std::uint64_t reg) -> pdb::register_rule & {
+            // vector registers show up in some CFI, we never unwind them
+            return reg < pdb::unwind_register_count ? row.registers[reg] : ignored;
+        };
+        auto advance = [&](std::uint64_t to) {
+            if (rows and to != location)
+            {
+                locations->push_back(location);
+                rows->push_back(row);
+            }
+            location = to;
+        };
+        auto block = [](pdb::dwarf_cursor &cursor) { return cursor.bytes(cursor.uleb128()); };
+
+        pdb::dwarf_cursor cursor(instructions);
+        while (!cursor.finished())
+        {
+            auto opcode = cursor.u8();
+            auto operand = static_cast<std::uint8_t>(opcode & 0x3f);
+
+            switch (opcode & 0xc0)
+            {
+            case DW_CFA_advance_loc:
+                advance(location + operand * code_alignment);
+                continue;
+            case DW_CFA_offset:
+                rule_for(operand) = {pdb::register_rule::at_offset, 0, static_cast<std::int64_t>(cursor.uleb128()) * data_alignment, {}};
+                continue;
+            case DW_CFA_restore:
+                rule_for(operand) = initial and operand < pdb::unwind_register_count ? initial->registers[operand] : pdb::register_rule{};
+                continue;
+            default:
+                break;
+            }
+
+            switch (opcode)
+            {
+            case DW_CFA_nop: break;
+            case DW_CFA_set_loc: advance(read_encoded(cursor, fde_encoding, instructions_address)); break;
+            case DW_CFA_advance_loc1: advance(location + cursor.u8() * code_alignment); break;
+            case DW_CFA_advance_loc2: advance(location + cursor.u16() * code_alignment); break;
+            case DW_CFA_advance_loc4: advance(location + cursor.u32() * code_alignment); break;
+            case DW_CFA_offset_extended:
+            {
+                auto reg = cursor.uleb128();
+                rule_for(reg) = {pdb::register_rule::at_offset, 0, static_cast<std::int64_t>(cursor.uleb128()) * data_alignment, {}};
+                break;
+            }
+            case DW_CFA_offset_extended_sf:
+            {
+                auto reg = cursor.uleb128();
+                rule_for(reg) = {pdb::register_rule::at_offset, 0, cursor.sleb128() * data_alignment, {}};
+                break;
+            }
+            case DW_CFA_GNU_negative_offset_extended:
+            {
+                auto reg = cursor.uleb128();
+                rule_for(reg) = {pdb::register_rule::at_offset, 0, -static_cast<std::int64_t>(cursor.uleb128()) * data_alignment, {}};
+                break;
+            }
+            case DW_CFA_val_offset:
+            {
+                auto reg = cursor.uleb128();
+                rule_for(reg) = {pdb::register_rule::val_offset, 0, static_cast<std::int64_t>(cursor.uleb128()) * data_alignment, {}};
+                break;
+            }
+            case DW_CFA_val_offset_sf:
+            {
+                auto reg = cursor.uleb128();
+                rule_for(reg) = {pdb::register_rule::val_offset, 0, cursor.sleb128() * data_alignment, {}};
+                break;
+            }
+            case DW_CFA_restore_extended:
+            {
+                auto reg = cursor.uleb128();
+                rule_for(reg) = initial and reg < pdb::unwind_register_count ? initial->registers[reg] : pdb::register_rule{};
+                break;
+            }
+            case DW_CFA_undefined: rule_for(cursor.uleb128()) = {pdb::register_rule::undefined, 0, 0, {}}; break;
+            case DW_CFA_same_value: rule_for(cursor.uleb128()) = {pdb::register_rule::same_value, 0, 0, {}}; break;
+            case DW_CFA_register:
+            {
+                auto reg = cursor.uleb128();
+                rule_for(reg) = {pdb::register_rule::in_register, static_cast<std::uint16_t>(cursor.uleb128()), 0, {}};
+                break;
+            }
+            case DW_CFA_expression:
+            {
+                auto reg = cursor.uleb128();
+                rule_for(reg) = {pdb::register_rule::at_expression, 0, 0, block(cursor)};
+                break;
+            }
+            case DW_CFA_val_expression:
+            {
+                auto reg = cursor.uleb128();
+                rule_for(reg) = {pdb::register_rule::val_expression, 0, 0, block(cursor)};
+                break;
+            }
+            case DW_CFA_remember_state: remembered.push_back(row); break;
+            case DW_CFA_restore_state:
+                if (remembered.empty())
+                    pdb::dwarf_cursor::malformed();
+                row = remembered.back();
+                remembered.pop_back();
+                break;
+            case DW_CFA_def_cfa:
+                row.cfa.is_expression = false;
+                row.cfa.reg = static_cast<std::uint16_t>(cursor.uleb128());
+                row.cfa.offset = static_cast<std::int64_t>(cursor.uleb128());
+                break;
+            case DW_CFA_def_cfa_sf:
+                row.cfa.is_expression = false;
+                row.cfa.reg = static_cast<std::uint16_t>(cursor.uleb128());
+                row.cfa.offset = cursor.sleb128() * data_alignment;
+                break;
+            case DW_CFA_def_cfa_register:
+                row.cfa.is_expression = false;
+                row.cfa.reg = static_cast<std::uint16_t>(cursor.uleb128());
+                break;
+            case DW_CFA_def_cfa_offset: row.cfa.offset = static_cast<std::int64_t>(cursor.uleb128()); break;
+            case DW_CFA_def_cfa_offset_sf: row.cfa.offset = cursor.sleb128() * data_alignment; break;
+            case DW_CFA_def_cfa_expression:
+                row.cfa.is_expression = true;
+                row.cfa.expr = block(cursor);
+                break;
+            case DW_CFA_GNU_args_size: cursor.uleb128(); break;
+            default: pdb::dwarf_cursor::malformed();
+            }
+        }
+    }
+}
+
+pdb::call_frame_info::fde_rules pdb::call_frame_info::decode_fde(std::uint64_t offset)
+{
+    dwarf_cursor cursor(eh_frame_);
+    cursor.seek(offset);
+    bool dwarf64;
+    auto length = cursor.initial_length(dwarf64);
+    auto end = cursor.position() + length;
+    auto pointer_position = cursor.position();
+    auto cie_pointer = cursor.section_offset(dwarf64);
+    if (cie_pointer == 0 or cie_pointer > pointer_position)
+        dwarf_cursor::malformed();
+
+    auto &owner = get_cie(pointer_position - cie_pointer);
+    fde_rules rules;
+    rules.low = read_encoded(cursor, owner.fde_encoding, eh_frame_address_);
+    rules.high = rules.low + read_encoded(cursor, owner.fde_encoding & 0x0f, eh_frame_address_);
+    rules.signal_frame = owner.signal_frame;
+    if (owner.has_augmentation_data)
+        cursor.skip(cursor.uleb128());
+
+    if (end < cursor.position() or end > eh_frame_.size())
+        dwarf_cursor::malformed();
+    span<const std::byte> instructions(eh_frame_.data() + cursor.position(), end - cursor.position());
+
+    // the CIE program sets up the row every FDE of it starts from
+    unwind_row row;
+    auto location = rules.low;
+    auto address_of = [&](span<const std::byte> data) { return eh_frame_address_ + (data.data() - eh_frame_.data()); };
+    run_cfa_program(owner.instructions, owner.code_alignment, owner.data_alignment, address_of(owner.instructions),
+                    owner.fde_encoding, nullptr, location, row, nullptr, nullptr);
+    auto initial = row;
+    location = rules.low;
+    run_cfa_program(instructions, owner.code_alignment, owner.data_alignment, address_of(instructions), owner.fde_encoding,
+                    &initial, location, row, &rules.locations, &rules.rows);
+    rules.locations.push_back(location);
+    rules.rows.push_back(row);
+    return rules;
+}
+
+const pdb::unwind_row *pdb::call_frame_info::find_row(file_addr pc, bool &signal_frame)
+{
+    auto offset = find_fde(pc.addr());
+    if (!offset)
+        return nullptr;
+
+    auto it = fdes_.find(*offset);
+    if (it != fdes_.end())
+    {
+        ++cache_hits_;
+    }
+    else
+    {
+        // an FDE we can't decode is cached as covering nothing, so it is only tried once
+        ++cache_misses_;
+        fde_rules rules;
+        try
+        {
+            rules = decode_fde(*offset);
+        }
+        catch (const error &)
+        {
+            rules = fde_rules{};
+        }
+        it = fdes_.emplace(*offset, std::move(rules)).first;
+    }
+
+    auto &rules = it->second;
+    if (pc.addr() < rules.low or pc.addr() >= rules.high or rules.rows.empty())
+        return nullptr;
+
+    auto row = std::upper_bound(rules.locations.begin(), rules.locations.end(), pc.addr()) - rules.locations.begin();
+    signal_frame = rules.signal_frame;
+    return &rules.rows[row == 0 ? 0 : row - 1];
+}
+
+pdb::module_map::module_map(pid_t pid) : pid_(pid)
+{
+}
+
+pdb::module_map::~module_map() = default;
+
+void pdb::module_map::reload()
+{
+    std::ifstream maps("/proc/" + std::to_string(pid_) + "/maps");
+    if (!maps)
+    {
+        error::send("Could not read the memory map of the inferior");
+    }
+
+    mappings_.clear();
+    std::string line;
+    while (std::getline(maps, line))
+    {
+        std::uint64_t start, end, offset;
+        char permissions[5] = {};
+        int path_start = 0;
+        if (std::sscanf(line.c_str(), "%" SCNx64 "-%" SCNx64 " %4s %" SCNx64 " %*s %*s %n", &start, &end, permissions, &offset, &path_start) < 4)
+            continue;
+
+        mapping entry{start, end, offset, permissions[2] == 'x', path_start > 0 ? line.substr(path_start) : std::string()};
+        mappings_.push_back(std::move(entry));
+    }
+
+    // modules we had opened already are kept, reopening libc for every new library is what we want to avoid
+    std::vector<module> modules;
+    for (auto &entry : mappings_)
+    {
+        if (!entry.executable or entry.path.empty())
+            continue;
+
+        auto old = std::find_if(modules_.begin(), modules_.end(), [&](auto &mod) {
+            return mod.start == entry.start and mod.end == entry.end and mod.path == entry.path;
+        });
+        if (old != modules_.end())
+        {
+            modules.push_back(std::move(*old));
+            continue;
+        }
+
+        module mod;
+        mod.start = entry.start;
+        mod.end = entry.end;
+        mod.path = entry.path;
+        modules.push_back(std::move(mod));
+    }
+    modules_ = std::move(modules);
+    fresh_ = true;
+}
+
+const pdb::module_map::mapping *pdb::module_map::find_mapping(std::uint64_t address)
+{
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        auto it = std::upper_bound(mappings_.begin(), mappings_.end(), address, [](auto address, auto &entry) { return address < entry.start; });
+        if (it != mappings_.begin() and address < std::prev(it)->end)
+            return &*std::prev(it);
+
+        if (fresh_)
+            break;
+        reload();
+    }
+    return nullptr;
+}
+
+pdb::module_map::module *pdb::module_map::find_module(std::uint64_t pc)
+{
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        auto it = std::upper_bound(modules_.begin(), modules_.end(), pc, [](auto pc, auto &mod) { return pc < mod.start; });
+        if (it != modules_.begin() and pc < std::prev(it)->end)
+        {
+            auto &mod = *std::prev(it);
+            if (!mod.loaded)
+                load_module(mod);
+            return &mod;
+        }
+
+        // new code since the last look, a dlopen or a thread stack we haven't seen
+        if (fresh_)
+            break;
+        reload();
+    }
+    return nullptr;
+}
+
+std::string_view pdb::module_map::symbol_name(virt_addr pc, bool return_address)
+{
+    auto address = return_address ? pc.addr() - 1 : pc.addr();
+    auto mod = find_module(address);
+    if (!mod or !mod->file)
+        return {};
+
+    auto symbol = mod->file->get_symbol_containing_address(file_addr(address - mod->load_bias));
+    return symbol ? mod->file->get_symbol_name(*symbol) : std::string_view();
+}
+
+void pdb::module_map::load_module(module &mod)
+{
+    mod.loaded = true;
+
+    // [vdso] and friends aren't files, their frames go through the frame pointer fallback
+    if (mod.path.empty() or mod.path[0] == '[')
+        return;
+
+    auto entry = std::find_if(mappings_.begin(), mappings_.end(), [&](auto &m) { return m.start == mod.start; });
+    try
+    {
+        mod.file = std::make_unique<elf>(mod.path);
+
+        // the kernel maps the page holding a segment's first byte at bias + its page aligned address
+        for (auto &segment : mod.file->segments())
+        {
+            if (segment.p_type == PT_LOAD and entry != mappings_.end() and
+                (segment.p_offset & ~std::uint64_t(0xfff)) == entry->offset)
+            {
+                mod.load_bias = mod.start - (segment.p_vaddr & ~std::uint64_t(0xfff));
+                break;
+            }
+        }
+
+        mod.cfi = std::make_unique<call_frame_info>(*mod.file);
+    }
+    catch (const error &)
+    {
+        mod.cfi.reset();
+        mod.file.reset();
+    }
+}
+
+pdb::unwinder::unwinder(process &proc) : process_(&proc), modules_(proc.pid()), window_(stack_window_size)
+{
+}
+
+pdb::unwinder::~unwinder() = default;
+
+bool pdb::unwinder::read_word(std::uint64_t address, std::uint64_t &value)
+{
+    if (address >= window_start_ and address + sizeof(value) <= window_start_ + window_size_)
+    {
+        std::memcpy(&value, window_.data() + (address - window_start_), sizeof(value));
+        return true;
+    }
+
+    // one transfer for the whole window, the frames above this one are almost always in it
+    auto area = modules_.find_mapping(address);
+    if (!area or address + sizeof(value) > area->end)
+        return false;
+
+    auto size = std::min<std::uint64_t>(stack_window_size, area->end - address);
+    try
+    {
+        process_->read_memory(virt_addr(address), span<std::byte>(window_.data(), size));
+    }
+    catch (const error &)
+    {
+        window_size_ = 0;
+        return false;
+    }
+
+    window_start_ = address;
+    window_size_ = size;
+    ++stats_.stack_reads;
+    stats_.stack_bytes += size;
+
+    std::memcpy(&value, window_.data(), sizeof(value));
+    return true;
+}
+
+bool pdb::unwinder::evaluate(span<const std::byte> expr, const register_set &regs, register_mask known,
+                             std::optional<std::uint64_t> initial, std::uint64_t &result)
+{
+    std::array<std::uint64_t, 64> stack;
+    std::size_t depth = 0;
+    auto push = [&](std::uint64_t value) {
+        if (depth == stack.size())
+            dwarf_cursor::malformed();
+        stack[depth++] = value;
+    };
+    auto pop = [&] {
+        if (depth == 0)
+            dwarf_cursor::malformed();
+        return stack[--depth];
+    };
+    auto reg = [&](std::uint64_t number) {
+        if (number >= unwind_register_count or !(known & register_bit(number)))
+            dwarf_cursor::malformed();
+        return regs[number];
+    };
+
+    if (initial)
+        push(*initial);
+
+    try
+    {
+        dwarf_cursor cursor(expr);
+        while (!cursor.finished())
+        {
+            auto opcode = cursor.u8();
+            if (opcode >= DW_OP_lit0 and opcode <= DW_OP_lit31)
+            {
+                push(opcode - DW_OP_lit0);
+                continue;
+            }
+            if (opcode >= DW_OP_reg0 and opcode <= DW_OP_reg31)
+            {
+                push(reg(opcode - DW_OP_reg0));
+                continue;
+            }
+            if (opcode >= DW_OP_breg0 and opcode <= DW_OP_breg31)
+            {
+                push(reg(opcode - DW_OP_breg0) + cursor.sleb128());
+                continue;
+            }
+
+            switch (opcode)
+            {
+            case DW_OP_addr: push(cursor.u64()); break;
+            case DW_OP_deref:
+            {
+                std::uint64_t value;
+                if (!read_word(pop(), value))
+                    return false;
+                push(value);
+                break;
+            }
+            case DW_OP_const1u: push(cursor.u8()); break;
+            case DW_OP_const1s: push(static_cast<std::int8_t>(cursor.u8())); break;
+            case DW_OP_const2u: push(cursor.u16()); break;
+            case DW_OP_const2s: push(static_cast<std::int16_t>(cursor.u16())); break;
+            case DW_OP_const4u: push(cursor.u32()); break;
+            case DW_OP_const4s: push(static_cast<std::int32_t>(cursor.u32())); break;
+            case DW_OP_const8u: case DW_OP_const8s: push(cursor.u64()); break;
+            case DW_OP_constu: push(cursor.uleb128()); break;
+            case DW_OP_consts: push(cursor.sleb128()); break;
+            case DW_OP_regx: push(reg(cursor.uleb128())); break;
+            case DW_OP_bregx:
+            {
+                auto number = cursor.uleb128();
+                push(reg(number) + cursor.sleb128());
+                break;
+            }
+            case DW_OP_dup: { auto a = pop(); push(a); push(a); break; }
+            case DW_OP_drop: pop(); break;
+            case DW_OP_over: { auto a = pop(); auto b = pop(); push(b); push(a); push(b); break; }
+            case DW_OP_pick:
+            {
+                auto index = cursor.u8();
+                if (index >= depth)
+                    return false;
+                push(stack[depth - 1 - index]);
+                break;
+            }
+            case DW_OP_swap: { auto a = pop(); auto b = pop(); push(a); push(b); break; }
+            case DW_OP_rot: { auto a = pop(); auto b = pop(); auto c = pop(); push(a); push(c); push(b); break; }
+            case DW_OP_abs: { auto a = static_cast<std::int64_t>(pop()); push(a < 0 ? -a : a); break; }
+            case DW_OP_neg: push(-pop()); break;
+            case DW_OP_not: push(~pop()); break;
+            case DW_OP_plus_uconst: push(pop() + cursor.uleb128()); break;
+            case DW_OP_and: case DW_OP_div: case DW_OP_minus: case DW_OP_mod: case DW_OP_mul: case DW_OP_or:
+            case DW_OP_plus: case DW_OP_shl: case DW_OP_shr: case DW_OP_shra: case DW_OP_xor:
+            case DW_OP_eq: case DW_OP_ge: case DW_OP_gt: case DW_OP_le: case DW_OP_lt: case DW_OP_ne:
+            {
+                auto b = pop();
+                auto a = pop();
+                auto sa = static_cast<std::int64_t>(a);
+                auto sb = static_cast<std::int64_t>(b);
+                std::uint64_t value = 0;
+                switch (opcode)
+                {
+                case DW_OP_and: value = a & b; break;
+                case DW_OP_div: if (sb == 0) return false; value = sa / sb; break;
+                case DW_OP_minus: value = a - b; break;
+                case DW_OP_mod: if (b == 0) return false; value = a % b; break;
+                case DW_OP_mul: value = a * b; break;
+                case DW_OP_or: value = a | b; break;
+                case DW_OP_plus: value = a + b; break;
+                case DW_OP_shl: value = b < 64 ? a << b : 0; break;
+                case DW_OP_shr: value = b < 64 ? a >> b : 0; break;
+                case DW_OP_shra: value = b < 64 ? sa >> b : (sa < 0 ? -1 : 0); break;
+                case DW_OP_xor: value = a ^ b; break;
+                case DW_OP_eq: value = sa == sb; break;
+                case DW_OP_ge: value = sa >= sb; break;
+                case DW_OP_gt: value = sa > sb; break;
+                case DW_OP_le: value = sa <= sb; break;
+                case DW_OP_lt: value = sa < sb; break;
+                case DW_OP_ne: value = sa != sb; break;
+                }
+                push(value);
+                break;
+            }
+            case DW_OP_skip:
+            {
+                auto offset = static_cast<std::int16_t>(cursor.u16());
+                cursor.seek(cursor.position() + offset);
+                break;
+            }
+            case DW_OP_bra:
+            {
+                auto offset = static_cast<std::int16_t>(cursor.u16());
+                if (pop() != 0)
+                    cursor.seek(cursor.position() + offset);
+                break;
+            }
+            case DW_OP_nop: break;
+            default: return false;
+            }
+        }
+    }
+    catch (const error &)
+    {
+        return false;
+    }
+
+    if (depth == 0)
+        return false;
+    result = stack[depth - 1];
+    return true;
+}
+
+bool pdb::unwinder::step_cfi(register_set &regs, register_mask &known, bool caller_frame, bool &signal_frame, std::uint64_t &cfa)
+{
+    // a return address is the instruction after the call, which can be past the end of a noreturn function
+    auto pc = regs[return_address_register];
+    auto lookup = caller_frame ? pc - 1 : pc;
+
+    auto mod = modules_.find_module(lookup);
+    if (!mod or !mod->cfi)
+        return false;
+
+    bool signal = false;
+    auto row = mod->cfi->find_row(file_addr(lookup - mod->load_bias), signal);
+    if (!row)
+        return false;
+
+    if (row->cfa.is_expression)
+    {
+        if (!evaluate(row->cfa.expr, regs, known, std::nullopt, cfa))
+            return false;
+    }
+    else
+    {
+        if (row->cfa.reg >= unwind_register_count or !(known & register_bit(row->cfa.reg)))
+            return false;
+        cfa = regs[row->cfa.reg] + row->cfa.offset;
+    }
+
+    auto caller = regs;
+    auto caller_known = known;
+    for (std::size_t i = 0; i < unwind_register_count; ++i)
+    {
+        auto &rule = row->registers[i];
+        switch (rule.type)
+        {
+        case register_rule::same_value:
+            break;
+        case register_rule::undefined:
+            caller_known &= ~register_bit(i);
+            break;
+        case register_rule::at_offset:
+            if (!read_word(cfa + rule.offset, caller[i]))
+                return false;
+            caller_known |= register_bit(i);
+            break;
+        case register_rule::val_offset:
+            caller[i] = cfa + rule.offset;
+            caller_known |= register_bit(i);
+            break;
+        case register_rule::in_register:
+            if (rule.reg >= unwind_register_count or !(known & register_bit(rule.reg)))
+            {
+                caller_known &= ~register_bit(i);
+                break;
+            }
+            caller[i] = regs[rule.reg];
+            caller_known |= register_bit(i);
+            break;
+        case register_rule::at_expression:
+        {
+            std::uint64_t address;
+            if (!evaluate(rule.expr, regs, known, cfa, address) or !read_word(address, caller[i]))
+                return false;
+            caller_known |= register_bit(i);
+            break;
+        }
+        case register_rule::val_expression:
+            if (!evaluate(rule.expr, regs, known, cfa, caller[i]))
+                return false;
+            caller_known |= register_bit(i);
+            break;
+        }
+    }
+
+    // the CFA is by definition the stack pointer of the caller
+    caller[stack_pointer_register] = cfa;
+    caller_known |= register_bit(stack_pointer_register);
+
+    regs = caller;
+    known = caller_known;
+    signal_frame = signal;
+    return true;
+}
+
+bool pdb::unwinder::step_frame_pointer(register_set &regs, register_mask &known, std::uint64_t &cfa)
+{
+    // push rbp; mov rsp, rbp leaves the caller's rbp at [rbp] and the return address above it
+    auto fp = regs[frame_pointer_register];
+    if (!(known & register_bit(frame_pointer_register)) or fp == 0 or fp % 8 != 0 or
+        ((known & register_bit(stack_pointer_register)) and fp < regs[stack_pointer_register]))
+        return false;
+
+    std::uint64_t saved_fp, return_address;
+    if (!read_word(fp, saved_fp) or !read_word(fp + 8, return_address))
+        return false;
+
+    cfa = fp + 16;
+    regs[frame_pointer_register] = saved_fp;
+    regs[return_address_register] = return_address;
+    regs[stack_pointer_register] = cfa;
+
+    // nothing says where the other registers went
+    known = register_bit(frame_pointer_register) | register_bit(return_address_register) | register_bit(stack_pointer_register);
+    return true;
+}
+
+std::size_t pdb::unwinder::backtrace(pid_t tid, span<stack_frame> out)
+{
+    if (out.empty())
+        return 0;
+
+    ++stats_.backtraces;
+    // the stack has moved on since the last backtrace, and the maps may have too
+    window_size_ = 0;
+    modules_.mark_stale();
+
+    auto &thread_registers = process_->get_registers(tid);
+    register_set regs;
+    for (std::size_t i = 0; i < unwind_register_count; ++i)
+        regs[i] = thread_registers.read_by_id_As<std::uint64_t>(register_info_by_dwarf(i).id);
+    register_mask known = register_bit(unwind_register_count) - 1;
+
+    std::size_t count = 0;
+    bool below_is_signal_frame = false;
+    std::uint64_t previous_cfa = 0;
+    while (count < out.size())
+    {
+        auto pc = regs[return_address_register];
+        if (pc == 0)
+            break;
+
+        auto caller = regs;
+        auto caller_known = known;
+        std::uint64_t cfa = 0;
+        bool signal_frame = false;
+        auto method = unwind_method::cfi;
+
+        auto unwound = cfi_enabled_ and step_cfi(caller, caller_known, count > 0 and !below_is_signal_frame, signal_frame, cfa);
+        if (!unwound)
+        {
+            caller = regs;
+            caller_known = known;
+            method = unwind_method::frame_pointer;
+            unwound = step_frame_pointer(caller, caller_known, cfa);
+        }
+
+        out[count++] = {virt_addr(pc), virt_addr(cfa), method};
+        if (!unwound)
+            break;
+        ++(method == unwind_method::cfi ? stats_.cfi_frames : stats_.frame_pointer_frames);
+
+        // the outermost frame says its return address is undefined, and stacks only grow one way
+        if (!(caller_known & register_bit(return_address_register)) or (count > 1 and cfa <= previous_cfa))
+            break;
+
+        previous_cfa = cfa;
+        regs = caller;
+        known = caller_known;
+        below_is_signal_frame = signal_frame;
+    }
+    return count;
+}
+
+std::vector<pdb::stack_frame> pdb::unwinder::backtrace(std::size_t max_frames)
+{
+    std::vector<stack_frame> frames(max_frames);
+    frames.resize(backtrace(process_->current_thread(), frames));
+    return frames;
+}
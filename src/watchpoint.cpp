@@ -0,0 +1,46 @@
+#include <libpdb/watchpoint.hpp>
+#include <libpdb/process.hpp>
+#include <libpdb/error.hpp>
+
+namespace
+{
+    // ids are unique across all processes
+    auto get_next_id()
+    {
+        static pdb::watchpoint::id_type id = 0;
+        return ++id;
+    }
+}
+
+pdb::watchpoint::watchpoint(process &proc, virt_addr address, stoppoint_mode mode, std::size_t size)
+    : id_(get_next_id()), process_(&proc), address_(address), mode_(mode), size_(size)
+{
+    // the cpu only matches naturally aligned addresses and execute stoppoints must have length 1
+    if (size != 1 and size != 2 and size != 4 and size != 8)
+        error::send("Invalid watchpoint size");
+
+    if (mode == stoppoint_mode::execute and size != 1)
+        error::send("Execute watchpoints must have size 1");
+
+    if ((address.addr() & (size - 1)) != 0)
+        error::send("Watchpoint must be aligned to size");
+}
+
+void pdb::watchpoint::enable()
+{
+    if (is_enabled_)
+        return;
+
+    hardware_index_ = process_->set_hardware_stoppoint(address_, mode_, size_);
+    is_enabled_ = true;
+}
+
+void pdb::watchpoint::disable()
+{
+    if (!is_enabled_)
+        return;
+
+    process_->clear_hardware_stoppoint(hardware_index_);
+    hardware_index_ = -1;
+    is_enabled_ = false;
+}
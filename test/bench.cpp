@@ -0,0 +1,247 @@
+// the benchmarks of the libpdb primitives, built as their own target so they run on their own
+// every benchmark also goes to the JSON file named by PDB_BENCH_JSON, `cmake --build . --target bench_json`
+// runs them all into bench.json in the build directory
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/reporters/catch_reporter_event_listener.hpp>
+#include <catch2/reporters/catch_reporter_registrars.hpp>
+#include <libpdb/process.hpp>
+#include <libpdb/register_info.hpp>
+#include <libpdb/registers.hpp>
+#include <sched.h>
+#include <sys/utsname.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace pdb;
+
+namespace
+{
+    std::string json_string(const std::string &text)
+    {
+        std::string quoted = "\"";
+        for (auto c : text)
+        {
+            if (c == '"' or c == '\\')
+                quoted += '\\';
+            if (static_cast<unsigned char>(c) < 0x20)
+                quoted += ' ';
+            else
+                quoted += c;
+        }
+        return quoted + '"';
+    }
+
+    // collects the statistics of every benchmark and writes them out at the end of the run
+    // the run is pinned to the cpu it started on, and so is every inferior it launches, a round trip then
+    // never waits for a wakeup on another cpu and the numbers hold still from one run to the next
+    class bench_json_listener : public Catch::EventListenerBase
+    {
+    public:
+        using EventListenerBase::EventListenerBase;
+
+        void testRunStarting(Catch::TestRunInfo const &) override
+        {
+            cpu_ = sched_getcpu();
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu_, &set);
+            if (sched_setaffinity(0, sizeof(set), &set) < 0)
+                cpu_ = -1;
+        }
+
+        void testCaseStarting(Catch::TestCaseInfo const &info) override { test_case_ = info.name; }
+
+        void benchmarkEnded(Catch::BenchmarkStats<> const &stats) override
+        {
+            std::vector<double> samples;
+            for (auto &sample : stats.samples)
+                samples.push_back(sample.count());
+            std::sort(samples.begin(), samples.end());
+
+            std::string entry = "    {\"group\": " + json_string(test_case_) + ", \"name\": " + json_string(stats.info.name);
+            entry += ", \"samples\": " + std::to_string(samples.size());
+            entry += ", \"iterations\": " + std::to_string(stats.info.iterations);
+            entry += ", \"mean_ns\": " + std::to_string(stats.mean.point.count());
+            entry += ", \"mean_low_ns\": " + std::to_string(stats.mean.lower_bound.count());
+            entry += ", \"mean_high_ns\": " + std::to_string(stats.mean.upper_bound.count());
+            entry += ", \"std_dev_ns\": " + std::to_string(stats.standardDeviation.point.count());
+            if (!samples.empty())
+            {
+                entry += ", \"median_ns\": " + std::to_string(samples[samples.size() / 2]);
+                entry += ", \"min_ns\": " + std::to_string(samples.front());
+            }
+            entry += ", \"outliers\": " + std::to_string(stats.outliers.total());
+            entry += ", \"outlier_variance\": " + std::to_string(stats.outlierVariance) + "}";
+            entries_.push_back(std::move(entry));
+        }
+
+        void testRunEnded(Catch::TestRunStats const &) override
+        {
+            auto path = std::getenv("PDB_BENCH_JSON");
+            if (!path)
+                return;
+
+            utsname host{};
+            uname(&host);
+            char date[32];
+            auto now = std::time(nullptr);
+            std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+            std::ofstream out(path);
+            out << "{\n  \"context\": {\"date\": " << json_string(date) << ", \"kernel\": " << json_string(host.release)
+                << ", \"machine\": " << json_string(host.machine) << ", \"pinned_cpu\": " << cpu_ << "},\n";
+            out << "  \"benchmarks\": [\n";
+            for (std::size_t i = 0; i < entries_.size(); ++i)
+                out << entries_[i] << (i + 1 < entries_.size() ? ",\n" : "\n");
+            out << "  ]\n}\n";
+        }
+
+    private:
+        int cpu_ = -1;
+        std::string test_case_;
+        std::vector<std::string> entries_;
+    };
+}
+
+CATCH_REGISTER_LISTENER(bench_json_listener)
+
+TEST_CASE("launch", "[benchmark][process]")
+{
+    launch_options options;
+
+    BENCHMARK("launch to the exec stop and kill")
+    {
+        return process::launch("targets/bench_idle", options)->pid();
+    };
+
+    // the debugger's memory, touched so its pages are really there to copy
+    options.debug = false;
+    std::vector<char> ballast;
+    for (std::size_t megabytes : {0, 256, 1024})
+    {
+        ballast.assign(megabytes << 20, 1);
+        for (auto method : {launch_method::fork, launch_method::vfork})
+        {
+            options.method = method;
+            auto name = std::string(method == launch_method::fork ? "fork" : "vfork") + " launch with " +
+                        std::to_string(megabytes) + " MiB resident";
+            BENCHMARK(name.c_str())
+            {
+                return process::launch("targets/end_immediately", options)->pid();
+            };
+        }
+    }
+}
+
+TEST_CASE("attach", "[benchmark][process]")
+{
+    auto target = process::launch("targets/bench_idle", false);
+
+    // attach, one register snapshot and detach is all the time the target spends stopped
+    BENCHMARK("PTRACE_ATTACH + SIGSTOP/SIGCONT")
+    {
+        auto proc = process::attach(target->pid(), attach_mode::attach);
+        auto pc = proc->get_pc();
+        proc->detach();
+        return pc;
+    };
+
+    BENCHMARK("PTRACE_SEIZE + PTRACE_INTERRUPT")
+    {
+        auto proc = process::attach(target->pid(), attach_mode::seize);
+        auto pc = proc->get_pc();
+        proc->detach();
+        return pc;
+    };
+}
+
+TEST_CASE("resume round trip", "[benchmark][process]")
+{
+    auto proc = process::launch("targets/bench_trap");
+
+    BENCHMARK("resume to the next int3")
+    {
+        proc->resume();
+        return proc->wait_on_signal().info;
+    };
+
+    BENCHMARK("try_resume to the next int3")
+    {
+        (void)proc->try_resume();
+        return proc->try_wait_on_signal()->info;
+    };
+}
+
+TEST_CASE("registers", "[benchmark][register]")
+{
+    auto proc = process::launch("targets/bench_trap");
+    proc->resume();
+    proc->wait_on_signal();
+    auto &regs = proc->get_registers();
+
+    BENCHMARK("read_all_registers")
+    {
+        regs.invalidate();
+        proc->read_all_registers();
+        return regs.stats().syscalls;
+    };
+
+    // one of each class, a cached read is a copy out of the user area, an uncached one fetches the bank
+    // writes go straight to the kernel, with the value already in there
+    for (auto name : {"rax", "eax", "ah", "xmm0", "st0", "dr7"})
+    {
+        auto &info = register_info_by_name(name);
+        auto value = regs.read(info);
+
+        BENCHMARK(std::string("read ") + name + " cached")
+        {
+            return regs.read(info);
+        };
+
+        BENCHMARK(std::string("read ") + name + " from the kernel")
+        {
+            regs.invalidate();
+            return regs.read(info);
+        };
+
+        BENCHMARK(std::string("write ") + name)
+        {
+            regs.write(info, value);
+        };
+    }
+}
+
+TEST_CASE("register_info lookup", "[benchmark][register]")
+{
+    // the last registers in the table are the worst case for a linear scan
+    BENCHMARK("by_name table")
+    {
+        return register_info_by_name("dr7").offset;
+    };
+    BENCHMARK("by_name linear scan")
+    {
+        return register_info_by([](auto &i) { return i.name == "dr7"; }).offset;
+    };
+    BENCHMARK("by_id table")
+    {
+        return register_info_by_id(register_id::dr7).offset;
+    };
+    BENCHMARK("by_id linear scan")
+    {
+        return register_info_by([](auto &i) { return i.id == register_id::dr7; }).offset;
+    };
+    BENCHMARK("by_dwarf table")
+    {
+        return register_info_by_dwarf(66).offset;
+    };
+    BENCHMARK("by_dwarf linear scan")
+    {
+        return register_info_by([](auto &i) { return i.dwarf_id == 66; }).offset;
+    };
+}
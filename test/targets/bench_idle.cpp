@@ -0,0 +1,8 @@
+// sleeps until it is killed, something to attach to that doesn't compete with us for the cpu
+#include <unistd.h>
+
+int main()
+{
+    for (;;)
+        pause();
+}
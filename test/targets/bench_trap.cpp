@@ -0,0 +1,6 @@
+// stops with a SIGTRAP every time it is resumed, one resume to wait_on_signal round trip per int3
+int main()
+{
+    for (;;)
+        __asm__ volatile("int3");
+}
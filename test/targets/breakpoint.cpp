@@ -0,0 +1,21 @@
+#include <cstdint>
+#include <signal.h>
+#include <unistd.h>
+
+// called a few times so the debugger can check that it keeps stopping on the same breakpoint
+__attribute__((noinline)) void hit_me()
+{
+    asm volatile("" ::: "memory");
+}
+
+// reports the address of hit_me on stdout as raw bytes and traps so the debugger can set a breakpoint on it
+int main()
+{
+    auto address = reinterpret_cast<std::uint64_t>(&hit_me);
+    write(STDOUT_FILENO, &address, sizeof(address));
+
+    raise(SIGTRAP);
+
+    for (int i = 0; i < 3; ++i)
+        hit_me();
+}
@@ -0,0 +1,25 @@
+// writes argv[1] bytes to stdout, byte i being 'a' + i % 26, then "done" to stderr
+#include <cstdlib>
+#include <unistd.h>
+
+int main(int argc, char **argv)
+{
+    auto total = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 0ul;
+
+    char chunk[64 * 26];
+    for (unsigned long i = 0; i < sizeof(chunk); ++i)
+        chunk[i] = static_cast<char>('a' + i % 26);
+
+    // the chunk is a multiple of 26 long, so the pattern carries on across writes, short ones included
+    for (unsigned long written = 0; written < total;)
+    {
+        auto offset = written % sizeof(chunk);
+        auto size = total - written < sizeof(chunk) - offset ? total - written : sizeof(chunk) - offset;
+        auto bytes = write(STDOUT_FILENO, chunk + offset, size);
+        if (bytes <= 0)
+            return 1;
+        written += bytes;
+    }
+
+    write(STDERR_FILENO, "done\n", 5);
+}
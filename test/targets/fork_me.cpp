@@ -0,0 +1,13 @@
+// prints its pid and how often main ran in this process, then exits with 42
+// every copy a fork server makes starts at main with the memory the template had there, so it prints 1
+#include <iostream>
+#include <unistd.h>
+
+int runs = 0;
+
+int main()
+{
+    ++runs;
+    std::cout << getpid() << ' ' << runs << std::endl;
+    return 42;
+}
@@ -0,0 +1,26 @@
+#include <cstdint>
+#include <cstring>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// maps a large patterned buffer and a read only page, reports their addresses on stdout
+// as raw bytes and then traps so the debugger can poke at them
+int main()
+{
+    std::size_t size = 16 << 20;
+    auto buffer = static_cast<unsigned char *>(
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    for (std::size_t i = 0; i < size; ++i)
+        buffer[i] = static_cast<unsigned char>(i);
+
+    auto page = mmap(nullptr, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    std::memset(page, 0xab, 4096);
+    mprotect(page, 4096, PROT_READ);
+
+    std::uint64_t info[] = {
+        reinterpret_cast<std::uint64_t>(buffer), size, reinterpret_cast<std::uint64_t>(page)};
+    write(STDOUT_FILENO, info, sizeof(info));
+
+    raise(SIGTRAP);
+}
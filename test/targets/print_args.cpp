@@ -0,0 +1,22 @@
+// prints its arguments, PDB_TEST from the environment and its working directory on stdout, one per line,
+// then copies a line from stdin to stderr, so a launch can check everything it passed on
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i)
+        std::printf("%s\n", argv[i]);
+
+    auto value = std::getenv("PDB_TEST");
+    std::printf("%s\n", value ? value : "(unset)");
+
+    char directory[4096];
+    std::printf("%s\n", getcwd(directory, sizeof(directory)) ? directory : "?");
+    std::fflush(stdout);
+
+    char line[256];
+    if (std::fgets(line, sizeof(line), stdin))
+        std::fputs(line, stderr);
+}
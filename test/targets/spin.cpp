@@ -0,0 +1,25 @@
+// burns cpu forever, about nine parts in hot and one in cold, for the profiler to find
+
+volatile unsigned long sink;
+
+// the counters live on the stack, gcc sets up no frame pointer in a leaf that doesn't use it
+__attribute__((noinline)) void hot()
+{
+    for (volatile int i = 0; i < 900000; i = i + 1)
+        sink = sink + i;
+}
+
+__attribute__((noinline)) void cold()
+{
+    for (volatile int i = 0; i < 100000; i = i + 1)
+        sink = sink + i;
+}
+
+int main()
+{
+    for (;;)
+    {
+        hot();
+        cold();
+    }
+}
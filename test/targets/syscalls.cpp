@@ -0,0 +1,14 @@
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// lots of cheap syscalls with three getpids in between, for catching getpid while everything else runs
+int main()
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int j = 0; j < 1000; ++j)
+            syscall(SYS_getppid);
+
+        syscall(SYS_getpid);
+    }
+}
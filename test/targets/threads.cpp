@@ -0,0 +1,44 @@
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include <signal.h>
+#include <unistd.h>
+
+constexpr int thread_count = 64;
+
+std::atomic<int> started{0};
+std::atomic<bool> go{false};
+volatile std::uint64_t shared = 0;
+
+// starts 64 threads, reports the address of shared on stdout as raw bytes and traps once they all run
+// after the trap the threads take turns writing shared so the debugger can watch it from any of them
+int main()
+{
+    std::vector<std::thread> threads;
+    for (int i = 0; i < thread_count; ++i)
+    {
+        threads.emplace_back([] {
+            ++started;
+            while (!go)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            for (;;)
+            {
+                shared = shared + 1;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+    }
+
+    while (started != thread_count)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    auto address = reinterpret_cast<std::uint64_t>(&shared);
+    write(STDOUT_FILENO, &address, sizeof(address));
+
+    raise(SIGTRAP);
+    go = true;
+
+    for (auto &thread : threads)
+        thread.join();
+}
@@ -0,0 +1,34 @@
+// recurses down to a fixed depth and traps at the bottom, so the debugger can check every frame of the stack
+// it is built twice: without frame pointers, where only the CFI can unwind it, and with them
+
+volatile int sink;
+
+__attribute__((noinline)) int recurse(int depth)
+{
+    if (depth == 0)
+    {
+        asm volatile("int3");
+        return 0;
+    }
+
+    // not a tail call, the frame has to stay on the stack
+    auto result = recurse(depth - 1) + 1;
+    sink = result;
+    return result;
+}
+
+__attribute__((noinline)) int start_recursion()
+{
+    auto result = recurse(32);
+    sink = result;
+    return result;
+}
+
+int main()
+{
+    start_recursion();
+
+    // trap again so the benchmark can stop once more at the same depth after resuming
+    for (int i = 0; i < 3; ++i)
+        start_recursion();
+}
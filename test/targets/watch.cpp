@@ -0,0 +1,24 @@
+#include <cstdint>
+#include <signal.h>
+#include <unistd.h>
+
+volatile std::uint64_t counter = 0;
+
+__attribute__((noinline)) void bump()
+{
+    counter = counter + 1;
+}
+
+// reports the addresses of counter and bump on stdout as raw bytes and traps
+// so the debugger can set watchpoints on them
+int main()
+{
+    std::uint64_t addresses[] = {
+        reinterpret_cast<std::uint64_t>(&counter), reinterpret_cast<std::uint64_t>(&bump)};
+    write(STDOUT_FILENO, addresses, sizeof(addresses));
+
+    raise(SIGTRAP);
+
+    for (int i = 0; i < 3; ++i)
+        bump();
+}
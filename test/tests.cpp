@@ -1,9 +1,34 @@
 #include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
 #include <libpdb/process.hpp>
 #include <sys/types.h>
 #include <signal.h>
 #include <libpdb/error.hpp>
+#include <libpdb/pipe.hpp>
+#include <libpdb/bit.hpp>
+#include <libpdb/session.hpp>
+#include <libpdb/syscalls.hpp>
+#include <libpdb/elf.hpp>
+#include <libpdb/dwarf.hpp>
+#include <libpdb/dwarf_index.hpp>
+#include <libpdb/thread_pool.hpp>
+#include <libpdb/index_cache.hpp>
+#include <libpdb/unwinder.hpp>
+#include <libpdb/profiler.hpp>
+#include <libpdb/fork_server.hpp>
+#include <libpdb/output_capture.hpp>
+#include <libpdb/expected.hpp>
+#include <libpdb/stats.hpp>
+#include <libpdb/trace.hpp>
+#include <atomic>
+#include <thread>
+#include <libpdb/detail/dwarf.h>
+#include <sys/auxv.h>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <chrono>
+#include <iostream>
 
 using namespace pdb;
 
@@ -30,6 +55,49 @@ namespace
         // when kill fails bcoz process does not exits it returns -1 and ESRCH is set
         return ret != -1 and errno != ESRCH;
     }
+
+    // launches a target that writes what the test needs to know to its stdout and then traps,
+    // and hands back the process stopped at that trap along with the report
+    std::pair<std::unique_ptr<process>, std::vector<std::byte>> launch_reporting_target(const std::filesystem::path &path)
+    {
+        pdb::pipe channel(/*close_on_exec=*/false);
+        auto proc = process::launch(path, true, channel.get_write());
+        channel.close_write();
+
+        proc->resume();
+        proc->wait_on_signal();
+
+        return {std::move(proc), channel.read()};
+    }
+
+    // targets/memory reports where its buffers live and then traps
+    struct memory_target
+    {
+        std::unique_ptr<process> proc;
+        virt_addr buffer;
+        std::size_t size;
+        virt_addr read_only_page;
+    };
+
+    memory_target launch_memory_target()
+    {
+        auto [proc, data] = launch_reporting_target("targets/memory");
+        auto info = reinterpret_cast<const std::uint64_t *>(data.data());
+        return {std::move(proc), virt_addr(info[0]), info[1], virt_addr(info[2])};
+    }
+
+    // targets/breakpoint reports where hit_me is, traps, and then calls it three times
+    struct breakpoint_target
+    {
+        std::unique_ptr<process> proc;
+        virt_addr hit_me;
+    };
+
+    breakpoint_target launch_breakpoint_target()
+    {
+        auto [proc, data] = launch_reporting_target("targets/breakpoint");
+        return {std::move(proc), virt_addr(from_bytes<std::uint64_t>(data.data()))};
+    }
 }
 
 // define testcase for launch
@@ -45,6 +113,218 @@ TEST_CASE("process::launch no such program", "[process]")
     REQUIRE_THROWS_AS(process::launch("potato_are_good"), error);
 }
 
+namespace
+{
+    // everything that comes out of a pipe until the other end is closed
+    std::string read_all(pdb::pipe &channel)
+    {
+        std::string out;
+        for (;;)
+        {
+            auto data = channel.read();
+            if (data.empty())
+                return out;
+            out.append(reinterpret_cast<const char *>(data.data()), data.size());
+        }
+    }
+}
+
+TEST_CASE("process::launch passes arguments, environment, directory and streams", "[process]")
+{
+    for (auto method : {launch_method::vfork, launch_method::fork})
+    {
+        pdb::pipe input(false), output(false), errors(false);
+
+        launch_options options;
+        options.arguments = {"first", "second argument"};
+        options.environment = std::vector<std::string>{"PDB_TEST=potato"};
+        options.working_directory = "/tmp";
+        options.stdin_replacement = input.get_read();
+        options.stdout_replacement = output.get_write();
+        options.stderr_replacement = errors.get_write();
+        options.method = method;
+
+        auto proc = process::launch(std::filesystem::absolute("targets/print_args"), options);
+        input.close_read();
+        output.close_write();
+        errors.close_write();
+
+        std::string line = "from stdin\n";
+        input.write(reinterpret_cast<std::byte *>(line.data()), line.size());
+        input.close_write();
+
+        proc->resume();
+        REQUIRE(proc->wait_on_signal().reason == process_state::exited);
+        REQUIRE(read_all(output) == "first\nsecond argument\npotato\n/tmp\n");
+        REQUIRE(read_all(errors) == "from stdin\n");
+    }
+}
+
+TEST_CASE("process::launch reports where the child failed", "[process]")
+{
+    for (auto method : {launch_method::vfork, launch_method::fork})
+    {
+        launch_options options;
+        options.method = method;
+        options.debug = false;
+
+        std::string message;
+        try
+        {
+            process::launch("potato_are_good", options);
+        }
+        catch (const error &err)
+        {
+            message = err.what();
+        }
+        REQUIRE(message == "exec failed: No such file or directory");
+
+        options.working_directory = "/potato/are/good";
+        try
+        {
+            process::launch("targets/end_immediately", options);
+            message.clear();
+        }
+        catch (const error &err)
+        {
+            message = err.what();
+        }
+        REQUIRE(message == "Could not change directory: No such file or directory");
+    }
+}
+
+TEST_CASE("fork server hands out fresh copies of the template", "[fork_server]")
+{
+    pdb::pipe channel(false);
+    launch_options options;
+    options.stdout_replacement = channel.get_write();
+
+    auto server = fork_server::launch("targets/fork_me", options);
+    channel.close_write();
+    auto template_pid = server->template_process().pid();
+
+    std::vector<pid_t> pids;
+    for (int i = 0; i < 3; ++i)
+    {
+        auto proc = server->spawn();
+        REQUIRE(proc->pid() != template_pid);
+        REQUIRE(get_process_status(proc->pid()) == 't');
+
+        proc->resume();
+        auto reason = proc->wait_on_signal();
+        REQUIRE(reason.reason == process_state::exited);
+        REQUIRE(reason.info == 42);
+        pids.push_back(proc->pid());
+    }
+    REQUIRE(server->spawned() == 3);
+
+    // the template never got past main, every copy ran it once
+    REQUIRE(get_process_status(template_pid) == 't');
+    std::string expected;
+    for (auto pid : pids)
+        expected += std::to_string(pid) + " 1\n";
+
+    server.reset();
+    REQUIRE(read_all(channel) == expected);
+}
+
+TEST_CASE("fork server benchmark", "[.][benchmark][fork_server]")
+{
+    launch_options options;
+
+    BENCHMARK("launch and run to the end")
+    {
+        auto proc = process::launch("targets/fork_me", options);
+        proc->resume();
+        return proc->wait_on_signal().info;
+    };
+
+    auto server = fork_server::launch("targets/fork_me", options);
+    BENCHMARK("spawn from main and run to the end")
+    {
+        auto proc = server->spawn();
+        proc->resume();
+        return proc->wait_on_signal().info;
+    };
+}
+
+namespace
+{
+    // the bytes chatty writes from position start on
+    bool is_chatty_output(const std::string &text, std::uint64_t start)
+    {
+        for (std::size_t i = 0; i < text.size(); ++i)
+        {
+            if (text[i] != static_cast<char>('a' + (start + i) % 26))
+                return false;
+        }
+        return true;
+    }
+}
+
+TEST_CASE("output capture keeps a chatty inferior running", "[output_capture]")
+{
+    // far more than a pipe holds, the inferior only gets to its exit if we drain while it runs
+    constexpr std::size_t total = 16 << 20;
+    constexpr std::size_t ring_size = 1 << 20;
+
+    output_capture capture(ring_size);
+    launch_options options;
+    options.arguments = {std::to_string(total)};
+    capture.attach(options);
+
+    auto proc = process::launch("targets/chatty", options);
+    capture.start();
+    proc->resume();
+    REQUIRE(proc->wait_on_signal().reason == process_state::exited);
+    REQUIRE(capture.wait_for_end(std::chrono::seconds(10)));
+
+    // the ring holds the last ring_size bytes, the rest was dropped
+    auto out = capture.get_stats(output_stream::out);
+    REQUIRE(out.bytes == total);
+    REQUIRE(out.dropped == total - ring_size);
+
+    std::vector<std::byte> first(100);
+    REQUIRE(capture.read(output_stream::out, first) == first.size());
+    std::string text(reinterpret_cast<char *>(first.data()), first.size());
+    REQUIRE(is_chatty_output(text, total - ring_size));
+
+    text = capture.take(output_stream::out);
+    REQUIRE(text.size() == ring_size - first.size());
+    REQUIRE(is_chatty_output(text, total - ring_size + first.size()));
+    REQUIRE(capture.take(output_stream::out).empty());
+
+    REQUIRE(capture.take(output_stream::err) == "done\n");
+}
+
+TEST_CASE("output capture splices a stream into a log", "[output_capture]")
+{
+    constexpr std::size_t total = 4 << 20;
+    auto log = std::filesystem::temp_directory_path() / "pdb_output_capture.log";
+
+    output_capture capture;
+    capture.log_to(output_stream::out, log);
+    launch_options options;
+    options.arguments = {std::to_string(total)};
+    capture.attach(options);
+
+    auto proc = process::launch("targets/chatty", options);
+    capture.start();
+    proc->resume();
+    REQUIRE(proc->wait_on_signal().reason == process_state::exited);
+    REQUIRE(capture.wait_for_end(std::chrono::seconds(10)));
+
+    REQUIRE(capture.get_stats(output_stream::out).bytes == total);
+    REQUIRE(capture.take(output_stream::out).empty());
+    REQUIRE(capture.take(output_stream::err) == "done\n");
+
+    std::ifstream file(log, std::ios::binary);
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    REQUIRE(text.size() == total);
+    REQUIRE(is_chatty_output(text, 0));
+    std::filesystem::remove(log);
+}
+
 TEST_CASE("process::attach invalid PID", "[process]")
 {
     REQUIRE_THROWS_AS(process::attach(0), error);
@@ -59,6 +339,245 @@ TEST_CASE("process::resume already terminated", "[process]")
     REQUIRE_THROWS_AS(proc->resume(), error);
 }
 
+TEST_CASE("try_ functions report failures as error codes", "[process][expected]")
+{
+    auto proc = process::launch("targets/run_endlessly");
+
+    auto pc = proc->get_registers().try_read(register_info_by_id(register_id::rip));
+    REQUIRE(pc.has_value());
+    REQUIRE(std::get<std::uint64_t>(*pc) == proc->get_pc().addr());
+
+    // nothing is mapped at 0, the /proc/<pid>/mem fallback fails too
+    std::byte buffer[8];
+    auto read = proc->try_read_memory(virt_addr(0), {buffer, sizeof(buffer)});
+    REQUIRE(!read);
+    REQUIRE(read.error().code == errc::read_memory_failed);
+    REQUIRE(read.error().message() == "Could not read memory: " + std::string(std::strerror(read.error().sys_errno)));
+
+    // killed behind our back, the bank we haven't fetched yet can't be read any more
+    kill(proc->pid(), SIGKILL);
+    auto xmm = proc->get_registers().try_read(register_info_by_id(register_id::xmm0));
+    REQUIRE(!xmm);
+    REQUIRE(xmm.error().code == errc::read_fprs_failed);
+    REQUIRE(xmm.error().sys_errno == ESRCH);
+
+    auto reason = proc->try_wait_on_signal();
+    REQUIRE(reason);
+    REQUIRE(reason->reason == process_state::terminated);
+
+    auto resumed = proc->try_resume();
+    REQUIRE(!resumed);
+    REQUIRE(resumed.error().code == errc::process_ended);
+
+    // the throwing API sends the same message
+    std::string message;
+    try
+    {
+        proc->resume();
+    }
+    catch (const error &err)
+    {
+        message = err.what();
+    }
+    REQUIRE(message == resumed.error().message());
+}
+
+TEST_CASE("expected benchmark", "[.][benchmark][expected]")
+{
+    auto proc = process::launch("targets/end_immediately");
+    proc->resume();
+    proc->wait_on_signal();
+
+    BENCHMARK("resume an ended process, throwing")
+    {
+        try
+        {
+            proc->resume();
+        }
+        catch (const error &)
+        {
+            return 1;
+        }
+        return 0;
+    };
+
+    BENCHMARK("resume an ended process, try_resume")
+    {
+        return proc->try_resume().has_value() ? 0 : 1;
+    };
+
+    auto target = process::launch("targets/run_endlessly");
+    std::byte buffer[8];
+
+    BENCHMARK("read unmapped memory, throwing")
+    {
+        try
+        {
+            target->read_memory(virt_addr(0), {buffer, sizeof(buffer)});
+        }
+        catch (const error &)
+        {
+            return 1;
+        }
+        return 0;
+    };
+
+    BENCHMARK("read unmapped memory, try_read_memory")
+    {
+        return target->try_read_memory(virt_addr(0), {buffer, sizeof(buffer)}).has_value() ? 0 : 1;
+    };
+}
+
+TEST_CASE("stats counts and times the kernel round trips", "[stats]")
+{
+    // a bucket is never more than a quarter wider than its floor
+    for (std::uint64_t ns : {0ull, 7ull, 8ull, 9ull, 15ull, 100ull, 1000ull, 123456ull, 1ull << 39})
+    {
+        auto bucket = stats::bucket_of(ns);
+        REQUIRE(stats::bucket_floor(bucket) <= ns);
+        REQUIRE(stats::bucket_floor(bucket + 1) > ns);
+        REQUIRE(stats::bucket_floor(bucket + 1) - stats::bucket_floor(bucket) <= std::max<std::uint64_t>(1, ns / 4));
+    }
+
+    if (!stats::enabled)
+    {
+        REQUIRE(stats::snapshot().empty());
+        return;
+    }
+
+    stats::reset();
+    auto proc = process::launch("targets/end_immediately");
+    auto pc = proc->get_pc();
+    proc->read_memory(pc, 8);
+    proc->resume();
+    proc->wait_on_signal();
+
+    auto operations = stats::snapshot();
+    auto find = [&](stats::op what) {
+        auto it = std::find_if(operations.begin(), operations.end(), [&](auto &operation) { return operation.what == what; });
+        REQUIRE(it != operations.end());
+        return *it;
+    };
+
+    REQUIRE(find(stats::op::ptrace_getregs).calls == 1);
+    REQUIRE(find(stats::op::ptrace_cont).calls == 1);
+    REQUIRE(find(stats::op::waitpid).calls >= 2);
+    REQUIRE(find(stats::op::process_vm_readv).bytes >= 8);
+
+    for (auto &operation : operations)
+    {
+        std::uint64_t counted = 0;
+        for (auto bucket : operation.buckets)
+            counted += bucket;
+        REQUIRE(counted == operation.calls);
+        REQUIRE(operation.errors == 0);
+        REQUIRE(operation.quantile_ns(0.5) <= operation.quantile_ns(0.99));
+    }
+
+    // a failed call counts as an error, and a reset starts the counts over
+    stats::reset();
+    REQUIRE(stats::snapshot().empty());
+    REQUIRE_THROWS_AS(proc->resume(), error);
+    // the process has been reaped, nobody has its pid
+    REQUIRE_THROWS_AS(process::attach(proc->pid(), attach_mode::attach), error);
+    operations = stats::snapshot();
+    REQUIRE(operations.size() == 1);
+    REQUIRE(operations[0].what == stats::op::ptrace_attach);
+    REQUIRE(operations[0].errors == 1);
+}
+
+TEST_CASE("trace records the stop handling path", "[trace]")
+{
+    trace::start();
+    auto proc = process::launch("targets/end_immediately");
+    auto &regs = proc->get_registers();
+    regs.write_by_id(register_id::rsi, regs.read_by_id_As<std::uint64_t>(register_id::rsi));
+    proc->resume();
+    proc->wait_on_signal();
+    trace::stop();
+
+    auto records = trace::records();
+    REQUIRE(trace::dropped() == 0);
+    auto count = [&](trace::event what) {
+        return std::count_if(records.begin(), records.end(), [&](auto &record) { return record.what == what; });
+    };
+    REQUIRE(count(trace::event::launch) == 1);
+    REQUIRE(count(trace::event::resume) == 1);
+    REQUIRE(count(trace::event::wait) == 2);
+    REQUIRE(count(trace::event::stop) == 2);
+    REQUIRE(count(trace::event::register_fetch) >= 1);
+    REQUIRE(count(trace::event::register_write) == 1);
+
+    auto launch = *std::find_if(records.begin(), records.end(), [](auto &record) { return record.what == trace::event::launch; });
+    REQUIRE(launch.pid == proc->pid());
+    for (auto &record : records)
+    {
+        REQUIRE(record.pid == proc->pid());
+        REQUIRE(trace::to_ns(record.start) <= trace::to_ns(record.end));
+    }
+
+    // the first wait and stop happen inside the launch, the last stop is the exit, reported
+    auto first_wait = *std::find_if(records.begin(), records.end(), [](auto &record) { return record.what == trace::event::wait; });
+    REQUIRE(first_wait.start >= launch.start);
+    REQUIRE(first_wait.end <= launch.end);
+    auto exit = records.back();
+    REQUIRE(exit.what == trace::event::stop);
+    REQUIRE(exit.arg == trace::stop_arg(static_cast<int>(process_state::exited), 0, true));
+
+    auto write = *std::find_if(records.begin(), records.end(), [](auto &record) { return record.what == trace::event::register_write; });
+    REQUIRE(write.arg == trace::register_arg(trace::register_bank::user_area, register_info_by_id(register_id::rsi).offset));
+
+    // nothing goes in once it is stopped
+    trace::emit(trace::event::resume, 1, 1, trace::now());
+    REQUIRE(trace::records().size() == records.size());
+
+    std::ostringstream json;
+    trace::write_chrome_json(json);
+    auto text = json.str();
+    REQUIRE(text.rfind("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", 0) == 0);
+    REQUIRE(text.find("\"name\":\"resume\",\"cat\":\"pdb\",\"ph\":\"X\"") != std::string::npos);
+    REQUIRE(text.find("\"reason\":\"exited\",\"info\":0,\"reported\":true") != std::string::npos);
+    std::size_t complete = 0;
+    for (auto at = text.find("\"ph\":\"X\""); at != std::string::npos; at = text.find("\"ph\":\"X\"", at + 1))
+        ++complete;
+    REQUIRE(complete == records.size());
+
+    // a full ring drops the oldest events
+    trace::start(3);
+    for (std::uint32_t i = 0; i < 10; ++i)
+        trace::emit(trace::event::resume, 1, 1, trace::now(), i);
+    trace::stop();
+    records = trace::records();
+    REQUIRE(records.size() == 4);
+    REQUIRE(trace::dropped() == 6);
+    REQUIRE(records.front().arg == 6);
+    REQUIRE(records.back().arg == 9);
+}
+
+TEST_CASE("trace benchmark", "[.][benchmark][trace]")
+{
+    auto proc = process::launch("targets/bench_trap");
+
+    BENCHMARK("resume to the next int3, not recording")
+    {
+        proc->resume();
+        return proc->wait_on_signal().info;
+    };
+
+    trace::start();
+    BENCHMARK("resume to the next int3, recording")
+    {
+        proc->resume();
+        return proc->wait_on_signal().info;
+    };
+
+    BENCHMARK("emit")
+    {
+        trace::emit(trace::event::resume, 1, 1, trace::now());
+    };
+    trace::stop();
+}
+
 TEST_CASE("process::attach success", "[process]")
 {
     auto target = process::launch("targets/run_endlessly", false);
@@ -66,6 +585,29 @@ TEST_CASE("process::attach success", "[process]")
     REQUIRE(get_process_status(target->pid()) == 't');
 }
 
+TEST_CASE("process::attach with PTRACE_SEIZE and detach", "[process]")
+{
+    auto target = process::launch("targets/run_endlessly", false);
+
+    for (auto mode : {attach_mode::seize, attach_mode::attach})
+    {
+        auto proc = process::attach(target->pid(), mode);
+        REQUIRE(proc->seized() == (mode == attach_mode::seize));
+        REQUIRE(get_process_status(target->pid()) == 't');
+        REQUIRE(proc->get_pc().addr() != 0);
+
+        // interrupts stop the seized process again after a resume
+        proc->resume();
+        proc->stop_all_threads();
+        REQUIRE(get_process_status(target->pid()) == 't');
+
+        proc->detach();
+        auto status = get_process_status(target->pid());
+        auto running = status == 'R' or status == 'S';
+        REQUIRE(running);
+    }
+}
+
 TEST_CASE("process::resume sucess", "[process]")
 {
     {
@@ -87,3 +629,1708 @@ TEST_CASE("process::resume sucess", "[process]")
         REQUIRE(sucess);
     }
 }
+
+TEST_CASE("registers are fetched lazily per bank", "[register]")
+{
+    auto proc = process::launch("targets/run_endlessly");
+    auto &regs = proc->get_registers();
+
+    // stopping does not touch the kernel until a register is read
+    REQUIRE(regs.stats().stops == 1);
+    REQUIRE(regs.stats().syscalls == 0);
+
+    // reading a gpr only pulls the gpr bank
+    auto rip = regs.read_by_id_As<std::uint64_t>(register_id::rip);
+    REQUIRE(rip != 0);
+    REQUIRE(regs.stats().syscalls == 1);
+
+    // the bank stays cached for the rest of the stop
+    regs.read_by_id_As<std::uint64_t>(register_id::rsp);
+    regs.read_by_id_As<std::uint32_t>(register_id::eax);
+    REQUIRE(regs.stats().syscalls == 1);
+    REQUIRE(regs.stats().syscalls_saved() == registers::eager_fetch_syscalls - 1);
+}
+
+TEST_CASE("registers write through the lazy cache", "[register]")
+{
+    auto proc = process::launch("targets/run_endlessly");
+    auto &regs = proc->get_registers();
+
+    regs.write_by_id(register_id::r13, std::uint64_t{0xcafecafe});
+    regs.write_by_id(register_id::mxcsr, std::uint32_t{0x1f80});
+
+    // drop the cache so the values come back from the kernel
+    regs.invalidate();
+    REQUIRE(regs.read_by_id_As<std::uint64_t>(register_id::r13) == 0xcafecafe);
+    REQUIRE(regs.read_by_id_As<std::uint32_t>(register_id::mxcsr) == 0x1f80);
+}
+
+TEST_CASE("registers write-back mode batches writes", "[register]")
+{
+    auto proc = process::launch("targets/run_endlessly");
+    auto &regs = proc->get_registers();
+    regs.set_write_back(true);
+
+    regs.write_by_id(register_id::rax, std::uint64_t{1});
+    regs.write_by_id(register_id::rdi, std::uint64_t{2});
+    regs.write_by_id(register_id::rsi, std::uint64_t{3});
+    regs.write_by_id(register_id::r12d, std::uint32_t{4});
+    REQUIRE(regs.dirty());
+    REQUIRE(regs.stats().write_syscalls == 0);
+
+    // all the gprs go out in a single PTRACE_SETREGS
+    regs.flush();
+    REQUIRE(!regs.dirty());
+    REQUIRE(regs.stats().write_syscalls == 1);
+
+    regs.invalidate();
+    REQUIRE(regs.read_by_id_As<std::uint64_t>(register_id::rax) == 1);
+    REQUIRE(regs.read_by_id_As<std::uint64_t>(register_id::rdi) == 2);
+    REQUIRE(regs.read_by_id_As<std::uint64_t>(register_id::rsi) == 3);
+    REQUIRE(regs.read_by_id_As<std::uint32_t>(register_id::r12d) == 4);
+}
+
+TEST_CASE("registers transactions commit or roll back together", "[register]")
+{
+    auto proc = process::launch("targets/run_endlessly");
+    auto &regs = proc->get_registers();
+
+    auto r14 = regs.read_by_id_As<std::uint64_t>(register_id::r14);
+
+    regs.begin_transaction();
+    regs.write_by_id(register_id::r14, std::uint64_t{0x1234});
+    REQUIRE(regs.read_by_id_As<std::uint64_t>(register_id::r14) == 0x1234);
+    REQUIRE_THROWS_AS(proc->resume(), error);
+    regs.rollback_transaction();
+    REQUIRE(regs.read_by_id_As<std::uint64_t>(register_id::r14) == r14);
+
+    regs.begin_transaction();
+    regs.write_by_id(register_id::r14, std::uint64_t{0x5678});
+    regs.write_by_id(register_id::r15, std::uint64_t{0x9abc});
+    regs.commit_transaction();
+    REQUIRE(!regs.dirty());
+
+    regs.invalidate();
+    REQUIRE(regs.read_by_id_As<std::uint64_t>(register_id::r14) == 0x5678);
+    REQUIRE(regs.read_by_id_As<std::uint64_t>(register_id::r15) == 0x9abc);
+}
+
+TEST_CASE("register_info lookups agree with g_register_infos", "[register]")
+{
+    for (auto &info : g_register_infos)
+    {
+        REQUIRE(&register_info_by_id(info.id) == &info);
+        REQUIRE(&register_info_by_name(info.name) == &info);
+        if (info.dwarf_id >= 0)
+            REQUIRE(&register_info_by_dwarf(info.dwarf_id) == &info);
+    }
+
+    REQUIRE_THROWS_AS(register_info_by_name("potato"), error);
+    REQUIRE_THROWS_AS(register_info_by_name(""), error);
+    REQUIRE_THROWS_AS(register_info_by_dwarf(-1), error);
+    REQUIRE_THROWS_AS(register_info_by_dwarf(1000), error);
+}
+
+TEST_CASE("process::read_memory bulk and vectored", "[memory]")
+{
+    auto target = launch_memory_target();
+    auto &proc = *target.proc;
+
+    auto data = proc.read_memory(target.buffer, target.size);
+    bool matches = true;
+    for (std::size_t i = 0; i < data.size(); ++i)
+        matches = matches and data[i] == static_cast<std::byte>(i & 0xff);
+    REQUIRE(matches);
+
+    // three ranges in one call
+    std::vector<std::byte> a(16), b(4096), c(3);
+    memory_read_request requests[] = {
+        {target.buffer + 0x10, a},
+        {target.buffer + 0x100000, b},
+        {target.read_only_page, c}};
+    auto calls = proc.memory_stats().vm_calls;
+    proc.read_memory_ranges(span<const memory_read_request>(requests, 3));
+    REQUIRE(proc.memory_stats().vm_calls == calls + 1);
+    REQUIRE(a[0] == std::byte{0x10});
+    REQUIRE(b[0] == std::byte{0x00});
+    REQUIRE(c[2] == std::byte{0xab});
+
+    REQUIRE(proc.read_memory_as<std::uint64_t>(target.buffer) == 0x0706050403020100);
+}
+
+TEST_CASE("process::write_memory falls back to /proc/pid/mem", "[memory]")
+{
+    auto target = launch_memory_target();
+    auto &proc = *target.proc;
+
+    std::uint64_t word = 0xdeadbeefcafef00d;
+    proc.write_memory(target.buffer, span<const std::byte>(as_bytes(word), sizeof(word)));
+    REQUIRE(proc.read_memory_as<std::uint64_t>(target.buffer) == word);
+    REQUIRE(proc.memory_stats().proc_mem_bytes == 0);
+
+    // process_vm_writev can't write to a read only page but /proc/pid/mem can
+    proc.write_memory(target.read_only_page, span<const std::byte>(as_bytes(word), sizeof(word)));
+    REQUIRE(proc.read_memory_as<std::uint64_t>(target.read_only_page) == word);
+    REQUIRE(proc.memory_stats().proc_mem_bytes == sizeof(word));
+
+    REQUIRE_THROWS_AS(proc.read_memory(virt_addr(0), 8), error);
+}
+
+TEST_CASE("process memory throughput benchmark", "[.][benchmark][memory]")
+{
+    auto target = launch_memory_target();
+    auto &proc = *target.proc;
+    std::vector<std::byte> into(target.size);
+
+    auto throughput = [&](const char *name, auto &&transfer) {
+        constexpr int rounds = 20;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; ++i)
+            transfer();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << name << ": " << (rounds * target.size / elapsed.count()) / (1 << 20) << " MB/s\n";
+    };
+
+    proc.set_memory_backend(memory_backend::process_vm);
+    throughput("read process_vm_readv", [&] { proc.read_memory(target.buffer, span<std::byte>(into)); });
+    throughput("write process_vm_writev", [&] { proc.write_memory(target.buffer, span<const std::byte>(into)); });
+
+    proc.set_memory_backend(memory_backend::proc_mem);
+    throughput("read /proc/pid/mem", [&] { proc.read_memory(target.buffer, span<std::byte>(into)); });
+    throughput("write /proc/pid/mem", [&] { proc.write_memory(target.buffer, span<const std::byte>(into)); });
+
+    // many small ranges in one vectored call against one call per range
+    proc.set_memory_backend(memory_backend::process_vm);
+    proc.set_memory_cache_enabled(false);
+    std::vector<memory_read_request> requests;
+    for (std::size_t offset = 0; offset < target.size; offset += 4096)
+        requests.push_back({target.buffer + offset, span<std::byte>(into.data() + offset, 64)});
+
+    BENCHMARK("4096 x 64 byte ranges vectored")
+    {
+        proc.read_memory_ranges(span<const memory_read_request>(requests));
+    };
+    BENCHMARK("4096 x 64 byte ranges one by one")
+    {
+        for (auto &request : requests)
+            proc.read_memory(request.address, request.into);
+    };
+
+    // the same few words read over and over, like a stack walk does during a stop
+    BENCHMARK("repeated 8 byte reads without page cache")
+    {
+        std::uint64_t sum = 0;
+        for (int i = 0; i < 64; ++i)
+            sum += proc.read_memory_as<std::uint64_t>(target.buffer + (i % 8) * 512);
+        return sum;
+    };
+    proc.set_memory_cache_enabled(true);
+    BENCHMARK("repeated 8 byte reads with page cache")
+    {
+        std::uint64_t sum = 0;
+        for (int i = 0; i < 64; ++i)
+            sum += proc.read_memory_as<std::uint64_t>(target.buffer + (i % 8) * 512);
+        return sum;
+    };
+}
+
+TEST_CASE("process memory page cache", "[memory]")
+{
+    auto target = launch_memory_target();
+    auto &proc = *target.proc;
+    auto &stats = proc.memory_cache_stats();
+
+    // first read misses and fills the page, the rest of the page is then served from the cache
+    auto first = proc.read_memory_as<std::uint64_t>(target.buffer + 8);
+    auto calls = proc.memory_stats().vm_calls;
+    REQUIRE(stats.misses == 1);
+    REQUIRE(proc.read_memory_as<std::uint64_t>(target.buffer + 8) == first);
+    REQUIRE(proc.read_memory_as<std::uint32_t>(target.buffer + 100) == 0x67666564);
+    REQUIRE(proc.memory_stats().vm_calls == calls);
+    REQUIRE(stats.hits == 2);
+    REQUIRE(stats.reads_served == 2);
+
+    // a read crossing into the next page only fetches the new page
+    proc.read_memory(target.buffer + 4090, 12);
+    REQUIRE(stats.misses == 2);
+
+    // writes drop the pages they touch
+    std::uint64_t word = 42;
+    proc.write_memory(target.buffer + 8, span<const std::byte>(as_bytes(word), sizeof(word)));
+    REQUIRE(proc.read_memory_as<std::uint64_t>(target.buffer + 8) == 42);
+    REQUIRE(stats.misses == 3);
+
+    // resuming drops everything
+    auto invalidations = stats.invalidations;
+    proc.resume();
+    proc.wait_on_signal();
+    REQUIRE(stats.invalidations == invalidations + 1);
+}
+
+TEST_CASE("breakpoint sites stop and step over", "[breakpoint]")
+{
+    auto [proc, hit_me] = launch_breakpoint_target();
+
+    auto &site = proc->create_breakpoint_site(hit_me);
+    REQUIRE(!site.is_enabled());
+    REQUIRE_THROWS_AS(proc->create_breakpoint_site(hit_me), error);
+
+    auto original = proc->read_memory(hit_me, 1)[0];
+    site.enable();
+    REQUIRE(proc->read_memory(hit_me, 1)[0] == std::byte{0xcc});
+
+    // hit_me is called three times, we must stop on the int3 each time with the pc moved back onto it
+    for (int i = 0; i < 3; ++i)
+    {
+        proc->resume();
+        auto reason = proc->wait_on_signal();
+        REQUIRE(reason.reason == process_state::stopped);
+        REQUIRE(reason.info == SIGTRAP);
+        REQUIRE(proc->get_pc() == hit_me);
+    }
+
+    site.disable();
+    REQUIRE(proc->read_memory(hit_me, 1)[0] == original);
+
+    proc->resume();
+    auto reason = proc->wait_on_signal();
+    REQUIRE(reason.reason == process_state::exited);
+}
+
+TEST_CASE("a signal that interrupts a step over is reported", "[breakpoint]")
+{
+    auto [proc, hit_me] = launch_breakpoint_target();
+    proc->create_breakpoint_site(hit_me).enable();
+
+    proc->resume();
+    REQUIRE(proc->wait_on_signal().info == SIGTRAP);
+    REQUIRE(proc->get_pc() == hit_me);
+
+    // queued while the thread is stopped, it is delivered ahead of the single step, so the step stops
+    // on the signal with the instruction not run yet
+    kill(proc->pid(), SIGUSR1);
+    proc->resume();
+    auto reason = proc->wait_on_signal();
+    REQUIRE(reason.reason == process_state::stopped);
+    REQUIRE(reason.info == SIGUSR1);
+    REQUIRE(proc->get_pc() == hit_me);
+    REQUIRE(proc->read_memory(hit_me, 1)[0] == std::byte{0xcc});
+
+    // the first call is not reported again, only the other two are
+    int hits = 0;
+    for (;;)
+    {
+        proc->resume();
+        reason = proc->wait_on_signal();
+        if (reason.reason != process_state::stopped)
+            break;
+        REQUIRE(reason.info == SIGTRAP);
+        ++hits;
+    }
+    REQUIRE(reason.reason == process_state::exited);
+    REQUIRE(hits == 2);
+}
+
+TEST_CASE("breakpoint sites are patched in batches", "[breakpoint]")
+{
+    auto target = launch_memory_target();
+    auto &proc = *target.proc;
+
+    // the memory target's buffer stands in for code here, one site every 16 bytes over 1 MiB
+    std::vector<virt_addr> addresses;
+    for (std::size_t offset = 0; offset < (1 << 20); offset += 16)
+        addresses.push_back(target.buffer + offset);
+
+    auto before = proc.memory_stats();
+    auto sites = proc.create_breakpoint_sites(addresses);
+    auto after = proc.memory_stats();
+    REQUIRE(proc.breakpoint_sites().size() == addresses.size());
+
+    // the sites are dense so this is a single run: one read and one write instead of 65536 pokes
+    REQUIRE(after.vm_calls - before.vm_calls == 1);
+    REQUIRE(after.proc_mem_calls - before.proc_mem_calls == 1);
+
+    auto patched = proc.read_memory(target.buffer, 1 << 20);
+    REQUIRE(patched[0] == std::byte{0xcc});
+    REQUIRE(patched[1] == std::byte{0x01});
+    REQUIRE(patched[16] == std::byte{0xcc});
+    REQUIRE(proc.breakpoint_sites().enabled_stoppoint_at_address(target.buffer + 32));
+    REQUIRE(!proc.breakpoint_sites().contains_address(target.buffer + 33));
+
+    proc.disable_breakpoint_sites(sites);
+    auto restored = proc.read_memory(target.buffer, 1 << 20);
+    REQUIRE(restored[16] == std::byte{0x10});
+
+    // removing goes through the address index too
+    proc.breakpoint_sites().remove_by_address(target.buffer + 16);
+    REQUIRE(!proc.breakpoint_sites().contains_address(target.buffer + 16));
+    REQUIRE(proc.breakpoint_sites().contains_address(target.buffer + 32));
+    REQUIRE(proc.breakpoint_sites().size() == addresses.size() - 1);
+}
+
+TEST_CASE("breakpoint sites are removed in batches", "[breakpoint]")
+{
+    auto target = launch_memory_target();
+    auto &proc = *target.proc;
+
+    std::vector<virt_addr> addresses;
+    for (std::size_t offset = 0; offset < (1 << 20); offset += 16)
+        addresses.push_back(target.buffer + offset);
+    proc.create_breakpoint_sites(addresses);
+
+    // every other site goes, the int3s come out in one read and one write like they went in
+    auto before = proc.memory_stats();
+    auto removed = proc.remove_breakpoint_sites_if([&](auto &site) { return (site.address().addr() - target.buffer.addr()) % 32 == 0; });
+    auto after = proc.memory_stats();
+    REQUIRE(removed == addresses.size() / 2);
+    REQUIRE(after.vm_calls - before.vm_calls == 1);
+    REQUIRE(after.proc_mem_calls - before.proc_mem_calls == 1);
+
+    REQUIRE(proc.breakpoint_sites().size() == addresses.size() / 2);
+    REQUIRE(!proc.breakpoint_sites().contains_address(target.buffer + 32));
+    REQUIRE(proc.breakpoint_sites().enabled_stoppoint_at_address(target.buffer + 48));
+    REQUIRE(proc.breakpoint_sites().get_by_address(target.buffer + 48).address() == target.buffer + 48);
+
+    auto code = proc.read_memory(target.buffer, 64);
+    REQUIRE(code[32] == std::byte{0x20});
+    REQUIRE(code[48] == std::byte{0xcc});
+
+    // sites that are already disabled are dropped without touching the inferior
+    std::vector<breakpoint_site *> rest;
+    proc.breakpoint_sites().for_each([&](auto &site) { rest.push_back(&site); });
+    proc.disable_breakpoint_sites(rest);
+    before = proc.memory_stats();
+    REQUIRE(proc.remove_breakpoint_sites_if([](auto &) { return true; }) == addresses.size() / 2);
+    after = proc.memory_stats();
+    REQUIRE(after.vm_calls == before.vm_calls);
+    REQUIRE(after.proc_mem_calls == before.proc_mem_calls);
+    REQUIRE(proc.breakpoint_sites().empty());
+    REQUIRE(!proc.breakpoint_sites().contains_address(target.buffer + 48));
+}
+
+TEST_CASE("flat_address_map survives churn", "[breakpoint]")
+{
+    flat_address_map<int> map;
+    for (int i = 1; i <= 5000; ++i)
+        map.insert(virt_addr(i * 8), i);
+
+    // erase every other key so the backward shift has to move probe chains around
+    for (int i = 1; i <= 5000; i += 2)
+        REQUIRE(map.erase(virt_addr(i * 8)));
+
+    REQUIRE(map.size() == 2500);
+    for (int i = 1; i <= 5000; ++i)
+    {
+        auto found = map.find(virt_addr(i * 8));
+        if (i % 2)
+            REQUIRE(found == nullptr);
+        else
+            REQUIRE((found and *found == i));
+    }
+}
+
+TEST_CASE("breakpoint site benchmark", "[.][benchmark][breakpoint]")
+{
+    auto target = launch_memory_target();
+    auto &proc = *target.proc;
+
+    std::vector<virt_addr> addresses;
+    for (std::size_t offset = 0; offset < target.size; offset += 160)
+        addresses.push_back(target.buffer + offset);
+
+    auto sites = proc.create_breakpoint_sites(addresses, false);
+
+    BENCHMARK("enable and disable 100k sites batched")
+    {
+        proc.enable_breakpoint_sites(sites);
+        proc.disable_breakpoint_sites(sites);
+    };
+    BENCHMARK("enable and disable 1k sites one by one")
+    {
+        for (std::size_t i = 0; i < 1000; ++i)
+        {
+            sites[i * 100]->enable();
+            sites[i * 100]->disable();
+        }
+    };
+
+    auto probe = target.buffer + 160 * 4321;
+    BENCHMARK("lookup by address among 100k sites")
+    {
+        return proc.breakpoint_sites().enabled_stoppoint_at_address(probe);
+    };
+}
+
+namespace
+{
+    struct watch_target
+    {
+        std::unique_ptr<process> proc;
+        virt_addr counter;
+        virt_addr bump;
+    };
+
+    watch_target launch_watch_target()
+    {
+        auto [proc, data] = launch_reporting_target("targets/watch");
+        auto info = reinterpret_cast<const std::uint64_t *>(data.data());
+        return {std::move(proc), virt_addr(info[0]), virt_addr(info[1])};
+    }
+}
+
+TEST_CASE("watchpoint fires on write", "[watchpoint]")
+{
+    auto target = launch_watch_target();
+    auto &proc = *target.proc;
+
+    auto &point = proc.create_watchpoint(target.counter, stoppoint_mode::write, 8);
+    point.enable();
+    REQUIRE(point.hardware_index() == 0);
+
+    for (std::uint64_t expected = 1; expected <= 3; ++expected)
+    {
+        proc.resume();
+        auto reason = proc.wait_on_signal();
+        REQUIRE(reason.info == SIGTRAP);
+        REQUIRE(reason.trap_reason == trap_type::hardware_break);
+        REQUIRE(proc.triggered_watchpoint() == point.id());
+        REQUIRE(proc.read_memory_as<std::uint64_t>(target.counter) == expected);
+    }
+
+    point.disable();
+    proc.resume();
+    REQUIRE(proc.wait_on_signal().reason == process_state::exited);
+}
+
+TEST_CASE("execute watchpoint steps over itself", "[watchpoint]")
+{
+    auto target = launch_watch_target();
+    auto &proc = *target.proc;
+
+    proc.get_registers().set_write_back(true);
+    auto &point = proc.create_watchpoint(target.bump, stoppoint_mode::execute, 1);
+    point.enable();
+
+    for (int i = 0; i < 3; ++i)
+    {
+        proc.resume();
+        auto reason = proc.wait_on_signal();
+        REQUIRE(reason.trap_reason == trap_type::hardware_break);
+        REQUIRE(proc.get_pc() == target.bump);
+        REQUIRE(proc.triggered_watchpoint() == point.id());
+    }
+
+    proc.resume();
+    REQUIRE(proc.wait_on_signal().reason == process_state::exited);
+}
+
+TEST_CASE("watchpoint slots run out and alignment is checked", "[watchpoint]")
+{
+    auto target = launch_watch_target();
+    auto &proc = *target.proc;
+
+    REQUIRE_THROWS_AS(proc.create_watchpoint(target.counter + 1, stoppoint_mode::write, 8), error);
+    REQUIRE_THROWS_AS(proc.create_watchpoint(target.counter, stoppoint_mode::execute, 8), error);
+
+    for (int i = 0; i < 4; ++i)
+        proc.create_watchpoint(target.counter + i * 8, stoppoint_mode::read_write, 8).enable();
+
+    auto &fifth = proc.create_watchpoint(target.counter + 32, stoppoint_mode::write, 8);
+    REQUIRE_THROWS_AS(fifth.enable(), error);
+
+    // freeing a slot makes room again
+    proc.watchpoints().remove_by_address(target.counter + 8);
+    fifth.enable();
+    REQUIRE(fifth.hardware_index() == 1);
+
+    // dr7 has the slot enabled with len 8 (0b10) and write (0b01)
+    auto dr7 = proc.get_registers().read_by_id_As<std::uint64_t>(register_id::dr7);
+    REQUIRE(((dr7 >> 2) & 0b11) == 0b01);
+    REQUIRE(((dr7 >> 20) & 0b1111) == 0b1001);
+}
+
+TEST_CASE("session collects events from many inferiors", "[session]")
+{
+    session sess;
+
+    constexpr int count = 16;
+    for (int i = 0; i < count; ++i)
+        sess.add(process::launch("targets/end_immediately"));
+
+    // a process outside the session must not have its events taken
+    auto outsider = process::launch("targets/end_immediately");
+
+    sess.for_each([](auto &proc) { proc.resume(); });
+    outsider->resume();
+
+    std::vector<session_event> events;
+    int exited = 0;
+    while (exited < count)
+    {
+        REQUIRE(sess.poll(events, 5000) > 0);
+        for (auto &event : events)
+        {
+            REQUIRE(event.reason.reason == process_state::exited);
+            REQUIRE(event.proc->state() == process_state::exited);
+            ++exited;
+        }
+    }
+
+    REQUIRE(outsider->wait_on_signal().reason == process_state::exited);
+}
+
+TEST_CASE("session reports stops and times out", "[session]")
+{
+    session sess;
+
+    pdb::pipe channel(/*close_on_exec=*/false);
+    auto &stopper = sess.add(process::launch("targets/memory", true, channel.get_write()));
+    auto &spinner = sess.add(process::launch("targets/run_endlessly"));
+    channel.close_write();
+
+    spinner.resume();
+    std::vector<session_event> events;
+    REQUIRE(sess.poll(events, 50) == 0);
+
+    stopper.resume();
+    REQUIRE(sess.poll(events, 5000) == 1);
+    REQUIRE(events[0].proc == &stopper);
+    REQUIRE(events[0].reason.reason == process_state::stopped);
+    REQUIRE(events[0].reason.info == SIGTRAP);
+
+    auto removed = sess.remove(spinner.pid());
+    REQUIRE(sess.size() == 1);
+    REQUIRE(sess.find(removed->pid()) == nullptr);
+}
+
+TEST_CASE("inferiors launched under a session don't inherit its SIGCHLD block", "[session]")
+{
+    auto blocked_signals = [](pid_t pid) {
+        std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+        std::string line;
+        while (std::getline(status, line))
+        {
+            if (line.rfind("SigBlk:", 0) == 0)
+                return std::stoull(line.substr(7), nullptr, 16);
+        }
+        return ~0ull;
+    };
+
+    session sess;
+    sigset_t ours;
+    pthread_sigmask(SIG_SETMASK, nullptr, &ours);
+    REQUIRE(sigismember(&ours, SIGCHLD));
+
+    for (auto method : {launch_method::vfork, launch_method::fork})
+    {
+        launch_options options;
+        options.debug = false;
+        options.method = method;
+        auto proc = process::launch("targets/run_endlessly", options);
+        REQUIRE((blocked_signals(proc->pid()) & (1ull << (SIGCHLD - 1))) == 0);
+    }
+}
+
+namespace
+{
+    char get_thread_status(pid_t pid, pid_t tid)
+    {
+        std::ifstream stat("/proc/" + std::to_string(pid) + "/task/" + std::to_string(tid) + "/stat");
+        std::string data;
+        std::getline(stat, data);
+        return data[data.rfind(')') + 2];
+    }
+
+    // targets/threads starts 64 threads and traps once they all run
+    struct threads_target
+    {
+        std::unique_ptr<process> proc;
+        virt_addr shared;
+    };
+
+    threads_target launch_threads_target()
+    {
+        auto [proc, data] = launch_reporting_target("targets/threads");
+        return {std::move(proc), virt_addr(from_bytes<std::uint64_t>(data.data()))};
+    }
+}
+
+TEST_CASE("threads are tracked and stopped together", "[thread]")
+{
+    auto target = launch_threads_target();
+    auto &proc = *target.proc;
+
+    REQUIRE(proc.threads().size() == 65);
+    REQUIRE(proc.current_thread() == proc.pid());
+
+    // all-stop: the trap in the main thread stopped every other thread too
+    for (auto &thread : proc.threads())
+    {
+        REQUIRE(thread.state == process_state::stopped);
+        REQUIRE(get_thread_status(proc.pid(), thread.tid) == 't');
+    }
+
+    // each thread has its own registers, built on first use
+    auto worker = proc.threads().back().tid;
+    REQUIRE(proc.threads().back().regs == nullptr);
+    auto &regs = proc.get_registers(worker);
+    REQUIRE(regs.tid() == worker);
+    REQUIRE(regs.read_by_id_As<std::uint64_t>(register_id::rsp) != proc.get_registers().read_by_id_As<std::uint64_t>(register_id::rsp));
+
+    proc.resume();
+    for (auto &thread : proc.threads())
+        REQUIRE(thread.state == process_state::running);
+
+    proc.stop_all_threads();
+    for (auto &thread : proc.threads())
+    {
+        REQUIRE(thread.state == process_state::stopped);
+        REQUIRE(get_thread_status(proc.pid(), thread.tid) == 't');
+    }
+
+    // the SIGSTOPs we sent are not reported, the process keeps running until the next real stop
+    proc.resume();
+    proc.stop_all_threads();
+    REQUIRE(proc.threads().size() == 65);
+}
+
+TEST_CASE("watchpoints are set in every thread", "[thread][watchpoint]")
+{
+    auto target = launch_threads_target();
+    auto &proc = *target.proc;
+
+    auto &point = proc.create_watchpoint(target.shared, stoppoint_mode::write, 8);
+    point.enable();
+
+    // only the workers write shared, so the hit comes from a thread other than the main one
+    proc.resume();
+    auto reason = proc.wait_on_signal();
+    REQUIRE(reason.reason == process_state::stopped);
+    REQUIRE(reason.trap_reason == trap_type::hardware_break);
+    REQUIRE(proc.current_thread() != proc.pid());
+    REQUIRE(proc.triggered_watchpoint() == point.id());
+
+    // the next hit is reported after a resume, whichever worker it comes from
+    proc.resume();
+    reason = proc.wait_on_signal();
+    REQUIRE(reason.trap_reason == trap_type::hardware_break);
+}
+
+TEST_CASE("thread stop benchmark", "[.][benchmark][thread]")
+{
+    auto target = launch_threads_target();
+    auto &proc = *target.proc;
+
+    BENCHMARK("stop and resume 65 threads")
+    {
+        proc.resume();
+        proc.stop_all_threads();
+    };
+}
+
+TEST_CASE("syscall names and ids", "[syscall]")
+{
+    REQUIRE(syscall_id_to_name(0) == "read");
+    REQUIRE(syscall_id_to_name(39) == "getpid");
+    REQUIRE(syscall_name_to_id("getppid") == 110);
+    REQUIRE_THROWS_AS(syscall_name_to_id("potato"), error);
+    REQUIRE_THROWS_AS(syscall_id_to_name(100000), error);
+}
+
+TEST_CASE("syscall catchpoints stop only on the caught syscalls", "[syscall]")
+{
+    auto getpid_id = syscall_name_to_id("getpid");
+
+    for (auto backend : {syscall_trace_backend::seccomp, syscall_trace_backend::ptrace_syscall})
+    {
+        auto proc = process::launch("targets/syscalls", true, std::nullopt, syscall_catch_policy::catch_some({getpid_id}, backend));
+
+        // each getpid is an entry stop with no arguments and an exit stop returning the pid
+        for (int i = 0; i < 3; ++i)
+        {
+            proc->resume();
+            auto reason = proc->wait_on_signal();
+            REQUIRE(reason.reason == process_state::stopped);
+            REQUIRE(reason.info == SIGTRAP);
+            REQUIRE(reason.trap_reason == trap_type::syscall);
+            REQUIRE(reason.syscall_info->id == getpid_id);
+            REQUIRE(reason.syscall_info->entry);
+
+            proc->resume();
+            reason = proc->wait_on_signal();
+            REQUIRE(reason.trap_reason == trap_type::syscall);
+            REQUIRE(reason.syscall_info->id == getpid_id);
+            REQUIRE(!reason.syscall_info->entry);
+            REQUIRE(reason.syscall_info->ret == proc->pid());
+        }
+
+        proc->resume();
+        REQUIRE(proc->wait_on_signal().reason == process_state::exited);
+    }
+}
+
+TEST_CASE("syscall catchpoint benchmark", "[.][benchmark][syscall]")
+{
+    // runs targets/syscalls to the end catching its three getpids among 3000 getppids
+    auto run = [](const syscall_catch_policy &policy) {
+        auto proc = process::launch("targets/syscalls", true, std::nullopt, policy);
+        int stops = 0;
+        for (;;)
+        {
+            proc->resume();
+            if (proc->wait_on_signal().reason != process_state::stopped)
+                break;
+            ++stops;
+        }
+        return stops;
+    };
+
+    auto getpid_id = syscall_name_to_id("getpid");
+
+    BENCHMARK("no catchpoints")
+    {
+        return run(syscall_catch_policy::catch_none());
+    };
+
+    BENCHMARK("catch getpid with seccomp")
+    {
+        return run(syscall_catch_policy::catch_some({getpid_id}, syscall_trace_backend::seccomp));
+    };
+
+    BENCHMARK("catch getpid with PTRACE_SYSCALL")
+    {
+        return run(syscall_catch_policy::catch_some({getpid_id}, syscall_trace_backend::ptrace_syscall));
+    };
+}
+
+namespace
+{
+    // a section for write_test_elf, NOBITS sections only use size
+    struct test_section
+    {
+        std::string name;
+        Elf64_Word type;
+        Elf64_Xword flags = 0;
+        Elf64_Addr address = 0;
+        std::string data;
+        Elf64_Xword size = 0;
+        Elf64_Word link = 0;
+        Elf64_Word info = 0;
+        Elf64_Xword entry_size = 0;
+    };
+
+    // writes an ELF with the given sections (section 0 and .shstrtab are added) into the temp directory
+    std::filesystem::path write_test_elf(const std::string &file_name, const std::vector<test_section> &sections)
+    {
+        std::string names(1, '\0');
+        std::vector<Elf64_Shdr> headers(1);
+        std::string contents;
+
+        auto add = [&](const test_section &section) {
+            Elf64_Shdr header{};
+            header.sh_name = names.size();
+            names += section.name;
+            names += '\0';
+
+            header.sh_type = section.type;
+            header.sh_flags = section.flags;
+            header.sh_addr = section.address;
+            header.sh_offset = sizeof(Elf64_Ehdr) + contents.size();
+            header.sh_size = section.type == SHT_NOBITS ? section.size : section.data.size();
+            header.sh_link = section.link;
+            header.sh_info = section.info;
+            header.sh_addralign = 1;
+            header.sh_entsize = section.entry_size;
+            headers.push_back(header);
+
+            if (section.type != SHT_NOBITS)
+                contents += section.data;
+        };
+        for (auto &section : sections)
+            add(section);
+
+        // .shstrtab holds its own name too, add() appends it to names at the same offset
+        auto shstrtab_index = headers.size();
+        add({".shstrtab", SHT_STRTAB, 0, 0, names + ".shstrtab" + '\0'});
+
+        contents.resize((contents.size() + 7) & ~std::size_t(7));
+
+        Elf64_Ehdr header{};
+        std::memcpy(header.e_ident, ELFMAG, SELFMAG);
+        header.e_ident[EI_CLASS] = ELFCLASS64;
+        header.e_ident[EI_DATA] = ELFDATA2LSB;
+        header.e_ident[EI_VERSION] = EV_CURRENT;
+        header.e_type = ET_EXEC;
+        header.e_machine = EM_X86_64;
+        header.e_version = EV_CURRENT;
+        header.e_entry = 0x400000;
+        header.e_shoff = sizeof(Elf64_Ehdr) + contents.size();
+        header.e_ehsize = sizeof(Elf64_Ehdr);
+        header.e_shentsize = sizeof(Elf64_Shdr);
+        header.e_shnum = headers.size();
+        header.e_shstrndx = shstrtab_index;
+
+        auto path = std::filesystem::temp_directory_path() / file_name;
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(contents.data(), contents.size());
+        out.write(reinterpret_cast<const char *>(headers.data()), headers.size() * sizeof(Elf64_Shdr));
+        return path;
+    }
+
+    template <class T>
+    void append_bytes(std::string &out, T value)
+    {
+        out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    // writes a minimal ELF with symbol_count functions sym_<i> of 16 bytes each, back to back from 0x400000
+    // there is no code, .text is NOBITS so the file is only headers, symbols and strings
+    std::filesystem::path write_symbols_elf(std::size_t symbol_count)
+    {
+        std::string symbols(sizeof(Elf64_Sym), '\0');
+        std::string strtab(1, '\0');
+        for (std::size_t i = 0; i < symbol_count; ++i)
+        {
+            Elf64_Sym sym{};
+            sym.st_name = strtab.size();
+            sym.st_info = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC);
+            sym.st_shndx = 1;
+            sym.st_value = 0x400000 + i * 16;
+            sym.st_size = 16;
+            append_bytes(symbols, sym);
+
+            strtab += "sym_" + std::to_string(i);
+            strtab += '\0';
+        }
+
+        return write_test_elf("pdb_symbols_" + std::to_string(symbol_count) + ".elf",
+                              {{".text", SHT_NOBITS, SHF_ALLOC | SHF_EXECINSTR, 0x400000, {}, symbol_count * 16},
+                               {".symtab", SHT_SYMTAB, 0, 0, std::move(symbols), 0, 3, 1, sizeof(Elf64_Sym)},
+                               {".strtab", SHT_STRTAB, 0, 0, std::move(strtab)}});
+    }
+}
+
+TEST_CASE("elf sections and symbol lookups", "[elf]")
+{
+    auto path = write_symbols_elf(1000);
+    elf file(path);
+
+    REQUIRE(file.sections().size() == 5);
+    REQUIRE(file.get_section_name(2) == ".symtab");
+    REQUIRE(file.get_section(".strtab") == &file.sections()[3]);
+    REQUIRE(file.get_section(".debug_info") == nullptr);
+    REQUIRE(file.get_section_containing_address(file_addr(0x400000 + 5000)) == &file.sections()[1]);
+    REQUIRE(file.symbol_count() == 1001);
+
+    auto by_name = file.get_symbols_by_name("sym_123");
+    REQUIRE(by_name.size() == 1);
+    REQUIRE(by_name[0]->st_value == 0x400000 + 123 * 16);
+    REQUIRE(file.get_symbol_name(*by_name[0]) == "sym_123");
+    REQUIRE(file.get_symbols_by_name("sym_1000").empty());
+    REQUIRE(file.get_symbols_by_name("").empty());
+
+    auto at = file.get_symbol_at_address(file_addr(0x400000 + 999 * 16));
+    REQUIRE(at);
+    REQUIRE(file.get_symbol_name(*at) == "sym_999");
+    REQUIRE(file.get_symbol_at_address(file_addr(0x400000 + 8)) == nullptr);
+
+    auto containing = file.get_symbol_containing_address(file_addr(0x400000 + 42 * 16 + 15));
+    REQUIRE(containing);
+    REQUIRE(file.get_symbol_name(*containing) == "sym_42");
+    REQUIRE(file.get_symbol_containing_address(file_addr(0x3fffff)) == nullptr);
+    REQUIRE(file.get_symbol_containing_address(file_addr(0x400000 + 1000 * 16)) == nullptr);
+
+    file.notify_loaded(virt_addr(0x10000));
+    containing = file.get_symbol_containing_address(virt_addr(0x410000 + 7 * 16 + 3));
+    REQUIRE(containing);
+    REQUIRE(file.get_symbol_name(*containing) == "sym_7");
+
+    std::filesystem::remove(path);
+
+    REQUIRE_THROWS_AS(elf("potato_are_good"), error);
+    REQUIRE_THROWS_AS(elf("/proc/self/cmdline"), error);
+}
+
+TEST_CASE("elf rejects a section count that doesn't fit the file", "[elf]")
+{
+    auto path = write_symbols_elf(10);
+    std::string bytes;
+    {
+        std::ifstream in(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), {});
+    }
+
+    // e_shnum 0 sends us to section 0 for the count, and 2^58 headers of 64 bytes wrap around to 0 bytes
+    Elf64_Ehdr header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    header.e_shnum = 0;
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    Elf64_Xword count = 1ull << 58;
+    std::memcpy(bytes.data() + header.e_shoff + offsetof(Elf64_Shdr, sh_size), &count, sizeof(count));
+
+    auto corrupt = std::filesystem::temp_directory_path() / "pdb_wrapped_section_count.elf";
+    std::ofstream(corrupt, std::ios::binary | std::ios::trunc).write(bytes.data(), bytes.size());
+    REQUIRE_THROWS_AS(elf(corrupt), error);
+}
+
+TEST_CASE("elf symbols resolve runtime addresses", "[elf]")
+{
+    auto [proc, hit_me] = launch_breakpoint_target();
+
+    // the entry point moves by the load bias, so the two entries tell us where the binary is
+    elf file("targets/breakpoint");
+    auto auxv = proc->get_auxv();
+    file.notify_loaded(virt_addr(auxv[AT_ENTRY] - file.get_header().e_entry));
+
+    auto symbols = file.get_symbols_by_name("_Z6hit_mev");
+    REQUIRE(symbols.size() == 1);
+    REQUIRE(file.to_virt_addr(file_addr(symbols[0]->st_value)) == hit_me);
+
+    auto containing = file.get_symbol_containing_address(hit_me + 1);
+    REQUIRE(containing);
+    REQUIRE(file.get_symbol_name(*containing) == "_Z6hit_mev");
+}
+
+TEST_CASE("elf benchmark", "[.][benchmark][elf]")
+{
+    // a million symbols, about the symbol count of our biggest binaries
+    constexpr std::size_t count = 1'000'000;
+    auto path = write_symbols_elf(count);
+
+    BENCHMARK("load and index 1M symbols")
+    {
+        return elf(path).symbol_count();
+    };
+
+    elf file(path);
+    std::vector<std::string> names;
+    std::vector<file_addr> addresses;
+    for (std::size_t i = 0; i < 4096; ++i)
+    {
+        auto n = (i * 7919) % count;
+        names.push_back("sym_" + std::to_string(n));
+        addresses.push_back(file_addr(0x400000 + n * 16 + 5));
+    }
+
+    BENCHMARK("4096 lookups by name")
+    {
+        std::size_t found = 0;
+        for (auto &name : names)
+            found += file.get_symbols_by_name(name).size();
+        return found;
+    };
+
+    BENCHMARK("4096 lookups by containing address")
+    {
+        std::size_t found = 0;
+        for (auto address : addresses)
+            found += file.get_symbol_containing_address(address) != nullptr;
+        return found;
+    };
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("line table maps addresses and lines", "[dwarf]")
+{
+    elf file("targets/breakpoint");
+    dwarf debug_info(file);
+
+    REQUIRE(debug_info.compile_units().size() == 1);
+    auto &unit = *debug_info.compile_units()[0];
+    REQUIRE(std::filesystem::path(unit.name()).filename() == "breakpoint.cpp");
+
+    auto hit_me = file_addr(file.get_symbols_by_name("_Z6hit_mev")[0]->st_value);
+
+    // nothing is decoded until an address is asked for
+    REQUIRE(!unit.line_table_decoded());
+    auto entry = debug_info.line_entry_at_address(hit_me);
+    REQUIRE(unit.line_table_decoded());
+
+    REQUIRE(entry);
+    REQUIRE(entry->file->filename() == "breakpoint.cpp");
+    REQUIRE(entry->line == 7);
+    REQUIRE(entry->address == hit_me);
+    REQUIRE(entry->flags & line_table::is_stmt);
+
+    // an address inside the function maps to a line of its body
+    auto inside = debug_info.line_entry_at_address(hit_me + 4);
+    REQUIRE(inside);
+    REQUIRE(inside->line >= 7);
+    REQUIRE(inside->line <= 9);
+
+    auto addresses = debug_info.addresses_for_line("targets/breakpoint.cpp", 7);
+    REQUIRE(addresses == std::vector<file_addr>{hit_me});
+    REQUIRE(debug_info.addresses_for_line("other.cpp", 7).empty());
+
+    // the rows of the table are sorted and every sequence is closed
+    auto &table = unit.lines();
+    REQUIRE(table.size() > 0);
+    for (std::size_t row = 1; row < table.size(); ++row)
+        REQUIRE(table[row - 1].address <= table[row].address);
+    REQUIRE(table[table.size() - 1].flags & line_table::end_sequence);
+
+    REQUIRE(!debug_info.line_entry_at_address(file_addr(0x10)));
+}
+
+TEST_CASE("line table benchmark", "[.][benchmark][dwarf]")
+{
+    // the test binary has libpdb and catch in it, a few dozen units with big line tables
+    elf file("/proc/self/exe");
+
+    BENCHMARK("index unit headers")
+    {
+        return dwarf(file).compile_units().size();
+    };
+
+    BENCHMARK("decode every line table")
+    {
+        dwarf debug_info(file);
+        std::size_t rows = 0;
+        for (auto &unit : debug_info.compile_units())
+        {
+            if (unit->has_line_table())
+                rows += unit->lines().size();
+        }
+        return rows;
+    };
+
+    // addresses spread over the whole text section
+    dwarf debug_info(file);
+    auto text = file.get_section(".text");
+    std::vector<file_addr> addresses;
+    for (std::size_t i = 0; i < 4096; ++i)
+        addresses.push_back(file_addr(text->sh_addr + (i * 7919 * 16) % text->sh_size));
+    for (auto address : addresses)
+        debug_info.line_entry_at_address(address);
+
+    BENCHMARK("4096 address to line lookups")
+    {
+        std::size_t found = 0;
+        for (auto address : addresses)
+            found += debug_info.line_entry_at_address(address).has_value();
+        return found;
+    };
+}
+
+namespace
+{
+    // writes an ELF whose DWARF has unit_count units, each with functions_per_unit functions fn_<unit>_<i>
+    // (16 bytes each, a local variable inside) and one global variable global_<unit>
+    // the functions of all units lie back to back from 0x400000 and have a symbol each
+    // the build-id is made up from the counts, so each shape of file gets its own
+    std::filesystem::path write_dwarf_elf(std::size_t unit_count, std::size_t functions_per_unit)
+    {
+        std::string symbols(sizeof(Elf64_Sym), '\0');
+        std::string strtab(1, '\0');
+        for (std::size_t unit = 0; unit < unit_count; ++unit)
+        {
+            for (std::size_t function = 0; function < functions_per_unit; ++function)
+            {
+                Elf64_Sym sym{};
+                sym.st_name = strtab.size();
+                sym.st_info = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC);
+                sym.st_shndx = 1;
+                sym.st_value = 0x400000 + (unit * functions_per_unit + function) * 16;
+                sym.st_size = 16;
+                append_bytes(symbols, sym);
+
+                strtab += "fn_" + std::to_string(unit) + "_" + std::to_string(function);
+                strtab += '\0';
+            }
+        }
+
+        std::string note;
+        append_bytes<Elf64_Word>(note, 4);
+        append_bytes<Elf64_Word>(note, 16);
+        append_bytes<Elf64_Word>(note, NT_GNU_BUILD_ID);
+        note += std::string("GNU", 4);
+        append_bytes<std::uint64_t>(note, unit_count);
+        append_bytes<std::uint64_t>(note, functions_per_unit);
+
+        std::string abbrev;
+        auto add_abbrev = [&](std::uint8_t code, std::uint8_t tag, bool children, std::vector<std::uint8_t> attrs) {
+            abbrev += static_cast<char>(code);
+            abbrev += static_cast<char>(tag);
+            abbrev += static_cast<char>(children);
+            for (auto byte : attrs)
+                abbrev += static_cast<char>(byte);
+            abbrev += std::string(2, '\0');
+        };
+        add_abbrev(1, DW_TAG_compile_unit, true, {DW_AT_name, DW_FORM_strp, DW_AT_low_pc, DW_FORM_addr, DW_AT_high_pc, DW_FORM_data8});
+        add_abbrev(2, DW_TAG_subprogram, true, {DW_AT_name, DW_FORM_strp, DW_AT_external, DW_FORM_flag_present, DW_AT_low_pc, DW_FORM_addr,
+                                                DW_AT_high_pc, DW_FORM_data4, DW_AT_sibling, DW_FORM_ref4});
+        add_abbrev(3, DW_TAG_variable, false, {DW_AT_name, DW_FORM_strp});
+        abbrev += '\0';
+
+        std::string str;
+        auto add_string = [&](const std::string &value) {
+            auto offset = static_cast<std::uint32_t>(str.size());
+            str += value;
+            str += '\0';
+            return offset;
+        };
+        auto local_name = add_string("local");
+
+        std::string info;
+        for (std::size_t unit = 0; unit < unit_count; ++unit)
+        {
+            auto unit_start = info.size();
+            auto low = 0x400000 + unit * functions_per_unit * 16;
+
+            append_bytes<std::uint32_t>(info, 0);
+            append_bytes<std::uint16_t>(info, 5);
+            append_bytes<std::uint8_t>(info, DW_UT_compile);
+            append_bytes<std::uint8_t>(info, 8);
+            append_bytes<std::uint32_t>(info, 0);
+
+            append_bytes<std::uint8_t>(info, 1);
+            append_bytes(info, add_string("unit_" + std::to_string(unit) + ".cpp"));
+            append_bytes<std::uint64_t>(info, low);
+            append_bytes<std::uint64_t>(info, functions_per_unit * 16);
+
+            for (std::size_t function = 0; function < functions_per_unit; ++function)
+            {
+                // 21 bytes of subprogram, 5 of variable and the 0 that closes the children
+                auto sibling = static_cast<std::uint32_t>(info.size() - unit_start + 27);
+                append_bytes<std::uint8_t>(info, 2);
+                append_bytes(info, add_string("fn_" + std::to_string(unit) + "_" + std::to_string(function)));
+                append_bytes<std::uint64_t>(info, low + function * 16);
+                append_bytes<std::uint32_t>(info, 16);
+                append_bytes(info, sibling);
+
+                append_bytes<std::uint8_t>(info, 3);
+                append_bytes(info, local_name);
+                append_bytes<std::uint8_t>(info, 0);
+            }
+
+            append_bytes<std::uint8_t>(info, 3);
+            append_bytes(info, add_string("global_" + std::to_string(unit)));
+            append_bytes<std::uint8_t>(info, 0);
+
+            auto length = static_cast<std::uint32_t>(info.size() - unit_start - 4);
+            std::memcpy(info.data() + unit_start, &length, 4);
+        }
+
+        return write_test_elf("pdb_dwarf_" + std::to_string(unit_count) + "_" + std::to_string(functions_per_unit) + ".elf",
+                              {{".text", SHT_NOBITS, SHF_ALLOC | SHF_EXECINSTR, 0x400000, {}, unit_count * functions_per_unit * 16},
+                               {".debug_abbrev", SHT_PROGBITS, 0, 0, std::move(abbrev)},
+                               {".debug_info", SHT_PROGBITS, 0, 0, std::move(info)},
+                               {".debug_str", SHT_PROGBITS, 0, 0, std::move(str)},
+                               {".symtab", SHT_SYMTAB, 0, 0, std::move(symbols), 0, 6, 1, sizeof(Elf64_Sym)},
+                               {".strtab", SHT_STRTAB, 0, 0, std::move(strtab)},
+                               {".note.gnu.build-id", SHT_NOTE, SHF_ALLOC, 0, std::move(note)}});
+    }
+}
+
+TEST_CASE("dwarf index finds names and function ranges", "[dwarf]")
+{
+    auto path = write_dwarf_elf(64, 32);
+    elf file(path);
+    dwarf debug_info(file);
+    REQUIRE(debug_info.compile_units().size() == 64);
+
+    dwarf_index index(debug_info, 4);
+
+    // the subtree of every function is skipped, its local is never counted
+    REQUIRE(index.die_count() == 64 * (1 + 32 + 1));
+    REQUIRE(index.functions().size() == 64 * 32);
+    REQUIRE(index.names().size() == 64 * (32 + 1));
+
+    auto found = index.find("fn_10_3");
+    REQUIRE(found.size() == 1);
+    REQUIRE(found[0].tag == DW_TAG_subprogram);
+    REQUIRE(index.find("global_63").size() == 1);
+    REQUIRE(index.find("local").empty());
+    REQUIRE(index.find("fn_64_0").empty());
+
+    auto address = file_addr(0x400000 + (10 * 32 + 3) * 16 + 5);
+    auto function = index.function_containing_address(address);
+    REQUIRE(function);
+    REQUIRE(function->name == "fn_10_3");
+    REQUIRE(function->die_offset == found[0].die_offset);
+    REQUIRE(!index.function_containing_address(file_addr(0x400000 + 64 * 32 * 16)));
+
+    // the merge order doesn't depend on how the units were split up
+    dwarf_index single(debug_info, 1);
+    REQUIRE(single.names().size() == index.names().size());
+    for (std::size_t i = 0; i < index.names().size(); ++i)
+    {
+        REQUIRE(single.names()[i].name == index.names()[i].name);
+        REQUIRE(single.names()[i].die_offset == index.names()[i].die_offset);
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("dwarf index of a real binary", "[dwarf]")
+{
+    elf file("targets/breakpoint");
+    dwarf debug_info(file);
+    auto &index = debug_info.index();
+
+    auto hit_me = file.get_symbols_by_name("_Z6hit_mev")[0];
+    auto function = index.function_containing_address(file_addr(hit_me->st_value + 1));
+    REQUIRE(function);
+    REQUIRE(function->name == "hit_me");
+    REQUIRE(function->linkage_name == "_Z6hit_mev");
+    REQUIRE(function->low == file_addr(hit_me->st_value));
+    REQUIRE(function->high == file_addr(hit_me->st_value + hit_me->st_size));
+
+    REQUIRE(index.find("hit_me").size() == 1);
+    REQUIRE(index.find("_Z6hit_mev").size() == 1);
+    REQUIRE(index.find("main").size() == 1);
+}
+
+TEST_CASE("work stealing pool runs every task once", "[dwarf]")
+{
+    work_stealing_pool pool(4);
+    REQUIRE(pool.size() == 4);
+
+    std::vector<std::atomic<int>> runs(10000);
+    std::vector<std::atomic<int>> per_worker(pool.size());
+    pool.parallel_for(runs.size(), [&](std::size_t i, unsigned worker) {
+        ++runs[i];
+        ++per_worker[worker];
+    });
+    REQUIRE(std::all_of(runs.begin(), runs.end(), [](auto &count) { return count == 1; }));
+
+    int total = 0;
+    for (auto &count : per_worker)
+        total += count;
+    REQUIRE(total == 10000);
+
+    REQUIRE_THROWS_AS(pool.parallel_for(100, [](std::size_t i, unsigned) {
+        if (i == 42)
+            error::send("task failed");
+    }), error);
+
+    // still usable after a failed run
+    std::atomic<int> after{0};
+    pool.parallel_for(100, [&](std::size_t, unsigned) { ++after; });
+    REQUIRE(after == 100);
+}
+
+TEST_CASE("dwarf index benchmark", "[.][benchmark][dwarf]")
+{
+    // 10k units with 50 functions each, half a million functions and a million DIEs
+    auto path = write_dwarf_elf(10000, 50);
+    elf file(path);
+    dwarf debug_info(file);
+
+    std::vector<unsigned> thread_counts{1, 2, 4};
+    auto cores = std::max(1u, std::thread::hardware_concurrency());
+    if (std::find(thread_counts.begin(), thread_counts.end(), cores) == thread_counts.end())
+        thread_counts.push_back(cores);
+
+    for (auto threads : thread_counts)
+    {
+        BENCHMARK("index 10k units with " + std::to_string(threads) + " threads")
+        {
+            return dwarf_index(debug_info, threads).names().size();
+        };
+    }
+
+    dwarf_index index(debug_info);
+    BENCHMARK("4096 lookups by name")
+    {
+        std::size_t found = 0;
+        for (std::size_t i = 0; i < 4096; ++i)
+            found += index.find("fn_" + std::to_string(i * 7 % 10000) + "_7").size();
+        return found;
+    };
+
+    std::filesystem::remove(path);
+}
+
+namespace
+{
+    // a cache directory of its own, gone again at the end of the test
+    struct scratch_cache_directory
+    {
+        scratch_cache_directory() : path(std::filesystem::temp_directory_path() / ("pdb_cache_" + std::to_string(getpid())))
+        {
+            std::filesystem::remove_all(path);
+        }
+        ~scratch_cache_directory() { std::filesystem::remove_all(path); }
+
+        std::filesystem::path path;
+    };
+}
+
+TEST_CASE("index cache round trips symbol, function and line indexes", "[cache]")
+{
+    scratch_cache_directory directory;
+
+    elf built("targets/breakpoint", directory.path);
+    REQUIRE(!built.build_id().empty());
+    REQUIRE(built.cache() == nullptr);
+
+    dwarf built_dwarf(built);
+    auto path = index_cache::write(built_dwarf, directory.path);
+    REQUIRE(path == directory.path / (built.build_id() + ".index"));
+    REQUIRE(std::filesystem::exists(path));
+
+    elf cached("targets/breakpoint", directory.path);
+    REQUIRE(cached.cache() != nullptr);
+    REQUIRE(cached.cache()->path() == path);
+
+    auto hit_me = cached.get_symbols_by_name("_Z6hit_mev");
+    REQUIRE(hit_me.size() == 1);
+    REQUIRE(hit_me[0]->st_value == built.get_symbols_by_name("_Z6hit_mev")[0]->st_value);
+
+    auto address = file_addr(hit_me[0]->st_value);
+    REQUIRE(cached.get_symbol_at_address(address) == hit_me[0]);
+    REQUIRE(cached.get_symbol_containing_address(address + 1) == hit_me[0]);
+
+    dwarf cached_dwarf(cached);
+    auto function = cached_dwarf.index().function_containing_address(address + 1);
+    REQUIRE(function);
+    REQUIRE(function->name == "hit_me");
+    REQUIRE(function->die_offset == built_dwarf.index().function_containing_address(address + 1)->die_offset);
+    REQUIRE(cached_dwarf.index().names().size() == built_dwarf.index().names().size());
+    REQUIRE(cached_dwarf.index().die_count() == built_dwarf.index().die_count());
+
+    auto entry = cached_dwarf.line_entry_at_address(address);
+    REQUIRE(entry);
+    REQUIRE(entry->line == 7);
+    REQUIRE(entry->file->filename() == "breakpoint.cpp");
+    REQUIRE(cached_dwarf.addresses_for_line("breakpoint.cpp", 7) == built_dwarf.addresses_for_line("breakpoint.cpp", 7));
+
+    // a cache written by another format version is left alone, and so is a cut off one
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(8);
+        std::uint32_t version = index_cache::format_version + 1;
+        file.write(reinterpret_cast<const char *>(&version), sizeof(version));
+    }
+    REQUIRE(elf("targets/breakpoint", directory.path).cache() == nullptr);
+
+    index_cache::write(built_dwarf, directory.path);
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) / 2);
+    REQUIRE(elf("targets/breakpoint", directory.path).cache() == nullptr);
+}
+
+TEST_CASE("index cache is keyed by build-id", "[cache]")
+{
+    scratch_cache_directory directory;
+
+    auto small = write_dwarf_elf(4, 8);
+    auto large = write_dwarf_elf(8, 8);
+    elf small_file(small, directory.path);
+    elf large_file(large, directory.path);
+    REQUIRE(small_file.build_id() != large_file.build_id());
+    REQUIRE(small_file.build_id().size() == 32);
+
+    index_cache::write(dwarf(small_file), directory.path);
+    REQUIRE(elf(small, directory.path).cache() != nullptr);
+    REQUIRE(elf(large, directory.path).cache() == nullptr);
+
+    // no build-id, nothing to key a cache on
+    auto symbols_only = write_symbols_elf(100);
+    elf unkeyed(symbols_only, directory.path);
+    REQUIRE(unkeyed.build_id().empty());
+    REQUIRE(index_cache::write(dwarf(unkeyed), directory.path).empty());
+
+    std::filesystem::remove(small);
+    std::filesystem::remove(large);
+    std::filesystem::remove(symbols_only);
+}
+
+TEST_CASE("index cache directory follows XDG_CACHE_HOME", "[cache]")
+{
+    auto saved = std::getenv("XDG_CACHE_HOME");
+    std::string old_value = saved ? saved : "";
+    std::string old_home = std::getenv("HOME") ? std::getenv("HOME") : "";
+
+    setenv("XDG_CACHE_HOME", "/tmp/pdb_xdg", 1);
+    REQUIRE(index_cache::default_directory() == "/tmp/pdb_xdg/pdb");
+
+    // relative paths are ignored, as the spec says
+    setenv("XDG_CACHE_HOME", "relative", 1);
+    setenv("HOME", "/home/someone", 1);
+    REQUIRE(index_cache::default_directory() == "/home/someone/.cache/pdb");
+
+    setenv("HOME", old_home.c_str(), 1);
+    if (saved)
+        setenv("XDG_CACHE_HOME", old_value.c_str(), 1);
+    else
+        unsetenv("XDG_CACHE_HOME");
+}
+
+TEST_CASE("index cache benchmark", "[.][benchmark][cache]")
+{
+    // half a million symbols and functions in 10k units
+    scratch_cache_directory directory;
+    auto path = write_dwarf_elf(10000, 50);
+    {
+        elf file(path);
+        index_cache::write(dwarf(file), directory.path);
+    }
+
+    BENCHMARK("parse and index")
+    {
+        elf file(path);
+        dwarf debug_info(file);
+        return debug_info.index().functions().size() + file.get_symbols_by_name("fn_77_7").size();
+    };
+
+    BENCHMARK("load from cache")
+    {
+        elf file(path, directory.path);
+        dwarf debug_info(file);
+        return debug_info.index().functions().size() + file.get_symbols_by_name("fn_77_7").size();
+    };
+
+    std::filesystem::remove(path);
+}
+
+namespace
+{
+    // launches an unwind target and lets it run into the int3 at the bottom of its recursion
+    std::unique_ptr<process> stop_at_recursion_bottom(const std::filesystem::path &path)
+    {
+        auto proc = process::launch(path);
+        proc->resume();
+        auto reason = proc->wait_on_signal();
+        REQUIRE(reason.reason == process_state::stopped);
+        REQUIRE(reason.info == SIGTRAP);
+        return proc;
+    }
+
+    // the symbol of every frame that is in the target itself, "?" for frames in libraries
+    std::vector<std::string> frame_symbols(process &proc, const std::filesystem::path &path, const std::vector<stack_frame> &frames)
+    {
+        elf file(path);
+        auto auxv = proc.get_auxv();
+        file.notify_loaded(virt_addr(auxv[AT_ENTRY] - file.get_header().e_entry));
+
+        std::vector<std::string> names;
+        for (std::size_t i = 0; i < frames.size(); ++i)
+        {
+            // return addresses point after the call, which can be the first byte of the next function
+            auto pc = i == 0 ? frames[i].pc : frames[i].pc - 1;
+            auto symbol = file.get_symbol_containing_address(pc);
+            names.push_back(symbol ? std::string(file.get_symbol_name(*symbol)) : "?");
+        }
+        return names;
+    }
+}
+
+TEST_CASE("unwinder walks a stack without frame pointers", "[unwind]")
+{
+    auto proc = stop_at_recursion_bottom("targets/unwind");
+    unwinder unwinder(*proc);
+
+    auto frames = unwinder.backtrace();
+    auto names = frame_symbols(*proc, "targets/unwind", frames);
+
+    // 33 levels of recursion (32 down to 0), then start_recursion and main, then libc
+    REQUIRE(frames.size() > 35);
+    REQUIRE(frames.size() < 64);
+    for (std::size_t i = 0; i < 33; ++i)
+    {
+        REQUIRE(names[i] == "_Z7recursei");
+        REQUIRE(frames[i].method == unwind_method::cfi);
+    }
+    REQUIRE(names[33] == "_Z15start_recursionv");
+    REQUIRE(names[34] == "main");
+
+    for (std::size_t i = 1; i < frames.size(); ++i)
+        REQUIRE(frames[i].cfa > frames[i - 1].cfa);
+
+    // the whole stack comes in with a window or two, not a read per frame
+    auto &stats = unwinder.get_stats();
+    REQUIRE(stats.backtraces == 1);
+    REQUIRE(stats.stack_reads <= 2);
+
+    // a second walk takes every rule from the per FDE cache
+    auto again = unwinder.backtrace();
+    REQUIRE(again.size() == frames.size());
+    for (std::size_t i = 0; i < frames.size(); ++i)
+    {
+        REQUIRE(again[i].pc == frames[i].pc);
+        REQUIRE(again[i].cfa == frames[i].cfa);
+    }
+}
+
+TEST_CASE("unwinder falls back to frame pointers", "[unwind]")
+{
+    auto proc = stop_at_recursion_bottom("targets/unwind_fp");
+    unwinder unwinder(*proc);
+    unwinder.set_cfi_enabled(false);
+
+    auto frames = unwinder.backtrace();
+    auto names = frame_symbols(*proc, "targets/unwind_fp", frames);
+
+    // libc is built without frame pointers, so only our own frames are sure to come out right
+    REQUIRE(frames.size() >= 35);
+    for (std::size_t i = 0; i < 33; ++i)
+    {
+        REQUIRE(names[i] == "_Z7recursei");
+        REQUIRE(frames[i].method == unwind_method::frame_pointer);
+    }
+    REQUIRE(names[33] == "_Z15start_recursionv");
+    REQUIRE(names[34] == "main");
+
+    // the same stack through the CFI ends in the same place
+    unwinder.set_cfi_enabled(true);
+    auto with_cfi = unwinder.backtrace();
+    for (std::size_t i = 0; i < 35; ++i)
+        REQUIRE(with_cfi[i].pc == frames[i].pc);
+}
+
+TEST_CASE("unwinder benchmark", "[.][benchmark][unwind]")
+{
+    auto proc = stop_at_recursion_bottom("targets/unwind");
+    unwinder unwinder(*proc);
+    std::vector<stack_frame> frames(512);
+    auto tid = proc->current_thread();
+    auto depth = unwinder.backtrace(tid, frames);
+
+    // per frame cost is the mean divided by the depth
+    BENCHMARK("backtrace of " + std::to_string(depth) + " frames with cfi")
+    {
+        return unwinder.backtrace(tid, frames);
+    };
+
+    // what a sampler pays, the stack has to come over again every time the inferior ran
+    proc->set_memory_cache_enabled(false);
+    BENCHMARK("backtrace of " + std::to_string(depth) + " frames with cfi, uncached stack")
+    {
+        return unwinder.backtrace(tid, frames);
+    };
+    proc->set_memory_cache_enabled(true);
+
+    auto fp_proc = stop_at_recursion_bottom("targets/unwind_fp");
+    pdb::unwinder fp_unwinder(*fp_proc);
+    fp_unwinder.set_cfi_enabled(false);
+    auto fp_tid = fp_proc->current_thread();
+    auto fp_depth = fp_unwinder.backtrace(fp_tid, frames);
+    BENCHMARK("backtrace of " + std::to_string(fp_depth) + " frames with frame pointers")
+    {
+        return fp_unwinder.backtrace(fp_tid, frames);
+    };
+}
+
+TEST_CASE("call trie aggregates call paths", "[profile]")
+{
+    // innermost first, 0x1xx is main, 0x2xx is work and 0x3xx is leaf
+    auto frames = [](std::initializer_list<std::uint64_t> pcs) {
+        std::vector<stack_frame> out;
+        for (auto pc : pcs)
+            out.push_back({virt_addr(pc), virt_addr(0), unwind_method::cfi});
+        return out;
+    };
+    auto name = [](virt_addr pc, bool) {
+        static const char *names[] = {"?", "main", "work", "leaf"};
+        return std::string(names[pc.addr() >> 8]);
+    };
+
+    call_trie trie;
+    trie.add(frames({0x310, 0x220, 0x110}));
+    trie.add(frames({0x310, 0x220, 0x110}), 2);
+    // another pc in leaf is another node, but the same folded line
+    trie.add(frames({0x318, 0x220, 0x110}));
+    trie.add(frames({0x230, 0x110}));
+    trie.add(frames({0x110}));
+
+    REQUIRE(trie.samples() == 6);
+    // root, main, work, two leaf pcs, work as the innermost frame and main as the innermost frame
+    REQUIRE(trie.nodes().size() == 7);
+
+    std::ostringstream folded;
+    trie.write_folded(folded, name);
+    REQUIRE(folded.str() == "main 1\nmain;work 1\nmain;work;leaf 4\n");
+
+    std::ostringstream flat;
+    trie.write_flat(flat, name);
+    auto text = flat.str();
+    REQUIRE(text.find("  66.67         4   66.67         4  leaf\n") != std::string::npos);
+    REQUIRE(text.find("  16.67         1  100.00         6  main\n") != std::string::npos);
+    REQUIRE(text.find("  16.67         1   83.33         5  work\n") != std::string::npos);
+
+    // enough distinct paths to grow the table a few times
+    for (std::uint64_t i = 0; i < 5000; ++i)
+        trie.add(frames({0x300 + i % 200, 0x200 + i % 50, 0x110}));
+    REQUIRE(trie.samples() == 5006);
+    std::uint64_t self = 0;
+    for (auto &node : trie.nodes())
+        self += node.self;
+    REQUIRE(self == 5006);
+}
+
+namespace
+{
+    // samples of folded output whose stack ends in main;hot() and main;cold()
+    std::pair<std::uint64_t, std::uint64_t> hot_and_cold_samples(const std::string &folded)
+    {
+        std::uint64_t hot = 0, cold = 0;
+        std::istringstream lines(folded);
+        for (std::string line; std::getline(lines, line);)
+        {
+            auto space = line.rfind(' ');
+            auto stack = line.substr(0, space);
+            auto count = std::stoull(line.substr(space + 1));
+            auto ends_with = [&](std::string_view suffix) {
+                return stack.size() >= suffix.size() and stack.compare(stack.size() - suffix.size(), suffix.size(), suffix) == 0;
+            };
+            if (ends_with("main;hot()"))
+                hot += count;
+            if (ends_with("main;cold()"))
+                cold += count;
+        }
+        return {hot, cold};
+    }
+}
+
+TEST_CASE("profiler samples a running process", "[profile]")
+{
+    auto proc = process::launch("targets/spin");
+    sampling_profiler profiler(*proc, 500);
+    profiler.run(std::chrono::milliseconds(400));
+
+    auto &stats = profiler.get_stats();
+    REQUIRE(stats.samples > 20);
+    REQUIRE(stats.stacks == stats.samples);
+    REQUIRE(profiler.trie().samples() == stats.samples);
+
+    // the stacks go through main and, nine times in ten, end in hot
+    std::ostringstream folded;
+    profiler.write_folded(folded);
+    auto [hot, cold] = hot_and_cold_samples(folded.str());
+    REQUIRE(hot > cold);
+    REQUIRE(hot + cold > stats.samples / 2);
+}
+
+TEST_CASE("perf sampler profiles without stopping the process", "[profile]")
+{
+    auto proc = process::launch("targets/spin");
+    auto stops = proc->get_registers().stats().stops;
+    proc->resume();
+
+    perf_sampler sampler(proc->pid(), 500);
+    REQUIRE(sampler.run(std::chrono::milliseconds(400)));
+
+    auto &stats = sampler.get_stats();
+    REQUIRE(stats.threads == 1);
+    REQUIRE(stats.samples > 20);
+    REQUIRE(sampler.trie().samples() == stats.samples);
+
+    // no ptrace stop was needed for any of them
+    REQUIRE(proc->get_registers().stats().stops == stops);
+
+    // same output as the ptrace sampler
+    std::ostringstream folded;
+    sampler.write_folded(folded);
+    auto [hot, cold] = hot_and_cold_samples(folded.str());
+    REQUIRE(hot > cold);
+    REQUIRE(hot + cold > stats.samples / 2);
+
+    // the samplers stop at the end of a process
+    perf_sampler short_lived(proc->pid(), 500);
+    kill(proc->pid(), SIGKILL);
+    proc->wait_on_signal();
+    REQUIRE_FALSE(short_lived.run(std::chrono::seconds(5)));
+}
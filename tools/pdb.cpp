@@ -4,17 +4,32 @@
 #include <vector>
 #include <algorithm>
 #include <sstream>
+#include <optional>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <csignal>
 
 #include <unistd.h>
 #include <sys/ptrace.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/auxv.h>
 
 #include <readline/readline.h>
 #include <readline/history.h>
 
 #include <libpdb/process.hpp>
 #include <libpdb/error.hpp>
+#include <libpdb/elf.hpp>
+#include <libpdb/dwarf.hpp>
+#include <libpdb/index_cache.hpp>
+#include <libpdb/unwinder.hpp>
+#include <libpdb/profiler.hpp>
+#include <libpdb/stats.hpp>
+#include <libpdb/trace.hpp>
 
 // namespace with no name is used when we want to restrict the programs to this file only
 namespace
@@ -43,6 +58,93 @@ namespace
         return std::equal(str.begin(), str.end(), of.begin());
     }
 
+    // parses an integer, hex with a 0x prefix, and returns nothing if the whole string isn't a number
+    std::optional<std::uint64_t> to_integral(std::string_view str, int base = 0)
+    {
+        std::string copy{str};
+        char *end = nullptr;
+        errno = 0;
+        auto value = std::strtoull(copy.c_str(), &end, base);
+
+        if (copy.empty() or errno != 0 or *end != '\0')
+            return std::nullopt;
+
+        return value;
+    }
+
+    // symbols and line tables of the inferior's executable, loaded the first time a stop is printed
+    // a binary without them (or one we can't read) just prints no source location
+    struct debug_info
+    {
+        std::unique_ptr<pdb::elf> file;
+        std::unique_ptr<pdb::dwarf> dwarf;
+        bool loaded = false;
+    };
+
+    debug_info &get_debug_info(const pdb::process &process)
+    {
+        static debug_info info;
+        if (info.loaded)
+            return info;
+
+        info.loaded = true;
+        try
+        {
+            auto cache_directory = pdb::index_cache::default_directory();
+            info.file = std::make_unique<pdb::elf>("/proc/" + std::to_string(process.pid()) + "/exe", cache_directory);
+
+            // where a PIE got loaded: the entry point the kernel jumped to minus the one in the file
+            auto auxv = process.get_auxv();
+            info.file->notify_loaded(pdb::virt_addr(auxv[AT_ENTRY] - info.file->get_header().e_entry));
+
+            info.dwarf = std::make_unique<pdb::dwarf>(*info.file);
+
+            // the first session on a build pays for every index once, later ones map them
+            if (!info.file->cache())
+            {
+                try
+                {
+                    pdb::index_cache::write(*info.dwarf, cache_directory);
+                }
+                catch (const pdb::error &)
+                {
+                    // no cache is only slower
+                }
+            }
+        }
+        catch (const pdb::error &)
+        {
+        }
+        return info;
+    }
+
+    // "in function (file:line)" for the pc, as far as the symbols and line tables know it
+    // a return address is looked up one byte back, it can be the first byte of the next function or line
+    void print_source_location(const pdb::process &process, pdb::virt_addr pc, bool return_address = false)
+    {
+        auto &info = get_debug_info(process);
+        if (!info.file)
+            return;
+
+        auto address = info.file->to_file_addr(return_address ? pc - 1 : pc);
+        if (auto symbol = info.file->get_symbol_containing_address(address))
+        {
+            std::string name(info.file->get_symbol_name(*symbol));
+
+            // c++ names are mangled in the symbol table, __cxa_demangle hands back a malloc'd string
+            int status = 0;
+            auto demangled = abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status);
+            std::cout << " in " << (status == 0 ? demangled : name.c_str());
+            std::free(demangled);
+        }
+
+        if (!info.dwarf)
+            return;
+
+        if (auto entry = info.dwarf->line_entry_at_address(address))
+            std::cout << " (" << entry->file->filename().string() << ':' << entry->line << ')';
+    }
+
     // whenever a child process or inferior stops we infer or print the reason here
     void print_stop_reason(const pdb::process &process, pdb::stop_reason reason)
     {
@@ -60,7 +162,37 @@ namespace
             break;
 
         case pdb::process_state::stopped:
-            std::cout << "Stopped with signal " << sigabbrev_np(reason.info);
+            std::cout << "Stopped with signal " << sigabbrev_np(reason.info)
+                      << " at 0x" << std::hex << process.get_pc().addr() << std::dec;
+            print_source_location(process, process.get_pc());
+
+            if (process.current_thread() != process.pid())
+                std::cout << " in thread " << process.current_thread();
+
+            if (reason.trap_reason == pdb::trap_type::syscall)
+            {
+                auto &info = *reason.syscall_info;
+                std::cout << " (syscall " << (info.entry ? "entry: " : "exit: ") << pdb::syscall_id_to_name(info.id);
+                if (info.entry)
+                {
+                    std::cout << '(' << std::hex;
+                    for (std::size_t i = 0; i < info.args.size(); ++i)
+                        std::cout << (i ? ", 0x" : "0x") << info.args[i];
+                    std::cout << ')' << std::dec;
+                }
+                else
+                {
+                    std::cout << " = " << info.ret;
+                }
+                std::cout << ')';
+            }
+
+            if (reason.trap_reason == pdb::trap_type::hardware_break)
+            {
+                if (auto id = process.triggered_watchpoint())
+                    std::cout << " (watchpoint " << *id << ")";
+            }
+            break;
 
         default:
             break;
@@ -69,6 +201,364 @@ namespace
         std::cout << std::endl;
     }
 
+    void print_help(const std::vector<std::string> &args)
+    {
+        if (args.size() == 1)
+        {
+            std::cerr << R"(Available commands:
+    backtrace   - Print the frames of the current thread
+    breakpoint  - Commands for operating on breakpoints
+    continue    - Resume the process
+    stats       - Count and latency of every ptrace, waitpid and memory transfer so far
+    thread      - Commands for operating on threads
+    trace       - Record a timeline of every resume, stop and register transfer
+    watchpoint  - Commands for operating on watchpoints
+)";
+        }
+        else if (is_prefix(args[1], "thread"))
+        {
+            std::cerr << R"(Available commands:
+    list
+    select <tid>
+)";
+        }
+        else if (is_prefix(args[1], "stats"))
+        {
+            std::cerr << R"(Available commands:
+    stats
+    stats reset
+)";
+        }
+        else if (is_prefix(args[1], "trace"))
+        {
+            std::cerr << R"(Available commands:
+    start [<events>]
+    stop
+    dump <file>
+)";
+        }
+        else if (is_prefix(args[1], "watchpoint"))
+        {
+            std::cerr << R"(Available commands:
+    list
+    delete <id>
+    disable <id>
+    enable <id>
+    set <address> <write|rw|execute> <size>
+)";
+        }
+        else if (is_prefix(args[1], "breakpoint"))
+        {
+            std::cerr << R"(Available commands:
+    list
+    delete <id>
+    disable <id>
+    enable <id>
+    set <address>
+)";
+        }
+        else
+        {
+            std::cerr << "No help available on that\n";
+        }
+    }
+
+    void handle_breakpoint_command(pdb::process &process, const std::vector<std::string> &args)
+    {
+        if (args.size() < 2)
+        {
+            print_help({"help", "breakpoint"});
+            return;
+        }
+
+        auto command = args[1];
+
+        if (is_prefix(command, "list"))
+        {
+            if (process.breakpoint_sites().empty())
+            {
+                std::cout << "No breakpoints set\n";
+                return;
+            }
+
+            std::cout << "Current breakpoints:\n";
+            process.breakpoint_sites().for_each([](auto &site) {
+                std::cout << site.id() << ": address = 0x" << std::hex << site.address().addr() << std::dec
+                          << ", " << (site.is_enabled() ? "enabled" : "disabled") << '\n';
+            });
+            return;
+        }
+
+        if (args.size() < 3)
+        {
+            print_help({"help", "breakpoint"});
+            return;
+        }
+
+        if (is_prefix(command, "set"))
+        {
+            auto address = to_integral(args[2], 16);
+            if (!address)
+            {
+                std::cerr << "Breakpoint command expects address in hexadecimal, prefixed with '0x'\n";
+                return;
+            }
+
+            process.create_breakpoint_site(pdb::virt_addr(*address)).enable();
+            return;
+        }
+
+        auto id = to_integral(args[2]);
+        if (!id)
+        {
+            std::cerr << "Command expects breakpoint id\n";
+            return;
+        }
+
+        if (is_prefix(command, "enable"))
+        {
+            process.breakpoint_sites().get_by_id(*id).enable();
+        }
+        else if (is_prefix(command, "disable"))
+        {
+            process.breakpoint_sites().get_by_id(*id).disable();
+        }
+        else if (is_prefix(command, "delete"))
+        {
+            process.breakpoint_sites().remove_by_id(*id);
+        }
+        else
+        {
+            print_help({"help", "breakpoint"});
+        }
+    }
+
+    void handle_watchpoint_command(pdb::process &process, const std::vector<std::string> &args)
+    {
+        if (args.size() < 2)
+        {
+            print_help({"help", "watchpoint"});
+            return;
+        }
+
+        auto command = args[1];
+
+        if (is_prefix(command, "list"))
+        {
+            if (process.watchpoints().empty())
+            {
+                std::cout << "No watchpoints set\n";
+                return;
+            }
+
+            auto mode_name = [](pdb::stoppoint_mode mode) {
+                switch (mode)
+                {
+                case pdb::stoppoint_mode::write:
+                    return "write";
+                case pdb::stoppoint_mode::read_write:
+                    return "read_write";
+                default:
+                    return "execute";
+                }
+            };
+
+            std::cout << "Current watchpoints:\n";
+            process.watchpoints().for_each([&](auto &point) {
+                std::cout << point.id() << ": address = 0x" << std::hex << point.address().addr() << std::dec
+                          << ", mode = " << mode_name(point.mode()) << ", size = " << point.size()
+                          << ", " << (point.is_enabled() ? "enabled" : "disabled") << '\n';
+            });
+            return;
+        }
+
+        if (args.size() < 3)
+        {
+            print_help({"help", "watchpoint"});
+            return;
+        }
+
+        if (is_prefix(command, "set"))
+        {
+            if (args.size() != 5)
+            {
+                print_help({"help", "watchpoint"});
+                return;
+            }
+
+            auto address = to_integral(args[2], 16);
+            auto size = to_integral(args[4]);
+            if (!address or !size)
+            {
+                print_help({"help", "watchpoint"});
+                return;
+            }
+
+            pdb::stoppoint_mode mode;
+            if (args[3] == "write")
+                mode = pdb::stoppoint_mode::write;
+            else if (args[3] == "rw")
+                mode = pdb::stoppoint_mode::read_write;
+            else if (args[3] == "execute")
+                mode = pdb::stoppoint_mode::execute;
+            else
+            {
+                print_help({"help", "watchpoint"});
+                return;
+            }
+
+            process.create_watchpoint(pdb::virt_addr(*address), mode, *size).enable();
+            return;
+        }
+
+        auto id = to_integral(args[2]);
+        if (!id)
+        {
+            std::cerr << "Command expects watchpoint id\n";
+            return;
+        }
+
+        if (is_prefix(command, "enable"))
+        {
+            process.watchpoints().get_by_id(*id).enable();
+        }
+        else if (is_prefix(command, "disable"))
+        {
+            process.watchpoints().get_by_id(*id).disable();
+        }
+        else if (is_prefix(command, "delete"))
+        {
+            process.watchpoints().remove_by_id(*id);
+        }
+        else
+        {
+            print_help({"help", "watchpoint"});
+        }
+    }
+
+    void handle_thread_command(pdb::process &process, const std::vector<std::string> &args)
+    {
+        if (args.size() < 2)
+        {
+            print_help({"help", "thread"});
+            return;
+        }
+
+        auto command = args[1];
+
+        if (is_prefix(command, "list"))
+        {
+            for (auto &thread : process.threads())
+            {
+                auto state = thread.state == pdb::process_state::running ? "running" : "stopped";
+                std::cout << (thread.tid == process.current_thread() ? "* " : "  ")
+                          << thread.tid << ": " << state << '\n';
+            }
+            return;
+        }
+
+        if (is_prefix(command, "select") and args.size() == 3)
+        {
+            auto tid = to_integral(args[2], 10);
+            if (!tid)
+            {
+                std::cerr << "Command expects a thread id\n";
+                return;
+            }
+
+            process.set_current_thread(static_cast<pid_t>(*tid));
+            return;
+        }
+
+        print_help({"help", "thread"});
+    }
+
+    // "#0 0x... in function (file:line)" for every frame of the current thread, frames outside the executable
+    // only get their address
+    // the unwinder stays around for the whole session so the CFI it decoded is reused on every stop
+    void handle_backtrace_command(pdb::process &process)
+    {
+        static pdb::unwinder unwinder(process);
+
+        auto frames = unwinder.backtrace();
+        for (std::size_t i = 0; i < frames.size(); ++i)
+        {
+            std::cout << '#' << i << " 0x" << std::hex << frames[i].pc.addr() << std::dec;
+            print_source_location(process, frames[i].pc, i != 0);
+            if (frames[i].method == pdb::unwind_method::frame_pointer)
+                std::cout << " [frame pointer]";
+            std::cout << '\n';
+        }
+    }
+
+    // the kernel round trips of this session, or since the last "stats reset"
+    void handle_stats_command(const std::vector<std::string> &args)
+    {
+        if (!pdb::stats::enabled)
+        {
+            std::cerr << "pdb was built with PDB_STATS off\n";
+            return;
+        }
+
+        if (args.size() == 2 and is_prefix(args[1], "reset"))
+        {
+            pdb::stats::reset();
+            return;
+        }
+        if (args.size() != 1)
+        {
+            print_help({"help", "stats"});
+            return;
+        }
+
+        pdb::stats::write_table(std::cout, pdb::stats::snapshot());
+    }
+
+    // the trace ring, "dump" writes it as a Chrome trace whether or not it is still recording
+    void handle_trace_command(const std::vector<std::string> &args)
+    {
+        if (args.size() < 2)
+        {
+            print_help({"help", "trace"});
+            return;
+        }
+
+        if (is_prefix(args[1], "start"))
+        {
+            std::size_t capacity = 1 << 16;
+            if (args.size() == 3)
+            {
+                auto events = to_integral(args[2]);
+                if (!events or *events == 0)
+                {
+                    std::cerr << "Invalid event count\n";
+                    return;
+                }
+                capacity = *events;
+            }
+            pdb::trace::start(capacity);
+        }
+        else if (is_prefix(args[1], "stop"))
+        {
+            pdb::trace::stop();
+        }
+        else if (is_prefix(args[1], "dump") and args.size() == 3)
+        {
+            std::ofstream file(args[2]);
+            if (!file)
+            {
+                std::cerr << "Could not open " << args[2] << "\n";
+                return;
+            }
+            pdb::trace::write_chrome_json(file);
+            std::cerr << pdb::trace::records().size() << " events written, " << pdb::trace::dropped() << " overwritten\n";
+        }
+        else
+        {
+            print_help({"help", "trace"});
+        }
+    }
+
     // handles each command passed through cmd
     void handle_command(std::unique_ptr<pdb::process> &process, std::string_view line)
     {
@@ -89,6 +579,34 @@ namespace
             // print the reason
             print_stop_reason(*process, reason);
         }
+        else if (is_prefix(command, "breakpoint"))
+        {
+            handle_breakpoint_command(*process, args);
+        }
+        else if (is_prefix(command, "watchpoint"))
+        {
+            handle_watchpoint_command(*process, args);
+        }
+        else if (is_prefix(command, "thread"))
+        {
+            handle_thread_command(*process, args);
+        }
+        else if (is_prefix(command, "backtrace") or command == "bt")
+        {
+            handle_backtrace_command(*process);
+        }
+        else if (is_prefix(command, "stats"))
+        {
+            handle_stats_command(args);
+        }
+        else if (is_prefix(command, "trace"))
+        {
+            handle_trace_command(args);
+        }
+        else if (is_prefix(command, "help"))
+        {
+            print_help(args);
+        }
         // if not recognized then we print error
         else
         {
@@ -105,12 +623,120 @@ namespace
             // we attach a process
             return pdb::process::attach(pid);
         }
+        // catch the listed syscalls (comma separated, or "all") from the first instruction on
+        else if (argc == 4 && argv[1] == std::string_view("-s"))
+        {
+            auto policy = pdb::syscall_catch_policy::catch_all();
+            if (argv[2] != std::string_view("all"))
+            {
+                std::vector<int> to_catch;
+                for (auto &name : split(argv[2], ','))
+                {
+                    auto id = to_integral(name, 10);
+                    to_catch.push_back(id ? static_cast<int>(*id) : pdb::syscall_name_to_id(name));
+                }
+                policy = pdb::syscall_catch_policy::catch_some(std::move(to_catch));
+            }
+            return pdb::process::launch(argv[3], true, std::nullopt, policy);
+        }
         else
         {
-            const char *program_path = argv[1];
-            // launch the new program and attach
-            return pdb::process::launch(program_path);
+            // launch the new program and attach, everything after it is its argv
+            pdb::launch_options options;
+            options.arguments.assign(argv + 2, argv + argc);
+            return pdb::process::launch(argv[1], options);
+        }
+    }
+
+    std::atomic<bool> stop_profiling{false};
+
+    // pdb profile -p <pid> [--hz N] [--duration seconds] [--perf] [--flat] [-o file]
+    // samples until the duration is over, the process ends or ctrl-c, then prints folded stacks (or a flat
+    // profile) of everything it saw
+    // --perf has the kernel take the samples (perf_event_open) instead of stopping the process with ptrace
+    int profile_main(int argc, const char **argv)
+    {
+        std::optional<std::uint64_t> pid;
+        std::uint64_t hz = 99;
+        std::uint64_t seconds = 0;
+        bool flat = false;
+        bool perf = false;
+        const char *output_path = nullptr;
+        bool usable = true;
+
+        for (int i = 2; i < argc and usable; ++i)
+        {
+            std::string_view arg = argv[i];
+            auto has_value = i + 1 < argc;
+            if (arg == "-p" and has_value)
+                pid = to_integral(argv[++i], 10);
+            else if (arg == "--hz" and has_value)
+                hz = to_integral(argv[++i], 10).value_or(0);
+            else if (arg == "--duration" and has_value)
+                seconds = to_integral(argv[++i], 10).value_or(0);
+            else if (arg == "--flat")
+                flat = true;
+            else if (arg == "--perf")
+                perf = true;
+            else if (arg == "-o" and has_value)
+                output_path = argv[++i];
+            else
+                usable = false;
+        }
+
+        if (!usable or !pid or hz == 0)
+        {
+            std::cerr << "Format: pdb profile -p <pid> [--hz N] [--duration seconds] [--perf] [--flat] [-o file]\n";
+            return -1;
+        }
+
+        // ctrl-c ends the sampling, not us, we still have to print and detach
+        struct sigaction action{};
+        action.sa_handler = [](int) { stop_profiling = true; };
+        sigaction(SIGINT, &action, nullptr);
+
+        std::ofstream file;
+        if (output_path)
+        {
+            file.open(output_path);
+            if (!file)
+            {
+                std::cerr << "Could not open " << output_path << '\n';
+                return -1;
+            }
         }
+        auto &out = output_path ? static_cast<std::ostream &>(file) : std::cout;
+
+        if (perf)
+        {
+            pdb::perf_sampler sampler(static_cast<pid_t>(*pid), static_cast<unsigned>(hz));
+            if (!sampler.run(std::chrono::seconds(seconds), &stop_profiling))
+                std::cerr << "Process " << *pid << " ended\n";
+            if (flat)
+                sampler.write_flat(out);
+            else
+                sampler.write_folded(out);
+
+            auto &stats = sampler.get_stats();
+            std::cerr << stats.samples << " samples from " << stats.threads << " threads, " << stats.lost << " lost\n";
+            return 0;
+        }
+
+        auto process = pdb::process::attach(static_cast<pid_t>(*pid));
+        pdb::sampling_profiler profiler(*process, static_cast<unsigned>(hz));
+        if (!profiler.run(std::chrono::seconds(seconds), &stop_profiling))
+            print_stop_reason(*process, process->wait_on_signal());
+        if (flat)
+            profiler.write_flat(out);
+        else
+            profiler.write_folded(out);
+
+        auto &stats = profiler.get_stats();
+        auto mean = stats.samples ? stats.stopped_time / static_cast<std::int64_t>(stats.samples) : std::chrono::nanoseconds(0);
+        std::cerr << stats.samples << " samples, " << stats.missed_ticks << " ticks missed, process stopped for "
+                  << std::chrono::duration_cast<std::chrono::microseconds>(mean).count() << " us per sample ("
+                  << std::chrono::duration_cast<std::chrono::microseconds>(stats.longest_stop).count() << " us at most)\n";
+        return 0;
     }
 
     void main_loop(std::unique_ptr<pdb::process> &process)
@@ -167,11 +793,26 @@ int main(int argc, const char **argv)
     if (argc == 1)
     {
         std::cerr << "No arguments give, Format-\n";
-        std::cerr << "1. pdb <filename>\n";
+        std::cerr << "1. pdb <filename> [args...]\n";
         std::cerr << "2. pdb -p <pid>\n";
+        std::cerr << "3. pdb -s <syscall,syscall,...|all> <filename>\n";
+        std::cerr << "4. pdb profile -p <pid> [--hz N] [--duration seconds] [--perf] [--flat] [-o file]\n";
         return -1;
     }
 
+    if (argv[1] == std::string_view("profile"))
+    {
+        try
+        {
+            return profile_main(argc, argv);
+        }
+        catch (const pdb::error &err)
+        {
+            std::cout << err.what() << '\n';
+            return -1;
+        }
+    }
+
     try
     {
         // attach to the inferior 